@@ -115,7 +115,7 @@ private:
 
 
         // rectification
-        Mem2<Vec2> tables[2];
+        RemapTable tables[2];
         {
             rectify(m_rects[0], m_rects[1], cams[0], zeroPose(), cams[1], m_cam2prj, (cams[0].fx + cams[0].fy) / 2.0);
 
@@ -0,0 +1,71 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main(){
+
+    //--------------------------------------------------------------------------------
+    // icp (iterative closest point)
+    //--------------------------------------------------------------------------------
+
+    Mem1<Mesh3> model = loadBunny(SP_DATA_DIR "/stanford/bun_zipper.ply");
+    SP_ASSERT(model.size() > 0);
+
+    // target points (mesh center and normal)
+    Mem1<VecPD3> pnts0(model.size());
+    for (int i = 0; i < model.size(); i++) {
+        pnts0[i] = getVecPD3(getMeshCent(model[i]), getMeshNrm(model[i]));
+    }
+
+    // source points
+    Mem1<VecPD3> pnts1;
+    for (int i = 0; i < pnts0.size(); i += 20) {
+        pnts1.push(pnts0[i]);
+    }
+    printf("target %d, source %d\n\n", pnts0.size(), pnts1.size());
+
+    // test pose
+    const Pose test = getPose(randgRot(5.0 * SP_PI / 180.0), getVec3(0.005, -0.005, 0.005));
+
+    const int maxit = 5;
+
+    // brute force search
+    {
+        Pose pose = test;
+
+        {
+            SP_LOGGER_SET("icp (brute force)");
+
+            for (int it = 0; it < maxit; it++) {
+                Mem1<VecPD3> cpnts0, cpnts1;
+                _icp::crsp(cpnts0, cpnts1, pose, pnts0, pnts1);
+                if (cpnts0.size() < SP_ICP_MIN_CRSP) break;
+
+                if (_icp::update(pose, cpnts0, cpnts1) == false) break;
+            }
+        }
+        SP_LOGGER_PRINT("icp (brute force)");
+
+        print(pose);
+        printf("\n");
+    }
+
+    // kd tree search
+    {
+        Pose pose = test;
+
+        {
+            SP_LOGGER_SET("icp (kd tree)");
+
+            calcICP(pose, pnts0, pnts1, maxit);
+        }
+        SP_LOGGER_PRINT("icp (kd tree)");
+
+        print(pose);
+        printf("\n");
+    }
+
+    return 0;
+}
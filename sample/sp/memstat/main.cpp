@@ -0,0 +1,62 @@
+﻿#include "simplesp.h"
+
+using namespace sp;
+
+void print(const char *name, const MemStat &stat, const double ms) {
+    printf("%-24s allocs %8lld, bytes %10.1f MB, heap allocs %8lld, heap bytes %10.1f MB, peak %8.1f MB, %8.1f ms\n",
+        name, stat.allocs, stat.bytes / 1024.0 / 1024.0, stat.heaps, stat.hbytes / 1024.0 / 1024.0, stat.peak / 1024.0 / 1024.0, ms);
+}
+
+int main() {
+
+    Mem2<Col3> imgs[2];
+    {
+        SP_ASSERT(loadBMP(SP_DATA_DIR  "/image/shiba02.bmp", imgs[0]));
+        SP_ASSERT(loadBMP(SP_DATA_DIR  "/image/shiba04.bmp", imgs[1]));
+    }
+
+    const int ITMAX = 3;
+
+    for (int p = 0; p < 2; p++) {
+        // aligned allocator (default) / thread local pool
+        setMemPool(p == 1);
+        printf("%s\n", (p == 0) ? "aligned" : "pool");
+
+        // SIFT::execute
+        {
+            SIFT sift;
+            Timer timer;
+
+            resetMemStat();
+            timer.start();
+            for (int it = 0; it < ITMAX; it++) {
+                sift.execute(imgs[0]);
+            }
+            timer.stop();
+            print("SIFT::execute", getMemStat(), timer.getms() / ITMAX);
+        }
+
+        // StereoBase::execute
+        {
+            StereoBase stereo;
+            stereo.setRange(60, 0);
+
+            Mem2<Byte> gimgs[2];
+            cnvImg(gimgs[0], imgs[0]);
+            cnvImg(gimgs[1], imgs[1]);
+
+            Timer timer;
+
+            resetMemStat();
+            timer.start();
+            for (int it = 0; it < ITMAX; it++) {
+                stereo.execute(gimgs[0], gimgs[1]);
+            }
+            timer.stop();
+            print("StereoBase::execute", getMemStat(), timer.getms() / ITMAX);
+        }
+    }
+    setMemPool(false);
+
+    return 0;
+}
@@ -59,5 +59,46 @@ int main(){
         printf("peak %lf\n", maxv);
     }
 
+    //--------------------------------------------------------------------------------
+    // benchmark (direct dft vs fft)
+    //--------------------------------------------------------------------------------
+
+    {
+        const int sizes[] = { 256, 250 };
+
+        for (int s = 0; s < 2; s++) {
+            Mem2<Byte> tmp;
+            crop(tmp, img, getRect2(0, 0, sizes[s], sizes[s]));
+
+            Mat mat;
+            cnvMem(mat, tmp);
+
+            Mat re0, im0, re1, im1;
+            Mat hre, him;
+
+            Timer timer;
+
+            timer.start();
+            _fourier::calcHorDFT(hre, him, mat);
+            _fourier::calcVerDFT(re0, im0, hre, him);
+            timer.stop();
+            const double ms0 = timer.getms();
+
+            timer.start();
+            _fourier::calcHor(hre, him, mat);
+            _fourier::calcVer(re1, im1, hre, him);
+            timer.stop();
+            const double ms1 = timer.getms();
+
+            double err = 0.0;
+            for (int i = 0; i < re0.size(); i++) {
+                err = maxVal(err, ::fabs(re0[i] - re1[i]));
+                err = maxVal(err, ::fabs(im0[i] - im1[i]));
+            }
+
+            printf("size %d x %d : dft %.3lf [ms], fft %.3lf [ms], max diff %e\n", sizes[s], sizes[s], ms0, ms1, err);
+        }
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -69,7 +69,7 @@ int main(){
         rectify(rects[0], rects[1], cams[0], poses[0], cams[1], poses[1]);
     }
 
-    Mem2<Vec2> tables[2];
+    RemapTable tables[2];
     Mem2<Byte> rimgs[2];
 
     for (int i = 0; i < 2; i++){
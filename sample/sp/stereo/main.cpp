@@ -37,7 +37,7 @@ int main() {
 
 
     RectParam rects[2];
-    Mem2<Vec2> tables[2];
+    RemapTable tables[2];
     
     // make remap table
     {
@@ -60,7 +60,7 @@ int main() {
     // remap
     {
         for (int i = 0; i < 2; i++) {
-            remap<Col3, Byte>(rimgs[i], imgs[i], tables[i]);
+            remap(rimgs[i], imgs[i], tables[i]);
 
             char str[512];
             sprintf(str, "rect%d.bmp", i);
@@ -75,6 +75,9 @@ int main() {
     estimator.setRange(maxDisp, minDisp);
     estimator.setCam(rects[0].cam, rects[1].cam);
 
+    // ModeBM : block matching (SAD), ModeSGM : semi-global matching (census)
+    estimator.setMode(StereoBase::ModeSGM);
+
     // matching
     {
         estimator.execute(rimgs[0], rimgs[1]);
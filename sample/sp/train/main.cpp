@@ -36,19 +36,15 @@ void mnist(const char *path) {
     const int epoch = 10;
     const int batch = 100;
 
-    for (int e = 0; e < epoch; e++) {
-        const Mem1<Mem<SP_REAL> > images = shuffle(trainImages, e);
-        const Mem1<int> labels = shuffle(trainLabels, e);
-
-        // train
-        for (int i = 0; i < trainImages.size(); i += batch) {
-            const Mem1<Mem<SP_REAL> > X = images.part(i, batch);
-            const Mem1<int> T = labels.part(i, batch);
+    // data parallel (mini batch is split across threads)
+    NetworkTrainer trainer(model);
 
-            model.train(X, T);
+    for (int e = 0; e < epoch; e++) {
 
-            printf("\r%02d train [%s] ", e, progress((i + batch), trainImages.size()));
-            fflush(stdout);
+        // train (shuffled by epoch)
+        {
+            const double rate = trainer.train(trainImages, trainLabels, batch, e);
+            printf("%02d train %.0f samples/sec (%d threads) ", e, rate, trainer.getThreadNum());
         }
 
         // test
@@ -58,6 +54,13 @@ void mnist(const char *path) {
         }
     }
 
+    // int8 inference (per node weight scale)
+    {
+        model.setPrecision(BaseLayer::Int8);
+        model.forward(testImages);
+        printf("test accuracy (int8) %.3lf\n", testAccuracy(model.getResult(), testLabels));
+    }
+
     //model.save("model.csv");
 }
 
@@ -94,19 +97,15 @@ void cifar(const char *path) {
     const int epoch = 30;
     const int batch = 100;
 
-    for (int e = 0; e < epoch; e++) {
-        const Mem1<Mem<SP_REAL> > images = shuffle(trainImages, e);
-        const Mem1<int> labels = shuffle(trainLabels, e);
-
-        // train
-        for (int i = 0; i < trainImages.size(); i += batch) {
-            const Mem1<Mem<SP_REAL> > X = images.part(i, batch);
-            const Mem1<int> T = labels.part(i, batch);
+    // data parallel (mini batch is split across threads)
+    NetworkTrainer trainer(model);
 
-            model.train(X, T);
+    for (int e = 0; e < epoch; e++) {
 
-            printf("\r%02d train [%s] ", e, progress((i + batch), trainImages.size()));
-            fflush(stdout);
+        // train (shuffled by epoch)
+        {
+            const double rate = trainer.train(trainImages, trainLabels, batch, e);
+            printf("%02d train %.0f samples/sec (%d threads) ", e, rate, trainer.getThreadNum());
         }
 
         // test
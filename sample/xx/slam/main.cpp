@@ -89,8 +89,9 @@ private:
         if (m_upflag == false) return;
 
         m_slam.updatePose(m_img);
-        
-        m_thread.run<SLAMGUI, &SLAMGUI::updateMap>(this, false);
+
+        // key frames are mapped in the mapping thread of SLAM
+        m_slam.updateMap(m_img);
 
     }
 
@@ -99,11 +100,6 @@ private:
         m_slam.addView(img);
     }
 
-    void updateMap() {
-        Mem2<Col3> img = m_img;
-        m_slam.updateMap(img);
-    }
-
     virtual void keyFun(int key, int scancode, int action, int mods) {
 
         if (m_key[GLFW_KEY_A] == 1) {
@@ -149,6 +149,28 @@ namespace sp{
             return result->index;
         }
 
+        // nearest data within maxDist that passes check(index) (-1 : not found)
+        template<typename CHECK>
+        int searchNear(const void *ptr, const SP_REAL maxDist, const CHECK &check) const {
+            SP_ASSERT(m_stack.size() == 0);
+            if (m_root == NULL) return -1;
+
+            const TYPE *data = (TYPE*)ptr;
+
+            Mem2<TYPE> rect = m_rect;
+
+            Node *result = NULL;
+            SP_REAL dist = maxDist;
+
+            searchOne(dist, result, m_root, data, rect, check);
+
+            return (result != NULL) ? result->index : -1;
+        }
+
+        int searchNear(const void *ptr, const SP_REAL maxDist) const {
+            return searchNear(ptr, maxDist, [](const int) { return true; });
+        }
+
         Mem1<int> search(const void *ptr, double range) const {
             SP_ASSERT(m_stack.size() == 0);
             Mem1<int> index;
@@ -258,6 +280,51 @@ namespace sp{
             }
         }
 
+        template<typename CHECK>
+        void searchOne(SP_REAL &mindist, Node *&result, Node *node, const TYPE *data, Mem2<TYPE> &rect, const CHECK &check) const {
+
+            const SP_REAL d = cmpData(data, node->data, node->div);
+            const int t = (d < 0.0) ? 0 : 1;
+
+            // check near node
+            if (node->sub[t] != NULL) {
+                TYPE &side = rect(node->div, 1 - t);
+
+                // cut rect
+                const TYPE tmp = side;
+                side = node->data[node->div];
+
+                if (normRect(rect, data) < mindist) {
+                    searchOne(mindist, result, node->sub[t], data, rect, check);
+                }
+
+                // reset
+                side = tmp;
+            }
+
+            const SP_REAL dist = normData(node->data, data);
+            if (dist < mindist && check(node->index) == true) {
+                result = node;
+                mindist = dist;
+            }
+
+            // check far node
+            if (node->sub[1 - t] != NULL) {
+                TYPE *side = &rect(node->div, t);
+
+                // cut rect
+                const TYPE tmp = *side;
+                *side = node->data[node->div];
+
+                if (normRect(rect, data) < mindist) {
+                    searchOne(mindist, result, node->sub[1 - t], data, rect, check);
+                }
+
+                // reset
+                *side = tmp;
+            }
+        }
+
         void searchRange(Mem1<int> &index, Node *node, const TYPE *data, TYPE rect) const {
             if (node == NULL) return;
 
@@ -51,6 +51,7 @@
 #include "spapp/spgeom/spdepth.h"
 #include "spapp/spgeom/spcalib.h"
 #include "spapp/spgeom/spicp.h"
+#include "spapp/spgeom/spbundle.h"
 #include "spapp/spgeom/spray.h"
 #include "spapp/spgeom/spvertex.h"
 
@@ -71,6 +72,7 @@
 #include "spapp/splearn/spneubase.h"
 #include "spapp/splearn/spneulayer.h"
 #include "spapp/splearn/spneumodel.h"
+#include "spapp/splearn/spneutrain.h"
 
 // util
 #include "spapp/sptool.h"
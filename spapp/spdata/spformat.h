@@ -87,6 +87,15 @@ namespace sp{
     }
 
 
+    //--------------------------------------------------------------------------------
+    // signed char
+    //--------------------------------------------------------------------------------
+
+    SP_CPUFUNC bool ftext(FILE *fp, const char *mode, const signed char *val, const int num) {
+        return ftextf(fp, mode, "%hhd", val, num, "\n");
+    }
+
+
     //--------------------------------------------------------------------------------
     // unsigned char
     //--------------------------------------------------------------------------------
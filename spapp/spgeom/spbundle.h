@@ -0,0 +1,552 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_BUNDLE_H__
+#define __SP_BUNDLE_H__
+
+#include "spcore/spcore.h"
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // bundle adjustment
+    //--------------------------------------------------------------------------------
+
+    // free views solved by dense cholesky (larger systems use conjugate gradient)
+#define SP_BUNDLE_DENSE 100
+
+#define SP_BUNDLE_PCGMAX 100
+
+    namespace _bundle {
+
+        // observation list (CSR, id -> [beg[id], beg[id + 1]))
+        SP_CPUFUNC void makeList(Mem1<int> &beg, Mem1<int> &list, const Mem1<int> &ids, const int size) {
+            beg.resize(size + 1);
+            beg.zero();
+            for (int i = 0; i < ids.size(); i++) {
+                beg[ids[i] + 1]++;
+            }
+            for (int i = 0; i < size; i++) {
+                beg[i + 1] += beg[i];
+            }
+
+            Mem1<int> cnt(size);
+            cnt.zero();
+
+            list.resize(ids.size());
+            for (int i = 0; i < ids.size(); i++) {
+                list[beg[ids[i]] + cnt[ids[i]]++] = i;
+            }
+        }
+
+        // residual (pix - prj), false : behind the camera
+        SP_CPUFUNC bool calcErr(Vec2 &err, const Pose &pose, const CamParam &cam, const Vec2 &pix, const Vec3 &pnt) {
+            const Vec3 pos = pose * pnt;
+            if (pos.z <= 0.0) return false;
+
+            err = pix - mulCamD(cam, prjVec(pos));
+            return true;
+        }
+
+        // solve A * x = b (A : symmetric positive definite, lower triangle is used and overwritten by cholesky factor)
+        SP_CPUFUNC bool solveCholesky(SP_REAL *x, SP_REAL *A, const SP_REAL *b, const int size) {
+
+            for (int c = 0; c < size; c++) {
+                SP_REAL *pc = &A[c * size];
+
+                SP_REAL d = pc[c];
+                for (int k = 0; k < c; k++) {
+                    d -= pc[k] * pc[k];
+                }
+                if (d < SP_SMALL) return false;
+                d = sqrt(d);
+                pc[c] = d;
+
+#if SP_USE_OMP
+#pragma omp parallel for if(size - c > 256)
+#endif
+                for (int r = c + 1; r < size; r++) {
+                    SP_REAL *pr = &A[r * size];
+
+                    SP_REAL s = pr[c];
+                    for (int k = 0; k < c; k++) {
+                        s -= pr[k] * pc[k];
+                    }
+                    pr[c] = s / d;
+                }
+            }
+
+            // L * y = b
+            for (int r = 0; r < size; r++) {
+                const SP_REAL *pr = &A[r * size];
+
+                SP_REAL s = b[r];
+                for (int k = 0; k < r; k++) {
+                    s -= pr[k] * x[k];
+                }
+                x[r] = s / pr[r];
+            }
+
+            // L^T * x = y
+            for (int r = size - 1; r >= 0; r--) {
+                SP_REAL s = x[r];
+                for (int k = r + 1; k < size; k++) {
+                    s -= A[k * size + r] * x[k];
+                }
+                x[r] = s / A[r * size + r];
+            }
+
+            return true;
+        }
+
+        // y = S * x (S : block sparse 6x6, row a -> blocks [sbeg[a], sbeg[a + 1]) at column scol)
+        SP_CPUFUNC void mulBlock(SP_REAL *y, const Mem1<int> &sbeg, const Mem1<int> &scol, const Mem1<SP_REAL> &sblk, const SP_REAL *x) {
+            const int cnum = sbeg.size() - 1;
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int a = 0; a < cnum; a++) {
+                SP_REAL *py = &y[a * 6];
+                memset(py, 0, 6 * sizeof(SP_REAL));
+
+                for (int k = sbeg[a]; k < sbeg[a + 1]; k++) {
+                    const SP_REAL *ps = &sblk[k * 6 * 6];
+                    const SP_REAL *px = &x[scol[k] * 6];
+                    for (int r = 0; r < 6; r++) {
+                        for (int c = 0; c < 6; c++) {
+                            py[r] += ps[r * 6 + c] * px[c];
+                        }
+                    }
+                }
+            }
+        }
+
+        // solve S * x = b by conjugate gradient (block jacobi preconditioner)
+        SP_CPUFUNC bool solvePCG(SP_REAL *x, const Mem1<int> &sbeg, const Mem1<int> &scol, const Mem1<int> &sdiag, const Mem1<SP_REAL> &sblk, const SP_REAL *b, const int itmax) {
+            const int cnum = sbeg.size() - 1;
+            const int size = cnum * 6;
+
+            Mem1<SP_REAL> M(cnum * 6 * 6);
+            {
+                SP_REAL buf[6 * 6];
+                for (int a = 0; a < cnum; a++) {
+                    if (invMat(&M[a * 6 * 6], &sblk[sdiag[a] * 6 * 6], 6, 6, buf) == false) return false;
+                }
+            }
+
+            auto precond = [&](SP_REAL *z, const SP_REAL *r) {
+                for (int a = 0; a < cnum; a++) {
+                    mulMat(&z[a * 6], 6, 1, &M[a * 6 * 6], 6, 6, &r[a * 6], 6, 1);
+                }
+            };
+            auto dot = [&](const SP_REAL *v0, const SP_REAL *v1) -> SP_REAL {
+                SP_REAL sum = 0.0;
+                for (int i = 0; i < size; i++) {
+                    sum += v0[i] * v1[i];
+                }
+                return sum;
+            };
+
+            Mem1<SP_REAL> r(size, b), z(size), p(size), q(size);
+            memset(x, 0, size * sizeof(SP_REAL));
+
+            precond(z.ptr, r.ptr);
+            p = z;
+
+            SP_REAL rz = dot(r.ptr, z.ptr);
+            const SP_REAL rr0 = dot(r.ptr, r.ptr);
+            if (rr0 < SP_SMALL) return true;
+
+            for (int it = 0; it < itmax; it++) {
+                mulBlock(q.ptr, sbeg, scol, sblk, p.ptr);
+
+                const SP_REAL pq = dot(p.ptr, q.ptr);
+                if (pq <= 0.0) return false;
+
+                const SP_REAL alpha = rz / pq;
+                for (int i = 0; i < size; i++) {
+                    x[i] += alpha * p[i];
+                    r[i] -= alpha * q[i];
+                }
+                if (dot(r.ptr, r.ptr) < 1.0e-12 * rr0) break;
+
+                precond(z.ptr, r.ptr);
+
+                const SP_REAL rzn = dot(r.ptr, z.ptr);
+                const SP_REAL beta = rzn / rz;
+                for (int i = 0; i < size; i++) {
+                    p[i] = z[i] + beta * p[i];
+                }
+                rz = rzn;
+            }
+
+            return true;
+        }
+    }
+
+    // sparse Levenberg-Marquardt (poses : camera <- world, reduced camera system by Schur complement on points)
+    // observation i : pixs[i] of pnts[pids[i]] in view vids[i], fixs : fixed view flag (NULL : all views are free)
+    SP_CPUFUNC bool refineBundle(Mem1<Pose> &poses, Mem1<Vec3> &pnts, const Mem1<CamParam> &cams, const Mem1<int> &vids, const Mem1<int> &pids, const Mem1<Vec2> &pixs, const Mem1<bool> *fixs = NULL, const int maxit = 10) {
+        SP_ASSERT(poses.size() == cams.size());
+        SP_ASSERT(vids.size() == pids.size() && vids.size() == pixs.size());
+        SP_ASSERT(fixs == NULL || fixs->size() == poses.size());
+
+        const int vnum = poses.size();
+        const int pnum = pnts.size();
+        const int onum = pixs.size();
+        if (vnum == 0 || pnum == 0 || onum == 0) return false;
+
+        // free view -> reduced camera system block
+        Mem1<int> cids(vnum);
+        int cnum = 0;
+        for (int v = 0; v < vnum; v++) {
+            cids[v] = (fixs != NULL && (*fixs)[v] == true) ? -1 : cnum++;
+        }
+        const int csize = 6 * cnum;
+
+        Mem1<int> vbeg, vlist;
+        Mem1<int> pbeg, plist;
+        _bundle::makeList(vbeg, vlist, vids, vnum);
+        _bundle::makeList(pbeg, plist, pids, pnum);
+
+        // reduced camera system structure (free views sharing a point)
+        Mem1<int> vfree(cnum);
+        Mem1<int> sbeg(cnum + 1), scol, sdiag(cnum);
+        {
+            Mem1<int> mark(cnum);
+            setElm(mark, -1);
+
+            sbeg[0] = 0;
+            for (int v = 0; v < vnum; v++) {
+                const int a = cids[v];
+                if (a < 0) continue;
+                vfree[a] = v;
+
+                const int base = scol.size();
+                for (int k = vbeg[v]; k < vbeg[v + 1]; k++) {
+                    const int p = pids[vlist[k]];
+                    for (int n = pbeg[p]; n < pbeg[p + 1]; n++) {
+                        const int b = cids[vids[plist[n]]];
+                        if (b < 0 || mark[b] == a) continue;
+                        mark[b] = a;
+                        scol.push(b);
+                    }
+                }
+                if (mark[a] != a) {
+                    scol.push(a);
+                }
+                sort(&scol[base], scol.size() - base);
+
+                sbeg[a + 1] = scol.size();
+                for (int k = base; k < scol.size(); k++) {
+                    if (scol[k] == a) sdiag[a] = k;
+                }
+            }
+        }
+
+        // observation
+        Mem1<SP_REAL> errs(onum);
+        Mem1<bool> fronts(onum);
+        Mem1<Vec2> E(onum);
+        Mem1<SP_REAL> Jc(onum * 2 * 6);
+        Mem1<SP_REAL> Jp(onum * 2 * 3);
+        Mem1<SP_REAL> W(onum * 6 * 3);
+        Mem1<SP_REAL> Y(onum * 6 * 3);
+
+        // camera block (U : 6x6, ec : 6), point block (V : 3x3, ep : 3)
+        Mem1<SP_REAL> U(cnum * 6 * 6), ec(cnum * 6);
+        Mem1<SP_REAL> V(pnum * 3 * 3), ep(pnum * 3);
+        Mem1<SP_REAL> Vi(pnum * 3 * 3);
+        Mem1<bool> pvalid(pnum);
+
+        // reduced camera system (dense : small system)
+        Mem1<SP_REAL> sblk(scol.size() * 6 * 6), rhs(csize), dc(csize);
+        Mem1<SP_REAL> S((cnum <= SP_BUNDLE_DENSE) ? csize * csize : 0);
+
+        Mem1<Pose> tposes(vnum);
+        Mem1<Vec3> tpnts(pnum);
+
+        SP_REAL lambda = 1.0e-3;
+
+        for (int it = 0; it < maxit; it++) {
+
+            // residual (robust weight, points behind the camera have no weight)
+            for (int i = 0; i < onum; i++) {
+                fronts[i] = _bundle::calcErr(E[i], poses[vids[i]], cams[vids[i]], pixs[i], pnts[pids[i]]);
+                if (fronts[i] == false) {
+                    E[i] = getVec2(0.0, 0.0);
+                }
+                errs[i] = normVec(E[i]);
+            }
+            Mat w = solver::calcW(errs);
+            for (int i = 0; i < onum; i++) {
+                if (fronts[i] == false) w[i] = 0.0;
+            }
+
+            SP_REAL cost0 = 0.0;
+            for (int i = 0; i < onum; i++) {
+                cost0 += w[i] * sq(errs[i]);
+            }
+
+            // jacobian
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int i = 0; i < onum; i++) {
+                const Pose &pose = poses[vids[i]];
+                const CamParam &cam = cams[vids[i]];
+                const Vec3 pos = pose * pnts[pids[i]];
+
+                SP_REAL *jc = &Jc[i * 2 * 6];
+                SP_REAL *jp = &Jp[i * 2 * 3];
+
+                jacobPoseToPix(jc, cam, pose, pnts[pids[i]]);
+
+                SP_REAL jPosToPix[2 * 3];
+                jacobPosToPix(jPosToPix, cam, pos);
+
+                SP_REAL rmat[3 * 3];
+                getMat(rmat, 3, 3, pose.rot);
+                mulMat(jp, 2, 3, jPosToPix, 2, 3, rmat, 3, 3);
+
+                // W = w * Jc^T * Jp
+                SP_REAL *pw = &W[i * 6 * 3];
+                for (int r = 0; r < 6; r++) {
+                    for (int c = 0; c < 3; c++) {
+                        pw[r * 3 + c] = w[i] * (jc[0 * 6 + r] * jp[0 * 3 + c] + jc[1 * 6 + r] * jp[1 * 3 + c]);
+                    }
+                }
+            }
+
+            // camera block
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int v = 0; v < vnum; v++) {
+                const int a = cids[v];
+                if (a < 0) continue;
+
+                SP_REAL *pu = &U[a * 6 * 6];
+                SP_REAL *pe = &ec[a * 6];
+                memset(pu, 0, 6 * 6 * sizeof(SP_REAL));
+                memset(pe, 0, 6 * sizeof(SP_REAL));
+
+                for (int k = vbeg[v]; k < vbeg[v + 1]; k++) {
+                    const int i = vlist[k];
+                    const SP_REAL *jc = &Jc[i * 2 * 6];
+                    for (int r = 0; r < 6; r++) {
+                        for (int c = 0; c < 6; c++) {
+                            pu[r * 6 + c] += w[i] * (jc[0 * 6 + r] * jc[0 * 6 + c] + jc[1 * 6 + r] * jc[1 * 6 + c]);
+                        }
+                        pe[r] += w[i] * (jc[0 * 6 + r] * E[i].x + jc[1 * 6 + r] * E[i].y);
+                    }
+                }
+            }
+
+            // point block
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int p = 0; p < pnum; p++) {
+                SP_REAL *pv = &V[p * 3 * 3];
+                SP_REAL *pe = &ep[p * 3];
+                memset(pv, 0, 3 * 3 * sizeof(SP_REAL));
+                memset(pe, 0, 3 * sizeof(SP_REAL));
+
+                for (int k = pbeg[p]; k < pbeg[p + 1]; k++) {
+                    const int i = plist[k];
+                    const SP_REAL *jp = &Jp[i * 2 * 3];
+                    for (int r = 0; r < 3; r++) {
+                        for (int c = 0; c < 3; c++) {
+                            pv[r * 3 + c] += w[i] * (jp[0 * 3 + r] * jp[0 * 3 + c] + jp[1 * 3 + r] * jp[1 * 3 + c]);
+                        }
+                        pe[r] += w[i] * (jp[0 * 3 + r] * E[i].x + jp[1 * 3 + r] * E[i].y);
+                    }
+                }
+            }
+
+            bool update = false;
+            for (int lt = 0; lt < 10 && update == false; lt++) {
+
+                // damped point block inverse, Y = W * V^-1
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                for (int p = 0; p < pnum; p++) {
+                    SP_REAL vd[3 * 3];
+                    memcpy(vd, &V[p * 3 * 3], 3 * 3 * sizeof(SP_REAL));
+                    for (int d = 0; d < 3; d++) {
+                        vd[d * 3 + d] += lambda * vd[d * 3 + d] + SP_SMALL;
+                    }
+
+                    SP_REAL *pi = &Vi[p * 3 * 3];
+                    pvalid[p] = (pbeg[p + 1] > pbeg[p]) && invMat33(pi, vd);
+                    if (pvalid[p] == false) continue;
+
+                    for (int k = pbeg[p]; k < pbeg[p + 1]; k++) {
+                        const int i = plist[k];
+                        mulMat(&Y[i * 6 * 3], 6, 3, &W[i * 6 * 3], 6, 3, pi, 3, 3);
+                    }
+                }
+
+                // S = U - sum(Y * W^T), rhs = ec - sum(Y * ep) (lower blocks, row a is built by one thread)
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                for (int a = 0; a < cnum; a++) {
+                    const int v = vfree[a];
+
+                    Mem1<int> pos(cnum);
+                    for (int k = sbeg[a]; k < sbeg[a + 1]; k++) {
+                        pos[scol[k]] = k;
+                        memset(&sblk[k * 6 * 6], 0, 6 * 6 * sizeof(SP_REAL));
+                    }
+
+                    SP_REAL *pd = &sblk[sdiag[a] * 6 * 6];
+                    for (int r = 0; r < 6; r++) {
+                        for (int c = 0; c < 6; c++) {
+                            pd[r * 6 + c] = U[a * 6 * 6 + r * 6 + c];
+                        }
+                        pd[r * 6 + r] += lambda * U[a * 6 * 6 + r * 6 + r] + SP_SMALL;
+                        rhs[a * 6 + r] = ec[a * 6 + r];
+                    }
+
+                    for (int k = vbeg[v]; k < vbeg[v + 1]; k++) {
+                        const int i = vlist[k];
+                        const int p = pids[i];
+                        if (pvalid[p] == false) continue;
+
+                        const SP_REAL *py = &Y[i * 6 * 3];
+                        for (int r = 0; r < 6; r++) {
+                            rhs[a * 6 + r] -= py[r * 3 + 0] * ep[p * 3 + 0] + py[r * 3 + 1] * ep[p * 3 + 1] + py[r * 3 + 2] * ep[p * 3 + 2];
+                        }
+
+                        for (int n = pbeg[p]; n < pbeg[p + 1]; n++) {
+                            const int j = plist[n];
+                            const int b = cids[vids[j]];
+                            if (b < 0 || b > a) continue;
+
+                            const SP_REAL *pw = &W[j * 6 * 3];
+                            SP_REAL *ps = &sblk[pos[b] * 6 * 6];
+                            for (int r = 0; r < 6; r++) {
+                                for (int c = 0; c < 6; c++) {
+                                    ps[r * 6 + c] -= py[r * 3 + 0] * pw[c * 3 + 0] + py[r * 3 + 1] * pw[c * 3 + 1] + py[r * 3 + 2] * pw[c * 3 + 2];
+                                }
+                            }
+                        }
+                    }
+                }
+
+                bool solve = true;
+                if (cnum <= SP_BUNDLE_DENSE) {
+                    S.zero();
+                    for (int a = 0; a < cnum; a++) {
+                        for (int k = sbeg[a]; k < sbeg[a + 1]; k++) {
+                            const int b = scol[k];
+                            if (b > a) continue;
+
+                            for (int r = 0; r < 6; r++) {
+                                memcpy(&S[(a * 6 + r) * csize + b * 6], &sblk[k * 6 * 6 + r * 6], 6 * sizeof(SP_REAL));
+                            }
+                        }
+                    }
+                    solve = _bundle::solveCholesky(dc.ptr, S.ptr, rhs.ptr, csize);
+                }
+                else {
+                    // upper blocks (transpose of lower blocks)
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                    for (int a = 0; a < cnum; a++) {
+                        for (int k = sbeg[a]; k < sbeg[a + 1]; k++) {
+                            const int b = scol[k];
+                            if (b <= a) continue;
+
+                            int t = sbeg[b];
+                            while (scol[t] != a) t++;
+
+                            for (int r = 0; r < 6; r++) {
+                                for (int c = 0; c < 6; c++) {
+                                    sblk[k * 6 * 6 + r * 6 + c] = sblk[t * 6 * 6 + c * 6 + r];
+                                }
+                            }
+                        }
+                    }
+                    solve = _bundle::solvePCG(dc.ptr, sbeg, scol, sdiag, sblk, rhs.ptr, SP_BUNDLE_PCGMAX);
+                }
+
+                if (solve == false) {
+                    lambda *= 10.0;
+                    continue;
+                }
+
+                // back substitution, dp = V^-1 * (ep - sum(W^T * dc))
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                for (int p = 0; p < pnum; p++) {
+                    if (pvalid[p] == false) {
+                        tpnts[p] = pnts[p];
+                        continue;
+                    }
+
+                    SP_REAL e[3] = { ep[p * 3 + 0], ep[p * 3 + 1], ep[p * 3 + 2] };
+                    for (int k = pbeg[p]; k < pbeg[p + 1]; k++) {
+                        const int i = plist[k];
+                        const int b = cids[vids[i]];
+                        if (b < 0) continue;
+
+                        const SP_REAL *pw = &W[i * 6 * 3];
+                        for (int c = 0; c < 3; c++) {
+                            for (int r = 0; r < 6; r++) {
+                                e[c] -= pw[r * 3 + c] * dc[b * 6 + r];
+                            }
+                        }
+                    }
+                    const SP_REAL *pi = &Vi[p * 3 * 3];
+                    tpnts[p] = pnts[p] + getVec3(
+                        pi[0] * e[0] + pi[1] * e[1] + pi[2] * e[2],
+                        pi[3] * e[0] + pi[4] * e[1] + pi[5] * e[2],
+                        pi[6] * e[0] + pi[7] * e[1] + pi[8] * e[2]);
+                }
+
+                for (int v = 0; v < vnum; v++) {
+                    tposes[v] = (cids[v] >= 0) ? updatePose(poses[v], &dc[cids[v] * 6]) : poses[v];
+                }
+
+                // same weight (a step that moves a point behind the camera is rejected)
+                SP_REAL cost1 = 0.0;
+                for (int i = 0; i < onum; i++) {
+                    if (fronts[i] == false) continue;
+
+                    Vec2 err;
+                    if (_bundle::calcErr(err, tposes[vids[i]], cams[vids[i]], pixs[i], tpnts[pids[i]]) == false) {
+                        cost1 = SP_INFINITY;
+                        break;
+                    }
+                    cost1 += w[i] * sqVec(err);
+                }
+
+                if (cost1 < cost0) {
+                    poses = tposes;
+                    pnts = tpnts;
+                    lambda = maxVal(lambda * 0.1, 1.0e-7);
+                    update = (cost0 - cost1 > 1.0e-6 * cost0) ? true : false;
+                    break;
+                }
+                else {
+                    lambda *= 10.0;
+                }
+            }
+
+            // converged
+            if (update == false) break;
+        }
+
+        return true;
+    }
+
+}
+#endif
@@ -6,6 +6,7 @@
 #define __SP_CALIBRATION_H__
 
 #include "spcore/spcore.h"
+#include "spapp/spimg/spimg.h"
 
 
 namespace sp{
@@ -940,6 +941,9 @@ namespace sp{
     SP_CPUFUNC void makeRemapTable(Mem2<Vec2> &table, const CamParam &cam){
         table.resize(cam.dsize);
 
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
         for (int v = 0; v < table.dsize[1]; v++){
             for (int u = 0; u < table.dsize[0]; u++){
                 const Vec2 src = getVec2(u, v);
@@ -954,6 +958,10 @@ namespace sp{
         table.resize(rect.cam.dsize);
 
         const Rot rot = invRot(rect.rot);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
         for (int v = 0; v < table.dsize[1]; v++){
             for (int u = 0; u < table.dsize[0]; u++){
                 const Vec2 src = getVec2(u, v);
@@ -967,6 +975,19 @@ namespace sp{
 
     }
 
+    // fixed-point table for remap of Byte / Col3 image
+    SP_CPUFUNC void makeRemapTable(RemapTable &table, const CamParam &cam, const bool useExt = false){
+        Mem2<Vec2> tmp;
+        makeRemapTable(tmp, cam);
+        table.set(tmp, useExt);
+    }
+
+    SP_CPUFUNC void makeRemapTable(RemapTable &table, const RectParam &rect, const bool useExt = false){
+        Mem2<Vec2> tmp;
+        makeRemapTable(tmp, rect);
+        table.set(tmp, useExt);
+    }
+
 
 
 }
@@ -702,36 +702,24 @@ namespace sp {
             return calcPnt3d(pos, poses, cams, pixs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Pose> _poses(poses, unit);
-        RandomSample<CamParam> _cams(cams, unit);
-        RandomSample<Vec2> _pixs(pixs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Pose> rposes = _poses.gen(it);
-            const Mem1<CamParam> rcams = _cams.gen(it);
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-
+        auto solve = [&](Mem1<Vec3> &tests, const int *ids) -> bool {
             Vec3 test;
-            if (calcPnt3d(test, rposes, rcams, rpixs) == false) continue;
+            if (calcPnt3d(test, ransacData(poses, ids, unit), ransacData(cams, ids, unit), ransacData(pixs, ids, unit)) == false) return false;
 
-            const Mem1<SP_REAL> errs = calcPrjErr(poses, cams, pixs, test);
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
+            tests.push(test);
+            return true;
+        };
 
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
+        auto error = [&](const Vec3 &test, const int i) -> SP_REAL {
+            return calcPrjErr(poses[i], cams[i], pixs[i], test);
+        };
 
-                pos = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        auto refine = [&](Vec3 &test, const Mem1<int> &ids) -> bool {
+            return refinePnt3d(test, ransacData(poses, ids.ptr, ids.size()), ransacData(cams, ids.ptr, ids.size()), ransacData(pixs, ids.ptr, ids.size()));
+        };
+
+        const SP_REAL eval = ransac(pos, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         {
@@ -757,37 +745,24 @@ namespace sp {
             return calcPose(pose, objs0, objs1);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec3> _objs0(objs0, unit);
-        RandomSample<Vec3> _objs1(objs1, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec3> robjs0 = _objs0.gen(it);
-            const Mem1<Vec3> robjs1 = _objs1.gen(it);
-
+        auto solve = [&](Mem1<Pose> &tests, const int *ids) -> bool {
             Pose test;
-            if (calcPose(test, robjs0, robjs1, 1) == false) continue;
+            if (calcPose(test, ransacData(objs0, ids, unit), ransacData(objs1, ids, unit), 1) == false) return false;
 
-            Mem1<SP_REAL> errs;
-            for (int i = 0; i < num; i++) {
-                errs.push(normVec(objs0[i] - test * objs1[i]));
-            }
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
+            tests.push(test);
+            return true;
+        };
 
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
+        auto error = [&](const Pose &test, const int i) -> SP_REAL {
+            return normVec(objs0[i] - test * objs1[i]);
+        };
 
-                pose = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        auto refine = [&](Pose &test, const Mem1<int> &ids) -> bool {
+            return refinePose(test, ransacData(objs0, ids.ptr, ids.size()), ransacData(objs1, ids.ptr, ids.size()), 1);
+        };
+
+        const SP_REAL eval = ransac(pose, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         {
@@ -816,36 +791,20 @@ namespace sp {
             return calcPose(pose, cam, pixs, objs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _pixs(pixs, unit);
-        RandomSample<Vec3> _objs(objs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-            const Mem1<Vec3> robjs = _objs.gen(it);
-
-            Mem1<Pose> tests;
-            if (calcPoseP3P(tests, cam, rpixs, robjs) == false) continue;
+        auto solve = [&](Mem1<Pose> &tests, const int *ids) -> bool {
+            return calcPoseP3P(tests, cam, ransacData(pixs, ids, unit), ransacData(objs, ids, unit));
+        };
 
-            for (int i = 0; i < tests.size(); i++) {
+        auto error = [&](const Pose &test, const int i) -> SP_REAL {
+            return calcPrjErr(test, cam, pixs[i], objs[i]);
+        };
 
-                const Mem1<SP_REAL> errs = calcPrjErr(tests[i], cam, pixs, objs);
-                const SP_REAL eval = ransacEval(errs, unit, thresh);
+        auto refine = [&](Pose &test, const Mem1<int> &ids) -> bool {
+            return refinePose(test, cam, ransacData(pixs, ids.ptr, ids.size()), ransacData(objs, ids.ptr, ids.size()), 1);
+        };
 
-                if (eval > maxe) {
-                    //SP_PRINTD("eval %lf\n", eval);
-                    maxe = eval;
-                    maxit = ransacAdaptiveStop(eval, unit);
-
-                    pose = tests[i];
-                }
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        const SP_REAL eval = ransac(pose, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         {
@@ -871,34 +830,24 @@ namespace sp {
             return calcPose(pose, cam, pixs, objs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _pixs(pixs, unit);
-        RandomSample<Vec2> _objs(objs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-            const Mem1<Vec2> robjs = _objs.gen(it);
-
+        auto solve = [&](Mem1<Pose> &tests, const int *ids) -> bool {
             Pose test;
-            if (calcPose(test, cam, rpixs, robjs, 1) == false) continue;
+            if (calcPose(test, cam, ransacData(pixs, ids, unit), ransacData(objs, ids, unit), 1) == false) return false;
 
-            const Mem1<SP_REAL> errs = calcPrjErr(test, cam, pixs, getVec3(objs, 0.0));
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
+            tests.push(test);
+            return true;
+        };
 
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
+        auto error = [&](const Pose &test, const int i) -> SP_REAL {
+            return calcPrjErr(test, cam, pixs[i], objs[i]);
+        };
 
-                pose = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        auto refine = [&](Pose &test, const Mem1<int> &ids) -> bool {
+            return refinePose(test, cam, ransacData(pixs, ids.ptr, ids.size()), ransacData(objs, ids.ptr, ids.size()), 1);
+        };
+
+        const SP_REAL eval = ransac(pose, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         {
@@ -6,6 +6,7 @@
 #define __SP_ICP_H__
 
 #include "spcore/spcore.h"
+#include "spapp/spalgo/spkdtree.h"
 
 namespace sp{
 
@@ -101,6 +102,51 @@ namespace sp{
             }
         }
 
+        template <typename TYEP0>
+        SP_CPUFUNC void makeTree(KdTree<SP_REAL> &kdtree, const Mem<TYEP0> &pnts0) {
+            Mem1<Vec3> pos(pnts0.size());
+            for (int i = 0; i < pnts0.size(); i++) {
+                pos[i] = getPos(pnts0[i]);
+            }
+
+            kdtree.init(3);
+            for (int i = 0; i < pos.size(); i++) {
+                kdtree.addData(&pos[i]);
+            }
+            kdtree.makeTree();
+        }
+
+        template <typename TYEP0, typename TYEP1>
+        SP_CPUFUNC void crsp(Mem1<TYEP0> &cpnts0, Mem1<TYEP1> &cpnts1, const Pose &pose, const KdTree<SP_REAL> &kdtree, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1, const SP_REAL maxDist = SP_INFINITY) {
+            cpnts0.clear();
+            cpnts1.clear();
+
+            Mem1<int> index(pnts1.size());
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int i = 0; i < pnts1.size(); i++) {
+                const TYEP1 vec = pose * pnts1[i];
+                const Vec3 pos = getPos(vec);
+
+                auto check = [&](const int j) -> bool {
+                    return checkOutlier(pnts0[j], vec);
+                };
+                index[i] = kdtree.searchNear(&pos, maxDist, check);
+            }
+
+            cpnts0.reserve(pnts1.size());
+            cpnts1.reserve(pnts1.size());
+
+            for (int i = 0; i < pnts1.size(); i++) {
+                if (index[i] < 0) continue;
+
+                cpnts0.push(pnts0[index[i]]);
+                cpnts1.push(pnts1[i]);
+            }
+        }
+
         template <typename TYEP0, typename TYEP1>
         SP_CPUFUNC void crsp(Mem1<TYEP0> &cpnts0, Mem1<TYEP1> &cpnts1, const Pose &pose, const CamParam &cam, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1){
             cpnts0.clear();
@@ -164,16 +210,19 @@ namespace sp{
         }
     }
 
-    // pnts0 <- pnts1 pose
+    // pnts0 <- pnts1 pose (maxDist : max correspondence distance)
     template<typename TYEP0, typename TYEP1>
-    SP_CPUFUNC bool calcICP(Pose &pose, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1, const int maxit = 10){
+    SP_CPUFUNC bool calcICP(Pose &pose, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1, const int maxit = 10, const SP_REAL maxDist = SP_INFINITY){
         SP_ASSERT(pnts0.dim == 1 && pnts1.dim == 1);
 
+        KdTree<SP_REAL> kdtree;
+        _icp::makeTree(kdtree, pnts0);
+
         for (int it = 0; it < maxit; it++){
             Mem1<TYEP0> cpnts0;
             Mem1<TYEP1> cpnts1;    
             
-            _icp::crsp(cpnts0, cpnts1, pose, pnts0, pnts1);
+            _icp::crsp(cpnts0, cpnts1, pose, kdtree, pnts0, pnts1, maxDist);
             if (cpnts0.size() < SP_ICP_MIN_CRSP) return false;
 
             if (_icp::update(pose, cpnts0, cpnts1) == false) return false;
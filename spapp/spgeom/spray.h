@@ -153,6 +153,7 @@ namespace sp {
     class BVH {
 
     public:
+        // binary node (build)
         struct Node {
             int level;
 
@@ -163,6 +164,16 @@ namespace sp {
             Node *n0, *n1;
         };
 
+        // 4-wide node (traversal), 32 bytes per child
+        // child k : box (bmin[*][k], bmax[*][k]), 
+        // num[k] > 0 : leaf [child[k], child[k] + num[k]), num[k] == 0 : node child[k], child[k] < 0 : empty
+        struct Node4 {
+            float bmin[3][4];
+            float bmax[3][4];
+            int child[4];
+            int num[4];
+        };
+
         struct Data {
             Mesh3 mesh;
             Material mat;
@@ -186,19 +197,46 @@ namespace sp {
             Mat invp;
         };
 
+        // triangle in leaf order
+        struct Tri {
+            Vec3 pos;
+            Vec3 A, B;
+        };
+
         struct Unit {
             Mem1<Data> data;
 
 
             Mem1<Node> nodes;
             Mem1<Index> idxs;
+
+            Mem1<Node4> tree;
+            Mem1<Tri> tris;
         };
+
     private:
 
+        // build primitive
+        struct Prim {
+            Box3 box;
+            Vec3 cent;
+            int id;
+        };
+
+        // build node (child, child + 1 : children, child < 0 : leaf)
+        struct BNode {
+            Box3 box;
+            int level;
+            int base;
+            int size;
+            int child;
+        };
+
         Mem1<Layout> m_layouts;
         MemP<Unit> m_units;
         Mem1<Node> m_nodes;
         Mem1<Index> m_idxs;
+        Mem1<Node4> m_tree;
 
     public:
         BVH() {
@@ -222,6 +260,7 @@ namespace sp {
             m_units.clear();
             m_nodes.clear();
             m_idxs.clear();
+            m_tree.clear();
         }
 
         void addModel(const Mem1<Mesh3> &meshes, const Mem1<Material> &mats, const Mem1<Mat> &poses) {
@@ -248,265 +287,482 @@ namespace sp {
         void build() {
             if (m_layouts.size() == 0) return;
 
-            struct IndexEx : public Index {
-                Box3 box;
-                Vec3 cent;
-            };
+            for (int i = 0; i < m_units.size(); i++) {
+                Unit &unit = m_units[i];
 
-            typedef int(*CMP)(const void*, const void*);
-            CMP cmp[3];
-            cmp[0] = [](const void* i1, const void* i2) -> int { return (((IndexEx*)i1)->cent.x < ((IndexEx*)i2)->cent.x) ? +1 : -1; };
-            cmp[1] = [](const void* i1, const void* i2) -> int { return (((IndexEx*)i1)->cent.y < ((IndexEx*)i2)->cent.y) ? +1 : -1; };
-            cmp[2] = [](const void* i1, const void* i2) -> int { return (((IndexEx*)i1)->cent.z < ((IndexEx*)i2)->cent.z) ? +1 : -1; };
-      
-            auto initn = [&](Mem1<Node> &nodes, Mem1<IndexEx> &idxs, const int level, const int base, const int size) -> Node* {
-                Node *n = NULL;
-#if SP_USE_OMP
-#pragma omp critical
-#endif
-                {
-                    n = nodes.extend();
+                Mem1<Prim> prims(unit.data.size());
+                for (int p = 0; p < prims.size(); p++) {
+                    prims[p].id = p;
+                    prims[p].box = getBox3(unit.data[p].mesh);
+                    prims[p].cent = getMeshCent(unit.data[p].mesh);
                 }
-                n->level = level;
-                n->base = base;
-                n->size = size;
-                n->n0 = NULL;
-                n->n1 = NULL;
-
-                n->box = nullBox3();
-                for (int i = base; i < base + size; i++) {
-                    n->box = orBox(n->box, idxs[i].box);
-                }
-                return n;
-            };
-            auto sorti = [&](Node &n, Mem1<IndexEx> &idxs, Mem1<SP_REAL> &buff) -> int {
-                int di = 0;
-                int da = 0;
 
-                double mina = SP_INFINITY;
-                for (int a = 0; a < 3; a++) {
-                    sort(&idxs[n.base], n.size, cmp[a]);
-                    Box3 bl = nullBox3();
-                    Box3 br = nullBox3();
-
-                    for (int i = 1; i < n.size; i++) {
-                        const int l = i;
-                        bl = orBox(bl, idxs[n.base + l - 1].box);
-                        buff[n.base + l] = 0;
-                        buff[n.base + l] += getBoxArea(bl) * i;
-                    }
-                    for (int i = 1; i < n.size; i++) {
-                        const int r = n.size - i;
-                        br = orBox(br, idxs[n.base + r].box);
-                        buff[n.base + r] += getBoxArea(br) * i;
-                    }
+                buildTree(unit.nodes, unit.tree, prims, 4);
 
-                    for (int i = 1; i < n.size; i++) {
-                        //const double area = 1.0 + (buff(i, 0) + buff(i, 1)) / getBoxArea(n.box);
-                        if (buff[n.base + i] < mina) {
-                            mina = buff[n.base + i];
-                            di = i;
-                            da = a;
-                        }
-                    }
-                }
-                if (da != 2) {
-                    sort(&idxs[n.base], n.size, cmp[da]);
+                unit.tris.resize(prims.size());
+                for (int p = 0; p < prims.size(); p++) {
+                    const Mesh3 &mesh = unit.data[prims[p].id].mesh;
+                    unit.idxs[p].id = prims[p].id;
+                    unit.tris[p].pos = mesh.pos[0];
+                    unit.tris[p].A = mesh.pos[1] - mesh.pos[0];
+                    unit.tris[p].B = mesh.pos[2] - mesh.pos[0];
                 }
-                return di;
-            };
-            
+            }
             {
-                for (int i = 0; i < m_units.size(); i++) {
-                    Unit &unit = m_units[i];
-                    Mem1<IndexEx> idxs(unit.idxs.size());
-
-                    for (int i = 0; i < idxs.size(); i++) {
-                        idxs[i].id = unit.idxs[i].id;
-                        idxs[i].box = getBox3(unit.data[idxs[i].id].mesh);
-                        idxs[i].cent = getMeshCent(unit.data[idxs[i].id].mesh);
+                Mem1<Prim> prims(m_layouts.size());
+                for (int p = 0; p < prims.size(); p++) {
+                    const Box3 &box = m_units[m_layouts[p].uid].nodes[0].box;
+
+                    prims[p].id = p;
+                    prims[p].box = nullBox3();
+                    for (int j = 0; j < 8; j++) {
+                        const int a = (j & 0x01) ? 1 : 0;
+                        const int b = (j & 0x02) ? 1 : 0;
+                        const int c = (j & 0x04) ? 1 : 0;
+                        const Vec3 v = getVec3(box.pos[a].x, box.pos[b].y, box.pos[c].z);
+                        prims[p].box = orBox(prims[p].box, m_layouts[p].pose * v);
                     }
+                    prims[p].cent = getBoxCent(prims[p].box);
+                }
+
+                // one instance per leaf (instances are visited near to far)
+                buildTree(m_nodes, m_tree, prims, 1);
+
+                m_idxs.resize(prims.size());
+                for (int p = 0; p < prims.size(); p++) {
+                    m_idxs[p].id = prims[p].id;
+                }
+            }
+        }
 
-                    unit.nodes.clear();
-                    unit.nodes.reserve(2 * idxs.size() - 1);
+        bool trace(Hit &hit, const VecPD3 &ray, const double minv, const double maxv) const {
+            memset(&hit, 0, sizeof(Hit));
+            hit.calc = true;
 
-                    Mem1<SP_REAL> buff(idxs.size());
-                    
-                    initn(unit.nodes, idxs, 0, 0, idxs.size());
+            double lmaxv = maxv;
 
-                    Mem1<Mem1<Node*> > tnodes;
-                    if (idxs.size() > 1000) {
-                        const int level = 5;
+            int minid = -1;
+            int minlt = -1;
 
-                        tnodes.reserve(256);
-                        for (int ni = 0; ni < unit.nodes.size(); ni++) {
-                            Node& n = unit.nodes[ni];
-                            if (n.size == 1) continue;
+            // instances
+            auto leaf = [&](const int base, const int num, double &tmaxv) {
+                for (int j = base; j < base + num; j++) {
+                    const int lt = m_idxs[j].id;
+                    const Unit &unit = m_units[m_layouts[lt].uid];
 
-                            if (n.level < level) {
-                                const int di = sorti(n, idxs, buff);
-                                n.n0 = initn(unit.nodes, idxs, n.level + 1, n.base, di);
-                                n.n1 = initn(unit.nodes, idxs, n.level + 1, n.base + di, n.size - di);
-                            }
-                            else {
-                                Mem1<Node*> &nodes = *tnodes.extend();
-                                nodes.reserve(2 * n.size - 1);
-                                nodes.push(&n);
+                    const VecPD3 bray = m_layouts[lt].invp * ray;
+
+                    // triangles
+                    auto tleaf = [&](const int tbase, const int tnum, double &tmaxv) {
+                        for (int id = tbase; id < tbase + tnum; id++) {
+                            if (traceTri(tmaxv, unit.tris[id], bray, minv, tmaxv) == true) {
+                                minid = id;
+                                minlt = lt;
                             }
                         }
-                    }
-                    else {
-                        Mem1<Node*> &nodes = *tnodes.extend();
-                        nodes.push(&unit.nodes[0]);
-                    }
+                    };
+                    traverse(unit.tree, bray, minv, tmaxv, tleaf);
+                }
+            };
+            traverse(m_tree, ray, minv, lmaxv, leaf);
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-                    for (int i = 0; i < tnodes.size(); i++) {
-                        for (int ni = 0; ni < tnodes[i].size(); ni++) {
-                            Node& n = *tnodes[i][ni];
-                            if (n.size == 1) continue;
+            if (minid >= 0) {
+                const Layout &layout = m_layouts[minlt];
+                const Unit &unit = m_units[layout.uid];
+                const Mem1<Data> &data = unit.data;
 
-                            const int di = sorti(n, idxs, buff);
+                const VecPD3 bray = layout.invp * ray;
 
-                            n.n0 = initn(unit.nodes, idxs, n.level + 1, n.base, di);
-                            n.n1 = initn(unit.nodes, idxs, n.level + 1, n.base + di, n.size - di);
-                            tnodes[i].push(n.n0);
-                            tnodes[i].push(n.n1);
-                        }
+                hit.find = true;
+                hit.mat = data[unit.idxs[minid].id].mat;
+
+                hit.vec.pos = layout.pose * (bray.pos + bray.drc * lmaxv);
+                hit.vec.drc = unitVec(layout.pose.part(0, 0, 3, 3) * getMeshNrm(data[unit.idxs[minid].id].mesh));
+            }
+            return hit.find;
+        }
+
+    private:
+
+        //--------------------------------------------------------------------------------
+        // build
+        //--------------------------------------------------------------------------------
+
+        // binned SAH (0 : leaf, leafMax : max primitives in a leaf)
+        static int split(Prim *prims, const int size, const Box3 &box, const int level, const int leafMax) {
+            const int BIN_NUM = 16;
+
+            // depth limit for the traversal stack
+            const int LEVEL_MAX = 60;
+
+            if (size <= 1) return 0;
+
+            Box3 cbox = nullBox3();
+            for (int i = 0; i < size; i++) {
+                cbox = orBox(cbox, prims[i].cent);
+            }
+
+            double mincost = SP_INFINITY;
+            int da = -1;
+            int db = 0;
+
+            for (int a = 0; a < 3 && level < LEVEL_MAX; a++) {
+                const double base = acsv(cbox.pos[0], a);
+                const double ext = acsv(cbox.pos[1], a) - base;
+                if (ext < SP_SMALL) continue;
+
+                const double scale = BIN_NUM * (1.0 - 1.0e-6) / ext;
+
+                int cnts[BIN_NUM] = { 0 };
+                Box3 boxs[BIN_NUM];
+                for (int b = 0; b < BIN_NUM; b++) {
+                    boxs[b] = nullBox3();
+                }
+                for (int i = 0; i < size; i++) {
+                    const int b = minVal(static_cast<int>((acsv(prims[i].cent, a) - base) * scale), BIN_NUM - 1);
+                    cnts[b]++;
+                    boxs[b] = orBox(boxs[b], prims[i].box);
+                }
+
+                // right side cost
+                double rcost[BIN_NUM];
+                {
+                    Box3 rbox = nullBox3();
+                    int rcnt = 0;
+                    for (int b = BIN_NUM - 1; b > 0; b--) {
+                        rbox = orBox(rbox, boxs[b]);
+                        rcnt += cnts[b];
+                        rcost[b] = (rcnt > 0) ? getBoxArea(rbox) * rcnt : 0.0;
                     }
+                }
 
-                    for (int i = 0; i < idxs.size(); i++) {
-                        unit.idxs[i].id = idxs[i].id;
+                Box3 lbox = nullBox3();
+                int lcnt = 0;
+                for (int b = 0; b < BIN_NUM - 1; b++) {
+                    lbox = orBox(lbox, boxs[b]);
+                    lcnt += cnts[b];
+                    if (lcnt == 0 || lcnt == size) continue;
+
+                    const double cost = getBoxArea(lbox) * lcnt + rcost[b + 1];
+                    if (cost < mincost) {
+                        mincost = cost;
+                        da = a;
+                        db = b;
                     }
                 }
             }
-            {
 
-                Mem1<IndexEx> idxs(m_layouts.size());
-                m_idxs.resize(m_layouts.size());
+            // leaf cost (size) vs traversal (1) + child cost
+            const double area = getBoxArea(box);
+            if (size <= leafMax && (da < 0 || size * area <= area + mincost)) return 0;
 
-                for (int i = 0; i < idxs.size(); i++) {
-                    Unit &unit = m_units[m_layouts[i].uid];
-                    idxs[i].id = i;
-                    idxs[i].box = nullBox3();
-                    for (int j = 0; j < 8; j++) {
-                        const int a = (j & 0x01) ? 1 : 0;
-                        const int b = (j & 0x02) ? 1 : 0;
-                        const int c = (j & 0x04) ? 1 : 0;
-                        const Vec3 v = getVec3(unit.nodes[0].box.pos[a].x, unit.nodes[0].box.pos[b].y, unit.nodes[0].box.pos[c].z);
-                        idxs[i].box = orBox(idxs[i].box, m_layouts[i].pose * v);
-                    }
-                    idxs[i].cent = getBoxCent(idxs[i].box);
+            // same centroids
+            if (da < 0) return size / 2;
+
+            const double base = acsv(cbox.pos[0], da);
+            const double scale = BIN_NUM * (1.0 - 1.0e-6) / (acsv(cbox.pos[1], da) - base);
+
+            int di = 0;
+            for (int i = 0; i < size; i++) {
+                const int b = minVal(static_cast<int>((acsv(prims[i].cent, da) - base) * scale), BIN_NUM - 1);
+                if (b <= db) {
+                    swap(prims[i], prims[di++]);
                 }
+            }
+            return di;
+        }
 
-                m_nodes.clear();
-                m_nodes.reserve(2 * idxs.size() - 1);
+        static void expand(Mem1<BNode> &bnodes, Mem1<Prim> &prims, const int ni, const int leafMax) {
+            const BNode n = bnodes[ni];
 
-                Mem1<SP_REAL> buff(idxs.size());
-                
-                initn(m_nodes, idxs, 0, 0, idxs.size());
+            const int di = split(&prims[n.base], n.size, n.box, n.level, leafMax);
+            if (di == 0) return;
 
-                Mem1<Node*> tnodes;
-                {
-                    tnodes.push(&m_nodes[0]);
+            bnodes[ni].child = bnodes.size();
+            for (int c = 0; c < 2; c++) {
+                BNode &b = *bnodes.extend();
+                b.level = n.level + 1;
+                b.base = (c == 0) ? n.base : n.base + di;
+                b.size = (c == 0) ? di : n.size - di;
+                b.child = -1;
+
+                b.box = nullBox3();
+                for (int i = b.base; i < b.base + b.size; i++) {
+                    b.box = orBox(b.box, prims[i].box);
+                }
+            }
+        }
+
+        // prims are reordered into the leaf order
+        static void buildTree(Mem1<Node> &nodes, Mem1<Node4> &tree, Mem1<Prim> &prims, const int leafMax) {
+            nodes.clear();
+            tree.clear();
+            if (prims.size() == 0) return;
+
+            Mem1<BNode> bnodes;
+            bnodes.reserve(2 * prims.size());
+            {
+                BNode &b = *bnodes.extend();
+                b.level = 0;
+                b.base = 0;
+                b.size = prims.size();
+                b.child = -1;
+
+                b.box = nullBox3();
+                for (int i = 0; i < prims.size(); i++) {
+                    b.box = orBox(b.box, prims[i].box);
+                }
+            }
+
+            // upper levels (serial)
+            const int level = (prims.size() > 1000) ? 5 : 0;
+
+            Mem1<int> roots;
+            for (int ni = 0; ni < bnodes.size(); ni++) {
+                if (bnodes[ni].level < level) {
+                    expand(bnodes, prims, ni, leafMax);
+                }
+                else {
+                    roots.push(ni);
                 }
+            }
 
-                for (int ni = 0; ni < tnodes.size(); ni++) {
-                    Node& n = *tnodes[ni];
-                    if (n.size == 1) continue;
+            // subtrees (parallel)
+            Mem1<Mem1<BNode> > subs(roots.size());
 
-                    const int di = sorti(n, idxs, buff);
+#if SP_USE_OMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+            for (int r = 0; r < roots.size(); r++) {
+                Mem1<BNode> &sub = subs[r];
+                sub.reserve(2 * bnodes[roots[r]].size);
+                sub.push(bnodes[roots[r]]);
 
-                    n.n0 = initn(m_nodes, idxs, n.level + 1, n.base, di);
-                    n.n1 = initn(m_nodes, idxs, n.level + 1, n.base + di, n.size - di);
-                    tnodes.push(n.n0);
-                    tnodes.push(n.n1);
+                for (int ni = 0; ni < sub.size(); ni++) {
+                    expand(sub, prims, ni, leafMax);
                 }
+            }
+
+            // merge (sub[0] is the root)
+            for (int r = 0; r < roots.size(); r++) {
+                const Mem1<BNode> &sub = subs[r];
+                const int offset = bnodes.size() - 1;
 
-                for (int i = 0; i < idxs.size(); i++) {
-                    m_idxs[i].id = idxs[i].id;
+                bnodes[roots[r]].child = (sub[0].child >= 0) ? sub[0].child + offset : -1;
+                for (int i = 1; i < sub.size(); i++) {
+                    BNode &b = *bnodes.extend();
+                    b = sub[i];
+                    b.child = (b.child >= 0) ? b.child + offset : -1;
                 }
             }
-        }
 
-        bool trace(Hit &hit, const VecPD3 &ray, const double minv, const double maxv) const {
-            memset(&hit, 0, sizeof(Hit));
-            hit.calc = true;
+            nodes.resize(bnodes.size());
+            for (int i = 0; i < bnodes.size(); i++) {
+                const BNode &b = bnodes[i];
+                Node &n = nodes[i];
+                n.level = b.level;
+                n.base = b.base;
+                n.size = b.size;
+                n.box = b.box;
+                n.n0 = (b.child >= 0) ? &nodes[b.child + 0] : NULL;
+                n.n1 = (b.child >= 0) ? &nodes[b.child + 1] : NULL;
+            }
 
-            const int QUE_MAX = 100;
-            const Node* queA[QUE_MAX];
-            const Node* queB[QUE_MAX];
+            tree.reserve(bnodes.size() / 2 + 1);
+            flatten(tree, bnodes, 0);
+        }
 
-            double lmaxv = maxv;
-            if (m_nodes.size() > 0) {
-                int stack = 0;
-                queA[stack++] = &m_nodes[0];
-
-                while (stack > 0) {
-                    const Node *n = queA[--stack];
-                    if (checkHit(n->box, ray, minv, lmaxv) == false) {
-                        continue;
-                    }
-                    if (n->n0 != NULL && n->n1 != NULL && stack < QUE_MAX - 2) {
-                        queA[stack++] = n->n0;
-                        queA[stack++] = n->n1;
-                        continue;
+        // collapse a binary tree into 4-wide nodes
+        static int flatten(Mem1<Node4> &tree, const Mem1<BNode> &bnodes, const int ni) {
+            int cs[4];
+            int cnum = 0;
+            if (bnodes[ni].child < 0) {
+                cs[cnum++] = ni;
+            }
+            else {
+                cs[cnum++] = bnodes[ni].child + 0;
+                cs[cnum++] = bnodes[ni].child + 1;
+            }
+
+            // open the largest child
+            while (cnum < 4) {
+                int k = -1;
+                double maxa = -1.0;
+                for (int c = 0; c < cnum; c++) {
+                    const BNode &b = bnodes[cs[c]];
+                    if (b.child >= 0 && getBoxArea(b.box) > maxa) {
+                        maxa = getBoxArea(b.box);
+                        k = c;
                     }
+                }
+                if (k < 0) break;
+
+                const int child = bnodes[cs[k]].child;
+                cs[k] = child + 0;
+                cs[cnum++] = child + 1;
+            }
+
+            const int id = tree.size();
+            tree.extend();
 
-                    const int i = m_idxs[n->base].id;
-                    {
-                        const Mat &pose = m_layouts[i].pose;
-                        const Mat &invp = m_layouts[i].invp;
+            Node4 node;
+            for (int c = 0; c < 4; c++) {
+                for (int a = 0; a < 3; a++) {
+                    node.bmin[a][c] = +1.0e30f;
+                    node.bmax[a][c] = -1.0e30f;
+                }
+                node.child[c] = -1;
+                node.num[c] = 0;
+            }
+            for (int c = 0; c < cnum; c++) {
+                const BNode &b = bnodes[cs[c]];
 
-                        const Unit &unit = m_units[m_layouts[i].uid];
+                // expanded for the float rounding
+                for (int a = 0; a < 3; a++) {
+                    const double v0 = acsv(b.box.pos[0], a);
+                    const double v1 = acsv(b.box.pos[1], a);
+                    node.bmin[a][c] = static_cast<float>(v0 - fabs(v0) * 1.0e-6);
+                    node.bmax[a][c] = static_cast<float>(v1 + fabs(v1) * 1.0e-6);
+                }
 
-                        const VecPD3 bray = invp * ray;
+                if (b.child < 0) {
+                    node.child[c] = b.base;
+                    node.num[c] = b.size;
+                }
+                else {
+                    node.child[c] = flatten(tree, bnodes, cs[c]);
+                }
+            }
+            tree[id] = node;
+            return id;
+        }
 
-                        int stack = 0;
-                        queB[stack++] = &unit.nodes[0];
 
-                        int minid = -1;
-                        int objid = -1;
+        //--------------------------------------------------------------------------------
+        // traverse
+        //--------------------------------------------------------------------------------
 
-                        const SP_REAL delta = 0.001;
+        // slab test of 4 boxes (bit c : hit of child c)
+        static int checkHit4(float *tnear, const Node4 &node, const float *org, const float *inv, const float tmin, const float tmax) {
+#if SP_USE_SSE
+            __m128 tn = _mm_set1_ps(tmin);
+            __m128 tf = _mm_set1_ps(tmax);
+            for (int a = 0; a < 3; a++) {
+                const __m128 o = _mm_set1_ps(org[a]);
+                const __m128 i = _mm_set1_ps(inv[a]);
+                const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmin[a]), o), i);
+                const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmax[a]), o), i);
+                tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+                tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+            }
+            _mm_storeu_ps(tnear, tn);
+            return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+#else
+            int mask = 0;
+            for (int c = 0; c < 4; c++) {
+                float tn = tmin;
+                float tf = tmax;
+                for (int a = 0; a < 3; a++) {
+                    const float t0 = (node.bmin[a][c] - org[a]) * inv[a];
+                    const float t1 = (node.bmax[a][c] - org[a]) * inv[a];
+                    tn = maxVal(tn, minVal(t0, t1));
+                    tf = minVal(tf, maxVal(t0, t1));
+                }
+                tnear[c] = tn;
+                mask |= (tn <= tf) ? (1 << c) : 0;
+            }
+            return mask;
+#endif
+        }
 
-                        while (stack > 0) {
-                            const Node *n = queB[--stack];
-                            if (checkHit(n->box, bray, minv, lmaxv) == false) {
-                                continue;
-                            }
-                            if (n->n0 != NULL && n->n1 != NULL && stack < QUE_MAX - 2) {
-                                queB[stack++] = n->n0;
-                                queB[stack++] = n->n1;
-                                continue;
-                            }
-                            {
-                                const int id = n->base;
-                                SP_REAL result[3] = { 0 };
-                                if (traceMesh(result, unit.data[unit.idxs[id].id].mesh, bray, minv, lmaxv) == true) {
+        // leaf(base, num, maxv) updates maxv on a hit
+        template<typename LEAF>
+        static void traverse(const Mem1<Node4> &tree, const VecPD3 &ray, const double minv, double &maxv, const LEAF &leaf) {
+            if (tree.size() == 0) return;
+
+            const int STACK_MAX = 256;
+            int stack[STACK_MAX];
+            float snear[STACK_MAX];
+
+            float org[3];
+            float inv[3];
+            for (int a = 0; a < 3; a++) {
+                const double d = acsv(ray.drc, a);
+                org[a] = static_cast<float>(acsv(ray.pos, a));
+                inv[a] = static_cast<float>((fabs(d) > 1.0e-30) ? maxVal(-1.0e30, minVal(1.0e30, 1.0 / d)) : 1.0e30);
+            }
 
-                                    const Vec3 nrm = getMeshNrm(unit.data[unit.idxs[id].id].mesh);
-                                    const bool f = (dotVec(nrm, bray.drc) < 0.0);
+            // float error margin
+            const double eps = 1.0e-5;
 
-                                    lmaxv = result[0];
-                                    minid = id;
-                                }
-                            }
-                        }
+            int sp = 0;
+            stack[sp] = 0;
+            snear[sp] = static_cast<float>(minv);
+            sp++;
 
-                        if (minid >= 0) {
-                            hit.find = true;
-                            hit.mat = unit.data[unit.idxs[minid].id].mat;
+            while (sp > 0) {
+                sp--;
+                if (snear[sp] > maxv * (1.0 + eps) + eps) continue;
 
-                            hit.vec.pos = pose * (bray.pos + bray.drc * lmaxv);
-                            hit.vec.drc = unitVec(pose.part(0, 0, 3, 3)  * getMeshNrm(unit.data[unit.idxs[minid].id].mesh));
-                        }
+                const Node4 &node = tree[stack[sp]];
+
+                const float tmax = static_cast<float>(minVal(maxv * (1.0 + eps) + eps, 1.0e30));
+
+                float tnear[4];
+                const int mask = checkHit4(tnear, node, org, inv, static_cast<float>(minv - eps), tmax);
+
+                // near to far
+                int order[4];
+                int cnum = 0;
+                for (int c = 0; c < 4; c++) {
+                    if (((mask >> c) & 1) == 0 || node.child[c] < 0) continue;
+
+                    int k = cnum++;
+                    while (k > 0 && tnear[order[k - 1]] > tnear[c]) {
+                        order[k] = order[k - 1];
+                        k--;
+                    }
+                    order[k] = c;
+                }
+
+                for (int k = 0; k < cnum; k++) {
+                    const int c = order[k];
+                    if (node.num[c] > 0 && tnear[c] <= maxv * (1.0 + eps) + eps) {
+                        leaf(node.child[c], node.num[c], maxv);
+                    }
+                }
+                for (int k = cnum - 1; k >= 0; k--) {
+                    const int c = order[k];
+                    if (node.num[c] == 0 && sp < STACK_MAX) {
+                        stack[sp] = node.child[c];
+                        snear[sp] = tnear[c];
+                        sp++;
                     }
                 }
             }
-            return hit.find;
+        }
+
+        // triangle intersection
+        static bool traceTri(double &result, const Tri &tri, const VecPD3 &ray, const double minv, const double maxv) {
+            const Vec3 p = crsVec(ray.drc, tri.B);
+            const double det = dotVec(tri.A, p);
+            if (fabs(det) < SP_SMALL) return false;
+
+            const double inv = 1.0 / det;
+            const Vec3 s = ray.pos - tri.pos;
+
+            const double u = dotVec(s, p) * inv;
+            if (u < -SP_SMALL || u > 1.0 + SP_SMALL) return false;
+
+            const Vec3 q = crsVec(s, tri.A);
+            const double v = dotVec(ray.drc, q) * inv;
+            if (v < -SP_SMALL || u + v > 1.0 + SP_SMALL) return false;
+
+            const double t = dotVec(tri.B, q) * inv;
+            if (t < minv || t > maxv) return false;
+
+            result = t;
+            return true;
         }
     };
 
@@ -708,34 +708,24 @@ namespace sp{
             return calcHMat(H, pixs, objs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _pixs(pixs, unit);
-        RandomSample<Vec2> _objs(objs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-            const Mem1<Vec2> robjs = _objs.gen(it);
-
+        auto solve = [&](Mem1<Mat> &tests, const int *ids) -> bool {
             Mat test;
-            if (calcHMat(test, rpixs, robjs, 1) == false) continue;
+            if (calcHMat(test, ransacData(pixs, ids, unit), ransacData(objs, ids, unit), 1) == false) return false;
 
-            const Mem1<SP_REAL> errs = errHMat(test, pixs, objs);
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
+            tests.push(test);
+            return true;
+        };
 
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
+        auto error = [&](const Mat &test, const int i) -> SP_REAL {
+            return errHMat(test, pixs[i], objs[i]);
+        };
 
-                H = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        auto refine = [&](Mat &test, const Mem1<int> &ids) -> bool {
+            return calcHMat(test, ransacData(pixs, ids.ptr, ids.size()), ransacData(objs, ids.ptr, ids.size()), 1);
+        };
+
+        const SP_REAL eval = ransac(H, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         const Mem1<SP_REAL> errs = errHMat(H, pixs, objs);
@@ -757,36 +747,20 @@ namespace sp{
             return calcEMat(E, npxs0, npxs1);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _npxs0(npxs0, unit);
-        RandomSample<Vec2> _npxs1(npxs1, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rnpxs0 = _npxs0.gen(it);
-            const Mem1<Vec2> rnpxs1 = _npxs1.gen(it);
+        auto solve = [&](Mem1<Mat> &tests, const int *ids) -> bool {
+            return calcEMat(tests, ransacData(npxs0, ids, unit), ransacData(npxs1, ids, unit));
+        };
 
-            Mem1<Mat> tests;
-            if (calcEMat(tests, rnpxs0, rnpxs1) == false) continue;
+        auto error = [&](const Mat &test, const int i) -> SP_REAL {
+            return errEMat(test, npxs0[i], npxs1[i]);
+        };
 
-            for (int i = 0; i < tests.size(); i++) {
-                const Mem1<SP_REAL> errs = errEMat(tests[i], npxs0, npxs1);
-                const SP_REAL eval = ransacEval(errs, unit, thresh);
+        auto refine = [&](Mat &test, const Mem1<int> &ids) -> bool {
+            return calcEMat(test, ransacData(npxs0, ids.ptr, ids.size()), ransacData(npxs1, ids.ptr, ids.size()), 1);
+        };
 
-                if (eval > maxe) {
-                    //SP_PRINTD("eval %lf\n", eval);
-                    maxe = eval;
-                    maxit = minVal(maxit, ransacAdaptiveStop(eval, unit));
-
-                    E = tests[i];
-                }
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d num %d rate %.2lf\n", it, num, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        const SP_REAL eval = ransac(E, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         {
@@ -812,34 +786,24 @@ namespace sp{
             return calcFMat(F, pixs0, pixs1);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _pixs0(pixs0, unit);
-        RandomSample<Vec2> _pixs1(pixs1, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rpixs0 = _pixs0.gen(it);
-            const Mem1<Vec2> rpixs1 = _pixs1.gen(it);
-
+        auto solve = [&](Mem1<Mat> &tests, const int *ids) -> bool {
             Mat test;
-            if (calcEMat8p(test, rpixs0, rpixs1) == false) continue;
+            if (calcEMat8p(test, ransacData(pixs0, ids, unit), ransacData(pixs1, ids, unit)) == false) return false;
 
-            const Mem1<SP_REAL> errs = errFMat(test, pixs0, pixs1);
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
+            tests.push(test);
+            return true;
+        };
 
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = minVal(maxit, ransacAdaptiveStop(eval, unit));
+        auto error = [&](const Mat &test, const int i) -> SP_REAL {
+            return errFMat(test, pixs0[i], pixs1[i]);
+        };
 
-                F = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d num %d rate %.2lf\n", it, num, maxe);
-        if (maxe < SP_RANSAC_MINEVAL) return false;
+        auto refine = [&](Mat &test, const Mem1<int> &ids) -> bool {
+            return calcFMat(test, ransacData(pixs0, ids.ptr, ids.size()), ransacData(pixs1, ids.ptr, ids.size()), 1);
+        };
+
+        const SP_REAL eval = ransac(F, num, unit, RansacParam(thresh), solve, error, refine);
+        if (eval < SP_RANSAC_MINEVAL) return false;
 
         // refine
         {
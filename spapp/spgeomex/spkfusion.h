@@ -17,6 +17,12 @@ namespace sp{
         // tsdf map
         Voxel<> m_tsdf;
 
+        // tsdf map (sparse voxel, unbounded)
+        SparseVoxel m_hash;
+
+        // flag for sparse voxel map
+        bool m_sparse;
+
         // casted pn
         Mem2<VecPD3> m_cast;
 
@@ -35,8 +41,25 @@ namespace sp{
             init(100, 2.0, getCamParam(0, 0), zeroPose());
         }
 
+        // dense voxel (size^3, centered on the map origin)
         void init(const int size, const double unit, const CamParam &cam, const Pose &base) {
             m_tsdf.init(size, unit);
+            m_hash.init(unit, 0);
+            m_sparse = false;
+
+            m_cast.resize(cam.dsize);
+            m_cast.zero();
+
+            m_cam = cam;
+            m_pose = base;
+            m_track = false;
+        }
+
+        // sparse voxel (bricks are allocated around observed surfaces)
+        void init(const double unit, const CamParam &cam, const Pose &base) {
+            m_tsdf.init(0, unit);
+            m_hash.init(unit);
+            m_sparse = true;
 
             m_cast.resize(cam.dsize);
             m_cast.zero();
@@ -72,7 +95,11 @@ namespace sp{
         }
 
         const Voxel<>* getMap() const {
-            return (m_track == true) ? &m_tsdf : NULL; ;
+            return (m_track == true && m_sparse == false) ? &m_tsdf : NULL; ;
+        }
+
+        const SparseVoxel* getSparseMap() const {
+            return (m_track == true && m_sparse == true) ? &m_hash : NULL;
         }
 
 
@@ -96,7 +123,12 @@ namespace sp{
 
             // clear data
             if (m_track == false){
-                m_tsdf.zero();
+                if (m_sparse == false) {
+                    m_tsdf.zero();
+                }
+                else {
+                    m_hash.zero();
+                }
                 m_cast.zero();
             }
 
@@ -118,12 +150,22 @@ namespace sp{
 
                 {
                     SP_LOGGER_SET("KinectFusion::updateTSDF");
-                    updateTSDF(m_tsdf, m_cam, m_pose, depth);
+                    if (m_sparse == false) {
+                        updateTSDF(m_tsdf, m_cam, m_pose, depth);
+                    }
+                    else {
+                        updateTSDF(m_hash, m_cam, m_pose, depth);
+                    }
                 }
 
                 {
                     SP_LOGGER_SET("KinectFusion::rayCasting");
-                    rayCasting(m_cast, m_cam, m_pose, m_tsdf);
+                    if (m_sparse == false) {
+                        rayCasting(m_cast, m_cam, m_pose, m_tsdf);
+                    }
+                    else {
+                        rayCasting(m_cast, m_cam, m_pose, m_hash);
+                    }
                 }
                 m_track = true;
             }
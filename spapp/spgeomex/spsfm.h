@@ -8,6 +8,11 @@
 #include "spcore/spcore.h"
 #include "spapp/spimgex/spfeature.h"
 #include "spapp/spgeom/spgeom.h"
+#include "spapp/spgeom/spbundle.h"
+
+#if SP_USE_OMP && defined(_OPENMP)
+#include <omp.h>
+#endif
 
 namespace sp {
 
@@ -19,6 +24,9 @@ namespace sp {
         class ViewEx : public View {
         public:
 
+            // view id (index of key views)
+            int id;
+
             // pose state
             enum PoseState {
                 POSE_NULL = 0,
@@ -31,6 +39,10 @@ namespace sp {
             Mem1<ViewEx*> views;
             Mem1<MatchPair*> pairs;
 
+            // cached descriptor matrix (pair matching) / word histogram (pair shortlist)
+            DscMat dmat;
+            Mem1<float> hist;
+
             // init pair count
             int icnt;
 
@@ -41,6 +53,7 @@ namespace sp {
             bool fix;
 
             ViewEx() : View() {
+                id = -1;
                 state = POSE_NULL;
 
                 icnt = 0;
@@ -55,11 +68,15 @@ namespace sp {
 
             ViewEx& operator = (const ViewEx &view) {
                 static_cast<View>(*this) = static_cast<View>(view);
+                id = view.id;
                 state = view.state;
 
                 views = view.views;
                 pairs = view.pairs;
 
+                dmat = view.dmat;
+                hist = view.hist;
+
                 icnt = view.icnt;
 
                 upcnt = view.upcnt;
@@ -132,6 +149,15 @@ namespace sp {
 
         Mem1<ViewEx*> m_queue;
 
+        // map point descriptor index
+        DscIndex m_index;
+
+        // index id -> map point
+        Mem1<MapPnt*> m_imaps;
+
+        // pair matching threads
+        ThreadPool m_pool;
+
     private:
 
         //--------------------------------------------------------------------------------
@@ -165,6 +191,9 @@ namespace sp {
             _mpntsPool.clear();
 
             m_queue.clear();
+
+            m_index.clear();
+            m_imaps.clear();
         }
 
 
@@ -176,6 +205,16 @@ namespace sp {
             m_mode = mode;
         }
 
+        // map point index recall / speed (0..3)
+        void setIndexRadius(const int radius) {
+            m_index.setRadius(radius);
+        }
+
+        // pair matching threads (num <= 0 : hardware concurrency)
+        void setThreads(const int num) {
+            m_pool.init(num);
+        }
+
 
         //--------------------------------------------------------------------------------
         // output parameter
@@ -215,6 +254,24 @@ namespace sp {
             return true;
         }
 
+        // bundle adjustment (all valid views, ViewEx::fix views are fixed)
+        bool adjustGlobal(const int maxit = 10) {
+            Mem1<ViewEx*> list;
+            for (int v = 0; v < m_views.size(); v++) {
+                if (m_views[v]->state == ViewEx::POSE_VALID) list.push(m_views[v]);
+            }
+            return adjustBundle(m_views, list, maxit);
+        }
+
+        // local bundle adjustment (latest valid views, the other views that see the map points are fixed)
+        bool adjustLocal(const int wsize = 5, const int maxit = 5) {
+            Mem1<ViewEx*> list;
+            for (int v = m_views.size() - 1; v >= 0 && list.size() < wsize; v--) {
+                if (m_views[v]->state == ViewEx::POSE_VALID) list.push(m_views[v]);
+            }
+            return adjustBundle(m_views, list, maxit);
+        }
+
 
     private:
 
@@ -228,6 +285,11 @@ namespace sp {
 
         int MAX_UPDATE = 3;
 
+        // pair candidates per view and update
+        int MAX_PAIRCAND = 10;
+
+        int MAX_ADJUST = 5;
+
         double MAX_NEARPOSE = 30.0 * SP_PI / 180.0;
 
 
@@ -288,6 +350,9 @@ namespace sp {
                     view.upcnt = minVal(m_views.size(), view.upcnt + 1);
                 }
 
+                // joint refinement of the updated views
+                adjustBundle(m_views, uplist, MAX_ADJUST);
+
                 m_update++;
             }
             catch (const char *str) {
@@ -300,6 +365,9 @@ namespace sp {
         }
 
         void initMem() {
+            for (int i = 0; i < m_queue.size(); i++) {
+                m_queue[i]->id = m_views.size() + i;
+            }
             m_views.push(m_queue);
             m_queue.clear();
 
@@ -329,6 +397,9 @@ namespace sp {
             view.cam = cam;
             view.ftrs = SIFT::getFtrs(img);
 
+            view.dmat.set(view.ftrs);
+            view.hist = getDscHist(view.dmat);
+
             if (hint != NULL) {
                 view.state = ViewEx::POSE_HINT;
                 view.pose = *hint;
@@ -347,13 +418,28 @@ namespace sp {
         // pair (a, b: view id)
         //--------------------------------------------------------------------------------
 
-        void initPair(Mem1<ViewEx*> &views, Mem2<MatchPair*> &pairs, const int a, const int b) {
-            MatchPair &pair = *_pairsPool.malloc();
+        // allocate the pair [a, b] and [b, a] (matched by matchPairs)
+        MatchPair* addPair(Mem1<ViewEx*> &views, Mem2<MatchPair*> &pairs, const int a, const int b) {
+            MatchPair &pab = *_pairsPool.malloc();
+            MatchPair &pba = *_pairsPool.malloc();
+
+            pab.a = a;
+            pab.b = b;
+            pba.a = b;
+            pba.b = a;
+
+            views[a]->icnt++;
+            views[b]->icnt++;
+            pairs(a, b) = &pab;
+            pairs(b, a) = &pba;
+
+            return &pab;
+        }
 
-            pair.a = a;
-            pair.b = b;
+        void linkPair(Mem1<ViewEx*> &views, MatchPair &pair) {
+            const int a = pair.a;
+            const int b = pair.b;
 
-            pair.matches = findMatch(views[a]->ftrs, views[b]->ftrs);
             pair.eval = getMatchEval(pair.matches);
 
             if (pair.eval > MIN_MATCHEVAL) {
@@ -361,12 +447,114 @@ namespace sp {
                 views[a]->pairs.push(&pair);
             }
 
-            views[a]->icnt++;
-            pairs(a, b) = &pair;
-
             //printf("[%d %d]: size %d, cnt %d, eval %.2lf\n", pair.a, pair.b, pair.matches.size(), getMatchCnt(pair.matches), pair.eval);
         }
 
+        // match the pairs on the thread pool and link them to the views in list order
+        void matchPairs(Mem1<ViewEx*> &views, Mem2<MatchPair*> &pairs, const Mem1<MatchPair*> &list) {
+            if (list.size() == 0) return;
+
+            std::atomic<int> next(0);
+
+            m_pool.run([&](const int) {
+#if SP_USE_OMP && defined(_OPENMP)
+                // pair parallel (no nested team in findMatch)
+                omp_set_num_threads(1);
+#endif
+                while (true) {
+                    const int i = next++;
+                    if (i >= list.size()) break;
+
+                    MatchPair &pab = *list[i];
+                    MatchPair &pba = *pairs(pab.b, pab.a);
+
+                    pab.matches = findMatch(views[pab.a]->dmat, views[pab.b]->dmat);
+
+                    // cross checked matches are symmetric
+                    pba.matches.resize(views[pab.b]->dmat.num);
+                    setElm(pba.matches, -1);
+                    for (int f = 0; f < pab.matches.size(); f++) {
+                        if (pab.matches[f] >= 0) pba.matches[pab.matches[f]] = f;
+                    }
+                }
+            });
+
+            for (int i = 0; i < list.size(); i++) {
+                linkPair(views, *list[i]);
+                linkPair(views, *pairs(list[i]->b, list[i]->a));
+            }
+        }
+
+        // word weight of the key views (idf)
+        Mem1<float> getHistWeight(const Mem1<ViewEx*> &views) {
+            const int dim = (views.size() > 0) ? views[0]->hist.size() : 0;
+
+            Mem1<float> weight(dim);
+            for (int d = 0; d < dim; d++) {
+                int cnt = 0;
+                for (int v = 0; v < views.size(); v++) {
+                    if (views[v]->hist.size() == dim && views[v]->hist[d] > 0.0f) cnt++;
+                }
+                weight[d] = static_cast<float>(log((views.size() + 1.0) / (cnt + 0.5)));
+            }
+            return weight;
+        }
+
+        // normalized global descriptor (sqrt(hist) * weight)
+        Mem1<float> getGlobalDsc(const ViewEx &view, const Mem1<float> &weight) {
+            Mem1<float> gdsc(weight.size());
+            gdsc.zero();
+            if (view.hist.size() != weight.size()) return gdsc;
+
+            double sum = 0.0;
+            for (int d = 0; d < weight.size(); d++) {
+                gdsc[d] = static_cast<float>(sqrt(view.hist[d])) * weight[d];
+                sum += gdsc[d] * gdsc[d];
+            }
+
+            const float nrm = static_cast<float>(1.0 / maxVal(sqrt(sum), SP_SMALL));
+            for (int d = 0; d < weight.size(); d++) {
+                gdsc[d] *= nrm;
+            }
+            return gdsc;
+        }
+
+        // unmatched views of a in the order of the global descriptor similarity
+        Mem1<int> getShortlist(Mem1<ViewEx*> &views, Mem2<MatchPair*> &pairs, const Mem1<Mem1<float> > &gdscs, const int a, const int maxn) {
+            struct Cand {
+                float eval;
+                int id;
+            };
+
+            Mem1<Cand> cands;
+            for (int b = 0; b < views.size(); b++) {
+                if (b == a || pairs(a, b) != NULL) continue;
+
+                float eval = 0.0f;
+                for (int d = 0; d < gdscs[a].size(); d++) {
+                    eval += gdscs[a][d] * gdscs[b][d];
+                }
+
+                Cand &cand = *cands.extend();
+                cand.eval = eval;
+                cand.id = b;
+            }
+
+            auto compare = [](const void *a, const void *b) -> int {
+                const Cand &ca = *static_cast<const Cand*>(a);
+                const Cand &cb = *static_cast<const Cand*>(b);
+                if (ca.eval != cb.eval) return (ca.eval < cb.eval) ? +1 : -1;
+                return (ca.id > cb.id) ? +1 : -1;
+            };
+            sort(cands, compare);
+
+            Mem1<int> list;
+            for (int i = 0; i < minVal(maxn, cands.size()); i++) {
+                list.push(cands[i].id);
+            }
+            return list;
+        }
+
         Mem1<MatchPair*> getPairs(Mem1<ViewEx*> &views, const ViewEx::PoseState &stateA, const ViewEx::PoseState &stateB) {
             Mem1<MatchPair*> ptrs;
 
@@ -387,6 +575,19 @@ namespace sp {
 
         bool updatePair(Mem1<ViewEx*> &views, Mem2<MatchPair*> &pairs, const int itmax) {
 
+            // global descriptor of the key views
+            Mem1<Mem1<float> > gdscs(views.size());
+            {
+                const Mem1<float> weight = getHistWeight(views);
+                for (int v = 0; v < views.size(); v++) {
+                    gdscs[v] = getGlobalDsc(*views[v], weight);
+                }
+            }
+
+            // scheduled pairs (matched at once)
+            Mem1<MatchPair*> list;
+
+            bool ret = true;
             for (int it = 0; it < itmax; it++) {
                 int a = -1;
                 {
@@ -398,34 +599,32 @@ namespace sp {
                         }
                     }
                 }
-                if (a < 0) return false;
-
-                Mem1<int> list;
-                for (int b = 0; b < views.size(); b++) {
-                    if (b != a && pairs(a, b) == NULL) {
-                        list.push(b);
-                    }
+                if (a < 0) {
+                    ret = false;
+                    break;
                 }
-                if (list.size() == 0) return false;
 
-                list = shuffle(list);
+                const Mem1<int> cands = getShortlist(views, pairs, gdscs, a, MAX_PAIRCAND);
+                if (cands.size() == 0) {
+                    ret = false;
+                    break;
+                }
 
-                for (int i = 0; i < minVal(10, list.size()); i++) {
-                    const int b = list[i];
-                    initPair(views, pairs, a, b);
-                    initPair(views, pairs, b, a);
+                for (int i = 0; i < cands.size(); i++) {
+                    list.push(addPair(views, pairs, a, cands[i]));
                 }
 
                 if (msize() > 0 && views[a]->state == ViewEx::POSE_HINT) {
                     const int v = searchNearViewId(views[a]->pose);
-                    if (pairs(a, v) != NULL) continue;
+                    if (v < 0 || v == a || pairs(a, v) != NULL) continue;
 
-                    initPair(views, pairs, a, v);
-                    initPair(views, pairs, v, a);
+                    list.push(addPair(views, pairs, a, v));
                 }
-
             }
-            return true;
+
+            matchPairs(views, pairs, list);
+
+            return ret;
         }
 
         //--------------------------------------------------------------------------------
@@ -464,6 +663,15 @@ namespace sp {
             mpnt.updateErr();
 
             view.ftrs[f].mpnt = &mpnt;
+
+            // index every observation (removed ids are reused by the index)
+            const int id = m_index.add(view.ftrs[f]);
+            if (id < m_imaps.size()) {
+                m_imaps[id] = &mpnt;
+            }
+            else {
+                m_imaps.push(&mpnt);
+            }
         }
 
         //--------------------------------------------------------------------------------
@@ -720,6 +928,134 @@ namespace sp {
             return true;
         }
 
+        // bundle adjustment of the window views and their map points
+        bool adjustBundle(Mem1<ViewEx*> &views, Mem1<ViewEx*> &window, const int maxit) {
+            if (window.size() == 0) return false;
+
+            // view id -> bundle view
+            Mem1<int> vmap(views.size());
+            setElm(vmap, -1);
+
+            Mem1<ViewEx*> blist;
+            Mem1<bool> fixs;
+            for (int i = 0; i < window.size(); i++) {
+                vmap[window[i]->id] = blist.size();
+                blist.push(window[i]);
+                fixs.push(window[i]->fix);
+            }
+
+            Mem1<MapPnt*> mlist;
+            for (int m = 0; m < m_mpnts.size(); m++) {
+                const MapPnt *mpnt = m_mpnts[m];
+                if (mpnt->valid == false) continue;
+
+                for (int i = 0; i < mpnt->views.size(); i++) {
+                    const ViewEx *view = static_cast<const ViewEx*>(mpnt->views[i]);
+                    if (vmap[view->id] >= 0 && fixs[vmap[view->id]] == false) {
+                        mlist.push(m_mpnts[m]);
+                        break;
+                    }
+                }
+            }
+            if (mlist.size() == 0) return false;
+
+            Mem1<int> vids, pids;
+            Mem1<Vec2> pixs;
+            for (int p = 0; p < mlist.size(); p++) {
+                const MapPnt *mpnt = mlist[p];
+
+                for (int i = 0; i < mpnt->views.size(); i++) {
+                    ViewEx *view = static_cast<ViewEx*>(mpnt->views[i]);
+                    if (view->state != ViewEx::POSE_VALID) continue;
+
+                    // views out of the window are fixed
+                    if (vmap[view->id] < 0) {
+                        vmap[view->id] = blist.size();
+                        blist.push(view);
+                        fixs.push(true);
+                    }
+
+                    vids.push(vmap[view->id]);
+                    pids.push(p);
+                    pixs.push(mpnt->ftrs[i]->pix);
+                }
+            }
+
+            // gauge (rotation, translation : fixed view, scale : distance to the reference view)
+            int fv = -1;
+            int sv = -1;
+            {
+                int fnum = 0;
+                for (int i = 0; i < fixs.size(); i++) {
+                    if (fixs[i] == false) continue;
+                    if (fv < 0) fv = i;
+                    fnum++;
+                }
+
+                // no fixed view : the first valid view is fixed, one fixed view : the next valid view keeps the scale
+                for (int v = 0; v < views.size() && fnum < 2; v++) {
+                    const int i = vmap[views[v]->id];
+                    if (i < 0 || fixs[i] == true || blist[i]->state != ViewEx::POSE_VALID) continue;
+
+                    if (fv < 0) {
+                        fixs[i] = true;
+                        fv = i;
+                        fnum++;
+                    }
+                    else {
+                        sv = i;
+                        break;
+                    }
+                }
+            }
+
+            Mem1<Pose> poses(blist.size());
+            Mem1<CamParam> cams(blist.size());
+            for (int i = 0; i < blist.size(); i++) {
+                poses[i] = blist[i]->pose;
+                cams[i] = blist[i]->cam;
+            }
+
+            Mem1<Vec3> pnts(mlist.size());
+            for (int p = 0; p < mlist.size(); p++) {
+                pnts[p] = mlist[p]->pos;
+            }
+
+            if (refineBundle(poses, pnts, cams, vids, pids, pixs, &fixs, maxit) == false) return false;
+
+            // restore the scale (similarity around the fixed view, reprojection is unchanged)
+            if (fv >= 0 && sv >= 0) {
+                const Vec3 c = invPose(poses[fv]).pos;
+
+                const SP_REAL d0 = normVec(invPose(blist[sv]->pose).pos - c);
+                const SP_REAL d1 = normVec(invPose(poses[sv]).pos - c);
+
+                if (d0 > SP_SMALL && d1 > SP_SMALL) {
+                    const SP_REAL scale = d0 / d1;
+
+                    for (int i = 0; i < poses.size(); i++) {
+                        if (fixs[i] == true) continue;
+
+                        Pose ipose = invPose(poses[i]);
+                        ipose.pos = c + (ipose.pos - c) * scale;
+                        poses[i] = invPose(ipose);
+                    }
+                    for (int p = 0; p < pnts.size(); p++) {
+                        pnts[p] = c + (pnts[p] - c) * scale;
+                    }
+                }
+            }
+
+            for (int i = 0; i < blist.size(); i++) {
+                if (fixs[i] == false) setView(*blist[i], poses[i]);
+            }
+            for (int p = 0; p < mlist.size(); p++) {
+                setMPnt(*mlist[p], pnts[p]);
+            }
+
+            return true;
+        }
+
         bool updatePose(Mem1<ViewEx*> &views, Mem1<MapPnt*> &mpnts, ViewEx &view) {
             if (view.fix == true) return false;
 
@@ -768,6 +1104,97 @@ namespace sp {
             return id;
         }
 
+        // search map point by descriptor index
+        const MapPnt* searchMPnt(const Ftr &ftr) const {
+            const int id = m_index.search(ftr);
+            return (id >= 0) ? m_imaps[id] : NULL;
+        }
+
+        // camera pose from map point index (pose : camera <- world)
+        bool relocalize(Pose &pose, const CamParam &cam, const Mem1<Ftr> &ftrs) const {
+            const Mem1<int> ids = m_index.search(ftrs);
+
+            Mem1<Vec2> pixs;
+            Mem1<Vec3> objs;
+            for (int i = 0; i < ftrs.size(); i++) {
+                if (ids[i] < 0) continue;
+
+                const MapPnt *mpnt = m_imaps[ids[i]];
+                if (mpnt->valid == false) continue;
+
+                pixs.push(ftrs[i].pix);
+                objs.push(mpnt->pos);
+            }
+            if (pixs.size() < MIN_POSEPNT) return false;
+
+            Pose tmp = zeroPose();
+            if (calcPoseRANSAC(tmp, cam, pixs, objs) == false) return false;
+
+            const Mem1<SP_REAL> errs = calcPrjErr(tmp, cam, pixs, objs);
+            if (evalErr(errs, MPNT_PRJERR) * pixs.size() < MIN_POSEPNT) return false;
+
+            pose = tmp;
+            return true;
+        }
+
+        // copy of the valid views and map points (ftrs[].mpnt -> mpnts, map point view links are not copied)
+        void copyMap(Mem1<View> &views, Mem1<MapPnt> &mpnts) const {
+            struct Index {
+                const MapPnt *ptr;
+                int id;
+            };
+
+            Mem1<Index> index(m_mpnts.size());
+            mpnts.resize(m_mpnts.size());
+            for (int i = 0; i < m_mpnts.size(); i++) {
+                mpnts[i] = *m_mpnts[i];
+                mpnts[i].views.clear();
+                mpnts[i].ftrs.clear();
+
+                index[i].ptr = m_mpnts[i];
+                index[i].id = i;
+            }
+
+            auto compare = [](const void *a, const void *b) -> int {
+                const MapPnt *pa = static_cast<const Index*>(a)->ptr;
+                const MapPnt *pb = static_cast<const Index*>(b)->ptr;
+                return (pa < pb) ? -1 : ((pa > pb) ? +1 : 0);
+            };
+            sort(index, compare);
+
+            int num = 0;
+            for (int v = 0; v < m_views.size(); v++) {
+                if (m_views[v]->state == ViewEx::POSE_VALID) num++;
+            }
+
+            views.resize(num);
+            num = 0;
+            for (int v = 0; v < m_views.size(); v++) {
+                if (m_views[v]->state != ViewEx::POSE_VALID) continue;
+
+                View &view = views[num++];
+                view = *m_views[v];
+
+                for (int f = 0; f < view.ftrs.size(); f++) {
+                    const MapPnt *mpnt = view.ftrs[f].mpnt;
+                    if (mpnt == NULL) continue;
+
+                    int lo = 0;
+                    int hi = index.size() - 1;
+                    while (lo < hi) {
+                        const int mid = (lo + hi) / 2;
+                        if (index[mid].ptr < mpnt) {
+                            lo = mid + 1;
+                        }
+                        else {
+                            hi = mid;
+                        }
+                    }
+                    view.ftrs[f].mpnt = (index.size() > 0 && index[lo].ptr == mpnt) ? &mpnts[index[lo].id] : NULL;
+                }
+            }
+        }
+
         const View* searchNearView(const Pose &pose) {
             ViewEx *view = NULL;
             const int id = searchNearViewId(pose);
@@ -11,24 +11,129 @@
 
 namespace sp {
 
+    //
+    // tracking runs in the caller thread (updatePose / updateMap / relocalize),
+    // mapping runs in a dedicated thread that owns SfM.
+    // key frames are passed by a double buffered queue and the tracker reads a versioned read only map,
+    // so tracking never waits for SfM.
+    //
+
     class SLAM {
 
+    public:
+
+        // read only map (published by the mapping thread)
+        class Map {
+        public:
+
+            // valid key views (ftrs[].mpnt -> mpnts)
+            Mem1<View> views;
+
+            // map points (view links are not copied)
+            Mem1<MapPnt> mpnts;
+        };
+
     private:
-        
-        SfM m_sfm;
+
+        class KeyFrame {
+        public:
+            CamParam cam;
+            Mem2<Col3> img;
+
+            Pose pose;
+            bool hint;
+        };
 
         ViewTrack m_vtrack;
 
+        //--------------------------------------------------------------------------------
+        // mapping thread
+        //--------------------------------------------------------------------------------
+
+        // owned by the mapping thread (m_smtx : relocalize)
+        SfM m_sfm;
+        std::mutex m_smtx;
+
+        std::thread m_thread;
+
+        // queue / request flags
+        std::mutex m_mtx;
+        std::condition_variable m_wake, m_idle;
+
+        // key frame queue (the tracker pushes to m_queue[m_qid], the mapper takes the other buffer)
+        Mem1<KeyFrame> m_queue[2];
+        int m_qid;
+
+        // update request
+        bool m_request;
+
+        // bundle adjustment request (iteration, 0 : none)
+        int m_gba;
+        int m_lba;
+        int m_lbaw;
+
+        bool m_busy;
+        bool m_quit;
+
+        Snapshot<Map> m_snap;
+
+        //--------------------------------------------------------------------------------
+        // tracking thread
+        //--------------------------------------------------------------------------------
+
+        // latest map
+        std::shared_ptr<const Map> m_map;
+        int m_version;
+
+        // map that has the base view of the tracker (version, view id)
+        std::shared_ptr<const Map> m_bmap;
+        int m_bversion;
+        int m_bid;
+
+        // queued key frame count / latest key frame pose
+        int m_kcnt;
+        Pose m_kpose;
+
     public:
 
         SLAM() {
+            m_quit = true;
             clear();
         }
 
+        ~SLAM() {
+            stop();
+        }
+
         void clear() {
+            stop();
+
             m_sfm.clear();
             m_sfm.setMode(SfM::MODE_SERIAL);
             m_vtrack.clear();
+
+            m_queue[0].clear();
+            m_queue[1].clear();
+            m_qid = 0;
+
+            m_request = false;
+            m_gba = 0;
+            m_lba = 0;
+            m_lbaw = 0;
+            m_busy = false;
+
+            m_snap.clear();
+            m_map.reset();
+            m_version = 0;
+
+            m_bmap.reset();
+            m_bversion = -1;
+            m_bid = -1;
+
+            m_kcnt = 0;
+            m_kpose = zeroPose();
+
+            start();
         }
 
         //--------------------------------------------------------------------------------
@@ -41,20 +146,22 @@ namespace sp {
         const CamParam& getCam() const {
             return m_vtrack.getCam();
         }
-        
+
         void setBase(const Mem2<Col3> &img, const Pose &pose, const Mem1<Ftr> *ftrs = NULL) {
             m_vtrack.setBase(img, pose, ftrs);
+            m_bid = -1;
         }
 
         void setBase(const View &view) {
             m_vtrack.setBase(view);
+            m_bid = -1;
         }
 
 
         //--------------------------------------------------------------------------------
         // output parameter
         //--------------------------------------------------------------------------------
-        
+
         const Pose* getPose() const {
             return m_vtrack.getPose();
         }
@@ -71,20 +178,26 @@ namespace sp {
             return m_vtrack.getMask();
         }
 
+        // map (valid until the next updatePose / updateMap / waitMap call)
         int vsize() const {
-            return m_sfm.vsize();
+            return (m_map != NULL) ? m_map->views.size() : 0;
         }
 
         const View* getView(const int i) const {
-            return m_sfm.getView(i);
+            return (i >= 0 && i < vsize()) ? &m_map->views[i] : NULL;
         }
 
         int msize() const {
-            return m_sfm.msize();
+            return (m_map != NULL) ? m_map->mpnts.size() : 0;
         }
 
         const MapPnt* getMPnt(const int i) const {
-            return m_sfm.getMPnt(i);
+            return (i >= 0 && i < msize()) ? &m_map->mpnts[i] : NULL;
+        }
+
+        // map version (0 : no map)
+        int getVersion() const {
+            return m_version;
         }
 
 
@@ -93,58 +206,89 @@ namespace sp {
         //--------------------------------------------------------------------------------
 
         bool updatePose(const Mem2<Col3> &img) {
+            syncMap();
 
             const Pose *pose = m_vtrack.getPose();
-            if (pose != NULL){
-                const View *view = m_sfm.searchNearView(*pose);
-                if (view != NULL) {
-                    m_vtrack.setBase(*view);
+            if (pose != NULL && m_map != NULL) {
+                const int id = searchNearView(*m_map, *pose);
+
+                // rebase only when the view or the map is changed
+                if (id >= 0 && (id != m_bid || m_version != m_bversion)) {
+                    m_vtrack.setBase(m_map->views[id]);
+                    m_bmap = m_map;
+                    m_bversion = m_version;
+                    m_bid = id;
                 }
             }
 
             return m_vtrack.execute(img);
         }
 
+        // recover tracking from the map point index (false : mapping thread is busy)
+        bool relocalize(const Mem2<Col3> &img) {
+            syncMap();
+            if (msize() == 0) return false;
+
+            const Mem1<Ftr> ftrs = SIFT::getFtrs(img);
+
+            Pose pose = zeroPose();
+            {
+                std::unique_lock<std::mutex> lock(m_smtx, std::try_to_lock);
+                if (lock.owns_lock() == false) return false;
+
+                if (m_sfm.relocalize(pose, m_vtrack.getCam(), ftrs) == false) return false;
+            }
+
+            const int id = searchNearView(*m_map, pose);
+            if (id < 0) return false;
+
+            m_vtrack.setBase(m_map->views[id]);
+            m_bmap = m_map;
+            m_bversion = m_version;
+            m_bid = id;
+
+            return m_vtrack.execute(img);
+        }
+
+
         //--------------------------------------------------------------------------------
-        // mapping
+        // mapping (asynchronous)
         //--------------------------------------------------------------------------------
 
-        void addView(const Mem2<Col3> &img, const Pose *hint = NULL) {
-            if (m_vtrack.getView() == NULL) return;
+        // false : not queued (the key frame queue is full)
+        bool addView(const Mem2<Col3> &img, const Pose *hint = NULL) {
+            if (m_vtrack.getView() == NULL) return false;
 
-            m_sfm.addView(m_vtrack.getCam(), img, hint);
+            return pushFrame(m_vtrack.getCam(), img, hint);
         }
-        
+
+        // add a key frame if the pose is far from the map and request a map update (return : key frame is queued)
         bool updateMap(const Mem2<Col3> &img) {
             if (m_vtrack.getView() == NULL) return false;
 
-            if (m_sfm.vsize() == 0) {
-                m_sfm.addView(m_vtrack.getCam(), m_vtrack.getView()->img, m_vtrack.getPose());
+            syncMap();
+
+            bool ret = false;
+            if (m_kcnt == 0) {
+                ret = pushFrame(m_vtrack.getCam(), m_vtrack.getView()->img, m_vtrack.getPose());
             }
             else if (m_vtrack.getPose() != NULL) {
-                const int i = m_sfm.vsize() - 1;
-                const Pose prePose = m_sfm.getView(i)->pose;
-
-                SP_REAL move = SP_INFINITY;
                 SP_REAL norm = SP_INFINITY;
                 SP_REAL angle = SP_INFINITY;
 
-                if (m_sfm.msize() == 0) {
-                    const Pose nearPose = m_sfm.getView(i)->pose;
-                    const Pose dif = *m_vtrack.getPose() * invPose(nearPose);
+                if (msize() == 0) {
+                    const Pose dif = *m_vtrack.getPose() * invPose(m_kpose);
 
                     norm = minVal(norm, normVec(dif.pos));
                     angle = minVal(angle, getAngle(dif.rot, 2));
                 }
 
-                const View *view = m_sfm.searchNearView(*m_vtrack.getPose());
-                if(view != NULL){
-                    const Pose nearPose = view->pose;
-                    const Pose dif = *m_vtrack.getPose() * invPose(nearPose);
+                const int id = (m_map != NULL) ? searchNearView(*m_map, *m_vtrack.getPose()) : -1;
+                if (id >= 0) {
+                    const Pose dif = *m_vtrack.getPose() * invPose(m_map->views[id].pose);
 
                     norm = minVal(norm, normVec(dif.pos));
                     angle = minVal(angle, getAngle(dif.rot, 2));
-
                 }
 
                 const SP_REAL nThresh = 0.5;
@@ -153,13 +297,191 @@ namespace sp {
                 const SP_REAL t = norm / nThresh + angle / aThresh;
 
                 if (t > 1.0) {
-                    m_sfm.addView(m_vtrack.getCam(), img, m_vtrack.getPose());
+                    ret = pushFrame(m_vtrack.getCam(), img, m_vtrack.getPose());
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_request = true;
+            }
+            m_wake.notify_one();
+
+            return ret;
+        }
+
+        // bundle adjustment of all key views
+        void adjustGlobal(const int maxit = 10) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_gba = maxit;
+            }
+            m_wake.notify_one();
+        }
+
+        // bundle adjustment of the latest key views
+        void adjustLocal(const int wsize = 5, const int maxit = 5) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_lba = maxit;
+                m_lbaw = wsize;
+            }
+            m_wake.notify_one();
+        }
+
+        // wait until the queued key frames and requests are processed
+        void waitMap() {
+            {
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_idle.wait(lock, [this] { return idle(); });
+            }
+            syncMap();
+        }
+
+    private:
+
+        // pending key frames (a new key frame is not queued while the queue is full, updateMap tries again on the next call)
+        static const int MAX_QUEUE = 2;
+
+        const double MAX_NEARPOSE = 30.0 * SP_PI / 180.0;
+
+        //--------------------------------------------------------------------------------
+        // tracking thread
+        //--------------------------------------------------------------------------------
+
+        void syncMap() {
+            int version = 0;
+            const std::shared_ptr<const Map> map = m_snap.get(&version);
+            if (version != m_version) {
+                m_map = map;
+                m_version = version;
+            }
+        }
+
+        bool pushFrame(const CamParam &cam, const Mem2<Col3> &img, const Pose *hint) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+
+                Mem1<KeyFrame> &queue = m_queue[m_qid];
+                if (queue.size() >= MAX_QUEUE) return false;
+
+                KeyFrame &frame = *queue.extend();
+                frame.cam = cam;
+                frame.img = img;
+                frame.pose = (hint != NULL) ? *hint : zeroPose();
+                frame.hint = (hint != NULL);
+            }
+            m_wake.notify_one();
+
+            m_kcnt++;
+            if (hint != NULL) {
+                m_kpose = *hint;
+            }
+            return true;
+        }
+
+        int searchNearView(const Map &map, const Pose &pose) const {
+            int id = -1;
+            SP_REAL maxd = SP_INFINITY;
+            for (int i = 0; i < map.views.size(); i++) {
+                const Pose &hypo = map.views[i].pose;
+
+                const SP_REAL angle = difRot(pose.rot, hypo.rot, 2);
+                if (angle > MAX_NEARPOSE) continue;
+
+                const SP_REAL d = normVec(pose.pos - hypo.pos);
+                if (d < maxd) {
+                    maxd = d;
+                    id = i;
+                }
+            }
+            return id;
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // mapping thread
+        //--------------------------------------------------------------------------------
+
+        bool idle() const {
+            return m_busy == false && m_request == false && m_gba == 0 && m_lba == 0 && m_queue[m_qid].size() == 0;
+        }
+
+        void start() {
+            m_quit = false;
+            m_thread = std::thread(&SLAM::mapping, this);
+        }
+
+        void stop() {
+            if (m_thread.joinable() == false) return;
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_quit = true;
+            }
+            m_wake.notify_one();
+            m_thread.join();
+        }
+
+        void mapping() {
+            while (true) {
+                int q = 0;
+                int gba = 0;
+                int lba = 0;
+                int lbaw = 0;
+                bool request = false;
+                {
+                    std::unique_lock<std::mutex> lock(m_mtx);
+                    m_wake.wait(lock, [this] { return m_quit == true || idle() == false; });
+                    if (m_quit == true) return;
+
+                    // swap queue buffer
+                    q = m_qid;
+                    m_qid = 1 - m_qid;
+
+                    request = m_request;
+                    gba = m_gba;
+                    lba = m_lba;
+                    lbaw = m_lbaw;
+
+                    m_request = false;
+                    m_gba = 0;
+                    m_lba = 0;
+                    m_busy = true;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_smtx);
+
+                    Mem1<KeyFrame> &queue = m_queue[q];
+                    for (int i = 0; i < queue.size(); i++) {
+                        m_sfm.addView(queue[i].cam, queue[i].img, (queue[i].hint == true) ? &queue[i].pose : NULL);
+                    }
+                    queue.clear();
+
+                    if (request == true) {
+                        m_sfm.update();
+                    }
+                    if (lba > 0) {
+                        m_sfm.adjustLocal(lbaw, lba);
+                    }
+                    if (gba > 0) {
+                        m_sfm.adjustGlobal(gba);
+                    }
+
+                    std::shared_ptr<Map> map = std::make_shared<Map>();
+                    m_sfm.copyMap(map->views, map->mpnts);
+                    m_snap.publish(map);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mtx);
+                    m_busy = false;
+                    if (idle() == true) m_idle.notify_all();
                 }
             }
-            return m_sfm.update();
         }
 
     };
 
 }
-#endif
\ No newline at end of file
+#endif
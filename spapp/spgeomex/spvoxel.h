@@ -131,6 +131,199 @@ namespace sp {
     };
 
 
+    //--------------------------------------------------------------------------------
+    // sparse voxel (voxel hashing)
+    //--------------------------------------------------------------------------------
+
+    //
+    // voxels are stored in 8x8x8 bricks allocated on demand and found through a spatial hash.
+    // voxel (x, y, z) is placed at (x, y, z) * unit in map coordinates (no bounds).
+    //
+
+    class SparseVoxel {
+
+    public:
+        static const int BBIT = 3;
+        static const int BSIZE = 1 << BBIT;
+        static const int BVOL = BSIZE * BSIZE * BSIZE;
+
+        struct Brick {
+            // brick index (voxel index >> BBIT)
+            int bx, by, bz;
+
+            // value map
+            char vmap[BVOL];
+
+            // weight map
+            char wmap[BVOL];
+        };
+
+    public:
+        // voxel unit length
+        SP_REAL unit;
+
+        // allocated bricks
+        Mem1<Brick> bricks;
+
+    private:
+        struct Slot {
+            // brick index
+            int bx, by, bz;
+
+            // brick id (-1 : empty)
+            int id;
+        };
+
+        // hash table (open addressing, linear probing)
+        Mem1<Slot> m_table;
+
+    public:
+
+        SparseVoxel() {
+            init(1.0, 0);
+        }
+
+        void init(const double unit, const int capacity = 1024) {
+            this->unit = unit;
+
+            bricks.reserve(capacity);
+
+            int tsize = 16;
+            while (tsize < 2 * capacity) tsize *= 2;
+            m_table.resize(tsize);
+
+            zero();
+        }
+
+        void zero() {
+            bricks.resize(0);
+            clearTable();
+        }
+
+        int size() const {
+            return bricks.size();
+        }
+
+        // brick id (-1 : not allocated)
+        int find(const int bx, const int by, const int bz) const {
+            const int mask = m_table.size() - 1;
+            for (int h = hash(bx, by, bz) & mask; ; h = (h + 1) & mask) {
+                const Slot &slot = m_table[h];
+                if (slot.id < 0) break;
+
+                if (slot.bx == bx && slot.by == by && slot.bz == bz) return slot.id;
+            }
+            return -1;
+        }
+
+        // brick id (allocated if not found, not thread safe)
+        int alloc(const int bx, const int by, const int bz) {
+            int id = find(bx, by, bz);
+            if (id >= 0) return id;
+
+            if (2 * (bricks.size() + 1) > m_table.size()) {
+                rehash(m_table.size() * 2);
+            }
+
+            id = bricks.size();
+
+            Brick &brick = *bricks.extend();
+            brick.bx = bx;
+            brick.by = by;
+            brick.bz = bz;
+            memset(brick.vmap, -SP_VOXEL_VMAX, BVOL);
+            memset(brick.wmap, 0, BVOL);
+
+            insert(id);
+            return id;
+        }
+
+        void update(const int x, const int y, const int z, const double srcv) {
+            if (srcv > +1.0) return;
+
+            const int id = find(x >> BBIT, y >> BBIT, z >> BBIT);
+            if (id < 0) return;
+
+            update(bricks[id], offset(x, y, z), srcv);
+        }
+
+        static void update(Brick &brick, const int i, const double srcv) {
+            if (srcv > +1.0) return;
+
+            char &val = brick.vmap[i];
+            char &wei = brick.wmap[i];
+
+            val = cast<char>((val * wei + SP_VOXEL_VMAX * srcv) / (wei + 1.0));
+            wei = minVal(wei + 1, SP_VOXEL_WMAX);
+        }
+
+        char getv(const int x, const int y, const int z) const {
+            const int id = find(x >> BBIT, y >> BBIT, z >> BBIT);
+            return (id >= 0) ? bricks[id].vmap[offset(x, y, z)] : SP_VOXEL_NULL;
+        }
+
+        char getw(const int x, const int y, const int z) const {
+            const int id = find(x >> BBIT, y >> BBIT, z >> BBIT);
+            return (id >= 0) ? bricks[id].wmap[offset(x, y, z)] : 0;
+        }
+
+        Vec3 getn(const int x, const int y, const int z) const {
+            const double vx = getv(x + 1, y, z) - getv(x - 1, y, z);
+            const double vy = getv(x, y + 1, z) - getv(x, y - 1, z);
+            const double vz = getv(x, y, z + 1) - getv(x, y, z - 1);
+            return unitVec(getVec3(-vx, -vy, -vz));
+        }
+
+        // voxel offset in a brick
+        static int offset(const int x, const int y, const int z) {
+            const int m = BSIZE - 1;
+            return ((z & m) * BSIZE + (y & m)) * BSIZE + (x & m);
+        }
+
+    private:
+
+        static int hash(const int bx, const int by, const int bz) {
+            unsigned int h = static_cast<unsigned int>(bx) * 73856093u ^ static_cast<unsigned int>(by) * 19349669u ^ static_cast<unsigned int>(bz) * 83492791u;
+
+            // mix upper bits into the table index
+            h = (h ^ (h >> 16)) * 0x45D9F3Bu;
+            h = h ^ (h >> 16);
+            return static_cast<int>(h & 0x7FFFFFFF);
+        }
+
+        void insert(const int id) {
+            const Brick &brick = bricks[id];
+
+            const int mask = m_table.size() - 1;
+            int h = hash(brick.bx, brick.by, brick.bz) & mask;
+            while (m_table[h].id >= 0) {
+                h = (h + 1) & mask;
+            }
+
+            Slot &slot = m_table[h];
+            slot.bx = brick.bx;
+            slot.by = brick.by;
+            slot.bz = brick.bz;
+            slot.id = id;
+        }
+
+        void clearTable() {
+            for (int h = 0; h < m_table.size(); h++) {
+                m_table[h].id = -1;
+            }
+        }
+
+        void rehash(const int tsize) {
+            m_table.resize(tsize);
+            clearTable();
+
+            for (int id = 0; id < bricks.size(); id++) {
+                insert(id);
+            }
+        }
+    };
+
+
     SP_CPUFUNC bool cnvMeshToVoxel(Voxel<> &voxel, const Mem1<Mesh3> &meshes, const double unit = 1.0) {
 
         const int size = (ceil(getModelRadius(meshes) / unit) + 2) * 2;
@@ -799,30 +992,610 @@ namespace sp {
     // truncated signed distance function
     //--------------------------------------------------------------------------------
 
+    namespace _tsdf {
+
+        // frustum plane (inside : n * p + d >= 0)
+        struct Plane {
+            Vec3 n;
+            double d;
+        };
+
+        // view frustum of the depth image (half pixel margin) in camera coordinates
+        SP_CPUFUNC void getFrustum(Plane *planes, const CamParam &cam, const int *dsize, const double zmax) {
+            const double u0 = -0.5;
+            const double v0 = -0.5;
+            const double u1 = dsize[0] - 0.5;
+            const double v1 = dsize[1] - 0.5;
+
+            // near / far
+            planes[0].n = getVec3(0.0, 0.0, +1.0);
+            planes[0].d = 0.0;
+            planes[1].n = getVec3(0.0, 0.0, -1.0);
+            planes[1].d = zmax;
+
+            // fx * x / z + cx >= u0, ...
+            planes[2].n = getVec3(+cam.fx, 0.0, cam.cx - u0);
+            planes[2].d = 0.0;
+            planes[3].n = getVec3(-cam.fx, 0.0, u1 - cam.cx);
+            planes[3].d = 0.0;
+            planes[4].n = getVec3(0.0, +cam.fy, cam.cy - v0);
+            planes[4].d = 0.0;
+            planes[5].n = getVec3(0.0, -cam.fy, v1 - cam.cy);
+            planes[5].d = 0.0;
+        }
+
+        // parallelogram (p + a * [0, 1] + b * [0, 1]) is outside of the frustum
+        SP_CPUFUNC bool cull(const Plane *planes, const Vec3 &p, const Vec3 &a, const Vec3 &b) {
+            for (int i = 0; i < 6; i++) {
+                const double f = dotVec(planes[i].n, p) + planes[i].d;
+                const double fa = dotVec(planes[i].n, a);
+                const double fb = dotVec(planes[i].n, b);
+                if (f + maxVal(fa, 0.0) + maxVal(fb, 0.0) < 0.0) return true;
+            }
+            return false;
+        }
+
+        // clip x range of a row (p + a * x) by the frustum
+        SP_CPUFUNC bool clip(int &x0, int &x1, const Plane *planes, const Vec3 &p, const Vec3 &a) {
+            double lo = x0;
+            double hi = x1;
+            for (int i = 0; i < 6; i++) {
+                const double f0 = dotVec(planes[i].n, p) + planes[i].d;
+                const double f1 = dotVec(planes[i].n, a);
+
+                if (fabs(f1) < SP_SMALL) {
+                    if (f0 < 0.0) return false;
+                }
+                else if (f1 > 0.0) {
+                    lo = maxVal(lo, -f0 / f1);
+                }
+                else {
+                    hi = minVal(hi, -f0 / f1);
+                }
+                if (lo > hi) return false;
+            }
+
+            // one voxel margin (exact test is done per voxel)
+            x0 = maxVal(x0, floor(lo) - 1);
+            x1 = minVal(x1, floor(hi) + 1);
+            return x0 <= x1;
+        }
+
+        SP_CPUFUNC void update(Voxel<> &voxel, const int x, const int y, const int z, const SP_REAL cz, const SP_REAL d, const SP_REAL step) {
+            if (d == 0.0) return;
+
+            const SP_REAL dist = maxVal(cz - d, -step) / step;
+            voxel.update(x, y, z, dist);
+        }
+
+        // update voxels (x0 <= x <= x1, y, z), camera position : p + a * x
+        SP_CPUFUNC void updateRow(Voxel<> &voxel, const int y, const int z, const int x0, const int x1, const Vec3 &p, const Vec3 &a,
+            const CamParam &cam, const Mem2<SP_REAL> &depth, const SP_REAL step) {
+
+            const int w = depth.dsize[0];
+            const int h = depth.dsize[1];
+
+            int x = x0;
+#if SP_USE_AVX
+            {
+                const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+                const __m256 px = _mm256_set1_ps(static_cast<float>(p.x));
+                const __m256 py = _mm256_set1_ps(static_cast<float>(p.y));
+                const __m256 pz = _mm256_set1_ps(static_cast<float>(p.z));
+                const __m256 ax = _mm256_set1_ps(static_cast<float>(a.x));
+                const __m256 ay = _mm256_set1_ps(static_cast<float>(a.y));
+                const __m256 az = _mm256_set1_ps(static_cast<float>(a.z));
+                const __m256 fx = _mm256_set1_ps(static_cast<float>(cam.fx));
+                const __m256 fy = _mm256_set1_ps(static_cast<float>(cam.fy));
+                const __m256 cx = _mm256_set1_ps(static_cast<float>(cam.cx));
+                const __m256 cy = _mm256_set1_ps(static_cast<float>(cam.cy));
+                const __m256 w1 = _mm256_set1_ps(static_cast<float>(w - 1));
+                const __m256 h1 = _mm256_set1_ps(static_cast<float>(h - 1));
+                const __m256 zero = _mm256_setzero_ps();
+                const __m256 half = _mm256_set1_ps(0.5f);
+                const __m256i iw = _mm256_set1_epi32(w);
+
+                int index[8];
+                float cz[8];
+                for (; x + 8 <= x1 + 1; x += 8) {
+                    const __m256 s = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane);
+                    const __m256 X = _mm256_add_ps(px, _mm256_mul_ps(s, ax));
+                    const __m256 Y = _mm256_add_ps(py, _mm256_mul_ps(s, ay));
+                    const __m256 Z = _mm256_add_ps(pz, _mm256_mul_ps(s, az));
+
+                    const __m256 u = _mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(X, Z), fx), cx);
+                    const __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(Y, Z), fy), cy);
+
+                    __m256 mask = _mm256_cmp_ps(Z, zero, _CMP_GT_OQ);
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, w1, _CMP_LE_OQ));
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, h1, _CMP_LE_OQ));
+
+                    int bits = _mm256_movemask_ps(mask);
+                    if (bits == 0) continue;
+
+                    // round (u, v >= 0 in the mask)
+                    const __m256i iu = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_and_ps(u, mask), half));
+                    const __m256i iv = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_and_ps(v, mask), half));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(index), _mm256_add_epi32(_mm256_mullo_epi32(iv, iw), iu));
+                    _mm256_storeu_ps(cz, Z);
+
+                    for (int i = 0; bits != 0; i++, bits >>= 1) {
+                        if ((bits & 1) == 0) continue;
+                        update(voxel, x + i, y, z, cz[i], depth.ptr[index[i]], step);
+                    }
+                }
+            }
+#elif SP_USE_SSE
+            {
+                const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+                const __m128 px = _mm_set1_ps(static_cast<float>(p.x));
+                const __m128 py = _mm_set1_ps(static_cast<float>(p.y));
+                const __m128 pz = _mm_set1_ps(static_cast<float>(p.z));
+                const __m128 ax = _mm_set1_ps(static_cast<float>(a.x));
+                const __m128 ay = _mm_set1_ps(static_cast<float>(a.y));
+                const __m128 az = _mm_set1_ps(static_cast<float>(a.z));
+                const __m128 fx = _mm_set1_ps(static_cast<float>(cam.fx));
+                const __m128 fy = _mm_set1_ps(static_cast<float>(cam.fy));
+                const __m128 cx = _mm_set1_ps(static_cast<float>(cam.cx));
+                const __m128 cy = _mm_set1_ps(static_cast<float>(cam.cy));
+                const __m128 w1 = _mm_set1_ps(static_cast<float>(w - 1));
+                const __m128 h1 = _mm_set1_ps(static_cast<float>(h - 1));
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 half = _mm_set1_ps(0.5f);
+
+                int iu[8], iv[8];
+                float cz[8];
+                for (; x + 8 <= x1 + 1; x += 8) {
+                    int bits = 0;
+                    for (int k = 0; k < 8; k += 4) {
+                        const __m128 s = _mm_add_ps(_mm_set1_ps(static_cast<float>(x + k)), lane);
+                        const __m128 X = _mm_add_ps(px, _mm_mul_ps(s, ax));
+                        const __m128 Y = _mm_add_ps(py, _mm_mul_ps(s, ay));
+                        const __m128 Z = _mm_add_ps(pz, _mm_mul_ps(s, az));
+
+                        const __m128 u = _mm_add_ps(_mm_mul_ps(_mm_div_ps(X, Z), fx), cx);
+                        const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_div_ps(Y, Z), fy), cy);
+
+                        __m128 mask = _mm_cmpgt_ps(Z, zero);
+                        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+                        mask = _mm_and_ps(mask, _mm_cmple_ps(u, w1));
+                        mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+                        mask = _mm_and_ps(mask, _mm_cmple_ps(v, h1));
+
+                        bits |= _mm_movemask_ps(mask) << k;
+
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(iu + k), _mm_cvttps_epi32(_mm_add_ps(_mm_and_ps(u, mask), half)));
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(iv + k), _mm_cvttps_epi32(_mm_add_ps(_mm_and_ps(v, mask), half)));
+                        _mm_storeu_ps(cz + k, Z);
+                    }
+
+                    for (int i = 0; bits != 0; i++, bits >>= 1) {
+                        if ((bits & 1) == 0) continue;
+                        update(voxel, x + i, y, z, cz[i], depth.ptr[iv[i] * w + iu[i]], step);
+                    }
+                }
+            }
+#endif
+            for (; x <= x1; x++) {
+                const Vec3 cpos = p + a * x;
+                if (cpos.z <= 0.0) continue;
+
+                const Vec2 pix = mulCam(cam, prjVec(cpos));
+                if (inRect(depth.dsize, pix.x, pix.y) == false) continue;
+
+                update(voxel, x, y, z, cpos.z, depth(round(pix.x), round(pix.y)), step);
+            }
+        }
+    }
+
     SP_CPUFUNC void updateTSDF(Voxel<> &voxel, const CamParam &cam, const Pose &pose, const Mem2<SP_REAL> &depth, const SP_REAL mu = 5.0) {
 
         const Vec3 cent = voxel.center();
         const SP_REAL step = mu * voxel.unit;
 
+        // voxels behind (max depth + step) are not updated
+        SP_REAL dmax = 0.0;
+        for (int i = 0; i < depth.size(); i++) {
+            dmax = maxVal(dmax, depth[i]);
+        }
+        if (dmax == 0.0) return;
+
+        _tsdf::Plane planes[6];
+        _tsdf::getFrustum(planes, cam, depth.dsize, dmax + step);
+
+        // camera position of voxel (x, y, z) : base + ax * x + ay * y + az * z
+        const Vec3 base = pose * (cent * (-voxel.unit));
+        const Vec3 ax = pose.rot * getVec3(voxel.unit, 0.0, 0.0);
+        const Vec3 ay = pose.rot * getVec3(0.0, voxel.unit, 0.0);
+        const Vec3 az = pose.rot * getVec3(0.0, 0.0, voxel.unit);
+
+        // (z, y) tiles
+        const int TILE = 8;
+        const int nx = voxel.dsize[0];
+        const int ny = voxel.dsize[1];
+        const int tnum = (ny + TILE - 1) / TILE;
+
+#if SP_USE_OMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int t = 0; t < voxel.dsize[2] * tnum; t++) {
+            const int z = t / tnum;
+            const int y0 = (t % tnum) * TILE;
+            const int y1 = minVal(y0 + TILE, ny) - 1;
+
+            const Vec3 tbase = base + ay * y0 + az * z;
+            if (_tsdf::cull(planes, tbase, ax * (nx - 1), ay * (y1 - y0)) == true) continue;
+
+            for (int y = y0; y <= y1; y++) {
+                const Vec3 rbase = tbase + ay * (y - y0);
+
+                int x0 = 0;
+                int x1 = nx - 1;
+                if (_tsdf::clip(x0, x1, planes, rbase, ax) == false) continue;
+
+                _tsdf::updateRow(voxel, y, z, x0, x1, rbase, ax, cam, depth, step);
+            }
+        }
+    }
+
+    namespace _tsdf {
+
+        // min / max of observed values in blocks (level 0 : 8^3 voxels, level 1 : 32^3 voxels)
+        // each block also covers a one voxel border, so a ray leaving a skipped block lands on a covered voxel
+        struct Pyramid {
+            static const int LEVEL = 2;
+
+            // block size (bit)
+            int bbit[LEVEL];
+
+            Mem3<char> vmin[LEVEL];
+            Mem3<char> vmax[LEVEL];
+
+            // no zero crossing (or no observed voxel) in the block
+            bool empty(const int lv, const int x, const int y, const int z) const {
+                const int b = bbit[lv];
+                const int i = acsid3(vmin[lv].dsize, x >> b, y >> b, z >> b);
+                return vmin[lv][i] > 0 || vmax[lv][i] < 0;
+            }
+        };
+
+        // lo = min(lo, v), hi = max(hi, v) for observed voxels (w > 0 or w == NULL)
+        SP_CPUFUNC void rowRange(char *lo, char *hi, const char *v, const char *w, const int n) {
+            int x = 0;
+#if SP_USE_AVX
+            {
+                const __m256i zero = _mm256_setzero_si256();
+                const __m256i vmax = _mm256_set1_epi8(+SP_VOXEL_VMAX);
+                const __m256i vmin = _mm256_set1_epi8(-SP_VOXEL_VMAX);
+                for (; x + 32 <= n; x += 32) {
+                    const __m256i vv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + x));
+                    const __m256i m = (w != NULL) ? _mm256_cmpgt_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + x)), zero) : _mm256_cmpeq_epi8(zero, zero);
+
+                    const __m256i a = _mm256_blendv_epi8(vmax, vv, m);
+                    const __m256i b = _mm256_blendv_epi8(vmin, vv, m);
+
+                    __m256i *pl = reinterpret_cast<__m256i*>(lo + x);
+                    __m256i *ph = reinterpret_cast<__m256i*>(hi + x);
+                    _mm256_storeu_si256(pl, _mm256_min_epi8(_mm256_loadu_si256(pl), a));
+                    _mm256_storeu_si256(ph, _mm256_max_epi8(_mm256_loadu_si256(ph), b));
+                }
+            }
+#elif SP_USE_SSE
+            {
+                // signed min / max by unsigned compare (sse2)
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i bias = _mm_set1_epi8(-128);
+                const __m128i vmax = _mm_set1_epi8(+SP_VOXEL_VMAX ^ -128);
+                const __m128i vmin = _mm_set1_epi8(-SP_VOXEL_VMAX ^ -128);
+                for (; x + 16 <= n; x += 16) {
+                    const __m128i vv = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x)), bias);
+                    const __m128i m = (w != NULL) ? _mm_cmpgt_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + x)), zero) : _mm_cmpeq_epi8(zero, zero);
+
+                    const __m128i a = _mm_or_si128(_mm_and_si128(m, vv), _mm_andnot_si128(m, vmax));
+                    const __m128i b = _mm_or_si128(_mm_and_si128(m, vv), _mm_andnot_si128(m, vmin));
+
+                    __m128i *pl = reinterpret_cast<__m128i*>(lo + x);
+                    __m128i *ph = reinterpret_cast<__m128i*>(hi + x);
+                    const __m128i l = _mm_min_epu8(_mm_xor_si128(_mm_loadu_si128(pl), bias), a);
+                    const __m128i h = _mm_max_epu8(_mm_xor_si128(_mm_loadu_si128(ph), bias), b);
+                    _mm_storeu_si128(pl, _mm_xor_si128(l, bias));
+                    _mm_storeu_si128(ph, _mm_xor_si128(h, bias));
+                }
+            }
+#endif
+            for (; x < n; x++) {
+                if (w != NULL && w[x] <= 0) continue;
+                lo[x] = minVal(lo[x], v[x]);
+                hi[x] = maxVal(hi[x], v[x]);
+            }
+        }
+
+        SP_CPUFUNC void buildPyramid(Pyramid &pyr, const Voxel<> &voxel) {
+            const int BBIT = 3;
+            const int B = 1 << BBIT;
+
+            const int *dsize = voxel.dsize;
+            const int bsize[3] = { (dsize[0] + B - 1) / B, (dsize[1] + B - 1) / B, (dsize[2] + B - 1) / B };
+
+            pyr.bbit[0] = BBIT;
+            pyr.vmin[0].resize(bsize);
+            pyr.vmax[0].resize(bsize);
+
 #if SP_USE_OMP
 #pragma omp parallel for
 #endif
-        for (int z = 0; z < voxel.dsize[2]; z++) {
-            for (int y = 0; y < voxel.dsize[1]; y++) {
-                for (int x = 0; x < voxel.dsize[0]; x++) {
-                    const Vec3 mpos = getVec3(x, y, z);
-                    const Vec3 cpos = pose * ((mpos - cent) * voxel.unit);
+            for (int t = 0; t < bsize[1] * bsize[2]; t++) {
+                const int by = t % bsize[1];
+                const int bz = t / bsize[1];
+
+                const int y0 = maxVal(by * B - 1, 0);
+                const int y1 = minVal(by * B + B, dsize[1] - 1);
+                const int z0 = maxVal(bz * B - 1, 0);
+                const int z1 = minVal(bz * B + B, dsize[2] - 1);
+
+                // min / max over the rows of the block row (not observed voxels are out of range)
+                Mem1<char> lo(dsize[0]), hi(dsize[0]);
+                setElm(lo, +SP_VOXEL_VMAX);
+                setElm(hi, -SP_VOXEL_VMAX);
+
+                for (int z = z0; z <= z1; z++) {
+                    for (int y = y0; y <= y1; y++) {
+                        const char *v = &voxel.vmap(0, y, z);
+                        const char *w = (voxel.wmap.ptr != NULL) ? &voxel.wmap(0, y, z) : NULL;
+
+                        rowRange(lo.ptr, hi.ptr, v, w, dsize[0]);
+                    }
+                }
 
-                    const Vec2 pix = mulCam(cam, prjVec(cpos));
-                    if (inRect(depth.dsize, pix.x, pix.y) == false) continue;
+                for (int bx = 0; bx < bsize[0]; bx++) {
+                    const int x0 = maxVal(bx * B - 1, 0);
+                    const int x1 = minVal(bx * B + B, dsize[0] - 1);
 
-                    const SP_REAL d = depth(round(pix.x), round(pix.y));
-                    if (d == 0.0) continue;
+                    char mn = +SP_VOXEL_VMAX;
+                    char mx = -SP_VOXEL_VMAX;
+                    for (int x = x0; x <= x1; x++) {
+                        mn = minVal(mn, lo[x]);
+                        mx = maxVal(mx, hi[x]);
+                    }
+                    pyr.vmin[0](bx, by, bz) = mn;
+                    pyr.vmax[0](bx, by, bz) = mx;
+                }
+            }
+
+            // upper levels (4^3 blocks)
+            for (int lv = 1; lv < Pyramid::LEVEL; lv++) {
+                const Mem3<char> &smin = pyr.vmin[lv - 1];
+                const Mem3<char> &smax = pyr.vmax[lv - 1];
+
+                const int size[3] = { (smin.dsize[0] + 3) / 4, (smin.dsize[1] + 3) / 4, (smin.dsize[2] + 3) / 4 };
+                pyr.bbit[lv] = pyr.bbit[lv - 1] + 2;
+                pyr.vmin[lv].resize(size);
+                pyr.vmax[lv].resize(size);
+
+                for (int bz = 0; bz < size[2]; bz++) {
+                    for (int by = 0; by < size[1]; by++) {
+                        for (int bx = 0; bx < size[0]; bx++) {
+                            char mn = +SP_VOXEL_VMAX;
+                            char mx = -SP_VOXEL_VMAX;
+                            for (int z = bz * 4; z < minVal(bz * 4 + 4, smin.dsize[2]); z++) {
+                                for (int y = by * 4; y < minVal(by * 4 + 4, smin.dsize[1]); y++) {
+                                    for (int x = bx * 4; x < minVal(bx * 4 + 4, smin.dsize[0]); x++) {
+                                        mn = minVal(mn, smin(x, y, z));
+                                        mx = maxVal(mx, smax(x, y, z));
+                                    }
+                                }
+                            }
+                            pyr.vmin[lv](bx, by, bz) = mn;
+                            pyr.vmax[lv](bx, by, bz) = mx;
+                        }
+                    }
+                }
+            }
+        }
+
+        // update near / far depth of tiles covered by a box (map coordinates, base + [0, size]^3)
+        SP_CPUFUNC void updateRange(Mem2<Vec2> &range, const int tile, const CamParam &cam, const Pose &pose, const Vec3 &base, const SP_REAL size) {
+            double minz = +SP_INFINITY;
+            double maxz = -SP_INFINITY;
+
+            bool front = true;
+            Vec2 pmin = getVec2(+SP_INFINITY, +SP_INFINITY);
+            Vec2 pmax = getVec2(-SP_INFINITY, -SP_INFINITY);
+
+            for (int c = 0; c < 8; c++) {
+                const Vec3 cpos = pose * (base + getVec3((c >> 0) & 1, (c >> 1) & 1, (c >> 2) & 1) * size);
+                minz = minVal(minz, cpos.z);
+                maxz = maxVal(maxz, cpos.z);
+
+                if (cpos.z <= SP_SMALL) {
+                    front = false;
+                    continue;
+                }
+                const Vec2 pix = mulCam(cam, prjVec(cpos));
+                pmin = getVec2(minVal(pmin.x, pix.x), minVal(pmin.y, pix.y));
+                pmax = getVec2(maxVal(pmax.x, pix.x), maxVal(pmax.y, pix.y));
+            }
+            if (maxz <= SP_SMALL) return;
+
+            // all tiles if the box crosses the camera plane
+            int u0 = 0, u1 = range.dsize[0] - 1;
+            int v0 = 0, v1 = range.dsize[1] - 1;
+            if (front == true) {
+                if (pmax.x < 0.0 || pmin.x > cam.dsize[0] - 1.0) return;
+                if (pmax.y < 0.0 || pmin.y > cam.dsize[1] - 1.0) return;
+
+                u0 = floor(maxVal(pmin.x, 0.0)) / tile;
+                v0 = floor(maxVal(pmin.y, 0.0)) / tile;
+                u1 = floor(minVal(pmax.x + 1.0, cam.dsize[0] - 1.0)) / tile;
+                v1 = floor(minVal(pmax.y + 1.0, cam.dsize[1] - 1.0)) / tile;
+            }
+
+            for (int v = v0; v <= v1; v++) {
+                for (int u = u0; u <= u1; u++) {
+                    Vec2 &r = range(u, v);
+                    r.x = minVal(r.x, minz);
+                    r.y = maxVal(r.y, maxz);
+                }
+            }
+        }
+
+        // trilinear interpolation (false : out of volume or not observed)
+        SP_CPUFUNC bool trilinear(double &val, const Voxel<> &voxel, const Vec3 &p) {
+            if (p.x < 0.0 || p.y < 0.0 || p.z < 0.0) return false;
+
+            const int x = static_cast<int>(p.x);
+            const int y = static_cast<int>(p.y);
+            const int z = static_cast<int>(p.z);
+            if (x + 1 >= voxel.dsize[0] || y + 1 >= voxel.dsize[1] || z + 1 >= voxel.dsize[2]) return false;
+
+            const int sy = voxel.dsize[0];
+            const int sz = voxel.dsize[0] * voxel.dsize[1];
+            const int i = acsid3(voxel.dsize, x, y, z);
+            const int offset[8] = { 0, 1, sy, sy + 1, sz, sz + 1, sz + sy, sz + sy + 1 };
+
+            if (voxel.wmap.ptr != NULL) {
+                const char *w = &voxel.wmap.ptr[i];
+                for (int c = 0; c < 8; c++) {
+                    if (w[offset[c]] == 0) return false;
+                }
+            }
+
+            const char *v = &voxel.vmap.ptr[i];
+            const double ax = p.x - x;
+            const double ay = p.y - y;
+            const double az = p.z - z;
+
+            const double v00 = v[offset[0]] + (v[offset[1]] - v[offset[0]]) * ax;
+            const double v10 = v[offset[2]] + (v[offset[3]] - v[offset[2]]) * ax;
+            const double v01 = v[offset[4]] + (v[offset[5]] - v[offset[4]]) * ax;
+            const double v11 = v[offset[6]] + (v[offset[7]] - v[offset[6]]) * ax;
+
+            const double v0 = v00 + (v10 - v00) * ay;
+            const double v1 = v01 + (v11 - v01) * ay;
+
+            val = v0 + (v1 - v0) * az;
+            return true;
+        }
+
+        // march a ray (voxel coordinates : o + m * t, t : camera depth) and detect the zero crossing
+        SP_CPUFUNC bool march(SP_REAL &detect, const Voxel<> &voxel, const Pyramid &pyr, const Vec3 &o, const Vec3 &m, double tmin, double tmax, const SP_REAL mu) {
+
+            const double org[3] = { o.x, o.y, o.z };
+            const double drc[3] = { m.x, m.y, m.z };
 
-                    const SP_REAL dist = maxVal(cpos.z - d, -step) / step;
-                    voxel.update(x, y, z, dist);
+            // inverse direction (0 : parallel to the axis)
+            double inv[3];
+            for (int i = 0; i < 3; i++) {
+                inv[i] = (fabs(drc[i]) > SP_SMALL) ? 1.0 / drc[i] : 0.0;
+            }
+
+            // volume range
+            for (int i = 0; i < 3; i++) {
+                const double lo = -0.5;
+                const double hi = voxel.dsize[i] - 0.5;
+                if (inv[i] != 0.0) {
+                    const double s0 = (lo - org[i]) * inv[i];
+                    const double s1 = (hi - org[i]) * inv[i];
+                    tmin = maxVal(tmin, minVal(s0, s1));
+                    tmax = minVal(tmax, maxVal(s0, s1));
+                }
+                else if (org[i] < lo || org[i] > hi) {
+                    return false;
+                }
+            }
+            tmin = maxVal(tmin, SP_SMALL);
+            if (tmin >= tmax) return false;
+
+            // t step of one voxel
+            const double fine = 1.0 / normVec(m);
+            const double coarse = mu * fine;
+
+            bool valid = false;
+            char pre = 0;
+            double tp = 0.0;
+
+            for (double t = tmin; t < tmax; ) {
+                // round (p >= -0.5 in the volume range)
+                const int x = static_cast<int>(org[0] + drc[0] * t + 0.5);
+                const int y = static_cast<int>(org[1] + drc[1] * t + 0.5);
+                const int z = static_cast<int>(org[2] + drc[2] * t + 0.5);
+                if (static_cast<unsigned int>(x) >= static_cast<unsigned int>(voxel.dsize[0]) ||
+                    static_cast<unsigned int>(y) >= static_cast<unsigned int>(voxel.dsize[1]) ||
+                    static_cast<unsigned int>(z) >= static_cast<unsigned int>(voxel.dsize[2])) {
+                    valid = false;
+                    t += fine;
+                    continue;
+                }
+
+                // empty space skipping (upper level first)
+                int lv = Pyramid::LEVEL - 1;
+                for (; lv >= 0; lv--) {
+                    if (pyr.empty(lv, x, y, z) == true) break;
+                }
+                if (lv >= 0) {
+                    const int b = pyr.bbit[lv];
+                    const int bi[3] = { x >> b, y >> b, z >> b };
+
+                    double exit = tmax;
+                    for (int i = 0; i < 3; i++) {
+                        if (inv[i] == 0.0) continue;
+
+                        const double bound = ((inv[i] > 0.0) ? ((bi[i] + 1) << b) : (bi[i] << b)) - 0.5;
+                        exit = minVal(exit, (bound - org[i]) * inv[i]);
+                    }
+                    valid = false;
+                    t = maxVal(t, exit) + 0.01 * fine;
+                    continue;
+                }
+
+                const int i = acsid3(voxel.dsize, x, y, z);
+                const char val = voxel.vmap.ptr[i];
+                const char wei = (voxel.wmap.ptr != NULL) ? voxel.wmap.ptr[i] : 1;
+                if (wei == 0) {
+                    valid = false;
+                    t += coarse;
+                    continue;
+                }
+
+                if (valid == true && pre < 0 && val >= 0) {
+                    double t0 = tp;
+                    double t1 = t;
+                    double f0 = pre;
+                    double f1 = val;
+
+                    // refine by trilinear interpolation (one regula falsi step)
+                    double g0, g1;
+                    if (trilinear(g0, voxel, o + m * t0) && trilinear(g1, voxel, o + m * t1) && g0 < 0.0 && g1 >= 0.0) {
+                        f0 = g0;
+                        f1 = g1;
+                        const double tm = t0 + (t1 - t0) * f0 / (f0 - f1);
+
+                        double fm;
+                        if (trilinear(fm, voxel, o + m * tm) == true) {
+                            if (fm < 0.0) {
+                                t0 = tm;
+                                f0 = fm;
+                            }
+                            else {
+                                t1 = tm;
+                                f1 = fm;
+                            }
+                        }
+                    }
+                    detect = t0 + (t1 - t0) * f0 / (f0 - f1);
+                    return true;
                 }
+
+                valid = true;
+                pre = val;
+                tp = t;
+
+                // near the surface, step by the truncated distance (at least one voxel)
+                t += (val > -0.9 * SP_VOXEL_VMAX) ? maxVal(fine, coarse * (-val) / SP_VOXEL_VMAX) : coarse;
             }
+            return false;
         }
     }
 
@@ -834,77 +1607,280 @@ namespace sp {
         const Vec3 cent = voxel.center();
         const Pose ipose = invPose(pose);
 
+        _tsdf::Pyramid pyr;
+        _tsdf::buildPyramid(pyr, voxel);
+
+        // ray range of each packet (near / far depth of projected blocks with zero crossing)
+        const int PACKET = 4;
+        Mem2<Vec2> range((cam.dsize[0] + PACKET - 1) / PACKET, (cam.dsize[1] + PACKET - 1) / PACKET);
+        setElm(range, getVec2(+SP_INFINITY, -SP_INFINITY));
+        {
+            const Mem3<char> &vmin = pyr.vmin[0];
+            const int B = 1 << pyr.bbit[0];
+
+            for (int bz = 0; bz < vmin.dsize[2]; bz++) {
+                for (int by = 0; by < vmin.dsize[1]; by++) {
+                    for (int bx = 0; bx < vmin.dsize[0]; bx++) {
+                        if (pyr.empty(0, bx * B, by * B, bz * B) == true) continue;
+
+                        const Vec3 base = (getVec3(bx, by, bz) * B - 1.5 - cent) * voxel.unit;
+                        _tsdf::updateRange(range, PACKET, cam, pose, base, (B + 2) * voxel.unit);
+                    }
+                }
+            }
+        }
+
+        // ray (voxel coordinates) : o + (m0 + mx * u + my * v) * t
+        const Vec3 o = ipose.pos / voxel.unit + cent;
+        const Vec3 m0 = ipose.rot * getVec3(-cam.cx / cam.fx, -cam.cy / cam.fy, 1.0) / voxel.unit;
+        const Vec3 mx = ipose.rot * getVec3(1.0 / cam.fx, 0.0, 0.0) / voxel.unit;
+        const Vec3 my = ipose.rot * getVec3(0.0, 1.0 / cam.fy, 0.0) / voxel.unit;
 
 #if SP_USE_OMP
-#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic)
 #endif
-        for (int v = 0; v < map.dsize[1]; v++) {
-            for (int u = 0; u < map.dsize[0]; u++) {
-                const Vec3 cvec = getVec3(invCam(cam, getVec2(u, v)), 1.0);
-                const Vec3 mvec = ipose.rot * cvec;
+        for (int pv = 0; pv < range.dsize[1]; pv++) {
+            for (int pu = 0; pu < range.dsize[0]; pu++) {
+                const Vec2 &r = range(pu, pv);
+                if (r.x >= r.y) continue;
 
-                double maxv = -SP_INFINITY;
-                double minv = +SP_INFINITY;
-
-                // voxel range
-                for (int i = 0; i < 3; i++) {
-                    if (fabs(acsv(mvec, i)) > SP_SMALL) {
-                        for(int j = 0; j < 2; j++){
-                            const int p = (j == 0) ? -1 : +1;
-                            const double s = (p * acsv(cent, i) - acsv(ipose.pos, i)) / acsv(mvec, i);
-                            const double a = acsv(mvec, (i + 1) % 3) * s + acsv(ipose.pos, (i + 1) % 3);
-                            const double b = acsv(mvec, (i + 2) % 3) * s + acsv(ipose.pos, (i + 2) % 3);
-                            if (fabs(a) < acsv(cent, (i + 1) % 3) && fabs(b) < acsv(cent, (i + 2) % 3)) {
-                                maxv = maxVal(maxv, s);
-                                minv = minVal(minv, s);
-                            }
+                // packet (PACKET x PACKET rays share the range)
+                for (int v = pv * PACKET; v < minVal((pv + 1) * PACKET, map.dsize[1]); v++) {
+                    for (int u = pu * PACKET; u < minVal((pu + 1) * PACKET, map.dsize[0]); u++) {
+                        const Vec3 m = m0 + mx * u + my * v;
+
+                        SP_REAL detect = 0.0;
+                        if (_tsdf::march(detect, voxel, pyr, o, m, r.x, r.y, mu) == false) continue;
+
+                        const Vec3 mpos = o + m * detect;
+                        const int x = round(mpos.x);
+                        const int y = round(mpos.y);
+                        const int z = round(mpos.z);
+
+                        // central difference
+                        if (x < 1 || y < 1 || z < 1 || x > voxel.dsize[0] - 2 || y > voxel.dsize[1] - 2 || z > voxel.dsize[2] - 2) continue;
+                        const Vec3 mnrm = voxel.getn(x, y, z);
+
+                        const Vec3 cpos = getVec3(invCam(cam, getVec2(u, v)), 1.0) * detect;
+                        const Vec3 cnrm = pose.rot * mnrm;
+
+                        map(u, v) = getVecPD3(cpos, cnrm);
+                    }
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------------
+    // truncated signed distance function (sparse voxel)
+    //--------------------------------------------------------------------------------
+
+    SP_CPUFUNC void updateTSDF(SparseVoxel &voxel, const CamParam &cam, const Pose &pose, const Mem2<SP_REAL> &depth, const SP_REAL mu = 5.0) {
+        const int BBIT = SparseVoxel::BBIT;
+        const int BSIZE = SparseVoxel::BSIZE;
+
+        const SP_REAL step = mu * voxel.unit;
+        const SP_REAL bunit = BSIZE * voxel.unit;
+        const Pose ipose = invPose(pose);
+
+        // allocate bricks in the truncation band of each depth
+        {
+            int pre[3] = { SP_INTMAX, SP_INTMAX, SP_INTMAX };
+
+            for (int v = 0; v < depth.dsize[1]; v++) {
+                for (int u = 0; u < depth.dsize[0]; u++) {
+                    const SP_REAL d = depth(u, v);
+                    if (d == 0.0) continue;
+
+                    const Vec3 cvec = getVec3(invCam(cam, getVec2(u, v)), 1.0);
+
+                    // half brick along the ray
+                    const SP_REAL s = 0.5 * bunit / normVec(cvec);
+
+                    for (SP_REAL t = d - step; ; t += s) {
+                        t = minVal(t, d + step);
+
+                        const Vec3 mpos = (ipose * (cvec * t)) / voxel.unit;
+                        const int bx = round(mpos.x) >> BBIT;
+                        const int by = round(mpos.y) >> BBIT;
+                        const int bz = round(mpos.z) >> BBIT;
+
+                        if (bx != pre[0] || by != pre[1] || bz != pre[2]) {
+                            voxel.alloc(bx, by, bz);
+                            pre[0] = bx;
+                            pre[1] = by;
+                            pre[2] = bz;
                         }
+                        if (t >= d + step) break;
                     }
                 }
+            }
+        }
+
+        // visible bricks
+        Mem1<int> list;
+        list.reserve(voxel.size());
+        {
+            const SP_REAL radius = 0.5 * sqrt(3.0) * bunit;
+            const SP_REAL margin = radius * maxVal(cam.fx, cam.fy);
 
-                if (minv <= SP_SMALL) continue;
+            for (int i = 0; i < voxel.size(); i++) {
+                const SparseVoxel::Brick &brick = voxel.bricks[i];
 
- 
-                SP_REAL detect = minv;
+                const Vec3 mpos = (getVec3(brick.bx, brick.by, brick.bz) * BSIZE + (BSIZE - 1) * 0.5) * voxel.unit;
+                const Vec3 cpos = pose * mpos;
+                if (cpos.z <= -radius) continue;
+
+                if (cpos.z > radius) {
+                    const Vec2 pix = mulCam(cam, prjVec(cpos));
+                    const SP_REAL m = margin / cpos.z;
+                    if (pix.x < -m || pix.x > depth.dsize[0] - 1 + m) continue;
+                    if (pix.y < -m || pix.y > depth.dsize[1] - 1 + m) continue;
+                }
+                list.push(i);
+            }
+        }
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+        for (int i = 0; i < list.size(); i++) {
+            SparseVoxel::Brick &brick = voxel.bricks[list[i]];
+
+            for (int z = 0; z < BSIZE; z++) {
+                for (int y = 0; y < BSIZE; y++) {
+                    for (int x = 0; x < BSIZE; x++) {
+                        const Vec3 mpos = getVec3((brick.bx << BBIT) + x, (brick.by << BBIT) + y, (brick.bz << BBIT) + z);
+                        const Vec3 cpos = pose * (mpos * voxel.unit);
+                        if (cpos.z <= 0.0) continue;
+
+                        const Vec2 pix = mulCam(cam, prjVec(cpos));
+                        if (inRect(depth.dsize, pix.x, pix.y) == false) continue;
+
+                        const SP_REAL d = depth(round(pix.x), round(pix.y));
+                        if (d == 0.0) continue;
+
+                        const SP_REAL dist = maxVal(cpos.z - d, -step) / step;
+                        SparseVoxel::update(brick, (z * BSIZE + y) * BSIZE + x, dist);
+                    }
+                }
+            }
+        }
+    }
+
+    SP_CPUFUNC void rayCasting(Mem2<VecPD3> &map, const CamParam &cam, const Pose &pose, const SparseVoxel &voxel, const SP_REAL mu = 5.0) {
+        const int BBIT = SparseVoxel::BBIT;
+        const int BSIZE = SparseVoxel::BSIZE;
+
+        map.resize(cam.dsize);
+        map.zero();
+
+        if (voxel.size() == 0) return;
+
+        const SP_REAL unit = voxel.unit;
+
+        // ray range of each tile (near / far depth of projected bricks)
+        const int TILE = 8;
+        Mem2<Vec2> range((cam.dsize[0] + TILE - 1) / TILE, (cam.dsize[1] + TILE - 1) / TILE);
+        setElm(range, getVec2(+SP_INFINITY, -SP_INFINITY));
+
+        for (int i = 0; i < voxel.size(); i++) {
+            const SparseVoxel::Brick &brick = voxel.bricks[i];
+            const Vec3 base = (getVec3(brick.bx, brick.by, brick.bz) * BSIZE - 0.5) * unit;
+
+            _tsdf::updateRange(range, TILE, cam, pose, base, BSIZE * unit);
+        }
+
+        const Pose ipose = invPose(pose);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+        for (int v = 0; v < map.dsize[1]; v++) {
+            for (int u = 0; u < map.dsize[0]; u++) {
+                const Vec2 &r = range(u / TILE, v / TILE);
+
+                const double minv = maxVal(r.x, SP_SMALL);
+                const double maxv = r.y;
+                if (minv >= maxv) continue;
+
+                const Vec3 cvec = getVec3(invCam(cam, getVec2(u, v)), 1.0);
+                const Vec3 mvec = ipose.rot * cvec;
+
+                SP_REAL detect = 0.0;
 
                 char pre = 0;
-                SP_REAL step = mu;
+                bool fine = false;
+
+                int id = -1;
+                int key[3] = { SP_INTMAX, SP_INTMAX, SP_INTMAX };
 
-                for (SP_REAL d = minv; d < maxv; d += step * voxel.unit) {
-                    const Vec3 mpos = (ipose.pos + mvec * d) / voxel.unit + cent;
+                for (SP_REAL d = minv; d < maxv; d += (fine == true) ? unit : mu * unit) {
+                    const Vec3 mpos = (ipose.pos + mvec * d) / unit;
                     const int x = round(mpos.x);
                     const int y = round(mpos.y);
                     const int z = round(mpos.z);
 
-                    if (inRect(voxel.dsize, x, y, z) == false) continue;
+                    const int bx = x >> BBIT;
+                    const int by = y >> BBIT;
+                    const int bz = z >> BBIT;
+                    if (bx != key[0] || by != key[1] || bz != key[2]) {
+                        id = voxel.find(bx, by, bz);
+                        key[0] = bx;
+                        key[1] = by;
+                        key[2] = bz;
+                    }
+
+                    // skip unallocated brick
+                    if (id < 0) {
+                        double exit = +SP_INFINITY;
+                        const int bi[3] = { bx, by, bz };
+                        for (int i = 0; i < 3; i++) {
+                            const double m = acsv(mvec, i);
+                            if (fabs(m) <= SP_SMALL) continue;
+
+                            const double b = ((m > 0.0) ? (bi[i] << BBIT) + BSIZE - 0.5 : (bi[i] << BBIT) - 0.5) * unit;
+                            exit = minVal(exit, (b - acsv(ipose.pos, i)) / m);
+                        }
+                        pre = 0;
+                        fine = false;
+
+                        // next loop adds a coarse step
+                        d = maxVal(d, exit + 0.01 * unit) - mu * unit;
+                        continue;
+                    }
 
-                    const char val = voxel.vmap(x, y, z);
-                    const char wei = voxel.wmap(x, y, z);
+                    const int i = SparseVoxel::offset(x, y, z);
+                    const char val = voxel.bricks[id].vmap[i];
+                    const char wei = voxel.bricks[id].wmap[i];
 
                     if (wei == 0) {
                         pre = 0;
-                        step = mu * voxel.unit;
+                        fine = false;
                         continue;
                     }
 
                     if (val >= 0 && pre < 0) {
-                        if (step == 1.0){
-                            detect = d - step * val / (val - pre);
+                        if (fine == true) {
+                            detect = d - unit * val / (val - pre);
                             break;
                         }
                         else {
-                            d -= step;
+                            // back to the previous sample and search with fine steps
+                            d -= mu * unit;
+                            fine = true;
+                            continue;
                         }
                     }
                     else {
                         pre = val;
                     }
 
-                    step = (val > -0.9 * SP_VOXEL_VMAX) ? 1.0 : mu;
+                    fine = (val > -0.9 * SP_VOXEL_VMAX) ? true : false;
                 }
 
-                if (detect > minv) {
-                    const Vec3 mpos = (ipose.pos + mvec * detect) / voxel.unit + cent;
+                if (detect > 0.0) {
+                    const Vec3 mpos = (ipose.pos + mvec * detect) / unit;
                     const Vec3 mnrm = voxel.getn(round(mpos.x), round(mpos.y), round(mpos.z));
 
                     const Vec3 cpos = cvec * detect;
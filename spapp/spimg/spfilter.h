@@ -10,123 +10,343 @@
 namespace sp{
 
     //--------------------------------------------------------------------------------
-    // filter 
+    // convolution core
     //--------------------------------------------------------------------------------
 
-    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
-    SP_CPUFUNC void filter(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernel){
-        SP_ASSERT(checkPtr(src, 2) && checkPtr(kernel, 2));
-        
-        dst.resize(2, src.dsize);
-        const Mem<TYPE0> &tmp = (reinterpret_cast<const Mem<TYPE0>*>(&dst) != &src) ? src : clone(src);
+    // border mode
+    enum BorderMode {
+        BorderNorm = 0,   // skip outside taps and renormalize the kernel
+        BorderClamp,      // replicate edge (aa|abcd|dd)
+        BorderReflect,    // mirror without edge (cb|abcd|cb)
+        BorderZero,       // zero outside
+    };
+
+    namespace _filter {
+
+        // intermediate element type of separable filter
+        template <typename ELEM> struct Buf { typedef ELEM type; };
+        template <> struct Buf<Byte> { typedef float type; };
+
+        // tap weight type (float : simd accumulation of Byte / float)
+        template <typename ELEM, typename ELEM0> struct Tap { typedef double type; };
+        template <> struct Tap<Byte, Byte> { typedef float type; };
+        template <> struct Tap<float, Byte> { typedef float type; };
+        template <> struct Tap<Byte, float> { typedef float type; };
+        template <> struct Tap<float, float> { typedef float type; };
+
+        // element view (TYPE -> ELEM, width x ch)
+        template <typename ELEM, typename TYPE>
+        SP_CPUFUNC MemView<ELEM> elemView(const MemView<TYPE> &view) {
+            const int ch = sizeof(TYPE) / sizeof(ELEM);
+            return MemView<ELEM>(view.ptr, view.dsize[0] * ch, view.dsize[1], view.pitch);
+        }
 
-        const int ch = sizeof(TYPE) / sizeof(ELEM);
-        const int halfX = kernel.dsize[0] / 2;
-        const int halfY = kernel.dsize[1] / 2;
+        // border index (-1 : outside)
+        SP_CPUFUNC int border(const int x, const int n, const int mode) {
+            if (x >= 0 && x < n) return x;
+
+            switch (mode) {
+            case BorderClamp:
+                return (x < 0) ? 0 : n - 1;
+            case BorderReflect:
+            {
+                if (n == 1) return 0;
+                const int p = 2 * (n - 1);
+                int m = x % p;
+                if (m < 0) m += p;
+                return (m < n) ? m : p - m;
+            }
+            default:
+                return -1;
+            }
+        }
 
-        const Rect2 rect = getRect2(dst.dsize);
+        // dst[i] = sum(tw[t] * tp[t][i]) (i < n)
+        template <typename ELEM, typename ELEM0>
+        SP_CPUFUNC void convTaps(ELEM *dst, const ELEM0 *const *tp, const double *tw, const int tn, const int n) {
+            for (int i = 0; i < n; i++) {
+                double sum = 0.0;
+                for (int t = 0; t < tn; t++) {
+                    sum += tw[t] * tp[t][i];
+                }
+                dst[i] = cast<ELEM>(sum);
+            }
+        }
 
-#if SP_USE_OMP
-#pragma omp parallel for
+#if SP_USE_AVX
+        SP_CPUFUNC __m256 loadf(const Byte *p) {
+            return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+        }
+        SP_CPUFUNC __m256 loadf(const float *p) {
+            return _mm256_loadu_ps(p);
+        }
+        SP_CPUFUNC void storef(float *p, const __m256 v) {
+            _mm256_storeu_ps(p, v);
+        }
+        SP_CPUFUNC void storef(Byte *p, const __m256 v) {
+            const __m256i i = _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+            const __m128i s = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(s, s));
+        }
+#elif SP_USE_SSE
+        SP_CPUFUNC __m128 loadf(const Byte *p) {
+            int x;
+            memcpy(&x, p, 4);
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(x), zero);
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+        }
+        SP_CPUFUNC __m128 loadf(const float *p) {
+            return _mm_loadu_ps(p);
+        }
+        SP_CPUFUNC void storef(float *p, const __m128 v) {
+            _mm_storeu_ps(p, v);
+        }
+        SP_CPUFUNC void storef(Byte *p, const __m128 v) {
+            const __m128i i = _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+            const __m128i s = _mm_packs_epi32(i, i);
+            const int x = _mm_cvtsi128_si32(_mm_packus_epi16(s, s));
+            memcpy(p, &x, 4);
+        }
 #endif
-        for (int v = 0; v < dst.dsize[1]; v++){
-            for (int u = 0; u < dst.dsize[0]; u++){
 
-                for (int c = 0; c < ch; c++){
-                    double sum = 0.0, div = 0.0;
+        // float accumulation (Byte / float)
+        template <typename ELEM, typename ELEM0>
+        SP_CPUFUNC void convTapsF(ELEM *dst, const ELEM0 *const *tp, const float *tf, const int tn, const int n) {
+            int i = 0;
+#if SP_USE_AVX
+            for (; i + 16 <= n; i += 16) {
+                __m256 a0 = _mm256_setzero_ps();
+                __m256 a1 = _mm256_setzero_ps();
+                for (int t = 0; t < tn; t++) {
+                    const __m256 w = _mm256_set1_ps(tf[t]);
+                    a0 = _mm256_add_ps(a0, _mm256_mul_ps(w, loadf(tp[t] + i + 0)));
+                    a1 = _mm256_add_ps(a1, _mm256_mul_ps(w, loadf(tp[t] + i + 8)));
+                }
+                storef(dst + i + 0, a0);
+                storef(dst + i + 8, a1);
+            }
+#elif SP_USE_SSE
+            for (; i + 8 <= n; i += 8) {
+                __m128 a0 = _mm_setzero_ps();
+                __m128 a1 = _mm_setzero_ps();
+                for (int t = 0; t < tn; t++) {
+                    const __m128 w = _mm_set1_ps(tf[t]);
+                    a0 = _mm_add_ps(a0, _mm_mul_ps(w, loadf(tp[t] + i + 0)));
+                    a1 = _mm_add_ps(a1, _mm_mul_ps(w, loadf(tp[t] + i + 4)));
+                }
+                storef(dst + i + 0, a0);
+                storef(dst + i + 4, a1);
+            }
+#endif
+            for (; i < n; i++) {
+                float sum = 0.0f;
+                for (int t = 0; t < tn; t++) {
+                    sum += tf[t] * tp[t][i];
+                }
+                dst[i] = cast<ELEM>(static_cast<double>(sum));
+            }
+        }
 
-                    for (int ky = -halfY; ky <= halfY; ky++){
-                        for (int kx = -halfX; kx <= halfX; kx++){
-                            if (inRect(rect, u + kx, v + ky) == false) continue;
-                            
-                            const ELEM0 &val = acs2<TYPE0, ELEM0>(tmp, u + kx, v + ky, c);
-                            const SP_REAL s = acs2(kernel, kx + halfX, ky + halfY);
+        SP_CPUFUNC void convTaps(Byte *dst, const Byte *const *tp, const float *tf, const int tn, const int n) {
+            convTapsF(dst, tp, tf, tn, n);
+        }
+        SP_CPUFUNC void convTaps(float *dst, const Byte *const *tp, const float *tf, const int tn, const int n) {
+            convTapsF(dst, tp, tf, tn, n);
+        }
+        SP_CPUFUNC void convTaps(Byte *dst, const float *const *tp, const float *tf, const int tn, const int n) {
+            convTapsF(dst, tp, tf, tn, n);
+        }
+        SP_CPUFUNC void convTaps(float *dst, const float *const *tp, const float *tf, const int tn, const int n) {
+            convTapsF(dst, tp, tf, tn, n);
+        }
 
-                            sum += s * val;
-                            div += fabs(s);
-                        }
-                    }
+        // single pixel with border handling
+        template <typename ELEM, typename ELEM0>
+        SP_CPUFUNC void convPixel(const MemView<ELEM> &dst, const MemView<ELEM0> &src, const int ch, const int u, const int v,
+            const SP_REAL *kernel, const int kw, const int kh, const double div, const int mode) {
+
+            const int W = src.dsize[0] / ch;
+            const int H = src.dsize[1];
 
-                    cnvVal(acs2<TYPE, ELEM>(dst, u, v, c), (div > 0.0) ? sum / div : 0.0);
+            for (int c = 0; c < ch; c++) {
+                double sum = 0.0, sdiv = 0.0;
+
+                for (int ky = 0; ky < kh; ky++) {
+                    const int sv = border(v + ky - kh / 2, H, mode);
+                    if (sv < 0) continue;
+
+                    const ELEM0 *ps = src.row(sv);
+                    for (int kx = 0; kx < kw; kx++) {
+                        const int su = border(u + kx - kw / 2, W, mode);
+                        if (su < 0) continue;
+
+                        const SP_REAL s = kernel[ky * kw + kx];
+                        sum += s * ps[su * ch + c];
+                        sdiv += fabs(s);
+                    }
                 }
+
+                const double nrm = (mode == BorderNorm) ? sdiv : div;
+                dst.row(v)[u * ch + c] = cast<ELEM>((nrm > 0.0) ? sum / nrm : 0.0);
             }
         }
 
-    }
+        // kw x kh convolution on element views (width = image width x ch)
+        // interior columns : pre-normalized tap list, vectorized over u
+        // border columns : per pixel with border mode
+        template <typename ELEM, typename ELEM0>
+        SP_CPUFUNC void conv(const MemView<ELEM> &dst, const MemView<ELEM0> &src, const int ch, 
+            const SP_REAL *kernel, const int kw, const int kh, const int mode) {
 
-    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
-    SP_CPUFUNC void filterX(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernel){
-        SP_ASSERT(checkPtr(src, 2) && checkPtr(kernel, 1));
+            const int W = src.dsize[0] / ch;
+            const int H = src.dsize[1];
 
-        dst.resize(2, src.dsize);
-        const Mem2<TYPE> &tmp = (reinterpret_cast<const Mem<TYPE0>*>(&dst) != &src) ? src : clone(src);
+            SP_PROFILE_SCOPE("conv");
+            SP_PROFILE_COUNT("pixels", W * H);
 
-        const int ch = sizeof(TYPE) / sizeof(ELEM);
-        const int halfX = kernel.dsize[0] / 2;
+            const int halfX = kw / 2;
+            const int halfY = kh / 2;
 
-        const Rect2 rect = getRect2(dst.dsize);
+            double div = 0.0;
+            for (int k = 0; k < kw * kh; k++) {
+                div += fabs(kernel[k]);
+            }
+
+            // interior columns [u0, u1)
+            const int u0 = minVal(halfX, W);
+            const int u1 = maxVal(u0, W - (kw - 1 - halfX));
 
 #if SP_USE_OMP
 #pragma omp parallel for
 #endif
-        for (int v = 0; v < dst.dsize[1]; v++){
-            for (int u = 0; u < dst.dsize[0]; u++){
+            for (int v = 0; v < H; v++) {
+                if (u1 > u0) {
+                    typedef typename Tap<ELEM, ELEM0>::type TAP;
 
-                for (int c = 0; c < ch; c++){
-                    double sum = 0.0, div = 0.0;
+                    Mem1<const ELEM0*> tp(kw * kh);
+                    Mem1<TAP> tw(kw * kh);
 
-                    for (int kx = -halfX; kx <= halfX; kx++){
-                        if (inRect(rect, u + kx, v) == false) continue;
-                        
-                        const ELEM0 &val = acs2<TYPE0, ELEM0>(tmp, u + kx, v, c);
-                        const SP_REAL s = acs1(kernel, kx + halfX);
+                    double sdiv = 0.0;
+                    for (int ky = 0; ky < kh; ky++) {
+                        if (border(v + ky - halfY, H, mode) < 0) continue;
 
-                        sum += s * val;
-                        div += fabs(s);
+                        for (int kx = 0; kx < kw; kx++) {
+                            sdiv += fabs(kernel[ky * kw + kx]);
+                        }
                     }
+                    const double nrm = (mode == BorderNorm) ? sdiv : div;
+
+                    int tn = 0;
+                    for (int ky = 0; ky < kh && nrm > 0.0; ky++) {
+                        const int sv = border(v + ky - halfY, H, mode);
+                        if (sv < 0) continue;
 
-                    acs2<TYPE, ELEM>(dst, u, v, c) = cast<ELEM>((div > 0.0) ? sum / div : 0.0);
+                        const ELEM0 *ps = src.row(sv);
+                        for (int kx = 0; kx < kw; kx++) {
+                            const SP_REAL s = kernel[ky * kw + kx];
+                            if (s == 0) continue;
+
+                            tp[tn] = ps + (u0 + kx - halfX) * ch;
+                            tw[tn] = static_cast<TAP>(s / nrm);
+                            tn++;
+                        }
+                    }
+
+                    convTaps(dst.row(v) + u0 * ch, tp.ptr, tw.ptr, tn, (u1 - u0) * ch);
+                }
+
+                for (int u = 0; u < u0; u++) {
+                    convPixel(dst, src, ch, u, v, kernel, kw, kh, div, mode);
+                }
+                for (int u = u1; u < W; u++) {
+                    convPixel(dst, src, ch, u, v, kernel, kw, kh, div, mode);
                 }
             }
         }
     }
 
 
+    //--------------------------------------------------------------------------------
+    // filter 
+    //--------------------------------------------------------------------------------
+
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void filter(Mem<TYPE> &dst, const MemView<TYPE0> &src, const Mem<SP_REAL> &kernel, const int border = BorderNorm){
+        SP_ASSERT(checkPtr(src, 2) && checkPtr(kernel, 2));
+        SP_ASSERT(sizeof(TYPE) / sizeof(ELEM) == sizeof(TYPE0) / sizeof(ELEM0));
+        
+        dst.resize(2, src.dsize);
+
+        const int ch = sizeof(TYPE) / sizeof(ELEM);
+        _filter::conv(_filter::elemView<ELEM>(MemView<TYPE>(dst)), _filter::elemView<ELEM0>(src), ch, kernel.ptr, kernel.dsize[0], kernel.dsize[1], border);
+    }
+
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void filter(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernel, const int border = BorderNorm){
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        filter<TYPE, ELEM, TYPE0, ELEM0>(dst, MemView<TYPE0>(same ? tmp : src), kernel, border);
+    }
+
     template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
-    SP_CPUFUNC void filterY(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernel){
+    SP_CPUFUNC void filterX(Mem<TYPE> &dst, const MemView<TYPE0> &src, const Mem<SP_REAL> &kernel, const int border = BorderNorm){
         SP_ASSERT(checkPtr(src, 2) && checkPtr(kernel, 1));
+        SP_ASSERT(sizeof(TYPE) / sizeof(ELEM) == sizeof(TYPE0) / sizeof(ELEM0));
 
         dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (reinterpret_cast<const Mem<TYPE0>*>(&dst) != &src) ? src : clone(src);
 
         const int ch = sizeof(TYPE) / sizeof(ELEM);
-        const int halfY = kernel.dsize[0] / 2;
+        _filter::conv(_filter::elemView<ELEM>(MemView<TYPE>(dst)), _filter::elemView<ELEM0>(src), ch, kernel.ptr, kernel.dsize[0], 1, border);
+    }
 
-        const Rect2 rect = getRect2(dst.dsize);
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void filterX(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernel, const int border = BorderNorm){
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        filterX<TYPE, ELEM, TYPE0, ELEM0>(dst, MemView<TYPE0>(same ? tmp : src), kernel, border);
+    }
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-        for (int v = 0; v < dst.dsize[1]; v++){
-            for (int u = 0; u < dst.dsize[0]; u++){
 
-                for (int c = 0; c < ch; c++){
-                    double sum = 0.0, div = 0.0;
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void filterY(Mem<TYPE> &dst, const MemView<TYPE0> &src, const Mem<SP_REAL> &kernel, const int border = BorderNorm){
+        SP_ASSERT(checkPtr(src, 2) && checkPtr(kernel, 1));
+        SP_ASSERT(sizeof(TYPE) / sizeof(ELEM) == sizeof(TYPE0) / sizeof(ELEM0));
 
-                    for (int ky = -halfY; ky <= halfY; ky++){
-                        if (inRect(rect, u, v + ky) == false) continue;
-                        
-                        const ELEM0 &val = acs2<TYPE0, ELEM0>(tmp, u, v + ky, c);
-                        const SP_REAL s = acs1(kernel, ky + halfY);
+        dst.resize(2, src.dsize);
 
-                        sum += s * val;
-                        div += fabs(s);
-                    }
+        const int ch = sizeof(TYPE) / sizeof(ELEM);
+        _filter::conv(_filter::elemView<ELEM>(MemView<TYPE>(dst)), _filter::elemView<ELEM0>(src), ch, kernel.ptr, 1, kernel.dsize[0], border);
+    }
 
-                    acs2<TYPE, ELEM>(dst, u, v, c) = cast<ELEM>((div > 0.0) ? sum / div : 0.0);
-                }
-            }
-        }
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void filterY(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernel, const int border = BorderNorm){
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        filterY<TYPE, ELEM, TYPE0, ELEM0>(dst, MemView<TYPE0>(same ? tmp : src), kernel, border);
+    }
+
+    // separable filter (kernelX -> kernelY, Byte elements are kept in float between passes)
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void sepFilter(Mem<TYPE> &dst, const MemView<TYPE0> &src, const Mem<SP_REAL> &kernelX, const Mem<SP_REAL> &kernelY, const int border = BorderNorm){
+        SP_ASSERT(checkPtr(src, 2) && checkPtr(kernelX, 1) && checkPtr(kernelY, 1));
+        SP_ASSERT(sizeof(TYPE) / sizeof(ELEM) == sizeof(TYPE0) / sizeof(ELEM0));
+
+        typedef typename _filter::Buf<ELEM>::type BUF;
+
+        const int ch = sizeof(TYPE) / sizeof(ELEM);
+
+        Mem2<BUF> tmp(src.dsize[0] * ch, src.dsize[1]);
+        _filter::conv(MemView<BUF>(tmp), _filter::elemView<ELEM0>(src), ch, kernelX.ptr, kernelX.dsize[0], 1, border);
+
+        // src is not referred after here (dst == src is allowed)
+        dst.resize(2, src.dsize);
+        _filter::conv(_filter::elemView<ELEM>(MemView<TYPE>(dst)), MemView<BUF>(tmp), ch, kernelY.ptr, 1, kernelY.dsize[0], border);
+    }
+
+    template <typename TYPE, typename ELEM = TYPE, typename TYPE0, typename ELEM0 = ELEM>
+    SP_CPUFUNC void sepFilter(Mem<TYPE> &dst, const Mem<TYPE0> &src, const Mem<SP_REAL> &kernelX, const Mem<SP_REAL> &kernelY, const int border = BorderNorm){
+        sepFilter<TYPE, ELEM, TYPE0, ELEM0>(dst, MemView<TYPE0>(src), kernelX, kernelY, border);
     }
 
     //--------------------------------------------------------------------------------
@@ -140,7 +360,7 @@ namespace sp{
     // half = round((sigma - 0.8) / 0.3 + 1)
 
     template <typename TYPE, typename ELEM = TYPE>
-    SP_CPUFUNC void gaussianFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const double sigma = 0.8){
+    SP_CPUFUNC void gaussianFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const double sigma = 0.8){
         SP_ASSERT(checkPtr(src, 2));
 
         const int half = maxVal(1, round((sigma - 0.8) / 0.3 + 1));
@@ -151,58 +371,31 @@ namespace sp{
             kernel(k + half) = exp(-r / (2.0 * sq(sigma)));
         }
 
-        Mem2<TYPE> tmp;
-        filterX<TYPE, ELEM>(tmp, src, kernel);
-        filterY<TYPE, ELEM>(dst, tmp, kernel);
+        sepFilter<TYPE, ELEM>(dst, src, kernel, kernel);
+    }
+
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void gaussianFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const double sigma = 0.8){
+        gaussianFilter<TYPE, ELEM>(dst, MemView<TYPE>(src), sigma);
     }
 
     template <typename TYPE, typename TYPE0>
-    SP_CPUFUNC void gaussianFilter3x3(Mem<TYPE> &dst, const Mem<TYPE0> &src) {
+    SP_CPUFUNC void gaussianFilter3x3(Mem<TYPE> &dst, const MemView<TYPE0> &src) {
         SP_ASSERT(checkPtr(src, 2));
 
-        const Mem<TYPE0> &tmp = (reinterpret_cast<const Mem<TYPE0>*>(&dst) != &src) ? src : clone(src);
-
-        const int dsize0 = src.dsize[0];
-        const int dsize1 = src.dsize[1];
-        const int dsize[2] = { dsize0, dsize1 };
-
-        dst.resize(2, dsize);
-
-        const TYPE0 *psrc = tmp.ptr;
-        TYPE *pdst = dst.ptr;
-
-        for (int v = 0; v < dsize1; v++) {
-            const int v0 = v + ((v == 0) ? 0 : -1);
-            const int v1 = v + 0;
-            const int v2 = v + ((v == dsize1 - 1) ? 0 : +1);
-
-            const TYPE0 *psrc0 = &psrc[v0 * dsize0];
-            const TYPE0 *psrc1 = &psrc[v1 * dsize0];
-            const TYPE0 *psrc2 = &psrc[v2 * dsize0];
-
-            TYPE *pd = &pdst[v * dsize0];
-
-            for (int u = 0; u < dsize0; u++) {
-                const int u0 = u + ((u == 0) ? 0 : -1);
-                const int u1 = u + 0;
-                const int u2 = u + ((u == dsize0 - 1) ? 0 : +1);
-
-                const TYPE0 a00 = psrc0[u0];
-                const TYPE0 a01 = psrc0[u1];
-                const TYPE0 a02 = psrc0[u2];
-
-                const TYPE0 a10 = psrc1[u0];
-                const TYPE0 a11 = psrc1[u1];
-                const TYPE0 a12 = psrc1[u2];
+        Mem1<SP_REAL> kernel(3);
+        kernel(0) = SP_CAST_REAL(1.0);
+        kernel(1) = SP_CAST_REAL(2.0);
+        kernel(2) = SP_CAST_REAL(1.0);
 
-                const TYPE0 a20 = psrc2[u0];
-                const TYPE0 a21 = psrc2[u1];
-                const TYPE0 a22 = psrc2[u2];
+        sepFilter<TYPE, TYPE, TYPE0, TYPE0>(dst, src, kernel, kernel, BorderClamp);
+    }
 
-                const double d = (a00 + 2.0 * a01 + a02) + 2.0 * (a10 + 2.0 * a11 + a12) + (a20 + 2.0 * a21 + a22);
-                *pd++ = cast<TYPE>(d / 16.0);
-            }
-        }
+    template <typename TYPE, typename TYPE0>
+    SP_CPUFUNC void gaussianFilter3x3(Mem<TYPE> &dst, const Mem<TYPE0> &src) {
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        gaussianFilter3x3(dst, MemView<TYPE0>(same ? tmp : src));
     }
 
     //--------------------------------------------------------------------------------
@@ -210,7 +403,7 @@ namespace sp{
     //--------------------------------------------------------------------------------
 
     template <typename TYPE, typename ELEM = TYPE>
-    SP_CPUFUNC void boxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+    SP_CPUFUNC void boxFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const int winSize) {
         SP_ASSERT(checkPtr(src, 2));
 
         Mem1<SP_REAL> kernel(winSize);
@@ -218,58 +411,31 @@ namespace sp{
             kernel(k) = SP_CAST_REAL(1.0);
         }
 
-        Mem2<TYPE> tmp;
-        filterX<TYPE, ELEM>(tmp, src, kernel);
-        filterY<TYPE, ELEM>(dst, tmp, kernel);
+        sepFilter<TYPE, ELEM>(dst, src, kernel, kernel);
+    }
+
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void boxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        boxFilter<TYPE, ELEM>(dst, MemView<TYPE>(src), winSize);
     }
     
     template <typename TYPE, typename TYPE0>
-    SP_CPUFUNC void boxFilter3x3(Mem<TYPE> &dst, const Mem<TYPE0> &src) {
+    SP_CPUFUNC void boxFilter3x3(Mem<TYPE> &dst, const MemView<TYPE0> &src) {
         SP_ASSERT(checkPtr(src, 2));
 
-        const Mem<TYPE0> &tmp = (reinterpret_cast<const Mem<TYPE0>*>(&dst) != &src) ? src : clone(src);
-
-        const int dsize0 = src.dsize[0];
-        const int dsize1 = src.dsize[1];
-        const int dsize[2] = { dsize0, dsize1 };
-
-        dst.resize(2, dsize);
-
-        const TYPE0 *psrc = tmp.ptr;
-        TYPE *pdst = dst.ptr;
-
-        for (int v = 0; v < dsize1; v++) {
-            const int v0 = v + ((v == 0) ? 0 : -1);
-            const int v1 = v + 0;
-            const int v2 = v + ((v == dsize1 - 1) ? 0 : +1);
-
-            const TYPE0 *psrc0 = &psrc[v0 * dsize0];
-            const TYPE0 *psrc1 = &psrc[v1 * dsize0];
-            const TYPE0 *psrc2 = &psrc[v2 * dsize0];
-
-            TYPE *pd = &pdst[v * dsize0];
-
-            for (int u = 0; u < dsize0; u++) {
-                const int u0 = u + ((u == 0) ? 0 : -1);
-                const int u1 = u + 0;
-                const int u2 = u + ((u == dsize0 - 1) ? 0 : +1);
-
-                const TYPE0 a00 = psrc0[u0];
-                const TYPE0 a01 = psrc0[u1];
-                const TYPE0 a02 = psrc0[u2];
-
-                const TYPE0 a10 = psrc1[u0];
-                const TYPE0 a11 = psrc1[u1];
-                const TYPE0 a12 = psrc1[u2];
+        Mem1<SP_REAL> kernel(3);
+        for (int k = 0; k < 3; k++) {
+            kernel(k) = SP_CAST_REAL(1.0);
+        }
 
-                const TYPE0 a20 = psrc2[u0];
-                const TYPE0 a21 = psrc2[u1];
-                const TYPE0 a22 = psrc2[u2];
+        sepFilter<TYPE, TYPE, TYPE0, TYPE0>(dst, src, kernel, kernel, BorderClamp);
+    }
 
-                const SP_REAL d = (a00 + a01 + a02 + a10 + a11 + a12 + a20 + a21 + a22) / 9.0;
-                cnvVal(*pd++, d);
-            }
-        }
+    template <typename TYPE, typename TYPE0>
+    SP_CPUFUNC void boxFilter3x3(Mem<TYPE> &dst, const Mem<TYPE0> &src) {
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        boxFilter3x3(dst, MemView<TYPE0>(same ? tmp : src));
     }
 
  
@@ -278,58 +444,135 @@ namespace sp{
     // max/min filter 
     //--------------------------------------------------------------------------------
 
-    template <typename TYPE>
-    SP_CPUFUNC void maxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
-        SP_ASSERT(checkPtr(src, 2));
+    namespace _filter {
 
-        dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
+        // rows per task of strip parallel filters
+        static const int STRIP_ROWS = 64;
 
-        const int offset = winSize / 2;
+        template <typename TYPE>
+        SP_CPUFUNC TYPE minmax(const TYPE &a, const TYPE &b, const bool max) {
+            return max ? maxVal(a, b) : minVal(a, b);
+        }
 
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
+        // van Herk / Gil-Werman (3 comparisons per pixel independent of winSize)
+        // dst[i] = max/min(ext[i * step] ... ext[(i + winSize - 1) * step]) (i < n)
+        // g, h : buffer (n + winSize - 1)
+        template <typename TYPE>
+        SP_CPUFUNC void vhgw(TYPE *dst, const TYPE *const *ext, const int n, const int winSize, const int len, TYPE *const *g, TYPE *const *h, const bool max) {
+            const int m = n + winSize - 1;
+
+            // forward max/min in block
+            for (int i = 0; i < m; i++) {
+                if (i % winSize == 0) {
+                    memcpy(g[i], ext[i], len * sizeof(TYPE));
+                }
+                else {
+                    for (int j = 0; j < len; j++) {
+                        g[i][j] = minmax(g[i - 1][j], ext[i][j], max);
+                    }
+                }
+            }
+
+            // backward max/min in block
+            for (int i = m - 1; i >= 0; i--) {
+                if (i % winSize == winSize - 1 || i == m - 1) {
+                    memcpy(h[i], ext[i], len * sizeof(TYPE));
+                }
+                else {
+                    for (int j = 0; j < len; j++) {
+                        h[i][j] = minmax(h[i + 1][j], ext[i][j], max);
+                    }
+                }
+            }
+
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < len; j++) {
+                    dst[i * len + j] = minmax(h[i][j], g[i + winSize - 1][j], max);
+                }
+            }
+        }
+
+        template <typename TYPE>
+        SP_CPUFUNC void minmaxFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const int winSize, const bool max) {
+            dst.resize(2, src.dsize);
 
-                TYPE maxv = acs2(tmp, u, v);
+            const int W = src.dsize[0];
+            const int H = src.dsize[1];
+            const int offset = winSize / 2;
 
-                for (int ky = 0; ky < winSize; ky++){
-                    for (int kx = 0; kx < winSize; kx++) {
+            const int strips = (H + STRIP_ROWS - 1) / STRIP_ROWS;
 
-                        const TYPE &val = acs2(tmp, u + kx - offset, v + ky - offset);
-                        maxv = maxVal(maxv, val);
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int s = 0; s < strips; s++) {
+                const int v0 = s * STRIP_ROWS;
+                const int n = minVal(H - v0, STRIP_ROWS);
+                const int m = maxVal(n, W) + winSize - 1;
+
+                Mem1<const TYPE*> ext(m);
+                Mem1<TYPE*> g(m);
+                Mem1<TYPE*> h(m);
+
+                // vertical (whole rows at once)
+                Mem2<TYPE> tmp(W, n);
+                {
+                    Mem2<TYPE> gbuf(W, n + winSize - 1);
+                    Mem2<TYPE> hbuf(W, n + winSize - 1);
+                    for (int i = 0; i < n + winSize - 1; i++) {
+                        ext[i] = src.row(border(v0 + i - offset, H, BorderClamp));
+                        g[i] = &gbuf(0, i);
+                        h[i] = &hbuf(0, i);
                     }
+                    vhgw(tmp.ptr, ext.ptr, n, winSize, W, g.ptr, h.ptr, max);
                 }
 
-                acs2(dst, u, v) = cast<TYPE>(maxv);
+                // horizontal
+                Mem1<TYPE> line(W + winSize - 1);
+                Mem1<TYPE> gbuf(W + winSize - 1);
+                Mem1<TYPE> hbuf(W + winSize - 1);
+                for (int i = 0; i < W + winSize - 1; i++) {
+                    ext[i] = &line[i];
+                    g[i] = &gbuf[i];
+                    h[i] = &hbuf[i];
+                }
+                for (int v = 0; v < n; v++) {
+                    const TYPE *pt = &tmp(0, v);
+                    for (int i = 0; i < W + winSize - 1; i++) {
+                        line[i] = pt[border(i - offset, W, BorderClamp)];
+                    }
+                    vhgw(&dst[(v0 + v) * W], ext.ptr, W, winSize, 1, g.ptr, h.ptr, max);
+                }
             }
         }
     }
 
     template <typename TYPE>
-    SP_CPUFUNC void minFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
-        SP_ASSERT(checkPtr(src, 2));
+    SP_CPUFUNC void maxFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const int winSize) {
+        SP_ASSERT(checkPtr(src, 2) && winSize > 0);
 
-        dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
-
-        const int offset = winSize / 2;
-
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
+        _filter::minmaxFilter(dst, src, winSize, true);
+    }
 
-                TYPE minv = acs2(tmp, u, v);
+    template <typename TYPE>
+    SP_CPUFUNC void maxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        const bool same = (&dst == &src);
+        const Mem<TYPE> tmp = same ? clone(src) : Mem<TYPE>();
+        maxFilter(dst, MemView<TYPE>(same ? tmp : src), winSize);
+    }
 
-                for (int ky = 0; ky < winSize; ky++) {
-                    for (int kx = 0; kx < winSize; kx++) {
+    template <typename TYPE>
+    SP_CPUFUNC void minFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const int winSize) {
+        SP_ASSERT(checkPtr(src, 2) && winSize > 0);
 
-                        const TYPE &val = acs2(tmp, u + kx - offset, v + ky - offset);
-                        minv = minVal(minv, val);
-                    }
-                }
+        _filter::minmaxFilter(dst, src, winSize, false);
+    }
 
-                cnvVal(acs2(dst, u, v), minv);
-            }
-        }
+    template <typename TYPE>
+    SP_CPUFUNC void minFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        const bool same = (&dst == &src);
+        const Mem<TYPE> tmp = same ? clone(src) : Mem<TYPE>();
+        minFilter(dst, MemView<TYPE>(same ? tmp : src), winSize);
     }
 
 
@@ -338,7 +581,7 @@ namespace sp{
     //--------------------------------------------------------------------------------
 
     template <typename TYPE, typename TYPE0>
-    SP_CPUFUNC void laplacianFilter(Mem<TYPE> &dst, const Mem<TYPE0> &src, const double sigma = 0.8){
+    SP_CPUFUNC void laplacianFilter(Mem<TYPE> &dst, const MemView<TYPE0> &src, const double sigma = 0.8){
         SP_ASSERT(checkPtr(src, 2));
 
         const int half = maxVal(1, round((sigma - 0.8) / 0.3 + 1));
@@ -351,56 +594,34 @@ namespace sp{
             }
         }
 
-        filter(dst, src, kernel);
+        filter<TYPE, TYPE, TYPE0, TYPE0>(dst, src, kernel);
     }
 
     template <typename TYPE, typename TYPE0>
-    SP_CPUFUNC void laplacianFilter3x3(Mem<TYPE> &dst, const Mem<TYPE0> &src) {
-        SP_ASSERT(checkPtr(src, 2));
-
-        const Mem<TYPE0> &tmp = (reinterpret_cast<const Mem<TYPE0>*>(&dst) != &src) ? src : clone(src);
-
-        const int dsize0 = src.dsize[0];
-        const int dsize1 = src.dsize[1];
-        const int dsize[2] = { dsize0, dsize1 };
-
-        dst.resize(2, dsize);
-
-        const TYPE0 *psrc = tmp.ptr;
-        TYPE *pdst = dst.ptr;
-
-        for (int v = 0; v < dsize1; v++) {
-            const int v0 = v + ((v == 0) ? 0 : -1);
-            const int v1 = v + 0;
-            const int v2 = v + ((v == dsize1 - 1) ? 0 : +1);
-
-            const TYPE0 *psrc0 = &psrc[v0 * dsize0];
-            const TYPE0 *psrc1 = &psrc[v1 * dsize0];
-            const TYPE0 *psrc2 = &psrc[v2 * dsize0];
-
-            TYPE *pd = &pdst[v * dsize0];
+    SP_CPUFUNC void laplacianFilter(Mem<TYPE> &dst, const Mem<TYPE0> &src, const double sigma = 0.8){
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        laplacianFilter(dst, MemView<TYPE0>(same ? tmp : src), sigma);
+    }
 
-            for (int u = 0; u < dsize0; u++) {
-                const int u0 = u + ((u == 0) ? 0 : -1);
-                const int u1 = u + 0;
-                const int u2 = u + ((u == dsize0 - 1) ? 0 : +1);
+    template <typename TYPE, typename TYPE0>
+    SP_CPUFUNC void laplacianFilter3x3(Mem<TYPE> &dst, const MemView<TYPE0> &src) {
+        SP_ASSERT(checkPtr(src, 2));
 
-                const TYPE0 a00 = psrc0[u0];
-                const TYPE0 a01 = psrc0[u1];
-                const TYPE0 a02 = psrc0[u2];
+        // (8 * center - neighbors) / 16
+        Mem2<SP_REAL> kernel(3, 3);
+        for (int k = 0; k < 9; k++) {
+            kernel[k] = SP_CAST_REAL((k == 4) ? 8.0 : -1.0);
+        }
 
-                const TYPE0 a10 = psrc1[u0];
-                const TYPE0 a11 = psrc1[u1];
-                const TYPE0 a12 = psrc1[u2];
-                
-                const TYPE0 a20 = psrc2[u0];
-                const TYPE0 a21 = psrc2[u1];
-                const TYPE0 a22 = psrc2[u2];
+        filter<TYPE, TYPE, TYPE0, TYPE0>(dst, src, kernel, BorderClamp);
+    }
 
-                const double d = (8 * a11 - (a00 + a01 + a02 + a10 + a12 + a20 + a21 + a22)) / 16.0;
-                cnvVal(*pd++, d);
-            }
-        }
+    template <typename TYPE, typename TYPE0>
+    SP_CPUFUNC void laplacianFilter3x3(Mem<TYPE> &dst, const Mem<TYPE0> &src) {
+        const bool same = (reinterpret_cast<const Mem<TYPE0>*>(&dst) == &src);
+        const Mem<TYPE0> tmp = same ? clone(src) : Mem<TYPE0>();
+        laplacianFilter3x3(dst, MemView<TYPE0>(same ? tmp : src));
     }
 
     //--------------------------------------------------------------------------------
@@ -408,7 +629,7 @@ namespace sp{
     //--------------------------------------------------------------------------------
 
     template <typename TYPE, typename TYPE0>
-    SP_CPUFUNC void sobelFilter3x3(Mem<TYPE> &dX, Mem<TYPE> &dY, const Mem<TYPE0> &src) {
+    SP_CPUFUNC void sobelFilter3x3(Mem<TYPE> &dX, Mem<TYPE> &dY, const MemView<TYPE0> &src) {
         SP_ASSERT(checkPtr(src, 2));
 
         const int dsize0 = src.dsize[0];
@@ -418,7 +639,6 @@ namespace sp{
         dX.resize(2, dsize);
         dY.resize(2, dsize);
 
-        const TYPE0 *psrc = src.ptr;
         TYPE *pdx = dX.ptr;
         TYPE *pdy = dY.ptr;
 
@@ -427,9 +647,9 @@ namespace sp{
             const int v1 = v + 0;
             const int v2 = v + ((v == dsize1 - 1) ? 0 : +1);
 
-            const TYPE0 *psrc0 = &psrc[v0 * dsize0];
-            const TYPE0 *psrc1 = &psrc[v1 * dsize0];
-            const TYPE0 *psrc2 = &psrc[v2 * dsize0];
+            const TYPE0 *psrc0 = src.row(v0);
+            const TYPE0 *psrc1 = src.row(v1);
+            const TYPE0 *psrc2 = src.row(v2);
 
             for (int u = 0; u < dsize0; u++) {
                 const int u0 = u + ((u == 0) ? 0 : -1);
@@ -456,13 +676,18 @@ namespace sp{
             }
         }
     }
+
+    template <typename TYPE, typename TYPE0>
+    SP_CPUFUNC void sobelFilter3x3(Mem<TYPE> &dX, Mem<TYPE> &dY, const Mem<TYPE0> &src) {
+        sobelFilter3x3(dX, dY, MemView<TYPE0>(src));
+    }
  
     //--------------------------------------------------------------------------------
     // scharr filter 
     //--------------------------------------------------------------------------------
     
     template <typename TYPE, typename TYPE0>
-    SP_CPUFUNC void scharrFilter3x3(Mem<TYPE> &dX, Mem<TYPE> &dY, const Mem<TYPE0> &src) {
+    SP_CPUFUNC void scharrFilter3x3(Mem<TYPE> &dX, Mem<TYPE> &dY, const MemView<TYPE0> &src) {
         SP_ASSERT(checkPtr(src, 2));
 
         const int dsize0 = src.dsize[0];
@@ -472,7 +697,6 @@ namespace sp{
         dX.resize(2, dsize);
         dY.resize(2, dsize);
 
-        const TYPE0 *psrc = src.ptr;
         TYPE *pdx = dX.ptr;
         TYPE *pdy = dY.ptr;
 
@@ -481,9 +705,9 @@ namespace sp{
             const int v1 = v + 0;
             const int v2 = v + ((v == dsize1 - 1) ? 0 : +1);
 
-            const TYPE0 *psrc0 = &psrc[v0 * dsize0];
-            const TYPE0 *psrc1 = &psrc[v1 * dsize0];
-            const TYPE0 *psrc2 = &psrc[v2 * dsize0];
+            const TYPE0 *psrc0 = src.row(v0);
+            const TYPE0 *psrc1 = src.row(v1);
+            const TYPE0 *psrc2 = src.row(v2);
 
             for (int u = 0; u < dsize0; u++) {
                 const int u0 = u + ((u == 0) ? 0 : -1);
@@ -511,46 +735,226 @@ namespace sp{
         }
     }
 
+    template <typename TYPE, typename TYPE0>
+    SP_CPUFUNC void scharrFilter3x3(Mem<TYPE> &dX, Mem<TYPE> &dY, const Mem<TYPE0> &src) {
+        scharrFilter3x3(dX, dY, MemView<TYPE0>(src));
+    }
+
     //--------------------------------------------------------------------------------
     // median filter 
     //--------------------------------------------------------------------------------
 
-    template <typename TYPE, typename ELEM = TYPE>
-    SP_CPUFUNC void medianFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
-        SP_ASSERT(checkPtr(src, 2));
+    namespace _filter {
+
+        // k-th smallest value (list is reordered)
+        // hint : first pivot (e.g. the median of the neighbor window)
+        template <typename ELEM>
+        SP_CPUFUNC ELEM selectVal(ELEM *list, const int n, const int k, const ELEM *hint = NULL) {
+            int l = 0, r = n - 1;
+            while (l < r) {
+                const ELEM pivot = (hint != NULL) ? *hint : list[(l + r) / 2];
+                hint = NULL;
+
+                int i = l, j = r;
+                while (i <= j) {
+                    while (i <= r && list[i] < pivot) i++;
+                    while (j >= l && pivot < list[j]) j--;
+                    if (i <= j) {
+                        const ELEM t = list[i]; list[i] = list[j]; list[j] = t;
+                        i++; j--;
+                    }
+                }
+                if (k <= j) r = j;
+                else if (k >= i) l = i;
+                else break;
+            }
+            return list[k];
+        }
 
-        dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
+        // element view median (any element type)
+        template <typename ELEM>
+        SP_CPUFUNC void median(const MemView<ELEM> &dst, const MemView<ELEM> &src, const int ch, const int winSize) {
+            const int W = src.dsize[0] / ch;
+            const int H = src.dsize[1];
+            const int offset = winSize / 2;
+            const int N = winSize * winSize;
 
-        const int offset = winSize / 2;
-        const int ch = sizeof(TYPE) / sizeof(ELEM);
+            const int strips = (H + STRIP_ROWS - 1) / STRIP_ROWS;
 
-        Mem1<ELEM> list;
-        list.resize(winSize * winSize);
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int s = 0; s < strips; s++) {
+                Mem1<ELEM> list(N);
 
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
+                // clamped element offsets / rows
+                Mem1<int> xs(W + winSize - 1);
+                for (int i = 0; i < xs.size(); i++) {
+                    xs[i] = border(i - offset, W, BorderClamp) * ch;
+                }
+                Mem1<const ELEM*> rows(winSize);
 
-                for (int c = 0; c < ch; c++) {
+                const int v0 = s * STRIP_ROWS;
+                const int v1 = minVal(H, v0 + STRIP_ROWS);
+                for (int v = v0; v < v1; v++) {
                     for (int ky = 0; ky < winSize; ky++) {
+                        rows[ky] = src.row(border(v + ky - offset, H, BorderClamp));
+                    }
+
+                    ELEM *pd = dst.row(v);
+                    for (int u = 0; u < W; u++) {
+                        const int *px = &xs[u];
+                        for (int c = 0; c < ch; c++) {
+                            ELEM *pl = list.ptr;
+                            for (int ky = 0; ky < winSize; ky++) {
+                                const ELEM *ps = rows[ky] + c;
+                                for (int kx = 0; kx < winSize; kx++) {
+                                    *pl++ = ps[px[kx]];
+                                }
+                            }
+                            pd[u * ch + c] = selectVal(list.ptr, N, N / 2, (u > 0) ? &pd[(u - 1) * ch + c] : NULL);
+                        }
+                    }
+                }
+            }
+        }
+
+        // histogram (16 coarse + 256 fine bins, unsigned short)
+        static const int HIST_SIZE = 16 + 256;
+
+        // dst += src (sign > 0), dst -= src (sign < 0)
+        SP_CPUFUNC void updateHist(unsigned short *dst, const unsigned short *src, const int sign) {
+            int i = 0;
+#if SP_USE_AVX
+            for (; i + 16 <= HIST_SIZE; i += 16) {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&dst[i]));
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), (sign > 0) ? _mm256_add_epi16(a, b) : _mm256_sub_epi16(a, b));
+            }
+#elif SP_USE_SSE
+            for (; i + 8 <= HIST_SIZE; i += 8) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i]));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), (sign > 0) ? _mm_add_epi16(a, b) : _mm_sub_epi16(a, b));
+            }
+#endif
+            for (; i < HIST_SIZE; i++) {
+                dst[i] = static_cast<unsigned short>(dst[i] + sign * src[i]);
+            }
+        }
+
+        SP_CPUFUNC void countHist(unsigned short *hist, const Byte val, const int sign) {
+            hist[val >> 4] += sign;
+            hist[16 + val] += sign;
+        }
+
+        // k-th smallest value in histogram
+        SP_CPUFUNC Byte selectHist(const unsigned short *hist, const int k) {
+            int sum = 0;
+            int b = 0;
+            while (sum + hist[b] <= k) {
+                sum += hist[b++];
+            }
+
+            const unsigned short *fine = &hist[16 + b * 16];
+            int f = 0;
+            while (sum + fine[f] <= k) {
+                sum += fine[f++];
+            }
+            return static_cast<Byte>(b * 16 + f);
+        }
+
+        // Perreault-Hebert constant time median (column histograms slide down, kernel histogram slides right)
+        SP_CPUFUNC void median(const MemView<Byte> &dst, const MemView<Byte> &src, const int ch, const int winSize) {
+            const int N = winSize * winSize;
+            if (N > 0xFFFF) {
+                median<Byte>(dst, src, ch, winSize);
+                return;
+            }
+
+            const int W = src.dsize[0] / ch;
+            const int H = src.dsize[1];
+            const int E = W * ch;
+            const int offset = winSize / 2;
+
+            const int strips = (H + STRIP_ROWS - 1) / STRIP_ROWS;
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int s = 0; s < strips; s++) {
+                const int v0 = s * STRIP_ROWS;
+                const int v1 = minVal(H, v0 + STRIP_ROWS);
+
+                // column histograms
+                Mem1<unsigned short> cols(E * HIST_SIZE);
+                cols.zero();
+
+                for (int ky = 0; ky < winSize; ky++) {
+                    const Byte *ps = src.row(border(v0 + ky - offset, H, BorderClamp));
+                    for (int e = 0; e < E; e++) {
+                        countHist(&cols[e * HIST_SIZE], ps[e], +1);
+                    }
+                }
+
+                Mem1<unsigned short> hist(HIST_SIZE);
+
+                for (int v = v0; v < v1; v++) {
+                    if (v > v0) {
+                        const Byte *pp = src.row(border(v - 1 - offset, H, BorderClamp));
+                        const Byte *pn = src.row(border(v - 1 - offset + winSize, H, BorderClamp));
+                        for (int e = 0; e < E; e++) {
+                            countHist(&cols[e * HIST_SIZE], pp[e], -1);
+                            countHist(&cols[e * HIST_SIZE], pn[e], +1);
+                        }
+                    }
+
+                    Byte *pd = dst.row(v);
+                    for (int c = 0; c < ch; c++) {
+                        hist.zero();
                         for (int kx = 0; kx < winSize; kx++) {
-                            ELEM val = acs2<TYPE, ELEM>(src, u + kx - offset, v + ky - offset, c);
-                            list[ky * winSize + kx] = val;
+                            const int e = border(kx - offset, W, BorderClamp) * ch + c;
+                            updateHist(hist.ptr, &cols[e * HIST_SIZE], +1);
+                        }
+                        pd[c] = selectHist(hist.ptr, N / 2);
+
+                        for (int u = 1; u < W; u++) {
+                            const int ep = border(u - 1 - offset, W, BorderClamp) * ch + c;
+                            const int en = border(u - 1 - offset + winSize, W, BorderClamp) * ch + c;
+                            updateHist(hist.ptr, &cols[ep * HIST_SIZE], -1);
+                            updateHist(hist.ptr, &cols[en * HIST_SIZE], +1);
+                            pd[u * ch + c] = selectHist(hist.ptr, N / 2);
                         }
                     }
-                    acs2<TYPE, ELEM>(dst, u, v, c) = medianVal(list);
                 }
             }
         }
     }
 
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void medianFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const int winSize) {
+        SP_ASSERT(checkPtr(src, 2) && winSize > 0);
+
+        dst.resize(2, src.dsize);
+
+        const int ch = sizeof(TYPE) / sizeof(ELEM);
+        _filter::median(_filter::elemView<ELEM>(MemView<TYPE>(dst)), _filter::elemView<ELEM>(src), ch, winSize);
+    }
+
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void medianFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        const bool same = (&dst == &src);
+        const Mem<TYPE> tmp = same ? clone(src) : Mem<TYPE>();
+        medianFilter<TYPE, ELEM>(dst, MemView<TYPE>(same ? tmp : src), winSize);
+    }
+
 
     //--------------------------------------------------------------------------------
     // normalize filter 
     //--------------------------------------------------------------------------------
 
     template <typename TYPE, typename ELEM = TYPE>
-    SP_CPUFUNC void normalizeFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize, const int maxv = SP_BYTEMAX) {
+    SP_CPUFUNC void normalizeFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const int winSize, const int maxv = SP_BYTEMAX) {
         SP_ASSERT(checkPtr(src, 2));
 
         dst.resize(2, src.dsize);
@@ -562,8 +966,7 @@ namespace sp{
                 kernel(k) = SP_CAST_REAL(1.0);
             }
 
-            filterX<TYPE, ELEM>(tmp, src, kernel);
-            filterY<TYPE, ELEM>(tmp, tmp, kernel);
+            sepFilter<TYPE, ELEM>(tmp, src, kernel, kernel);
         }
 
         const int ch = sizeof(TYPE) / sizeof(ELEM);
@@ -578,17 +981,23 @@ namespace sp{
         }
     }
 
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void normalizeFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize, const int maxv = SP_BYTEMAX) {
+        const bool same = (&dst == &src);
+        const Mem<TYPE> tmp = same ? clone(src) : Mem<TYPE>();
+        normalizeFilter<TYPE, ELEM>(dst, MemView<TYPE>(same ? tmp : src), winSize, maxv);
+    }
+
 
     //--------------------------------------------------------------------------------
     //  bilateral filter 
     //--------------------------------------------------------------------------------
 
     template <typename TYPE, typename ELEM = TYPE>
-    SP_CPUFUNC void bilateralFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const double sigma_s, const double sigma_c){
+    SP_CPUFUNC void bilateralFilter(Mem<TYPE> &dst, const MemView<TYPE> &src, const double sigma_s, const double sigma_c){
         SP_ASSERT(checkPtr(src, 2));
 
         dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
 
         const int half = maxVal(1, round((sigma_s - 0.8) / 0.3 + 1));
 
@@ -619,14 +1028,14 @@ namespace sp{
             for (int u = 0; u < dst.dsize[0]; u++){
 
                 for (int c = 0; c < ch; c++) {
-                    const ELEM base = acs2<TYPE, ELEM>(tmp, u, v, c);
+                    const ELEM base = acs2<TYPE, ELEM>(src, u, v, c);
 
                     SP_REAL sum = 0.0, div = 0.0;
                     for (int ky = -half; ky <= +half; ky++){
                         for (int kx = -half; kx <= +half; kx++){
                             if (inRect(rect, u + kx, v + ky) == false) continue;
 
-                            const ELEM &val = acs2<TYPE, ELEM>(tmp, u + kx, v + ky, c);
+                            const ELEM &val = acs2<TYPE, ELEM>(src, u + kx, v + ky, c);
 
                             const SP_REAL a = kernel(kx + half, ky + half);
                             const SP_REAL b = exptable(round(fabs(val - base) * expscale / sigma_c));
@@ -642,6 +1051,13 @@ namespace sp{
         }
     }
 
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void bilateralFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const double sigma_s, const double sigma_c){
+        const bool same = (&dst == &src);
+        const Mem<TYPE> tmp = same ? clone(src) : Mem<TYPE>();
+        bilateralFilter<TYPE, ELEM>(dst, MemView<TYPE>(same ? tmp : src), sigma_s, sigma_c);
+    }
+
 }
 
 #endif
\ No newline at end of file
@@ -338,6 +338,246 @@ namespace sp{
 
     }
 
+    //--------------------------------------------------------------------------------
+    // remap (fixed-point table)
+    //--------------------------------------------------------------------------------
+
+    // fixed-point remap table (6 bytes / pixel)
+    class RemapTable {
+    public:
+        // sub pixel bits
+        static const int BITS = 7;
+        static const int ONE = 1 << BITS;
+
+        // top-left src index of bilinear (-1 : outside)
+        Mem2<int> idx;
+
+        // bilinear weight (wx | wy << 8, 0 <= wx, wy <= ONE)
+        Mem2<unsigned short> wgt;
+
+    public:
+
+        // table : offset (src - dst) of each pixel
+        void set(const Mem<Vec2> &table, const bool useExt = false) {
+            SP_ASSERT(checkPtr(table, 2));
+            SP_ASSERT(table.dsize[0] >= 2 && table.dsize[1] >= 2);
+
+            idx.resize(table.dsize);
+            wgt.resize(table.dsize);
+
+            const int W = table.dsize[0];
+            const int H = table.dsize[1];
+            const Rect2 rect = getRect2(table.dsize);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int v = 0; v < H; v++) {
+                for (int u = 0; u < W; u++) {
+                    const Vec2 &vec = acs2(table, u, v);
+                    const SP_REAL x = u + vec.x;
+                    const SP_REAL y = v + vec.y;
+
+                    if (x != x || y != y || (useExt == false && inRect(rect, x, y) == false)) {
+                        idx(u, v) = -1;
+                        wgt(u, v) = 0;
+                        continue;
+                    }
+
+                    const int fx = round(maxVal(0.0, minVal(W - 1.0, x)) * ONE);
+                    const int fy = round(maxVal(0.0, minVal(H - 1.0, y)) * ONE);
+
+                    // keep (x + 1, y + 1) inside of src
+                    int ix = fx >> BITS;
+                    int iy = fy >> BITS;
+                    int wx = fx & (ONE - 1);
+                    int wy = fy & (ONE - 1);
+                    if (ix > W - 2) { ix = W - 2; wx = ONE; }
+                    if (iy > H - 2) { iy = H - 2; wy = ONE; }
+
+                    idx(u, v) = iy * W + ix;
+                    wgt(u, v) = static_cast<unsigned short>(wx | (wy << 8));
+                }
+            }
+        }
+    };
+
+    namespace _remap {
+
+        SP_CPUFUNC Byte lerp(const Byte *p0, const Byte *p1, const int ch, const int wx, const int wy) {
+            const int ONE = RemapTable::ONE;
+            const int t = p0[0] * (ONE - wx) + p0[ch] * wx;
+            const int b = p1[0] * (ONE - wx) + p1[ch] * wx;
+            return static_cast<Byte>((t * (ONE - wy) + b * wy + (ONE * ONE / 2)) >> (2 * RemapTable::BITS));
+        }
+
+#if SP_USE_SSE
+        SP_CPUFUNC short load2(const Byte *p) {
+            unsigned short v;
+            memcpy(&v, p, 2);
+            return static_cast<short>(v);
+        }
+
+        // 1ch x 8 pixels
+        SP_CPUFUNC void lerp8(Byte *dst, const Byte *src, const int W, const int *idx, const unsigned short *wgt) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i one = _mm_set1_epi16(RemapTable::ONE);
+
+            int o[8];
+            for (int i = 0; i < 8; i++) {
+                o[i] = maxVal(idx[i], 0);
+            }
+
+            // (p00, p10), (p01, p11)
+            const __m128i t = _mm_setr_epi16(load2(src + o[0]), load2(src + o[1]), load2(src + o[2]), load2(src + o[3]),
+                load2(src + o[4]), load2(src + o[5]), load2(src + o[6]), load2(src + o[7]));
+            const __m128i b = _mm_setr_epi16(load2(src + o[0] + W), load2(src + o[1] + W), load2(src + o[2] + W), load2(src + o[3] + W),
+                load2(src + o[4] + W), load2(src + o[5] + W), load2(src + o[6] + W), load2(src + o[7] + W));
+
+            const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wgt));
+            const __m128i wx = _mm_and_si128(w, _mm_set1_epi16(0xFF));
+            const __m128i wy = _mm_srli_epi16(w, 8);
+
+            const __m128i hx0 = _mm_unpacklo_epi16(_mm_sub_epi16(one, wx), wx);
+            const __m128i hx1 = _mm_unpackhi_epi16(_mm_sub_epi16(one, wx), wx);
+            const __m128i vy0 = _mm_unpacklo_epi16(_mm_sub_epi16(one, wy), wy);
+            const __m128i vy1 = _mm_unpackhi_epi16(_mm_sub_epi16(one, wy), wy);
+
+            // horizontal (<= 255 * ONE)
+            const __m128i ht = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(t, zero), hx0), _mm_madd_epi16(_mm_unpackhi_epi8(t, zero), hx1));
+            const __m128i hb = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(b, zero), hx0), _mm_madd_epi16(_mm_unpackhi_epi8(b, zero), hx1));
+
+            // vertical
+            const __m128i rnd = _mm_set1_epi32(RemapTable::ONE * RemapTable::ONE / 2);
+            const __m128i r0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(ht, hb), vy0), rnd), 2 * RemapTable::BITS);
+            const __m128i r1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(ht, hb), vy1), rnd), 2 * RemapTable::BITS);
+
+            // outside -> 0
+            const __m128i m0 = _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(idx + 0)), zero);
+            const __m128i m1 = _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(idx + 4)), zero);
+            const __m128i r = _mm_andnot_si128(_mm_packs_epi32(m0, m1), _mm_packs_epi32(r0, r1));
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(r, r));
+        }
+
+        // 3ch x 2 pixels
+        SP_CPUFUNC void lerp2c3(Byte *dst, const Byte *src, const int W, const int *idx, const unsigned short *wgt) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i one = _mm_set1_epi16(RemapTable::ONE);
+
+            // (r0 g0 b0 r1 g1 b1 - -) of top / bottom row
+            __m128i t[2], b[2];
+            for (int i = 0; i < 2; i++) {
+                const Byte *p0 = src + maxVal(idx[i], 0) * 3;
+                const Byte *p1 = p0 + W * 3;
+                t[i] = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p0)), zero);
+                b[i] = _mm_unpacklo_epi8(_mm_srli_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p1 - 2)), 16), zero);
+            }
+
+            const int wx0 = wgt[0] & 0xFF, wy0 = wgt[0] >> 8;
+            const int wx1 = wgt[1] & 0xFF, wy1 = wgt[1] >> 8;
+            const __m128i wx = _mm_setr_epi16(wx0, wx0, wx0, wx0, wx1, wx1, wx1, wx1);
+            const __m128i iwx = _mm_sub_epi16(one, wx);
+
+            const __m128i p00 = _mm_unpacklo_epi64(t[0], t[1]);
+            const __m128i p10 = _mm_unpacklo_epi64(_mm_srli_si128(t[0], 6), _mm_srli_si128(t[1], 6));
+            const __m128i p01 = _mm_unpacklo_epi64(b[0], b[1]);
+            const __m128i p11 = _mm_unpacklo_epi64(_mm_srli_si128(b[0], 6), _mm_srli_si128(b[1], 6));
+
+            // horizontal (<= 255 * ONE)
+            const __m128i ht = _mm_add_epi16(_mm_mullo_epi16(p00, iwx), _mm_mullo_epi16(p10, wx));
+            const __m128i hb = _mm_add_epi16(_mm_mullo_epi16(p01, iwx), _mm_mullo_epi16(p11, wx));
+
+            // vertical
+            const __m128i rnd = _mm_set1_epi32(RemapTable::ONE * RemapTable::ONE / 2);
+            const __m128i vy0 = _mm_set1_epi32((wy0 << 16) | (RemapTable::ONE - wy0));
+            const __m128i vy1 = _mm_set1_epi32((wy1 << 16) | (RemapTable::ONE - wy1));
+            const __m128i r0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(ht, hb), vy0), rnd), 2 * RemapTable::BITS);
+            const __m128i r1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(ht, hb), vy1), rnd), 2 * RemapTable::BITS);
+
+            // outside -> 0
+            const short m0 = (idx[0] < 0) ? -1 : 0;
+            const short m1 = (idx[1] < 0) ? -1 : 0;
+            const __m128i m = _mm_setr_epi16(m0, m0, m0, m0, m1, m1, m1, m1);
+            const __m128i r = _mm_andnot_si128(m, _mm_packs_epi32(r0, r1));
+            const __m128i c = _mm_packus_epi16(r, r);
+
+            // 4th byte of 1st pixel is overwritten by 2nd pixel
+            const int c0 = _mm_cvtsi128_si32(c);
+            const int c1 = _mm_cvtsi128_si32(_mm_srli_si128(c, 4));
+            memcpy(dst + 0, &c0, 4);
+            memcpy(dst + 3, &c1, 3);
+        }
+#endif
+
+        // ch : 1 or 3
+        SP_CPUFUNC void remapRow(Byte *dst, const Byte *src, const int W, const int ch, const int *idx, const unsigned short *wgt) {
+            int u = 0;
+#if SP_USE_SSE
+            if (ch == 1) {
+                for (; u + 8 <= W; u += 8) {
+                    lerp8(dst + u, src, W, idx + u, wgt + u);
+                }
+            }
+            if (ch == 3) {
+                for (; u + 2 <= W; u += 2) {
+                    lerp2c3(dst + u * 3, src, W, idx + u, wgt + u);
+                }
+            }
+#endif
+            for (; u < W; u++) {
+                if (idx[u] < 0) {
+                    for (int c = 0; c < ch; c++) {
+                        dst[u * ch + c] = 0;
+                    }
+                    continue;
+                }
+
+                const Byte *p0 = src + idx[u] * ch;
+                const Byte *p1 = p0 + W * ch;
+                const int wx = wgt[u] & 0xFF;
+                const int wy = wgt[u] >> 8;
+                for (int c = 0; c < ch; c++) {
+                    dst[u * ch + c] = lerp(p0 + c, p1 + c, ch, wx, wy);
+                }
+            }
+        }
+
+        SP_CPUFUNC void remap(Byte *dst, const Byte *src, const int *dsize, const int ch, const RemapTable &table) {
+            SP_PROFILE_SCOPE("remap");
+            SP_PROFILE_COUNT("pixels", dsize[0] * dsize[1]);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int v = 0; v < dsize[1]; v++) {
+                const int *idx = &table.idx(0, v);
+                const unsigned short *wgt = &table.wgt(0, v);
+                remapRow(dst + v * dsize[0] * ch, src, dsize[0], ch, idx, wgt);
+            }
+        }
+    }
+
+    SP_CPUFUNC void remap(Mem<Byte> &dst, const Mem<Byte> &src, const RemapTable &table) {
+        SP_ASSERT(checkPtr(src, 2));
+        SP_ASSERT(cmp(src.dsize, table.idx.dsize, 2));
+
+        const Mem<Byte> &tmp = (&dst != &src) ? src : clone(src);
+        dst.resize(2, tmp.dsize);
+
+        _remap::remap(dst.ptr, tmp.ptr, tmp.dsize, 1, table);
+    }
+
+    SP_CPUFUNC void remap(Mem<Col3> &dst, const Mem<Col3> &src, const RemapTable &table) {
+        SP_ASSERT(checkPtr(src, 2));
+        SP_ASSERT(cmp(src.dsize, table.idx.dsize, 2));
+
+        const Mem<Col3> &tmp = (&dst != &src) ? src : clone(src);
+        dst.resize(2, tmp.dsize);
+
+        _remap::remap(reinterpret_cast<Byte*>(dst.ptr), reinterpret_cast<const Byte*>(tmp.ptr), tmp.dsize, 3, table);
+    }
+
     //--------------------------------------------------------------------------------
     // warp
     //--------------------------------------------------------------------------------
@@ -386,6 +626,22 @@ namespace sp{
             dst[i] = cast<DST>(src[i]);
         }
     }
+
+    template<typename DST, typename SRC>
+    SP_CPUFUNC void cnvImg(Mem<DST> &dst, const MemView<SRC> &src){
+        SP_ASSERT(checkPtr(src, 2));
+
+        dst.resize(2, src.dsize);
+
+        for (int v = 0; v < dst.dsize[1]; v++){
+            const SRC *psrc = src.row(v);
+            DST *pdst = &dst.ptr[v * dst.dsize[0]];
+
+            for (int u = 0; u < dst.dsize[0]; u++){
+                pdst[u] = cast<DST>(psrc[u]);
+            }
+        }
+    }
         
     template <typename TYPE0, typename TYPE1>
     SP_CPUFUNC void cnvDepthToImg(Mem<TYPE0> &dst, const Mem<TYPE1> &src, const double nearPlane = 100.0, const double farPlane = 10000.0){
@@ -459,26 +715,24 @@ namespace sp{
         }
     }
 
+    // pitch : row pitch (bytes, 0 : no padding)
     template<typename TYPE>
-    SP_CPUFUNC void cnvPtrToImg(Mem<TYPE> &dst, const void *src, const int dsize0, const int dsize1, const int ch){
+    SP_CPUFUNC void cnvPtrToImg(Mem<TYPE> &dst, const void *src, const int dsize0, const int dsize1, const int ch, const int pitch = 0){
 
         switch (ch) {
         case 1:
         {
-            Mem2<Byte> gry(dsize0, dsize1, src);
-            cnvImg(dst, gry);
+            cnvImg(dst, MemView<Byte>(src, dsize0, dsize1, pitch));
             break;
         }
         case 3:
         {
-            Mem2<Col3> col(dsize0, dsize1, src);
-            cnvImg(dst, col);
+            cnvImg(dst, MemView<Col3>(src, dsize0, dsize1, pitch));
             break;
         }
         case 4:
         {
-            Mem2<Col4> col(dsize0, dsize1, src);
-            cnvImg(dst, col);
+            cnvImg(dst, MemView<Col4>(src, dsize0, dsize1, pitch));
             break;
         }
         default:
@@ -348,94 +348,308 @@ namespace sp{
     // render geom
     //--------------------------------------------------------------------------------
     
-    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mesh3 &mesh) {
+    namespace _render {
 
-        if (cmp(dst.dsize, cam.dsize, 2) == false) {
-            dst.resize(2, cam.dsize);
-            dst.zero();
+        // tile size (pixel)
+        const int TILE = 32;
+
+        struct Triangle {
+            // edge function s[k] = dot((npx.x, npx.y, 1.0), edge[k]), inside if s[k] >= 0 for all k
+            Vec3 edge[3];
+
+            // depth = area / (s[0] + s[1] + s[2])
+            double area;
+
+            Vec3 nrm;
+
+            // pixel range [xs, xe] x [ys, ye]
+            int xs, xe, ys, ye;
+        };
+
+        struct Tile {
+            int xs, xe, ys, ye;
+
+            SP_REAL zbuf[TILE * TILE];
+            int ibuf[TILE * TILE];
+
+            // undistorted npx (distorted camera only)
+            bool dist;
+            Vec2 npxs[TILE * TILE];
+        };
+
+        SP_CPUFUNC bool isDist(const CamParam &cam) {
+            return cam.k1 != 0.0 || cam.k2 != 0.0 || cam.k3 != 0.0 || cam.p1 != 0.0 || cam.p2 != 0.0;
         }
 
-        Rect2 rect;
+        // triangle setup (homogeneous edge functions, vertices behind the camera need no clipping)
+        SP_CPUFUNC bool setup(Triangle &tri, const CamParam &cam, const bool dist, const Mesh3 &pm) {
+            const Vec3 n0 = crsVec(pm.pos[1], pm.pos[2]);
+            const Vec3 n1 = crsVec(pm.pos[2], pm.pos[0]);
+            const Vec3 n2 = crsVec(pm.pos[0], pm.pos[1]);
 
-        const Mesh3 pm = pose * mesh;
-        {
-            int xs = dst.dsize[0];
-            int xe = 0;
+            // the plane passes through the camera center
+            const double det = dotVec(pm.pos[0], n0);
+            if (fabs(det) < SP_SMALL) return false;
 
-            int ys = dst.dsize[1];
-            int ye = 0;
+            const double sgn = (det > 0.0) ? +1.0 : -1.0;
+            tri.edge[0] = n0 * sgn;
+            tri.edge[1] = n1 * sgn;
+            tri.edge[2] = n2 * sgn;
+            tri.area = fabs(det);
 
-            bool valid = false;
+            // pixel range of the part in front of the camera
+            int cnt = 0;
+            Vec2 pmin = getVec2(+SP_INFINITY, +SP_INFINITY);
+            Vec2 pmax = getVec2(-SP_INFINITY, -SP_INFINITY);
             for (int i = 0; i < 3; i++) {
-                if (pm.pos[i].z < SP_SMALL) continue;
+                const Vec3 &a = pm.pos[i];
+                const Vec3 &b = pm.pos[(i + 1) % 3];
 
-                valid |= true;
+                Vec3 pnts[2];
+                int num = 0;
+                if (a.z >= SP_SMALL) {
+                    pnts[num++] = a;
+                }
+                if ((a.z < SP_SMALL) != (b.z < SP_SMALL)) {
+                    pnts[num++] = a + (b - a) * ((SP_SMALL - a.z) / (b.z - a.z));
+                }
+                for (int j = 0; j < num; j++) {
+                    const Vec2 npx = getVec2(pnts[j].x / pnts[j].z, pnts[j].y / pnts[j].z);
+                    const Vec2 pix = (dist == true) ? mulCamD(cam, npx) : mulCam(cam, npx);
+                    pmin = getVec2(minVal(pmin.x, pix.x), minVal(pmin.y, pix.y));
+                    pmax = getVec2(maxVal(pmax.x, pix.x), maxVal(pmax.y, pix.y));
+                }
+                cnt += (a.z >= SP_SMALL) ? 1 : 0;
+            }
+            if (cnt == 0) return false;
 
-                const Vec2 pix = mulCamD(cam, prjVec(pm.pos[i]));
+            // the distortion model is not valid far outside of the image
+            if (cnt < 3 && dist == true) {
+                pmin = getVec2(0.0, 0.0);
+                pmax = getVec2(cam.dsize[0] - 1.0, cam.dsize[1] - 1.0);
+            }
 
-                xs = minVal(xs, floor(pix.x + 1));
-                xe = maxVal(xe, floor(pix.x + 1));
+            if (pmax.x < 0.0 || pmin.x > cam.dsize[0] - 1.0) return false;
+            if (pmax.y < 0.0 || pmin.y > cam.dsize[1] - 1.0) return false;
 
-                ys = minVal(ys, floor(pix.y + 1));
-                ye = maxVal(ye, floor(pix.y + 1));
-            }
-            if (valid == false) return;
+            tri.xs = floor(maxVal(pmin.x, 0.0));
+            tri.ys = floor(maxVal(pmin.y, 0.0));
+            tri.xe = floor(minVal(pmax.x, cam.dsize[0] - 1.0));
+            tri.ye = floor(minVal(pmax.y, cam.dsize[1] - 1.0));
 
-            rect = andRect(getRect2(dst.dsize), getRect2(xs, ys, xe - xs, ye - ys));
+            // (p1 - p0) x (p2 - p0)
+            tri.nrm = unitVec(n0 + n1 + n2);
+            return true;
         }
 
-        const Vec3 nrm = getMeshNrm(pm);
+        // false if the triangle misses the pixel range (undistorted camera)
+        SP_CPUFUNC bool overlap(const Triangle &tri, const CamParam &cam, const int xs, const int xe, const int ys, const int ye) {
+            const double x0 = (xs - cam.cx) / cam.fx;
+            const double x1 = (xe - cam.cx) / cam.fx;
+            const double y0 = (ys - cam.cy) / cam.fy;
+            const double y1 = (ye - cam.cy) / cam.fy;
+
+            for (int k = 0; k < 3; k++) {
+                const Vec3 &e = tri.edge[k];
+                if (e.z + maxVal(e.x * x0, e.x * x1) + maxVal(e.y * y0, e.y * y1) < 0.0) return false;
+            }
+            return true;
+        }
+
+        SP_CPUFUNC bool overlap(const Triangle &tri, const CamParam &cam, const bool dist, const int tx, const int ty) {
+            const int xs = maxVal(tri.xs, tx * TILE);
+            const int xe = minVal(tri.xe, tx * TILE + TILE - 1);
+            const int ys = maxVal(tri.ys, ty * TILE);
+            const int ye = minVal(tri.ye, ty * TILE + TILE - 1);
+
+            // small triangle
+            if (dist == true || (xs == tri.xs && xe == tri.xe && ys == tri.ys && ye == tri.ye)) return true;
+
+            return overlap(tri, cam, xs, xe, ys, ye);
+        }
+
+        SP_CPUFUNC void raster(Tile &tile, const int id, const Triangle &tri, const CamParam &cam) {
+            const int xs = maxVal(tile.xs, tri.xs);
+            const int xe = minVal(tile.xe, tri.xe);
+            const int ys = maxVal(tile.ys, tri.ys);
+            const int ye = minVal(tile.ye, tri.ye);
+            if (xs > xe || ys > ye) return;
+
+            for (int v = ys; v <= ye; v++) {
+                SP_REAL *zbuf = &tile.zbuf[(v - tile.ys) * TILE - tile.xs];
+                int *ibuf = &tile.ibuf[(v - tile.ys) * TILE - tile.xs];
+
+                if (tile.dist == false) {
+                    // s[k] = a[k] + b[k] * u, the span is solved per row
+                    const double npy = (v - cam.cy) / cam.fy;
+
+                    double lo = xs;
+                    double hi = xe;
+                    double sa = 0.0;
+                    double sb = 0.0;
+                    for (int k = 0; k < 3; k++) {
+                        const Vec3 &e = tri.edge[k];
+                        const double b = e.x / cam.fx;
+                        const double a = e.y * npy + e.z - b * cam.cx;
+                        if (b > 0.0) {
+                            lo = maxVal(lo, -a / b);
+                        }
+                        else if (b < 0.0) {
+                            hi = minVal(hi, -a / b);
+                        }
+                        else if (a < 0.0) {
+                            hi = lo - 1.0;
+                        }
+                        sa += a;
+                        sb += b;
+                    }
+                    if (lo > hi) continue;
+
+                    // lo >= 0
+                    const int us = floor(lo) + ((floor(lo) < lo) ? 1 : 0);
+                    const int ue = floor(hi);
+                    for (int u = us; u <= ue; u++) {
+                        // area / w < zbuf[u]
+                        const double w = sa + sb * u;
+                        if (w <= 0.0 || tri.area >= w * zbuf[u]) continue;
+
+                        zbuf[u] = tri.area / w;
+                        ibuf[u] = id;
+                    }
+                }
+                else {
+                    const Vec2 *npx = &tile.npxs[(v - tile.ys) * TILE - tile.xs];
+                    for (int u = xs; u <= xe; u++) {
+                        const double s0 = tri.edge[0].x * npx[u].x + tri.edge[0].y * npx[u].y + tri.edge[0].z;
+                        const double s1 = tri.edge[1].x * npx[u].x + tri.edge[1].y * npx[u].y + tri.edge[1].z;
+                        const double s2 = tri.edge[2].x * npx[u].x + tri.edge[2].y * npx[u].y + tri.edge[2].z;
+                        if (s0 < 0.0 || s1 < 0.0 || s2 < 0.0) continue;
+
+                        // area / w < zbuf[u]
+                        const double w = s0 + s1 + s2;
+                        if (w <= 0.0 || tri.area >= w * zbuf[u]) continue;
+
+                        zbuf[u] = tri.area / w;
+                        ibuf[u] = id;
+                    }
+                }
+            }
+        }
+    }
 
-        const Vec3 base = pm.pos[0];
-        const Vec3 A = pm.pos[1] - base;
-        const Vec3 B = pm.pos[2] - base;
+    // tile binned rasterizer (triangles are kept in order in each tile, the first one wins on a tie)
+    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mem<Mesh3> &meshes) {
+        const int TILE = _render::TILE;
 
-        SP_REAL mat[3 * 3] = { -A.x, -B.x, 0.0, -A.y, -B.y, 0.0, -A.z, -B.z, 0.0 };
-        SP_REAL val[3] = { base.x, base.y, base.z };
+        if (cmp(dst.dsize, cam.dsize, 2) == false) {
+            dst.resize(2, cam.dsize);
+            dst.zero();
+        }
 
-        for (int v = rect.dbase[1]; v < rect.dbase[1] + rect.dsize[1]; v++) {
-            for (int u = rect.dbase[0]; u < rect.dbase[0] + rect.dsize[0]; u++) {
-                const Vec2 prj = npxUndist(cam, invCam(cam, getVec2(u, v)));
-                const Vec3 vec = getVec3(prj.x, prj.y, 1.0);
+        const bool dist = _render::isDist(cam);
 
-                mat[0 * 3 + 2] = vec.x;
-                mat[1 * 3 + 2] = vec.y;
-                mat[2 * 3 + 2] = vec.z;
+        // triangle setup
+        Mem1<_render::Triangle> tris(meshes.size());
+        Mem1<bool> valids(meshes.size());
+        {
+            SP_REAL poseMat[3 * 4];
+            getMat(poseMat, 3, 4, pose);
 
-                SP_REAL inv[3 * 3];
-                if (invMat33(inv, mat) == false) continue;
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int i = 0; i < meshes.size(); i++) {
+                valids[i] = _render::setup(tris[i], cam, dist, mulMat(poseMat, 3, 4, meshes[i]));
+            }
+        }
 
-                SP_REAL result[3];
-                mulMat(result, 3, 1, inv, 3, 3, val, 3, 1);
+        // bin triangles into tiles
+        const int tw = (cam.dsize[0] + TILE - 1) / TILE;
+        const int th = (cam.dsize[1] + TILE - 1) / TILE;
 
-                if (result[0] < 0.0 || result[1] < 0.0 || result[0] + result[1] > 1.0) continue;
+        Mem1<int> heads(tw * th + 1);
+        heads.zero();
+        for (int i = 0; i < tris.size(); i++) {
+            if (valids[i] == false) continue;
 
-                const SP_REAL depth = result[2];
-                if (depth < SP_SMALL) continue;
+            const _render::Triangle &tri = tris[i];
+            for (int y = tri.ys / TILE; y <= tri.ye / TILE; y++) {
+                for (int x = tri.xs / TILE; x <= tri.xe / TILE; x++) {
+                    if (_render::overlap(tri, cam, dist, x, y) == false) continue;
+                    heads[y * tw + x + 1]++;
+                }
+            }
+        }
+        for (int t = 0; t < tw * th; t++) {
+            heads[t + 1] += heads[t];
+        }
 
-                const SP_REAL ref = extractZ(acs2(dst, u, v));
-                if (ref == 0.0 || depth < ref) {
-                    acs2(dst, u, v) = getVecPD3(vec * depth, nrm);
+        Mem1<int> bins(heads[tw * th]);
+        {
+            Mem1<int> cnts(tw * th, heads.ptr);
+            for (int i = 0; i < tris.size(); i++) {
+                if (valids[i] == false) continue;
+
+                const _render::Triangle &tri = tris[i];
+                for (int y = tri.ys / TILE; y <= tri.ye / TILE; y++) {
+                    for (int x = tri.xs / TILE; x <= tri.xe / TILE; x++) {
+                        if (_render::overlap(tri, cam, dist, x, y) == false) continue;
+                        bins[cnts[y * tw + x]++] = i;
+                    }
                 }
             }
         }
 
-    }
+        // rasterize tiles (per tile z-buffer)
+#if SP_USE_OMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int t = 0; t < tw * th; t++) {
+            if (heads[t] == heads[t + 1]) continue;
+
+            _render::Tile tile;
+            tile.xs = (t % tw) * TILE;
+            tile.ys = (t / tw) * TILE;
+            tile.xe = minVal(tile.xs + TILE, cam.dsize[0]) - 1;
+            tile.ye = minVal(tile.ys + TILE, cam.dsize[1]) - 1;
+            tile.dist = dist;
+
+            for (int v = tile.ys; v <= tile.ye; v++) {
+                for (int u = tile.xs; u <= tile.xe; u++) {
+                    const int i = (v - tile.ys) * TILE + (u - tile.xs);
+                    const SP_REAL ref = extractZ(acs2(dst, u, v));
+                    tile.zbuf[i] = (ref == 0.0) ? SP_INFINITY : ref;
+                    tile.ibuf[i] = -1;
+
+                    tile.npxs[i] = (dist == true) ? npxUndist(cam, invCam(cam, getVec2(u, v))) : invCam(cam, getVec2(u, v));
+                }
+            }
 
-    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mem<Mesh3> &meshes) {
+            for (int b = heads[t]; b < heads[t + 1]; b++) {
+                _render::raster(tile, bins[b], tris[bins[b]], cam);
+            }
+
+            for (int v = tile.ys; v <= tile.ye; v++) {
+                for (int u = tile.xs; u <= tile.xe; u++) {
+                    const int i = (v - tile.ys) * TILE + (u - tile.xs);
+                    if (tile.ibuf[i] < 0) continue;
 
-        for (int i = 0; i < meshes.size(); i++) {
-            renderVecPD(dst, cam, pose, meshes[i]);
+                    const Vec2 &npx = tile.npxs[i];
+                    acs2(dst, u, v) = getVecPD3(getVec3(npx.x, npx.y, 1.0) * tile.zbuf[i], tris[tile.ibuf[i]].nrm);
+                }
+            }
         }
     }
 
+    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mesh3 &mesh) {
+        renderVecPD(dst, cam, pose, Mem1<Mesh3>(1, &mesh));
+    }
+
     template<typename DEPTH>
     SP_CPUFUNC void renderDepth(Mem<DEPTH> &dst, const CamParam &cam, const Pose &pose, const Mem<Mesh3> &meshes) {
 
         Mem<VecPD3> pnmap;
-        for (int i = 0; i < meshes.size(); i++) {
-            renderVecPD(pnmap, cam, pose, meshes[i]);
-        }
+        renderVecPD(pnmap, cam, pose, meshes);
 
         dst.resize(2, cam.dsize);
         for (int i = 0; i < dst.size(); i++) {
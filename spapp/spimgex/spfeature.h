@@ -343,34 +343,615 @@ namespace sp {
         return id;
     }
 
-    SP_CPUFUNC Mem1<int> findMatch(const Mem1<Ftr> &ftrs0, const Mem1<Ftr> &ftrs1, const bool crossCheck = true) {
-        Mem1<int> matches(ftrs0.size());
+    //--------------------------------------------------------------------------------
+    // descriptor matrix (packed descriptors for batched matching)
+    //--------------------------------------------------------------------------------
 
-//#if SP_USE_OMP
-//#pragma omp parallel for
-//#endif
-        for (int i = 0; i < ftrs0.size(); i++) {
-            matches[i] = -1;
+    class DscMat {
 
-            int j, k;
-            {
-                j = findMatch(ftrs0[i], ftrs1);
-                if (j < 0) continue;
+    public:
+        // descriptor num
+        int num;
+
+        // descriptor dim
+        int dim;
+
+        // binary size [byte]
+        int bsize;
+
+        // binary size [64bit word]
+        int wsize;
+
+        // real value (num x dim)
+        Mem1<float> val;
+
+        // binary (num x wsize)
+        Mem1<unsigned long long> bin;
+
+        // contrast
+        Mem1<SP_REAL> cst;
+
+        // descripter type
+        Mem1<Dsc::Type> type;
+
+        DscMat() {
+            clear();
+        }
+
+        DscMat(const Mem1<Ftr> &ftrs) {
+            set(ftrs);
+        }
+
+        void clear() {
+            num = 0;
+
+            // SIFT / CFBlob dim = 128
+            dim = 128;
+
+            bsize = 0;
+            wsize = 0;
+
+            val.clear();
+            bin.clear();
+            cst.clear();
+            type.clear();
+        }
+
+        void set(const Mem1<Ftr> &ftrs) {
+            clear();
+
+            for (int i = 0; i < ftrs.size(); i++) {
+                bsize = maxVal(bsize, ftrs[i].dsc.bin.size());
             }
+            wsize = (bsize + 7) / 8;
 
-            // cross check
-            if (crossCheck == true) 
-            {
-                k = findMatch(ftrs1[j], ftrs0);
-                if (k != i) continue;
+            val.reserve(ftrs.size() * dim);
+            bin.reserve(ftrs.size() * wsize);
+            cst.reserve(ftrs.size());
+            type.reserve(ftrs.size());
+
+            for (int i = 0; i < ftrs.size(); i++) {
+                push(ftrs[i]);
+            }
+        }
+
+        void push(const Ftr &ftr) {
+            if (num == 0 && bsize == 0) {
+                bsize = ftr.dsc.bin.size();
+                wsize = (bsize + 7) / 8;
+            }
+
+            val.extend(dim);
+            if (wsize > 0) {
+                bin.extend(wsize);
+            }
+            cst.extend();
+            type.extend();
+
+            set(num++, ftr);
+        }
+
+        // overwrite descriptor (id < num)
+        void set(const int id, const Ftr &ftr) {
+            const Dsc &dsc = ftr.dsc;
+
+            const bool valid = (dsc.val.size() >= dim * static_cast<int>(sizeof(float)));
+
+            float *v = &val[id * dim];
+            unsigned long long *b = (wsize > 0) ? &bin[id * wsize] : NULL;
+            memset(v, 0, dim * sizeof(float));
+            if (b != NULL) {
+                memset(b, 0, wsize * sizeof(unsigned long long));
             }
 
-            matches[i] = j;
+            if (valid == true) {
+                memcpy(v, dsc.val.ptr, dim * sizeof(float));
+                if (b != NULL) {
+                    memcpy(b, dsc.bin.ptr, minVal(dsc.bin.size(), bsize));
+                }
+            }
+
+            cst[id] = ftr.cst;
+            type[id] = (valid == true) ? dsc.type : Dsc::DSC_NULL;
+        }
+    };
+
+    namespace _feature {
+
+        // dot products of 4 queries and 1 reference (dim % 8 == 0)
+        SP_CPUFUNC void dot4(float *dst, const float *q0, const float *q1, const float *q2, const float *q3, const float *r, const int dim) {
+#if SP_USE_AVX
+            __m256 s0 = _mm256_setzero_ps();
+            __m256 s1 = _mm256_setzero_ps();
+            __m256 s2 = _mm256_setzero_ps();
+            __m256 s3 = _mm256_setzero_ps();
+
+            for (int d = 0; d < dim; d += 8) {
+                const __m256 v = _mm256_loadu_ps(r + d);
+#if defined(__FMA__)
+                s0 = _mm256_fmadd_ps(_mm256_loadu_ps(q0 + d), v, s0);
+                s1 = _mm256_fmadd_ps(_mm256_loadu_ps(q1 + d), v, s1);
+                s2 = _mm256_fmadd_ps(_mm256_loadu_ps(q2 + d), v, s2);
+                s3 = _mm256_fmadd_ps(_mm256_loadu_ps(q3 + d), v, s3);
+#else
+                s0 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(q0 + d), v), s0);
+                s1 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(q1 + d), v), s1);
+                s2 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(q2 + d), v), s2);
+                s3 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(q3 + d), v), s3);
+#endif
+            }
+            dst[0] = hsum(s0);
+            dst[1] = hsum(s1);
+            dst[2] = hsum(s2);
+            dst[3] = hsum(s3);
+#elif SP_USE_SSE
+            __m128 s0 = _mm_setzero_ps();
+            __m128 s1 = _mm_setzero_ps();
+            __m128 s2 = _mm_setzero_ps();
+            __m128 s3 = _mm_setzero_ps();
+
+            for (int d = 0; d < dim; d += 4) {
+                const __m128 v = _mm_loadu_ps(r + d);
+                s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(q0 + d), v));
+                s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(q1 + d), v));
+                s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(q2 + d), v));
+                s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(q3 + d), v));
+            }
+            dst[0] = hsum(s0);
+            dst[1] = hsum(s1);
+            dst[2] = hsum(s2);
+            dst[3] = hsum(s3);
+#else
+            float s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int d = 0; d < dim; d++) {
+                s[0] += q0[d] * r[d];
+                s[1] += q1[d] * r[d];
+                s[2] += q2[d] * r[d];
+                s[3] += q3[d] * r[d];
+            }
+            for (int i = 0; i < 4; i++) {
+                dst[i] = s[i];
+            }
+#endif
+        }
+
+        // same accumulation as findMatch(const Ftr &, const Mem1<Ftr> &)
+        SP_CPUFUNC SP_REAL dotRef(const float *data0, const float *data1, const int dim) {
+            SP_REAL sum = 0.0;
+            for (int d = 0; d < dim; d++) {
+                sum += (*data0++) * (*data1++);
+            }
+            return sum;
+        }
+
+        // best match for each query in qids (result is written to best[qid])
+        SP_CPUFUNC void searchBest(Mem1<int> &best, const DscMat &qmat, const DscMat &rmat, const Mem1<int> &qids) {
+            const SP_REAL MIN_NCC = 0.9f;
+            const SP_REAL MIN_BIN = MIN_NCC * 0.9f;
+
+            // margin for float simd accumulation (rescored exactly)
+            const float EPS = 1.0e-4f;
+
+            const int dim = qmat.dim;
+            const int T = 4;
+
+            const int tnum = (qids.size() + T - 1) / T;
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int t = 0; t < tnum; t++) {
+                int ids[T];
+                bool valid[T];
+                const float *q[T];
+
+                Mem1<int> cids[T];
+                Mem1<float> cvals[T];
+                float maxv[T];
+
+                for (int k = 0; k < T; k++) {
+                    const int n = t * T + k;
+                    ids[k] = (n < qids.size()) ? qids[n] : qids[t * T];
+
+                    const Dsc::Type type = qmat.type[ids[k]];
+                    valid[k] = (n < qids.size()) && (type == Dsc::DSC_SIFT || type == Dsc::DSC_CFBlob);
+
+                    q[k] = &qmat.val[ids[k] * dim];
+                    maxv[k] = -SP_INFINITY;
+                }
+
+                for (int j = 0; j < rmat.num; j++) {
+                    bool pass[T];
+                    bool any = false;
+
+                    for (int k = 0; k < T; k++) {
+                        pass[k] = false;
+                        if (valid[k] == false) continue;
+                        if (qmat.cst[ids[k]] * rmat.cst[j] <= 0.0) continue;
+
+                        const unsigned long long *b0 = &qmat.bin[ids[k] * qmat.wsize];
+                        const unsigned long long *b1 = &rmat.bin[j * rmat.wsize];
+
+                        int cnt = 8 * qmat.bsize;
+                        for (int w = 0; w < rmat.wsize; w++) {
+                            cnt -= popcnt64(b0[w] ^ b1[w]);
+                        }
+
+                        const SP_REAL btest = static_cast<SP_REAL>(cnt) / dim;
+                        if (btest < MIN_BIN) continue;
+
+                        pass[k] = true;
+                        any = true;
+                    }
+                    if (any == false) continue;
+
+                    float dots[T];
+                    dot4(dots, q[0], q[1], q[2], q[3], &rmat.val[j * dim], dim);
+
+                    for (int k = 0; k < T; k++) {
+                        if (pass[k] == false || dots[k] <= MIN_NCC - EPS) continue;
+
+                        cids[k].push(j);
+                        cvals[k].push(dots[k]);
+                        maxv[k] = maxVal(maxv[k], dots[k]);
+                    }
+                }
+
+                // exact rescoring of the candidates near the maximum
+                for (int k = 0; k < T; k++) {
+                    if (t * T + k >= qids.size()) continue;
+
+                    int id = -1;
+                    SP_REAL maxs = MIN_NCC;
+                    for (int c = 0; c < cids[k].size(); c++) {
+                        if (cvals[k][c] < maxv[k] - 2 * EPS) continue;
+
+                        const int j = cids[k][c];
+                        const SP_REAL sum = dotRef(q[k], &rmat.val[j * dim], dim);
+                        if (sum > maxs) {
+                            maxs = sum;
+                            id = j;
+                        }
+                    }
+                    best[ids[k]] = id;
+                }
+            }
+        }
+    }
+
+    SP_CPUFUNC Mem1<int> findMatch(const DscMat &mat0, const DscMat &mat1, const bool crossCheck = true) {
+        Mem1<int> matches(mat0.num);
+
+        Mem1<int> ids0(mat0.num);
+        for (int i = 0; i < mat0.num; i++) {
+            ids0[i] = i;
+        }
+        _feature::searchBest(matches, mat0, mat1, ids0);
+
+        // cross check
+        if (crossCheck == true) {
+            Mem1<bool> flags(mat1.num);
+            flags.zero();
+
+            Mem1<int> ids1;
+            ids1.reserve(mat1.num);
+            for (int i = 0; i < mat0.num; i++) {
+                const int j = matches[i];
+                if (j < 0 || flags[j] == true) continue;
+
+                flags[j] = true;
+                ids1.push(j);
+            }
+
+            Mem1<int> backs(mat1.num);
+            _feature::searchBest(backs, mat1, mat0, ids1);
+
+            for (int i = 0; i < mat0.num; i++) {
+                const int j = matches[i];
+                if (j < 0) continue;
+
+                if (backs[j] != i) matches[i] = -1;
+            }
         }
 
         return matches;
     }
 
+    SP_CPUFUNC Mem1<int> findMatch(const Mem1<Ftr> &ftrs0, const Mem1<Ftr> &ftrs1, const bool crossCheck = true) {
+        const DscMat mat0(ftrs0);
+        const DscMat mat1(ftrs1);
+
+        return findMatch(mat0, mat1, crossCheck);
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // global descriptor (bag of binary words, each byte of the binary descriptor is a word)
+    //--------------------------------------------------------------------------------
+
+    // word histogram (bsize x 256)
+    SP_CPUFUNC Mem1<float> getDscHist(const DscMat &mat) {
+        const int WORD_NUM = 256;
+
+        Mem1<float> hist(mat.bsize * WORD_NUM);
+        hist.zero();
+
+        for (int i = 0; i < mat.num; i++) {
+            if (mat.type[i] == Dsc::DSC_NULL) continue;
+
+            const Byte *bin = reinterpret_cast<const Byte*>(&mat.bin[i * mat.wsize]);
+            for (int t = 0; t < mat.bsize; t++) {
+                hist[t * WORD_NUM + bin[t]] += 1.0f;
+            }
+        }
+        return hist;
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // descriptor index (multi-index hashing on the binary descriptor)
+    //--------------------------------------------------------------------------------
+
+    class DscIndex {
+
+    private:
+
+        // 16bit key per hash table
+        static const int KEY_BITS = 16;
+        static const int KEY_SIZE = 1 << KEY_BITS;
+
+        // descriptor data (id order)
+        DscMat m_mat;
+
+        // valid flag (false : removed)
+        Mem1<bool> m_valid;
+
+        // valid descriptor num
+        int m_size;
+
+        // probe radius per key
+        int m_radius;
+
+        // hash table num
+        int m_tnum;
+
+        // bucket head (tnum x KEY_SIZE, -1 : empty)
+        Mem1<int> m_heads;
+
+        // bucket link (num x tnum)
+        Mem1<int> m_nexts;
+
+        // removed ids (reused by add)
+        Mem1<int> m_frees;
+
+    public:
+
+        DscIndex(const int radius = 1) {
+            clear();
+            setRadius(radius);
+        }
+
+        void clear() {
+            m_mat.clear();
+            m_valid.clear();
+            m_size = 0;
+            m_tnum = 0;
+            m_heads.clear();
+            m_nexts.clear();
+            m_frees.clear();
+        }
+
+        //--------------------------------------------------------------------------------
+        // recall / speed (radius 0..3, 3 : same result as findMatch for 128bit binary)
+        //--------------------------------------------------------------------------------
+
+        void setRadius(const int radius) {
+            m_radius = maxVal(0, minVal(3, radius));
+        }
+
+        int getRadius() const {
+            return m_radius;
+        }
+
+        //--------------------------------------------------------------------------------
+        // util
+        //--------------------------------------------------------------------------------
+
+        // valid descriptor num
+        int size() const {
+            return m_size;
+        }
+
+        // id range (including removed ids not reused yet)
+        int num() const {
+            return m_mat.num;
+        }
+
+        bool valid(const int id) const {
+            return (id >= 0 && id < m_mat.num) ? m_valid[id] : false;
+        }
+
+        //--------------------------------------------------------------------------------
+        // insert / remove
+        //--------------------------------------------------------------------------------
+
+        // return id (removed id is reused first)
+        int add(const Ftr &ftr) {
+            int id = -1;
+
+            if (m_frees.size() > 0) {
+                id = *m_frees.last();
+                m_frees.pop();
+
+                m_mat.set(id, ftr);
+                m_valid[id] = true;
+            }
+            else {
+                id = m_mat.num;
+
+                m_mat.push(ftr);
+                m_valid.push(true);
+
+                if (m_tnum == 0) {
+                    m_tnum = (m_mat.bsize * 8) / KEY_BITS;
+
+                    m_heads.resize(m_tnum * KEY_SIZE);
+                    setElm(m_heads, -1);
+                }
+                m_nexts.extend(m_tnum);
+            }
+            m_size++;
+
+            int *nexts = &m_nexts[id * m_tnum];
+            for (int t = 0; t < m_tnum; t++) {
+                int &head = m_heads[t * KEY_SIZE + getKey(id, t)];
+                nexts[t] = head;
+                head = id;
+            }
+
+            return id;
+        }
+
+        void del(const int id) {
+            if (valid(id) == false) return;
+
+            for (int t = 0; t < m_tnum; t++) {
+                int *link = &m_heads[t * KEY_SIZE + getKey(id, t)];
+                while (*link >= 0 && *link != id) {
+                    link = &m_nexts[*link * m_tnum + t];
+                }
+                if (*link == id) {
+                    *link = m_nexts[id * m_tnum + t];
+                }
+            }
+
+            m_valid[id] = false;
+            m_size--;
+
+            m_frees.push(id);
+        }
+
+        //--------------------------------------------------------------------------------
+        // search (-1 : not found)
+        //--------------------------------------------------------------------------------
+
+        int search(const Ftr &ftr) const {
+            const SP_REAL MIN_NCC = 0.9f;
+            const SP_REAL MIN_BIN = MIN_NCC * 0.9f;
+
+            if (m_size == 0 || m_tnum == 0) return -1;
+            if (ftr.dsc.type != Dsc::DSC_SIFT && ftr.dsc.type != Dsc::DSC_CFBlob) return -1;
+
+            const int dim = m_mat.dim;
+            if (ftr.dsc.val.size() < dim * static_cast<int>(sizeof(float))) return -1;
+
+            Mem1<unsigned long long> qbin(m_mat.wsize);
+            qbin.zero();
+            memcpy(qbin.ptr, ftr.dsc.bin.ptr, minVal(ftr.dsc.bin.size(), m_mat.bsize));
+
+            const int bcnt = 8 * ftr.dsc.bin.size();
+
+            // collect candidates (visited flag per id, hamming test)
+            Mem1<int> list;
+            {
+                Mem1<unsigned long long> visit((m_mat.num + 63) / 64);
+                visit.zero();
+
+                const Mem1<int> &masks = getMasks();
+                const int mnum = getMaskNum(m_radius);
+
+                for (int t = 0; t < m_tnum; t++) {
+                    const int key = getKey(qbin.ptr, t);
+
+                    for (int m = 0; m < mnum; m++) {
+                        int id = m_heads[t * KEY_SIZE + (key ^ masks[m])];
+                        while (id >= 0) {
+                            unsigned long long &v = visit[id / 64];
+                            const unsigned long long f = 1ULL << (id % 64);
+
+                            if ((v & f) == 0) {
+                                v |= f;
+
+                                const unsigned long long *b = &m_mat.bin[id * m_mat.wsize];
+                                int dist = 0;
+                                for (int w = 0; w < m_mat.wsize; w++) {
+                                    dist += popcnt64(qbin[w] ^ b[w]);
+                                }
+                                const SP_REAL btest = static_cast<SP_REAL>(bcnt - dist) / dim;
+                                if (btest >= MIN_BIN) list.push(id);
+                            }
+                            id = m_nexts[id * m_tnum + t];
+                        }
+                    }
+                }
+                sort(list);
+            }
+
+            // same criterion as findMatch (ascending id order)
+            const float *qval = reinterpret_cast<const float*>(ftr.dsc.val.ptr);
+
+            int best = -1;
+            SP_REAL maxv = MIN_NCC;
+            for (int i = 0; i < list.size(); i++) {
+                const int id = list[i];
+                if (ftr.cst * m_mat.cst[id] <= 0.0) continue;
+
+                const SP_REAL sum = _feature::dotRef(qval, &m_mat.val[id * dim], dim);
+                if (sum > maxv) {
+                    maxv = sum;
+                    best = id;
+                }
+            }
+
+            return best;
+        }
+
+        Mem1<int> search(const Mem1<Ftr> &ftrs) const {
+            Mem1<int> ids(ftrs.size());
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int i = 0; i < ftrs.size(); i++) {
+                ids[i] = search(ftrs[i]);
+            }
+            return ids;
+        }
+
+    private:
+
+        int getKey(const unsigned long long *bin, const int t) const {
+            const int bits = t * KEY_BITS;
+            return static_cast<int>((bin[bits / 64] >> (bits % 64)) & (KEY_SIZE - 1));
+        }
+
+        int getKey(const int id, const int t) const {
+            return getKey(&m_mat.bin[id * m_mat.wsize], t);
+        }
+
+        // probe masks sorted by bit count
+        static Mem1<int> makeMasks() {
+            Mem1<int> masks;
+            for (int c = 0; c <= 3; c++) {
+                for (int m = 0; m < KEY_SIZE; m++) {
+                    if (popcnt64(m) == c) masks.push(m);
+                }
+            }
+            return masks;
+        }
+
+        static const Mem1<int>& getMasks() {
+            static const Mem1<int> masks = makeMasks();
+            return masks;
+        }
+
+        static int getMaskNum(const int radius) {
+            // sum of C(16, k), k = 0..radius
+            const int nums[] = { 1, 17, 137, 697 };
+            return nums[radius];
+        }
+    };
+
 }
 
 #endif
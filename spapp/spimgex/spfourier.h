@@ -11,8 +11,292 @@
 namespace sp{
 
     namespace _fourier {
-        
-        SP_CPUFUNC void calcHor(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat srcIm = Mat(), const bool flag = true) {
+
+        //--------------------------------------------------------------------------------
+        // fft table (twiddle factor / bit reverse / bluestein chirp)
+        //--------------------------------------------------------------------------------
+
+        class FFTTable {
+        public:
+            // data size
+            int size;
+
+            // log2(size) (power of two) or -1
+            int lg2;
+
+            // twiddle factor exp(-2 pi i k / size), k < size / 2
+            Mem1<Cmp> twd;
+
+            // bit reverse index
+            Mem1<int> rev;
+
+            // bluestein chirp exp(-pi i n^2 / size)
+            Mem1<Cmp> chirp;
+
+            // bluestein filter (fft of conj chirp)
+            Mem1<Cmp> filter;
+
+            // power of two table for bluestein convolution
+            const FFTTable *sub;
+
+            // work size for fft
+            int wsize() const {
+                return (sub != NULL) ? sub->size : 0;
+            }
+        };
+
+        SP_CPUFUNC int getLog2(const int size) {
+            int lg2 = 0;
+            while ((1 << lg2) < size) lg2++;
+            return ((1 << lg2) == size) ? lg2 : -1;
+        }
+
+        // radix-2/4 decimation in time (forward, in-place)
+        SP_CPUFUNC void fftPow2(Cmp *data, const FFTTable &table) {
+            const int N = table.size;
+            const Cmp *twd = table.twd.ptr;
+
+            for (int i = 0; i < N; i++) {
+                const int j = table.rev[i];
+                if (i < j) swap(data[i], data[j]);
+            }
+
+            int h = 1;
+
+            // radix-2 stage
+            if (table.lg2 % 2 == 1) {
+                for (int i = 0; i < N; i += 2) {
+                    const Cmp u = data[i + 0];
+                    const Cmp v = data[i + 1];
+                    data[i + 0] = u + v;
+                    data[i + 1] = u - v;
+                }
+                h = 2;
+            }
+
+            // radix-4 stages
+            for (; h < N; h *= 4) {
+                const int s = N / (4 * h);
+
+                for (int i = 0; i < N; i += 4 * h) {
+                    Cmp *p0 = &data[i + 0 * h];
+                    Cmp *p1 = &data[i + 1 * h];
+                    Cmp *p2 = &data[i + 2 * h];
+                    Cmp *p3 = &data[i + 3 * h];
+
+                    for (int j = 0; j < h; j++) {
+                        const Cmp &w1 = twd[2 * j * s];
+                        const Cmp &w2 = twd[j * s];
+
+                        const Cmp a1 = mulCmp(p1[j], w1);
+                        const Cmp a3 = mulCmp(p3[j], w1);
+
+                        const Cmp b0 = p0[j] + a1;
+                        const Cmp b1 = p0[j] - a1;
+                        const Cmp b2 = mulCmp(p2[j] + a3, w2);
+                        const Cmp b3 = mulCmp(p2[j] - a3, w2);
+
+                        // b3 * (-i)
+                        const Cmp c3 = getCmp(b3.im, -b3.re);
+
+                        p0[j] = b0 + b2;
+                        p2[j] = b0 - b2;
+                        p1[j] = b1 + c3;
+                        p3[j] = b1 - c3;
+                    }
+                }
+            }
+        }
+
+        // bluestein (chirp-z) for arbitrary size (forward, in-place)
+        SP_CPUFUNC void fftBluestein(Cmp *data, const FFTTable &table, Cmp *work) {
+            const int N = table.size;
+            const int M = table.sub->size;
+
+            for (int i = 0; i < M; i++) {
+                work[i] = (i < N) ? mulCmp(data[i], table.chirp[i]) : getCmp(0.0, 0.0);
+            }
+            fftPow2(work, *table.sub);
+
+            // inverse fft of the product (conj -> fft -> conj)
+            for (int i = 0; i < M; i++) {
+                const Cmp v = mulCmp(work[i], table.filter[i]);
+                work[i] = getCmp(v.re, -v.im);
+            }
+            fftPow2(work, *table.sub);
+
+            for (int i = 0; i < N; i++) {
+                const Cmp v = getCmp(work[i].re / M, -work[i].im / M);
+                data[i] = mulCmp(v, table.chirp[i]);
+            }
+        }
+
+        // fft (in-place, inverse is not normalized)
+        SP_CPUFUNC void fft(Cmp *data, const FFTTable &table, const bool inv, Cmp *work) {
+            if (inv == true) {
+                for (int i = 0; i < table.size; i++) data[i].im = -data[i].im;
+            }
+
+            if (table.lg2 >= 0) {
+                fftPow2(data, table);
+            }
+            else {
+                fftBluestein(data, table, work);
+            }
+
+            if (inv == true) {
+                for (int i = 0; i < table.size; i++) data[i].im = -data[i].im;
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // fft table cache (keyed by size)
+        //--------------------------------------------------------------------------------
+
+        class FFTCache {
+        private:
+            Mem1<FFTTable*> m_tables;
+            std::mutex m_mtx;
+
+        public:
+            ~FFTCache() {
+                for (int i = 0; i < m_tables.size(); i++) {
+                    delete m_tables[i];
+                }
+            }
+
+            const FFTTable* get(const int size) {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                return search(size);
+            }
+
+            static FFTCache *instance() {
+                static FFTCache cache;
+                return &cache;
+            }
+
+        private:
+
+            const FFTTable* search(const int size) {
+                for (int i = 0; i < m_tables.size(); i++) {
+                    if (m_tables[i]->size == size) return m_tables[i];
+                }
+
+                FFTTable *table = new FFTTable();
+                table->size = size;
+                table->lg2 = getLog2(size);
+                table->sub = NULL;
+
+                if (table->lg2 >= 0) {
+                    table->twd.resize(maxVal(size / 2, 1));
+                    for (int k = 0; k < table->twd.size(); k++) {
+                        const double a = -2.0 * SP_PI * k / size;
+                        table->twd[k] = getCmp(::cos(a), ::sin(a));
+                    }
+
+                    table->rev.resize(size);
+                    for (int i = 0; i < size; i++) {
+                        int r = 0;
+                        for (int b = 0; b < table->lg2; b++) {
+                            r |= ((i >> b) & 1) << (table->lg2 - 1 - b);
+                        }
+                        table->rev[i] = r;
+                    }
+                }
+                else {
+                    int M = 1;
+                    while (M < 2 * size - 1) M *= 2;
+                    table->sub = search(M);
+
+                    table->chirp.resize(size);
+                    for (int n = 0; n < size; n++) {
+                        // n^2 mod 2N keeps the angle accurate for large n
+                        const long long nn = (static_cast<long long>(n) * n) % (2 * size);
+                        const double a = -SP_PI * nn / size;
+                        table->chirp[n] = getCmp(::cos(a), ::sin(a));
+                    }
+
+                    table->filter.resize(M);
+                    table->filter.zero();
+                    for (int n = 0; n < size; n++) {
+                        const Cmp c = getCmp(table->chirp[n].re, -table->chirp[n].im);
+                        table->filter[n] = c;
+                        if (n > 0) table->filter[M - n] = c;
+                    }
+                    fftPow2(table->filter.ptr, *table->sub);
+                }
+
+                m_tables.push(table);
+                return table;
+            }
+        };
+
+        SP_CPUFUNC const FFTTable* getFFTTable(const int size) {
+            return FFTCache::instance()->get(size);
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // 1d transform for each row (flag: true -> forward, false -> inverse)
+        //--------------------------------------------------------------------------------
+
+        SP_CPUFUNC void calcHor(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat &srcIm = Mat(), const bool flag = true) {
+
+            const int M = srcRe.dsize[0];
+
+            const int offset = M / 2;
+            const bool useIm = (srcIm.size() != 0) ? true : false;
+
+            dstRe.resize(srcRe.dsize);
+            dstIm.resize(srcRe.dsize);
+
+            const FFTTable &table = *getFFTTable(M);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int y = 0; y < srcRe.dsize[1]; y++) {
+                Mem1<Cmp> buf(M + table.wsize());
+                Cmp *data = buf.ptr;
+                Cmp *work = buf.ptr + M;
+
+                for (int k = 0; k < M; k++) {
+                    const int i = (flag == true) ? k : (k + offset) % M;
+                    data[k].re = acs2(srcRe, i, y);
+                    data[k].im = (useIm == true) ? acs2(srcIm, i, y) : 0.0;
+                }
+
+                fft(data, table, !flag, work);
+
+                for (int x = 0; x < M; x++) {
+                    if (flag == true) {
+                        const Cmp &v = data[(x - offset + M) % M];
+                        acs2(dstRe, x, y) = v.re;
+                        acs2(dstIm, x, y) = v.im;
+                    }
+                    else {
+                        const Cmp &v = data[x];
+                        acs2(dstRe, x, y) = v.re / M;
+                        acs2(dstIm, x, y) = v.im / M;
+                    }
+                }
+            }
+        }
+
+        SP_CPUFUNC void calcVer(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat &srcIm = Mat(), bool flag = true) {
+
+            calcHor(dstRe, dstIm, trnMat(srcRe), trnMat(srcIm), flag);
+
+            dstRe = trnMat(dstRe);
+            dstIm = trnMat(dstIm);
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // direct O(N^2) transform (reference)
+        //--------------------------------------------------------------------------------
+
+        SP_CPUFUNC void calcHorDFT(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat srcIm = Mat(), const bool flag = true) {
 
             const int M = srcRe.dsize[0];
             
@@ -58,9 +342,9 @@ namespace sp{
             }
         }
 
-        SP_CPUFUNC void calcVer(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat &srcIm = Mat(), bool flag = true) {
+        SP_CPUFUNC void calcVerDFT(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat &srcIm = Mat(), bool flag = true) {
 
-            calcHor(dstRe, dstIm, trnMat(srcRe), trnMat(srcIm), flag);
+            calcHorDFT(dstRe, dstIm, trnMat(srcRe), trnMat(srcIm), flag);
 
             dstRe = trnMat(dstRe);
             dstIm = trnMat(dstIm);
@@ -116,10 +116,23 @@ namespace sp{
             return _execute(img);
         }
 
+        // external buffer / sub region (no copy, feature pixels are relative to the view)
+        bool execute(const MemView<Col3> &img){
+
+            Mem2<Byte> gry;
+            cnvImg(gry, img);
+            return _execute(gry);
+        }
+
+        bool execute(const MemView<Byte> &img){
+
+            return _execute(img);
+        }
+
 
     private:
 
-        bool _execute(const Mem2<Byte> &img){
+        bool _execute(const MemView<Byte> &img){
             SP_LOGGER_SET("SIFT.execute");
 
             // clear data
@@ -165,9 +178,14 @@ namespace sp{
         // modules
         //--------------------------------------------------------------------------------
 
-        void makeImgSet(Mem1<ImgSet> &imgsets, const Mem2<Byte> &img){
-            Mem2<float> imgf;
-            cnvMem(imgf, img, 1.0 / 255.0);
+        void makeImgSet(Mem1<ImgSet> &imgsets, const MemView<Byte> &img){
+            Mem2<float> imgf(img.dsize);
+            for (int v = 0; v < img.dsize[1]; v++) {
+                const Byte *pimg = img.row(v);
+                for (int u = 0; u < img.dsize[0]; u++) {
+                    imgf(u, v) = static_cast<float>(pimg[u] * (1.0 / 255.0));
+                }
+            }
 
             const int pynum = round(log2(minVal(img.dsize[0], img.dsize[1]) / (8.0 * BASE_SIGMA)));
 
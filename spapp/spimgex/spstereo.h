@@ -12,6 +12,288 @@
 
 namespace sp{
 
+    namespace _stereo {
+
+        // col[j] += |a - r[j]| - |b - s[j]| (j < n, n : multiple of 32)
+        SP_CPUFUNC void updateCol(unsigned short *col, const Byte a, const Byte *r, const Byte b, const Byte *s, const int n) {
+            int j = 0;
+#if SP_USE_AVX
+            const __m256i va = _mm256_set1_epi8(static_cast<char>(a));
+            const __m256i vb = _mm256_set1_epi8(static_cast<char>(b));
+            for (; j + 32 <= n; j += 32) {
+                const __m256i vr = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&r[j]));
+                const __m256i vs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&s[j]));
+                const __m256i dr = _mm256_or_si256(_mm256_subs_epu8(va, vr), _mm256_subs_epu8(vr, va));
+                const __m256i ds = _mm256_or_si256(_mm256_subs_epu8(vb, vs), _mm256_subs_epu8(vs, vb));
+
+                __m256i *pc = reinterpret_cast<__m256i*>(&col[j]);
+                const __m256i c0 = _mm256_loadu_si256(pc + 0);
+                const __m256i c1 = _mm256_loadu_si256(pc + 1);
+
+                const __m256i r0 = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(dr));
+                const __m256i r1 = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(dr, 1));
+                const __m256i s0 = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(ds));
+                const __m256i s1 = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(ds, 1));
+
+                _mm256_storeu_si256(pc + 0, _mm256_sub_epi16(_mm256_add_epi16(c0, r0), s0));
+                _mm256_storeu_si256(pc + 1, _mm256_sub_epi16(_mm256_add_epi16(c1, r1), s1));
+            }
+#elif SP_USE_SSE
+            const __m128i va = _mm_set1_epi8(static_cast<char>(a));
+            const __m128i vb = _mm_set1_epi8(static_cast<char>(b));
+            const __m128i zero = _mm_setzero_si128();
+            for (; j + 16 <= n; j += 16) {
+                const __m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&r[j]));
+                const __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&s[j]));
+                const __m128i dr = _mm_or_si128(_mm_subs_epu8(va, vr), _mm_subs_epu8(vr, va));
+                const __m128i ds = _mm_or_si128(_mm_subs_epu8(vb, vs), _mm_subs_epu8(vs, vb));
+
+                __m128i *pc = reinterpret_cast<__m128i*>(&col[j]);
+                const __m128i c0 = _mm_loadu_si128(pc + 0);
+                const __m128i c1 = _mm_loadu_si128(pc + 1);
+
+                const __m128i r0 = _mm_unpacklo_epi8(dr, zero);
+                const __m128i r1 = _mm_unpackhi_epi8(dr, zero);
+                const __m128i s0 = _mm_unpacklo_epi8(ds, zero);
+                const __m128i s1 = _mm_unpackhi_epi8(ds, zero);
+
+                _mm_storeu_si128(pc + 0, _mm_sub_epi16(_mm_add_epi16(c0, r0), s0));
+                _mm_storeu_si128(pc + 1, _mm_sub_epi16(_mm_add_epi16(c1, r1), s1));
+            }
+#endif
+            for (; j < n; j++) {
+                col[j] = static_cast<unsigned short>(col[j] + abs(a - r[j]) - abs(b - s[j]));
+            }
+        }
+
+        // sum[j] += add[j] - sub[j] (j < n, n : multiple of 32)
+        SP_CPUFUNC void updateSum(int *sum, const unsigned short *add, const unsigned short *sub, const int n) {
+            int j = 0;
+#if SP_USE_AVX
+            for (; j + 8 <= n; j += 8) {
+                __m256i *ps = reinterpret_cast<__m256i*>(&sum[j]);
+                const __m256i va = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&add[j])));
+                const __m256i vb = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&sub[j])));
+                _mm256_storeu_si256(ps, _mm256_sub_epi32(_mm256_add_epi32(_mm256_loadu_si256(ps), va), vb));
+            }
+#elif SP_USE_SSE
+            const __m128i zero = _mm_setzero_si128();
+            for (; j + 8 <= n; j += 8) {
+                __m128i *ps = reinterpret_cast<__m128i*>(&sum[j]);
+                const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&add[j]));
+                const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sub[j]));
+                const __m128i d0 = _mm_sub_epi32(_mm_unpacklo_epi16(va, zero), _mm_unpacklo_epi16(vb, zero));
+                const __m128i d1 = _mm_sub_epi32(_mm_unpackhi_epi16(va, zero), _mm_unpackhi_epi16(vb, zero));
+                _mm_storeu_si128(ps + 0, _mm_add_epi32(_mm_loadu_si128(ps + 0), d0));
+                _mm_storeu_si128(ps + 1, _mm_add_epi32(_mm_loadu_si128(ps + 1), d1));
+            }
+#endif
+            for (; j < n; j++) {
+                sum[j] += add[j] - sub[j];
+            }
+        }
+
+        // min value of sum[0, n) and its largest index
+        SP_CPUFUNC int argMin(int &minv, const int *sum, const int n) {
+            int j = 0;
+            minv = SP_INTMAX;
+#if SP_USE_AVX
+            if (n >= 8) {
+                __m256i vmin = _mm256_set1_epi32(SP_INTMAX);
+                for (; j + 8 <= n; j += 8) {
+                    vmin = _mm256_min_epi32(vmin, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&sum[j])));
+                }
+                __m128i m = _mm_min_epi32(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+                m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+                m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+                minv = _mm_cvtsi128_si32(m);
+            }
+#endif
+            for (int k = j; k < n; k++) {
+                minv = minVal(minv, sum[k]);
+            }
+            for (int k = n - 1; k >= j; k--) {
+                if (sum[k] == minv) return k;
+            }
+#if SP_USE_AVX
+            const __m256i vmin = _mm256_set1_epi32(minv);
+            for (int k = j - 8; k >= 0; k -= 8) {
+                const __m256i vs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&sum[k]));
+                const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(vs, vmin)));
+                for (int b = 7; b >= 0; b--) {
+                    if ((mask >> b) & 1) return k + b;
+                }
+            }
+#endif
+            return -1;
+        }
+
+        // best[j] = sum[j], id[j] = x (if sum[j] < best[j], j < n)
+        SP_CPUFUNC void updateBest(int *best, int *id, const int *sum, const int x, const int n) {
+            int j = 0;
+#if SP_USE_AVX
+            const __m256i vx = _mm256_set1_epi32(x);
+            for (; j + 8 <= n; j += 8) {
+                __m256i *pb = reinterpret_cast<__m256i*>(&best[j]);
+                __m256i *pi = reinterpret_cast<__m256i*>(&id[j]);
+                const __m256i vs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&sum[j]));
+                const __m256i vb = _mm256_loadu_si256(pb);
+                const __m256i mask = _mm256_cmpgt_epi32(vb, vs);
+                _mm256_storeu_si256(pb, _mm256_min_epi32(vb, vs));
+                _mm256_storeu_si256(pi, _mm256_blendv_epi8(_mm256_loadu_si256(pi), vx, mask));
+            }
+#elif SP_USE_SSE
+            const __m128i vx = _mm_set1_epi32(x);
+            for (; j + 4 <= n; j += 4) {
+                __m128i *pb = reinterpret_cast<__m128i*>(&best[j]);
+                __m128i *pi = reinterpret_cast<__m128i*>(&id[j]);
+                const __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sum[j]));
+                const __m128i vb = _mm_loadu_si128(pb);
+                const __m128i mask = _mm_cmpgt_epi32(vb, vs);
+                _mm_storeu_si128(pb, _mm_or_si128(_mm_and_si128(mask, vs), _mm_andnot_si128(mask, vb)));
+                _mm_storeu_si128(pi, _mm_or_si128(_mm_and_si128(mask, vx), _mm_andnot_si128(mask, _mm_loadu_si128(pi))));
+            }
+#endif
+            for (; j < n; j++) {
+                if (sum[j] < best[j]) {
+                    best[j] = sum[j];
+                    id[j] = x;
+                }
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // semi-global matching
+        //--------------------------------------------------------------------------------
+
+        // census transform (7x7, bit : neighbor < center)
+        SP_CPUFUNC void census(Mem2<unsigned long long> &dst, const MemView<Byte> &src) {
+            dst.resize(src.dsize);
+
+            const int half = 3;
+
+            // clamped image
+            Mem2<Byte> tmp(src.dsize[0] + 2 * half, src.dsize[1] + 2 * half);
+            for (int v = 0; v < tmp.dsize[1]; v++) {
+                for (int u = 0; u < tmp.dsize[0]; u++) {
+                    tmp(u, v) = src(u - half, v - half);
+                }
+            }
+
+            const int step = tmp.dsize[0];
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int v = 0; v < src.dsize[1]; v++) {
+                for (int u = 0; u < src.dsize[0]; u++) {
+                    const Byte *p = &tmp(u + half, v + half);
+                    const Byte c = *p;
+
+                    unsigned long long code = 0;
+                    for (int y = -half; y <= half; y++) {
+                        const Byte *py = p + y * step;
+                        for (int x = -half; x <= half; x++) {
+                            if (x == 0 && y == 0) continue;
+                            code = (code << 1) | ((py[x] < c) ? 1 : 0);
+                        }
+                    }
+                    dst(u, v) = code;
+                }
+            }
+        }
+
+        // path cost (16bit, lane -1 and n : invalid value)
+        // dst[j] = cost[j] + min(prev[j], prev[j -+ 1] + P1, pmin + P2) - pmin (j < n, n : multiple of 16)
+        SP_CPUFUNC void aggregate(short *dst, const short *prev, const Byte *cost, const int n, const short pmin, const short P1, const short P2) {
+            const short pmp2 = static_cast<short>(minVal(pmin + P2, 0x7FFF));
+
+            int j = 0;
+#if SP_USE_AVX
+            const __m256i vp1 = _mm256_set1_epi16(P1);
+            const __m256i vp2 = _mm256_set1_epi16(pmp2);
+            const __m256i vpm = _mm256_set1_epi16(pmin);
+            for (; j + 16 <= n; j += 16) {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&prev[j]));
+                const __m256i b = _mm256_adds_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&prev[j - 1])), vp1);
+                const __m256i c = _mm256_adds_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&prev[j + 1])), vp1);
+                const __m256i m = _mm256_min_epi16(_mm256_min_epi16(a, b), _mm256_min_epi16(c, vp2));
+                const __m256i e = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&cost[j])));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[j]), _mm256_adds_epi16(_mm256_sub_epi16(m, vpm), e));
+            }
+#elif SP_USE_SSE
+            const __m128i vp1 = _mm_set1_epi16(P1);
+            const __m128i vp2 = _mm_set1_epi16(pmp2);
+            const __m128i vpm = _mm_set1_epi16(pmin);
+            const __m128i zero = _mm_setzero_si128();
+            for (; j + 8 <= n; j += 8) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&prev[j]));
+                const __m128i b = _mm_adds_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&prev[j - 1])), vp1);
+                const __m128i c = _mm_adds_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&prev[j + 1])), vp1);
+                const __m128i m = _mm_min_epi16(_mm_min_epi16(a, b), _mm_min_epi16(c, vp2));
+                const __m128i e = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&cost[j])), zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[j]), _mm_adds_epi16(_mm_sub_epi16(m, vpm), e));
+            }
+#endif
+            for (; j < n; j++) {
+                const int m = minVal(minVal(prev[j], prev[j - 1] + P1), minVal(prev[j + 1] + P1, static_cast<int>(pmp2)));
+                dst[j] = static_cast<short>(minVal(m - pmin + cost[j], 0x7FFF));
+            }
+        }
+
+        // dst[j] = dst[j] + src[j] (saturated, j < n, n : multiple of 16)
+        SP_CPUFUNC void addCost(short *dst, const short *src, const int n) {
+            int j = 0;
+#if SP_USE_AVX
+            for (; j + 16 <= n; j += 16) {
+                __m256i *pd = reinterpret_cast<__m256i*>(&dst[j]);
+                _mm256_storeu_si256(pd, _mm256_adds_epi16(_mm256_loadu_si256(pd), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[j]))));
+            }
+#elif SP_USE_SSE
+            for (; j + 8 <= n; j += 8) {
+                __m128i *pd = reinterpret_cast<__m128i*>(&dst[j]);
+                _mm_storeu_si128(pd, _mm_adds_epi16(_mm_loadu_si128(pd), _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[j]))));
+            }
+#endif
+            for (; j < n; j++) {
+                dst[j] = static_cast<short>(minVal(dst[j] + src[j], 0x7FFF));
+            }
+        }
+
+        // min value of src[0, n) (n : multiple of 16)
+        SP_CPUFUNC short minCost(const short *src, const int n) {
+            int j = 0;
+            short minv = 0x7FFF;
+#if SP_USE_AVX
+            if (n >= 16) {
+                __m256i vmin = _mm256_set1_epi16(0x7FFF);
+                for (; j + 16 <= n; j += 16) {
+                    vmin = _mm256_min_epi16(vmin, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[j])));
+                }
+                __m128i m = _mm_min_epi16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+                m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+                m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+                m = _mm_min_epi16(m, _mm_shufflelo_epi16(m, _MM_SHUFFLE(2, 3, 0, 1)));
+                minv = static_cast<short>(_mm_cvtsi128_si32(m));
+            }
+#elif SP_USE_SSE
+            if (n >= 8) {
+                __m128i m = _mm_set1_epi16(0x7FFF);
+                for (; j + 8 <= n; j += 8) {
+                    m = _mm_min_epi16(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[j])));
+                }
+                m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+                m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+                m = _mm_min_epi16(m, _mm_shufflelo_epi16(m, _MM_SHUFFLE(2, 3, 0, 1)));
+                minv = static_cast<short>(_mm_cvtsi128_si32(m));
+            }
+#endif
+            for (; j < n; j++) {
+                minv = minVal(minv, src[j]);
+            }
+            return minv;
+        }
+    }
+
     class StereoBase {
     private:
 
@@ -24,6 +306,9 @@ namespace sp{
         // window size
         int m_winSize;
 
+        // max window size (16 bit column sum : SP_BYTEMAX * winSize <= 0xFFFF)
+        static const int MAX_WINSIZE = 0xFFFF / SP_BYTEMAX;
+
         // camera parameter
         CamParam m_cam[2];
 
@@ -39,6 +324,21 @@ namespace sp{
         // depth map
         Mem2<Vec3> m_depthMap[2];
 
+        // matching mode
+        int m_mode;
+
+        // sgm penalty (small / large disparity change)
+        int m_P1, m_P2;
+
+        // sgm path num (4 or 8)
+        int m_paths;
+
+        // sgm max census cost (7x7 - 1 bits)
+        static const int SGM_MAXCOST = 48;
+
+        // sgm max penalty (path cost <= SGM_MAXCOST + P2, the sum of 8 paths fits in 16 bit)
+        static const int SGM_MAXP = 0x7FFF / 8 - SGM_MAXCOST;
+
     public:
 
         enum Order{
@@ -46,6 +346,13 @@ namespace sp{
             StereoR = -1
         };
 
+        enum Mode{
+            // block matching (SAD)
+            ModeBM = 0,
+            // semi-global matching (census)
+            ModeSGM = 1
+        };
+
     public:
 
         StereoBase() {
@@ -57,6 +364,11 @@ namespace sp{
             m_minDisp = 0;
 
             m_winSize = 21;
+
+            m_mode = ModeBM;
+            m_P1 = 8;
+            m_P2 = 96;
+            m_paths = 8;
         }
 
 
@@ -76,7 +388,21 @@ namespace sp{
         }
 
         void setWinSize(const int winSize) {
-            m_winSize = winSize;
+            m_winSize = maxVal(1, minVal(MAX_WINSIZE, winSize));
+        }
+
+        void setMode(const Mode mode) {
+            m_mode = mode;
+        }
+
+        Mode getMode() const {
+            return static_cast<Mode>(m_mode);
+        }
+
+        void setSGMParam(const int P1, const int P2, const int paths = 8) {
+            m_P1 = maxVal(0, minVal(SGM_MAXP, P1));
+            m_P2 = maxVal(m_P1, minVal(SGM_MAXP, P2));
+            m_paths = (paths == 4) ? 4 : 8;
         }
 
         Mem2<float>& getDispMap(const Order &order) {
@@ -110,15 +436,31 @@ namespace sp{
             return _execute(gryL, gryR);
         }
 
+        // external buffer / sub region (no copy)
+        virtual bool execute(const MemView<Byte> &srcL, const MemView<Byte> &srcR) {
+            return _execute(srcL, srcR);
+        }
+
+        virtual bool execute(const MemView<Col3> &srcL, const MemView<Col3> &srcR) {
+            Mem2<Byte> gryL, gryR;
+            cnvImg(gryL, srcL);
+            cnvImg(gryR, srcR);
+            return _execute(gryL, gryR);
+        }
+
     protected:
 
-        virtual bool _execute(const Mem2<Byte> &srcL, const Mem2<Byte> &srcR) {
+        virtual bool _execute(const MemView<Byte> &srcL, const MemView<Byte> &srcR) {
 
             m_dsize[0] = srcL.dsize[0];
             m_dsize[1] = srcL.dsize[1];
             {
-                correspBM(m_dispMap[0], m_evalMap[0], srcL, srcR, StereoL);
-                correspBM(m_dispMap[1], m_evalMap[1], srcR, srcL, StereoR);
+                if (m_mode == ModeSGM) {
+                    correspSGM(m_dispMap[0], m_evalMap[0], m_dispMap[1], m_evalMap[1], srcL, srcR);
+                }
+                else {
+                    correspBM(m_dispMap[0], m_evalMap[0], m_dispMap[1], m_evalMap[1], srcL, srcR);
+                }
 
                 consistencyCheck(m_dispMap[0], m_evalMap[0], m_dispMap[1], m_evalMap[1], 2.0, StereoL);
                 consistencyCheck(m_dispMap[1], m_evalMap[1], m_dispMap[0], m_evalMap[0], 2.0, StereoR);
@@ -133,14 +475,15 @@ namespace sp{
 
         Rect2 getDispRect(const int order) {
             const int layers = m_maxDisp - m_minDisp + 1;
+            const int winSize = (m_mode == ModeSGM) ? 7 : m_winSize;
 
             Rect2 rect = getRect2(m_dsize);
 
             const int maxv = (order > 0) ? m_maxDisp : -m_minDisp;
             const int minv = (order > 0) ? m_minDisp : -m_maxDisp;
 
-            const int lx = maxVal(+m_winSize + maxv - layers / 2, 0);
-            const int rx = maxVal(+m_winSize - minv - layers / 2, 0);
+            const int lx = maxVal(+winSize + maxv - layers / 2, 0);
+            const int rx = maxVal(+winSize - minv - layers / 2, 0);
 
             rect.dbase[0] += lx;
             rect.dsize[0] -= lx + rx;
@@ -148,38 +491,350 @@ namespace sp{
             return rect;
         }
 
-        void correspBM(Mem2<float> &dispMap, Mem2<float> &evalMap, const Mem2<Byte> &src, const Mem2<Byte> &ref, const int order) {
+        // left and right disparity from one cost volume (incremental SAD)
+        void correspBM(Mem2<float> &dispMapL, Mem2<float> &evalMapL, Mem2<float> &dispMapR, Mem2<float> &evalMapR, const MemView<Byte> &srcL, const MemView<Byte> &srcR) {
 
-            const Rect2 rect = getDispRect(order);
+            Rect2 rectL = getDispRect(StereoL);
+            Rect2 rectR = getDispRect(StereoR);
 
-            dispMap.resize(m_dsize);
-            dispMap.zero();
-            evalMap.resize(m_dsize);
-            evalMap.zero();
+            dispMapL.resize(m_dsize);
+            dispMapL.zero();
+            evalMapL.resize(m_dsize);
+            evalMapL.zero();
+            dispMapR.resize(m_dsize);
+            dispMapR.zero();
+            evalMapR.resize(m_dsize);
+            evalMapR.zero();
+
+            rectL.dsize[0] = maxVal(rectL.dsize[0], 0);
+            rectR.dsize[0] = maxVal(rectR.dsize[0], 0);
+
+            const int D = m_maxDisp - m_minDisp + 1;
+            if (D <= 0 || m_dsize[1] <= 0 || (rectL.dsize[0] == 0 && rectR.dsize[0] == 0)) return;
+
+            // disparity lane j : d = maxDisp - j (padded to 32 lanes)
+            const int Dp = (D + 31) / 32 * 32;
+
+            const int win = m_winSize;
+            const int offset = win / 2;
+            const int maxe = SP_BYTEMAX * win * win;
+
+            // column sums are 16 bit (SP_BYTEMAX * win)
+            SP_ASSERT(win >= 1 && win <= MAX_WINSIZE);
+
+            // evaluated x range
+            int xs = SP_INTMAX;
+            int xe = -SP_INTMAX;
+            if (rectL.dsize[0] > 0) {
+                xs = minVal(xs, rectL.dbase[0]);
+                xe = maxVal(xe, rectL.dbase[0] + rectL.dsize[0]);
+            }
+            if (rectR.dsize[0] > 0) {
+                xs = minVal(xs, rectR.dbase[0] + m_minDisp);
+                xe = maxVal(xe, rectR.dbase[0] + rectR.dsize[0] + m_maxDisp);
+            }
+
+            // column sum range
+            const int cx = xs - offset;
+            const int cn = (xe - xs) + win - 1;
+
+            // clamped images (row y -> y + offset)
+            const int rows = m_dsize[1] + win - 1;
+
+            Mem2<Byte> imgL(cn, rows);
+            Mem2<Byte> imgR(cn + Dp, rows);
+            for (int y = 0; y < rows; y++) {
+                for (int k = 0; k < cn; k++) {
+                    imgL(k, y) = srcL(cx + k, y - offset);
+                }
+                for (int k = 0; k < cn + Dp; k++) {
+                    imgR(k, y) = srcR(cx - m_maxDisp + k, y - offset);
+                }
+            }
+
+            const int STRIP = 32;
+            const int snum = (m_dsize[1] + STRIP - 1) / STRIP;
 
 #if SP_USE_OMP
 #pragma omp parallel for
 #endif
-            for (int v = rect.dbase[1]; v < rect.dbase[1] + rect.dsize[1]; v++) {
-                for (int d = m_minDisp; d <= m_maxDisp; d++) {
+            for (int s = 0; s < snum; s++) {
+                const int y0 = s * STRIP;
+                const int y1 = minVal(y0 + STRIP, m_dsize[1]);
+
+                Mem1<unsigned short> cols(cn * Dp);
+                cols.zero();
+
+                Mem1<unsigned short> czero(Dp);
+                czero.zero();
+
+                Mem1<Byte> bzero(Dp);
+                bzero.zero();
+
+                Mem1<int> sum(Dp);
 
-                    int sad = -1;
-                    for (int u = rect.dbase[0]; u < rect.dbase[0] + rect.dsize[0]; u++) {
-                        float &disp = dispMap(u, v);
-                        float &eval = evalMap(u, v);
+                // right : u = x - maxDisp + j
+                const int un = (xe - xs) + D - 1;
+                Mem1<int> best(un);
+                Mem1<int> bx(un);
 
-                        sad = calcSAD(src, ref, u, v, d, order, sad);
-                        const int e = (SP_BYTEMAX * m_winSize * m_winSize) - sad;
+                for (int wy = 0; wy < win; wy++) {
+                    for (int k = 0; k < cn; k++) {
+                        _stereo::updateCol(&cols[k * Dp], imgL(k, y0 + wy), &imgR(k, y0 + wy), 0, bzero.ptr, Dp);
+                    }
+                }
 
-                        if (e > eval) {
-                            eval = static_cast<float>(e);
-                            disp = static_cast<float>(d);
+                for (int y = y0; y < y1; y++) {
+                    if (y > y0) {
+                        const int ya = y + win - 1;
+                        const int yb = y - 1;
+                        for (int k = 0; k < cn; k++) {
+                            _stereo::updateCol(&cols[k * Dp], imgL(k, ya), &imgR(k, ya), imgL(k, yb), &imgR(k, yb), Dp);
+                        }
+                    }
+
+                    sum.zero();
+                    for (int k = 0; k < win; k++) {
+                        _stereo::updateSum(sum.ptr, &cols[k * Dp], czero.ptr, Dp);
+                    }
+                    setElm(best, SP_INTMAX);
+
+                    for (int x = xs; x < xe; x++) {
+                        const int k = x - xs;
+                        if (k > 0) {
+                            _stereo::updateSum(sum.ptr, &cols[(k + win - 1) * Dp], &cols[(k - 1) * Dp], Dp);
+                        }
+
+                        if (x >= rectL.dbase[0] && x < rectL.dbase[0] + rectL.dsize[0]) {
+                            int minv;
+                            const int j = _stereo::argMin(minv, sum.ptr, D);
+                            if (minv < maxe) {
+                                dispMapL(x, y) = static_cast<float>(m_maxDisp - j);
+                                evalMapL(x, y) = static_cast<float>(maxe - minv);
+                            }
+                        }
+
+                        _stereo::updateBest(&best[k], &bx[k], sum.ptr, x, D);
+                    }
+
+                    for (int u = rectR.dbase[0]; u < rectR.dbase[0] + rectR.dsize[0]; u++) {
+                        const int i = u - (xs - m_maxDisp);
+                        if (best[i] < maxe) {
+                            dispMapR(u, y) = static_cast<float>(bx[i] - u);
+                            evalMapR(u, y) = static_cast<float>(maxe - best[i]);
                         }
                     }
                 }
             }
         }
 
+        // semi-global matching (census cost, 4/8 path aggregation, subpixel)
+        void correspSGM(Mem2<float> &dispMapL, Mem2<float> &evalMapL, Mem2<float> &dispMapR, Mem2<float> &evalMapR, const MemView<Byte> &srcL, const MemView<Byte> &srcR) {
+
+            Rect2 rectL = getDispRect(StereoL);
+            Rect2 rectR = getDispRect(StereoR);
+
+            dispMapL.resize(m_dsize);
+            dispMapL.zero();
+            evalMapL.resize(m_dsize);
+            evalMapL.zero();
+            dispMapR.resize(m_dsize);
+            dispMapR.zero();
+            evalMapR.resize(m_dsize);
+            evalMapR.zero();
+
+            const int D = m_maxDisp - m_minDisp + 1;
+            if (D <= 0 || m_dsize[0] <= 0 || m_dsize[1] <= 0) return;
+
+            const int W = m_dsize[0];
+            const int H = m_dsize[1];
+
+            // disparity lane j : d = minDisp + j (padded to 16 lanes)
+            const int Dv = (D + 15) / 16 * 16;
+
+            // path cost stride (lane -1 and Dv : invalid value)
+            const int Ds = Dv + 2;
+            const short INVALID = 0x3FFF;
+
+            // path cost stays below INVALID
+            const short P1 = static_cast<short>(maxVal(0, minVal(SGM_MAXP, m_P1)));
+            const short P2 = static_cast<short>(maxVal(0, minVal(SGM_MAXP, m_P2)));
+
+            // matching cost
+            Mem1<Byte> costs(W * H * Dv);
+            {
+                Mem2<unsigned long long> cenL, cenR;
+                _stereo::census(cenL, srcL);
+                _stereo::census(cenR, srcR);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                for (int v = 0; v < H; v++) {
+                    // clamped row (x -> x + maxDisp)
+                    Mem1<unsigned long long> row(W + D - 1);
+                    for (int k = 0; k < row.size(); k++) {
+                        row[k] = cenR(k - m_maxDisp, v);
+                    }
+
+                    for (int u = 0; u < W; u++) {
+                        Byte *cost = &costs[(v * W + u) * Dv];
+                        const unsigned long long c = cenL(u, v);
+                        const unsigned long long *r = &row[u + m_maxDisp - m_minDisp];
+                        for (int j = 0; j < D; j++) {
+                            cost[j] = static_cast<Byte>(popcnt64(c ^ r[-j]));
+                        }
+                        for (int j = D; j < Dv; j++) {
+                            cost[j] = SP_BYTEMAX;
+                        }
+                    }
+                }
+            }
+
+            // aggregated cost
+            Mem1<short> sums(W * H * Dv);
+            sums.zero();
+
+            // L[j] (invalid lanes are reset after aggregation)
+            auto aggregate = [&](short *dst, const short *prev, const short pmin, const Byte *cost) -> short {
+                if (prev != NULL) {
+                    _stereo::aggregate(dst, prev, cost, Dv, pmin, P1, P2);
+                }
+                else {
+                    for (int j = 0; j < Dv; j++) dst[j] = cost[j];
+                }
+                for (int j = D; j < Dv; j++) dst[j] = INVALID;
+                return minVal(_stereo::minCost(dst, Dv), INVALID);
+            };
+
+            // horizontal paths (parallel over rows)
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int v = 0; v < H; v++) {
+                Mem1<short> buf(2 * Ds);
+                setElm(buf, INVALID);
+
+                for (int dir = -1; dir <= +1; dir += 2) {
+                    short pmin = 0;
+                    for (int i = 0; i < W; i++) {
+                        const int u = (dir > 0) ? i : W - 1 - i;
+                        short *crnt = &buf[(i % 2) * Ds + 1];
+                        const short *prev = (i > 0) ? &buf[((i + 1) % 2) * Ds + 1] : NULL;
+
+                        pmin = aggregate(crnt, prev, pmin, &costs[(v * W + u) * Dv]);
+                        _stereo::addCost(&sums[(v * W + u) * Dv], crnt, Dv);
+                    }
+                }
+            }
+
+            // vertical and diagonal paths (one sweep per direction, parallel over blocks of scanlines)
+            {
+                const int pnum = (m_paths == 8) ? 3 : 1;
+                const int dxs[3] = { 0, +1, -1 };
+
+                // scanlines per block
+                const int B = 16;
+
+                for (int dir = -1; dir <= +1; dir += 2) {
+                    for (int p = 0; p < pnum; p++) {
+
+                        // scanline c : u = c + s * i (i : step)
+                        const int s = dir * dxs[p];
+                        const int c0 = minVal(0, -s * (H - 1));
+                        const int c1 = maxVal(W - 1, W - 1 - s * (H - 1));
+                        const int bnum = (c1 - c0 + B) / B;
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                        for (int b = 0; b < bnum; b++) {
+                            Mem1<short> buf(2 * B * Ds);
+                            setElm(buf, INVALID);
+
+                            short mins[2 * B];
+
+                            for (int i = 0; i < H; i++) {
+                                const int v = (dir > 0) ? i : H - 1 - i;
+
+                                short *crnt = &buf[(i % 2) * B * Ds];
+                                const short *prev = &buf[((i + 1) % 2) * B * Ds];
+                                short *cmin = &mins[(i % 2) * B];
+                                const short *pmin = &mins[((i + 1) % 2) * B];
+
+                                for (int l = 0; l < B; l++) {
+                                    const int c = c0 + b * B + l;
+                                    const int u = c + s * i;
+                                    if (c > c1 || u < 0 || u >= W) continue;
+
+                                    const bool start = (i == 0 || u - s < 0 || u - s >= W);
+
+                                    short *dst = &crnt[l * Ds + 1];
+                                    const short *src = (start == false) ? &prev[l * Ds + 1] : NULL;
+
+                                    cmin[l] = aggregate(dst, src, (start == false) ? pmin[l] : 0, &costs[(v * W + u) * Dv]);
+                                    _stereo::addCost(&sums[(v * W + u) * Dv], dst, Dv);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            // winner takes all + subpixel (parabola)
+            const int paths = (m_paths == 8) ? 8 : 4;
+            const float maxe = static_cast<float>(paths * (SGM_MAXCOST + P2));
+
+            auto select = [&](float &disp, float &eval, const short *sum, const int stride, const int n) -> void {
+                int best = -1;
+                int minv = 0x7FFF;
+                if (stride == 1) {
+                    minv = _stereo::minCost(sum, Dv);
+                    for (int j = 0; j < n; j++) {
+                        if (sum[j] == minv) {
+                            best = j;
+                            break;
+                        }
+                    }
+                }
+                else {
+                    for (int j = 0; j < n; j++) {
+                        if (sum[j * stride] < minv) {
+                            minv = sum[j * stride];
+                            best = j;
+                        }
+                    }
+                }
+                if (best < 0 || minv >= INVALID) return;
+
+                float sub = 0.0f;
+                if (best > 0 && best < n - 1) {
+                    const int c0 = sum[(best - 1) * stride];
+                    const int c2 = sum[(best + 1) * stride];
+                    const int den = c0 - 2 * minv + c2;
+                    if (den > 0) sub = static_cast<float>(c0 - c2) / (2.0f * den);
+                }
+                disp = m_minDisp + best + sub;
+                eval = maxVal(maxe - minv, 1.0f);
+            };
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int v = rectL.dbase[1]; v < rectL.dbase[1] + rectL.dsize[1]; v++) {
+                for (int u = rectL.dbase[0]; u < rectL.dbase[0] + rectL.dsize[0]; u++) {
+                    select(dispMapL(u, v), evalMapL(u, v), &sums[(v * W + u) * Dv], 1, D);
+                }
+
+                // right : C_R(u, d) = C_L(u + d, d)
+                for (int u = rectR.dbase[0]; u < rectR.dbase[0] + rectR.dsize[0]; u++) {
+                    const int x0 = u + m_minDisp;
+                    if (x0 < 0 || x0 + D - 1 >= W) continue;
+                    select(dispMapR(u, v), evalMapR(u, v), &sums[(v * W + x0) * Dv], Dv + 1, D);
+                }
+            }
+        }
+
         void consistencyCheck(Mem2<float> &dispMap0, Mem2<float> &evalMap0, const Mem2<float> &dispMap1, const Mem2<float> &evalMap1, const double thresh, const int order) {
 
             const Rect2 rect = getDispRect(order);
@@ -223,48 +878,6 @@ namespace sp{
             }
         }
 
-    protected:
-
-        int calcSAD(const Mem2<Byte> &src, const Mem2<Byte> &ref, const int x, const int y, const int d, const int order, const int pre = -1) {
-
-            const int offset = m_winSize / 2;
-
-            int sad;
-
-            if (pre < 0) {
-                sad = 0;
-
-                for (int wy = 0; wy < m_winSize; wy++) {
-                    for (int wx = 0; wx < m_winSize; wx++) {
-                        const int v0 = src(x + wx - offset, y + wy - offset);
-                        const int v1 = ref(x + wx - offset - order * d, y + wy - offset);
-                        sad += abs(v0 - v1);
-                    }
-                }
-            }
-            else {
-                sad = pre;
-                
-                int wx;
-                
-                wx = -1;
-                for (int wy = 0; wy < m_winSize; wy++) {
-                    const int v0 = src(x + wx - offset, y + wy - offset);
-                    const int v1 = ref(x + wx - offset - order * d, y + wy - offset);
-                    sad -= abs(v0 - v1);
-                }
-
-                wx = m_winSize - 1;
-                for (int wy = 0; wy < m_winSize; wy++) {
-                    const int v0 = src(x + wx - offset, y + wy - offset);
-                    const int v1 = ref(x + wx - offset - order * d, y + wy - offset);
-                    sad += abs(v0 - v1);
-                }
-            }
-
-            return sad;
-        }
-
     };
 
 }
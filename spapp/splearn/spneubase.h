@@ -9,6 +9,98 @@
 
 namespace sp{
 
+    //--------------------------------------------------------------------------------
+    // tensor (mini batch in one contiguous buffer, sample major : N, C, H, W)
+    //--------------------------------------------------------------------------------
+
+    class Tensor{
+    public:
+
+        // sample number
+        int num;
+
+        // sample dim / dsize (dsize[0] : width, dsize[1] : height, dsize[2] : channel)
+        int dim;
+        int dsize[SP_DIMMAX];
+
+        // buffer (capacity is kept, resize reallocates only to grow)
+        Mem1<SP_REAL> buf;
+
+    public:
+
+        Tensor(){
+            num = 0;
+            dim = 0;
+            for (int i = 0; i < SP_DIMMAX; i++){
+                dsize[i] = 0;
+            }
+        }
+
+        Tensor(const Mem1<Mem<SP_REAL> > &src){
+            num = 0;
+            dim = 0;
+            set(src);
+        }
+
+        void resize(const int num, const int dim, const int *dsize){
+            this->num = num;
+            this->dim = dim;
+            for (int i = 0; i < SP_DIMMAX; i++){
+                this->dsize[i] = (i < dim) ? dsize[i] : 0;
+            }
+            buf.resize(size());
+        }
+
+        // sample size
+        int step() const{
+            int ret = (dim > 0) ? 1 : 0;
+            for (int i = 0; i < dim; i++){
+                ret *= dsize[i];
+            }
+            return ret;
+        }
+
+        int size() const{
+            return num * step();
+        }
+
+        SP_REAL* operator [](const int n){
+            return buf.ptr + n * step();
+        }
+
+        const SP_REAL* operator [](const int n) const{
+            return buf.ptr + n * step();
+        }
+
+        void zero(){
+            buf.zero();
+        }
+
+        // copy src[base, base + num) (num < 0 : all, empty range : empty tensor)
+        void set(const Mem1<Mem<SP_REAL> > &src, const int base = 0, const int num = -1){
+            const int cnt = (num < 0) ? src.size() - base : minVal(num, src.size() - base);
+            if (base < 0 || cnt <= 0){
+                resize(0, 0, NULL);
+                return;
+            }
+            resize(cnt, src[base].dim, src[base].dsize);
+
+            const int stp = step();
+            for (int n = 0; n < cnt; n++){
+                memcpy(buf.ptr + n * stp, src[base + n].ptr, stp * sizeof(SP_REAL));
+            }
+        }
+
+        // split into samples
+        void get(Mem1<Mem<SP_REAL> > &dst) const{
+            dst.resize(num);
+            for (int n = 0; n < num; n++){
+                dst[n].resize(dim, dsize, buf.ptr + n * step());
+            }
+        }
+    };
+
+
     //--------------------------------------------------------------------------------
     // one hot
     //--------------------------------------------------------------------------------
@@ -33,6 +125,15 @@ namespace sp{
         return loss;
     }
 
+    SP_CPUFUNC SP_REAL crossEntropy(const Tensor &result, const Mem1<int> &truth){
+
+        SP_REAL loss = 0.0;
+        for (int n = 0; n < result.num; n++){
+            loss += -log(result[n][truth[n]]);
+        }
+        return (result.num > 0) ? loss / result.num : 0.0;
+    }
+
     SP_CPUFUNC SP_REAL crossEntropy(const Mem1<Mem<SP_REAL> > &result, const Mem1<int> &truth){
 
         Mem1<SP_REAL> loss(result.size());
@@ -59,6 +160,23 @@ namespace sp{
         return (maxArg(result) == maxArg(label)) ? 1.0 : 0.0;
     }
 
+    SP_CPUFUNC SP_REAL testAccuracy(const Tensor &result, const Mem1<int> &truth) {
+
+        const int step = result.step();
+
+        SP_REAL accuracy = 0.0;
+        for (int n = 0; n < result.num; n++) {
+            const SP_REAL *p = result[n];
+
+            int id = 0;
+            for (int i = 1; i < step; i++) {
+                if (p[i] > p[id]) id = i;
+            }
+            accuracy += testAccuracy(id, truth[n]);
+        }
+        return (result.num > 0) ? accuracy / result.num : 0.0;
+    }
+
     template<typename TYPE0, typename TYPE1>
     SP_CPUFUNC SP_REAL testAccuracy(const Mem1<TYPE0> &result, const Mem1<TYPE1> &truth) {
 
@@ -106,5 +224,66 @@ namespace sp{
 
     };
 
+
+    //--------------------------------------------------------------------------------
+    // int8 quantization
+    //--------------------------------------------------------------------------------
+
+    namespace _neu {
+
+        // symmetric quantization (dst = round(src / scale), scale = max|src| / 127)
+        template <typename TYPE>
+        SP_CPUFUNC SP_REAL quantize(signed char *dst, const TYPE *src, const int num) {
+            SP_REAL maxv = 0.0;
+            for (int i = 0; i < num; i++) {
+                maxv = maxVal(maxv, fabs(src[i]));
+            }
+            const SP_REAL scale = (maxv > 0.0) ? maxv / 127.0 : 1.0;
+
+            for (int i = 0; i < num; i++) {
+                const SP_REAL v = src[i] / scale;
+                dst[i] = static_cast<signed char>(maxVal(-127, minVal(127, static_cast<int>(floor(v + 0.5)))));
+            }
+            return scale;
+        }
+
+        // int8 dot product (int32 accumulation)
+        SP_CPUFUNC int dot8(const signed char *a, const signed char *b, const int num) {
+            int i = 0;
+            int sum = 0;
+
+#if SP_USE_AVX
+            __m256i s = _mm256_setzero_si256();
+            for (; i + 16 <= num; i += 16) {
+                const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+                const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+                s = _mm256_add_epi32(s, _mm256_madd_epi16(va, vb));
+            }
+            __m128i h = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+            h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0x4E));
+            h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0xB1));
+            sum = _mm_cvtsi128_si32(h);
+#elif SP_USE_SSE
+            __m128i s = _mm_setzero_si128();
+            for (; i + 8 <= num; i += 8) {
+                const __m128i la = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i));
+                const __m128i lb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i));
+
+                // sign extension (int8 -> int16)
+                const __m128i va = _mm_srai_epi16(_mm_unpacklo_epi8(la, la), 8);
+                const __m128i vb = _mm_srai_epi16(_mm_unpacklo_epi8(lb, lb), 8);
+                s = _mm_add_epi32(s, _mm_madd_epi16(va, vb));
+            }
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+            sum = _mm_cvtsi128_si32(s);
+#endif
+            for (; i < num; i++) {
+                sum += a[i] * b[i];
+            }
+            return sum;
+        }
+    }
+
 }
 #endif
@@ -34,13 +34,18 @@ namespace sp{
         //
 
         // src (mini batch)
-        const Mem1<Mem<SP_REAL> > *m_X, *m_A;
+        const Tensor *m_X, *m_A;
 
-        // dst (mini batch)
-        Mem1<Mem<SP_REAL> > m_Y, m_B;
+        // dst (mini batch, buffers are reused over iterations)
+        Tensor m_Y, m_B;
 
     public:
 
+        // computation precision
+        enum Precision{
+            Double = 0, Float = 1, Int8 = 2,
+        };
+
         // initialize flag
         bool m_init;
 
@@ -50,17 +55,31 @@ namespace sp{
         // node number
         int m_nodeNum;
 
+        // precision (Int8 : inference only)
+        Precision m_precision;
+
         BaseLayer(){
+            m_X = NULL;
+            m_A = NULL;
             m_init = false;
             m_train = false;
             m_nodeNum = 0;
+            m_precision = Double;
         }
-        ~BaseLayer() {
+        virtual ~BaseLayer() {
         }
 
         // get layer name
         virtual const char* getName() = 0;
 
+        // copy layer (parameter and buffer)
+        virtual BaseLayer* clone() const = 0;
+
+        // set computation precision
+        virtual void setPrecision(const Precision precision){
+            m_precision = precision;
+        }
+
         // file text
         SP_TEXTEX(){
             file.text(&m_init, 1, "init");
@@ -73,22 +92,21 @@ namespace sp{
         //--------------------------------------------------------------------------------
 
         // execute foward(true) / backward(false)
-        const Mem1<Mem<SP_REAL> >* execute(const Mem1<Mem<SP_REAL> > *src, const bool direct){
+        const Tensor* execute(const Tensor *src, const bool direct){
 
             return (direct == true) ? _forward(src) : _backward(src);
         }
 
         // get result data
-        const Mem1<Mem<SP_REAL> >& getResult(const bool direct){
+        const Tensor& getResult(const bool direct){
 
             return (direct == true) ? m_Y : m_B;
         }
 
     private:
 
-        const Mem1<Mem<SP_REAL> >* _forward(const Mem1<Mem<SP_REAL> > *src){
+        const Tensor* _forward(const Tensor *src){
             m_X = src;
-            m_Y.resize(src->size());
 
             if (m_init == false){
                 m_init = true;
@@ -99,26 +117,23 @@ namespace sp{
             return &m_Y;
         }
 
-        const Mem1<Mem<SP_REAL> >* _backward(const Mem1<Mem<SP_REAL> > *src){
+        const Tensor* _backward(const Tensor *src){
             m_A = src;
-            m_B.resize(src->size());
 
             backward(m_B, *m_A, m_Y, *m_X);
 
             // reshape
-            for (int n = 0; n < m_B.size(); n++){
-                m_B[n].resize((*m_X)[n].dim, (*m_X)[n].dsize);
-            }
+            m_B.resize(m_X->num, m_X->dim, m_X->dsize);
             return &m_B;
         }
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor &X){
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor &Y, const Tensor &X){
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
         }
 
     };
@@ -135,6 +150,9 @@ namespace sp{
         };
         UpdataMethod m_update;
 
+        // hold gradient in backward (reduced and applied by the caller, data parallel training)
+        bool m_hold;
+
     private:
 
         // update rate
@@ -148,11 +166,28 @@ namespace sp{
         // velocity for momentum
         NodeParam m_vel;
 
+        // gradient (reused over iterations)
+        NodeParam m_grd;
+
+        // float parameter (Float, Int8)
+        Mem2<float> m_fw;
+        Mem1<float> m_fb;
+
+        // int8 weight and per node scale (Int8)
+        Mem2<signed char> m_qw;
+        Mem1<SP_REAL> m_qs;
+
+        // parameter update flag
+        bool m_fdirty, m_qdirty;
+
     public:
 
         ParamLayer(){
             m_update = Momentum;
+            m_hold = false;
             m_lambda = 0.1;
+            m_fdirty = true;
+            m_qdirty = false;
         }
 
         SP_TEXTEX(){
@@ -165,6 +200,22 @@ namespace sp{
 
             file.text(&m_vel.w, 1, "vel.w");
             file.text(&m_vel.b, 1, "vel.b");
+
+            // quantized parameter is kept as it is (not re-quantized from prm.w)
+            file.textf("%d", &m_precision, 1, "precision");
+            if (m_precision == Int8){
+                file.text(&m_qw, 1, "q.w");
+                file.text(&m_qs, 1, "q.s");
+            }
+        }
+
+        virtual void setPrecision(const Precision precision){
+            BaseLayer::setPrecision(precision);
+            m_fdirty = true;
+
+            if (m_init == true){
+                prepare();
+            }
         }
 
         void update(const NodeParam &grd){
@@ -175,8 +226,62 @@ namespace sp{
             case Momentum:
                 momentum(grd); break;
             }
+            m_fdirty = true;
+            m_qdirty = true;
+        }
+
+        // gradient of the last backward
+        NodeParam& getGrad(){
+            return m_grd;
+        }
+
+    protected:
+
+        // update by the last backward (skipped while holding)
+        void updateGrad(){
+            if (m_hold == false){
+                update(m_grd);
+            }
+        }
+
+        // low precision compute (Float, or Int8 while training)
+        bool useFloat(){
+            return m_precision == Float || (m_precision == Int8 && m_train == true);
+        }
+
+        // int8 compute (inference)
+        bool useInt8(){
+            return m_precision == Int8 && m_train == false;
+        }
+
+        // refresh float / int8 parameter
+        void prepare(){
+            if (m_precision == Double) return;
+
+            if (m_fdirty == true || m_fw.size() != m_prm.w.size()){
+                m_fw.resize(m_prm.w.dsize);
+                m_fb.resize(m_prm.b.size());
+                setMem(m_fw.ptr, m_fw.size(), m_prm.w.ptr);
+                setMem(m_fb.ptr, m_fb.size(), m_prm.b.ptr);
+                m_fdirty = false;
+            }
+
+            if (m_precision == Int8 && (m_qdirty == true || m_qw.size() != m_prm.w.size())){
+                const int rows = m_prm.w.rows();
+                const int cols = m_prm.w.cols();
+                m_qw.resize(m_prm.w.dsize);
+                m_qs.resize(rows);
+
+                // per node (output channel) scale
+                for (int r = 0; r < rows; r++){
+                    m_qs[r] = _neu::quantize(&m_qw[r * cols], &m_prm.w(r, 0), cols);
+                }
+                m_qdirty = false;
+            }
         }
 
+    public:
+
         void update(const Mem1<NodeParam> &grds){
             NodeParam grd = grds[0];
             for (int n = 1; n < grds.size(); n++){
@@ -187,9 +292,15 @@ namespace sp{
         }
 
     private:
+
+        // in place (no temporary matrix)
         void sgd(const NodeParam &grd){
-            m_prm.w -= grd.w * m_lambda;
-            m_prm.b -= grd.b * m_lambda;
+            for (int i = 0; i < m_prm.w.size(); i++){
+                m_prm.w[i] -= grd.w[i] * m_lambda;
+            }
+            for (int i = 0; i < m_prm.b.size(); i++){
+                m_prm.b[i] -= grd.b[i] * m_lambda;
+            }
         }
 
         void momentum(const NodeParam &grd){
@@ -199,11 +310,14 @@ namespace sp{
             }
             const double momentum = 0.9;
 
-            m_vel.w = m_vel.w * momentum + grd.w * m_lambda;
-            m_vel.b = m_vel.b * momentum + grd.b * m_lambda;
-            m_prm.w -= m_vel.w;
-            m_prm.b -= m_vel.b;
-
+            for (int i = 0; i < m_prm.w.size(); i++){
+                m_vel.w[i] = m_vel.w[i] * momentum + grd.w[i] * m_lambda;
+                m_prm.w[i] -= m_vel.w[i];
+            }
+            for (int i = 0; i < m_prm.b.size(); i++){
+                m_vel.b[i] = m_vel.b[i] * momentum + grd.b[i] * m_lambda;
+                m_prm.b[i] -= m_vel.b[i];
+            }
         }
 
     };
@@ -215,6 +329,12 @@ namespace sp{
 
     class AffineLayer : public ParamLayer{
 
+    private:
+
+        // float / int8 work buffer
+        Mem1<float> m_fX, m_fY, m_fA, m_fB, m_fW;
+        Mem1<signed char> m_qX;
+
     public:
         AffineLayer(){
         }
@@ -227,12 +347,16 @@ namespace sp{
             return "AffineLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            return new AffineLayer(*this);
+        }
+
         SP_TEXTEX(){
             ParamLayer::textex(file);
         }
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
-            const int dataNum = X[0].size();
+        virtual void init(const Tensor &X){
+            const int dataNum = X.step();
 
             // foward parameter
             m_prm.resize(m_nodeNum, dataNum);
@@ -240,40 +364,99 @@ namespace sp{
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor &Y, const Tensor &X){
+            prepare();
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < Y.size(); n++){
-                const Mat mX = Mat(X[n].size(), 1, X[n].ptr);
+            const int N = X.num;
+            const int D = X.step();
+
+            const int dsize[2] = { 1, m_nodeNum };
+            Y.resize(N, 2, dsize);
+
+            if (useInt8() == true){
+                fwrdInt8(Y, X);
+                return;
+            }
 
-                // Y = w * X + b
-                Y[n] = m_prm.w * mX + m_prm.b;
+            // Y = X * w^T + b (minibatch, row : sample)
+            if (useFloat() == true){
+                m_fX.resize(N * D);
+                m_fY.resize(N * m_nodeNum);
+                setMem(m_fX.ptr, N * D, X.buf.ptr);
+
+                gemm<float>(m_fY.ptr, m_nodeNum, m_fX.ptr, D, false, m_fw.ptr, D, true, N, m_nodeNum, D);
+
+                for (int n = 0; n < N; n++){
+                    addMem(Y[n], m_nodeNum, &m_fY[n * m_nodeNum], m_fb.ptr);
+                }
+            }
+            else{
+                gemm<SP_REAL>(Y.buf.ptr, m_nodeNum, X.buf.ptr, D, false, m_prm.w.ptr, D, true, N, m_nodeNum, D);
+
+                for (int n = 0; n < N; n++){
+                    addMem(Y[n], m_nodeNum, Y[n], m_prm.b.ptr);
+                }
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            prepare();
 
-            const Mat wt = trnMat(m_prm.w);
+            const int N = X.num;
+            const int D = X.step();
 
-            Mem1<NodeParam> m_grds(B.size());
+            m_grd.resize(m_nodeNum, D);
+            B.resize(N, X.dim, X.dsize);
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < B.size(); n++){
-                const Mat mA(A[n].size(), 1, A[n].ptr);
-                const Mat mX(X[n].size(), 1, X[n].ptr);
+            // dw = A^T * X, db = sum(A), B = A * w
+            if (useFloat() == true){
+                m_fA.resize(N * m_nodeNum);
+                m_fX.resize(N * D);
+                m_fB.resize(N * D);
+                m_fW.resize(m_nodeNum * D);
+                setMem(m_fA.ptr, N * m_nodeNum, A.buf.ptr);
+                setMem(m_fX.ptr, N * D, X.buf.ptr);
 
-                m_grds[n].w = mA * trnMat(mX);
-                m_grds[n].b = mA;
+                gemm<float>(m_fW.ptr, D, m_fA.ptr, m_nodeNum, true, m_fX.ptr, D, false, m_nodeNum, D, N);
+                setMem(m_grd.w.ptr, m_nodeNum * D, m_fW.ptr);
+
+                gemm<float>(m_fB.ptr, D, m_fA.ptr, m_nodeNum, false, m_fw.ptr, D, false, N, D, m_nodeNum);
+                setMem(B.buf.ptr, N * D, m_fB.ptr);
+            }
+            else{
+                gemm<SP_REAL>(m_grd.w.ptr, D, A.buf.ptr, m_nodeNum, true, X.buf.ptr, D, false, m_nodeNum, D, N);
+                gemm<SP_REAL>(B.buf.ptr, D, A.buf.ptr, m_nodeNum, false, m_prm.w.ptr, D, false, N, D, m_nodeNum);
+            }
 
-                B[n] = wt * mA;
+            m_grd.b.zero();
+            for (int n = 0; n < N; n++){
+                addMem(m_grd.b.ptr, m_nodeNum, m_grd.b.ptr, A[n]);
             }
 
             // update
-            update(m_grds);
+            updateGrad();
+        }
+
+    private:
+
+        // Y = sx * sw * (qx * qw^T) + b (int8, per sample / per node scale)
+        void fwrdInt8(Tensor &Y, const Tensor &X){
+            const int cols = m_qw.dsize[0];
+            m_qX.resize(X.num * cols);
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int n = 0; n < X.num; n++){
+                signed char *qx = &m_qX[n * cols];
+                const SP_REAL sx = _neu::quantize(qx, X[n], cols);
+
+                SP_REAL *py = Y[n];
+                for (int c = 0; c < m_nodeNum; c++){
+                    const int sum = _neu::dot8(&m_qw[c * cols], qx, cols);
+                    py[c] = sx * m_qs[c] * sum + m_prm.b[c];
+                }
+            }
         }
 
     };
@@ -292,28 +475,42 @@ namespace sp{
 
     private:
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor &Y, const Tensor &X){
+            const int step = X.step();
+            Y.resize(X.num, X.dim, X.dsize);
 
-            for (int n = 0; n < Y.size(); n++){
-                const SP_REAL maxv = maxVal(X[n]);
+            for (int n = 0; n < Y.num; n++){
+                const SP_REAL *px = X[n];
+                SP_REAL *py = Y[n];
 
-                Mem1<SP_REAL> S(X[n].size());
-                for (int i = 0; i < S.size(); i++){
-                    S[i] = exp(X[n][i] - maxv);
+                SP_REAL maxv = px[0];
+                for (int i = 1; i < step; i++){
+                    maxv = maxVal(maxv, px[i]);
+                }
+
+                SP_REAL sum = 0.0;
+                for (int i = 0; i < step; i++){
+                    py[i] = exp(px[i] - maxv);
+                    sum += py[i];
                 }
 
                 // Y = S / sum(S)
-                divElm(Y[n], S, sumVal(S));
+                for (int i = 0; i < step; i++){
+                    py[i] /= sum;
+                }
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            B.resize(A.num, A.dim, A.dsize);
 
-            for (int n = 0; n < B.size(); n++){
+            const SP_REAL *py = Y.buf.ptr;
+            const SP_REAL *pa = A.buf.ptr;
+            SP_REAL *pb = B.buf.ptr;
 
-                // B = (Y - A) / batch
-                subMem(B[n], Y[n], A[n]);
-                divElm(B[n], B[n], B.size());
+            // B = (Y - A) / batch
+            for (int i = 0; i < B.size(); i++){
+                pb[i] = (py[i] - pa[i]) / B.num;
             }
         }
 
@@ -327,6 +524,10 @@ namespace sp{
             return "SoftMaxLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            return new SoftMaxLayer(*this);
+        }
+
         SP_TEXTEX(){
             BaseLayer::textex(file);
         }
@@ -355,6 +556,10 @@ namespace sp{
             return "ActivationLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            return new ActivationLayer(*this);
+        }
+
         SP_TEXTEX(){
             BaseLayer::textex(file);
             file.textf("%d", &m_activation, 1, "activation");
@@ -362,25 +567,25 @@ namespace sp{
 
     private:
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-            for (int n = 0; n < Y.size(); n++){
-                Y[n].resize(X[n].dim, X[n].dsize);
+        virtual void forward(Tensor &Y, const Tensor &X){
+            Y.resize(X.num, X.dim, X.dsize);
 
-                for (int i = 0; i < Y[n].size(); i++){
-                    Y[n][i] = calcFwrd(X[n][i]);
-                }
+            const SP_REAL *px = X.buf.ptr;
+            SP_REAL *py = Y.buf.ptr;
+            for (int i = 0; i < Y.size(); i++){
+                py[i] = calcFwrd(px[i]);
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-            for (int n = 0; n < B.size(); n++){
-                B[n].resize(A[n].dim, A[n].dsize);
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            B.resize(A.num, A.dim, A.dsize);
 
-                for (int i = 0; i < B[n].size(); i++){
-                    B[n][i] = calcBwrd(A[n][i], Y[n][i], X[n][i]);
-                }
+            const SP_REAL *pa = A.buf.ptr;
+            const SP_REAL *py = Y.buf.ptr;
+            const SP_REAL *px = X.buf.ptr;
+            SP_REAL *pb = B.buf.ptr;
+            for (int i = 0; i < B.size(); i++){
+                pb[i] = calcBwrd(pa[i], py[i], px[i]);
             }
         }
 
@@ -430,6 +635,20 @@ namespace sp{
         // kernel dsize
         int m_kernel[3];
 
+        // work buffer (col : im2col, mat : Y or A, dcol : col gradient, gw : weight gradient)
+        template<typename MAT>
+        struct Work{
+            MAT col, mat, dcol, gw;
+        };
+        Work<Mat> m_work;
+        Work<Mem2<float> > m_fwork;
+
+        // clamped source index / valid output range
+        Mem1<int> m_us, m_vs, m_ous;
+
+        // int8 input / transposed im2col
+        Mem1<signed char> m_qX, m_qcol;
+
     public:
         ConvolutionLayer(){
             m_nodeNum = 0;
@@ -449,6 +668,10 @@ namespace sp{
             return "ConvolutionLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            return new ConvolutionLayer(*this);
+        }
+
         SP_TEXTEX(){
             ParamLayer::textex(file);
 
@@ -461,17 +684,17 @@ namespace sp{
 
     private:
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor &X){
 
             // output dsize
-            m_output[0] = (X[0].dsize[0] - 2 * m_margin) / m_stride;
-            m_output[1] = (X[0].dsize[1] - 2 * m_margin) / m_stride;
+            m_output[0] = (X.dsize[0] - 2 * m_margin) / m_stride;
+            m_output[1] = (X.dsize[1] - 2 * m_margin) / m_stride;
             m_output[2] = m_nodeNum;
 
             // kernel dsize
             m_kernel[0] = m_winSize;
             m_kernel[1] = m_winSize;
-            m_kernel[2] = maxVal(X[0].dsize[2], 1);
+            m_kernel[2] = maxVal(X.dsize[2], 1);
 
             // foward parameter
             m_prm.resize(m_nodeNum, m_kernel[0] * m_kernel[1] * m_kernel[2]);
@@ -479,126 +702,274 @@ namespace sp{
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor &Y, const Tensor &X){
+            prepare();
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < X.size(); n++){
-                Y[n] = cnvFwrd(X[n]);
+            Y.resize(X.num, 3, m_output);
+
+            if (useInt8() == true){
+                fwrdInt8(Y, X);
+            }
+            else if (useFloat() == true){
+                fwrd<float>(Y, X, m_fw, m_fwork);
+            }
+            else{
+                fwrd<SP_REAL>(Y, X, m_prm.w, m_work);
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            prepare();
 
-            Mem1<NodeParam> grds(B.size());
+            m_grd.resize(m_nodeNum, m_kernel[0] * m_kernel[1] * m_kernel[2]);
+            m_grd.zero();
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < B.size(); n++){
-                B[n] = cnvBwrd(A[n], X[n]);
-                grds[n] = grdBwrd(A[n], X[n]);
+            B.resize(X.num, X.dim, X.dsize);
+
+            if (useFloat() == true){
+                bwrd<float>(B, A, X, m_fw, m_fwork);
+            }
+            else{
+                bwrd<SP_REAL>(B, A, X, m_prm.w, m_work);
             }
 
             // update
-            update(grds);
+            updateGrad();
         }
 
-        Mem<SP_REAL>  cnvFwrd(const Mem<SP_REAL>  &X){
-            Mem<SP_REAL>  Y(3, m_output);
+        // samples per im2col matrix (about 32 MB)
+        int getChunk(){
+            const int size = m_kernel[0] * m_kernel[1] * m_kernel[2] * m_output[0] * m_output[1];
+            return maxVal(1, (1 << 22) / maxVal(size, 1));
+        }
 
-            for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
+        // Y = w * col + b (MAT : Mat or Mem2<float>)
+        template<typename TYPE, typename MAT>
+        void fwrd(Tensor &Y, const Tensor &X, const MAT &w, Work<MAT> &work){
+            const int P = m_output[0] * m_output[1];
+            const int chunk = getChunk();
 
-                        const int u = ou * m_stride + m_margin;
-                        const int v = ov * m_stride + m_margin;
+            for (int n0 = 0; n0 < X.num; n0 += chunk){
+                const int num = minVal(chunk, X.num - n0);
 
-                        const SP_REAL *pw = &m_prm.w(oc, 0);
-                        const int hsize = m_winSize / 2;
+                im2col<TYPE>(work.col, X, n0, num);
 
-                        SP_REAL sum = 0.0;
+                // node x num * P
+                gemm(work.mat, w, false, work.col, false);
 
-                        // convolution forward
-                        for (int kc = 0; kc < m_kernel[2]; kc++){
-                            for (int ky = 0; ky < m_kernel[1]; ky++){
-                                for (int kx = 0; kx < m_kernel[0]; kx++){
-                                    sum += *(pw++) * acs3(X, u + kx - hsize, v + ky - hsize, kc);
-                                }
-                            }
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                for (int n = 0; n < num; n++){
+                    SP_REAL *py = Y[n0 + n];
+
+                    for (int oc = 0; oc < m_output[2]; oc++){
+                        const SP_REAL b = m_prm.b(oc, 0);
+                        const TYPE *pm = &work.mat[oc * work.mat.dsize[0] + n * P];
+                        for (int p = 0; p < P; p++){
+                            py[oc * P + p] = pm[p] + b;
                         }
-                        acs3(Y, ou, ov, oc) = sum + m_prm.b(oc, 0);
                     }
                 }
             }
-            return Y;
         }
 
-        Mem<SP_REAL>  cnvBwrd(const Mem<SP_REAL>  &A, const Mem<SP_REAL>  &X){
-            Mem<SP_REAL>  B(X.dim, X.dsize);
-            B.zero();
+        // dw = A * col^T, db = sum(A), dcol = w^T * A
+        template<typename TYPE, typename MAT>
+        void bwrd(Tensor &B, const Tensor &A, const Tensor &X, const MAT &w, Work<MAT> &work){
+            const int P = m_output[0] * m_output[1];
+            const int chunk = getChunk();
+
+            for (int n0 = 0; n0 < B.num; n0 += chunk){
+                const int num = minVal(chunk, B.num - n0);
+
+                im2col<TYPE>(work.col, X, n0, num);
+
+                // A (node x num * P)
+                const int dsize[2] = { num * P, m_nodeNum };
+                work.mat.resize(dsize);
+                for (int n = 0; n < num; n++){
+                    for (int oc = 0; oc < m_nodeNum; oc++){
+                        const SP_REAL *pa = &A[n0 + n][oc * P];
+                        setMem(&work.mat[oc * dsize[0] + n * P], P, pa);
 
-            Mat mB = trnMat(Mat(m_nodeNum, m_output[0] * m_output[1], A.ptr)) * m_prm.w;
+                        SP_REAL sum = 0.0;
+                        for (int p = 0; p < P; p++){
+                            sum += pa[p];
+                        }
+                        m_grd.b(oc, 0) += sum;
+                    }
+                }
 
-            const Rect2 rect = getRect2(X.dsize);
-            for (int ov = 0; ov < m_output[1]; ov++){
+                gemm(work.gw, work.mat, false, work.col, true, TYPE(1), TYPE((n0 > 0) ? 1 : 0));
+
+                gemm(work.dcol, w, true, work.mat, false);
+                col2im<TYPE>(B, work.dcol, X, n0, num);
+            }
+            setMem(m_grd.w.ptr, m_grd.w.size(), work.gw.ptr);
+        }
+
+        // clamped source index (u : kx * O0 + ou, v : ky * O1 + ov)
+        void getIndex(const int W, const int H){
+            const int hsize = m_winSize / 2;
+
+            m_us.resize(m_kernel[0] * m_output[0]);
+            m_vs.resize(m_kernel[1] * m_output[1]);
+            for (int kx = 0; kx < m_kernel[0]; kx++){
                 for (int ou = 0; ou < m_output[0]; ou++){
+                    m_us[kx * m_output[0] + ou] = maxVal(0, minVal(W - 1, ou * m_stride + m_margin + kx - hsize));
+                }
+            }
+            for (int ky = 0; ky < m_kernel[1]; ky++){
+                for (int ov = 0; ov < m_output[1]; ov++){
+                    m_vs[ky * m_output[1] + ov] = maxVal(0, minVal(H - 1, ov * m_stride + m_margin + ky - hsize));
+                }
+            }
+        }
 
-                    const int u = ou * m_stride + m_margin;
-                    const int v = ov * m_stride + m_margin;
+        // col(k, n * P + p) = X[n0 + n](u + kx - hsize, v + ky - hsize, kc) (clamped, k : kc, ky, kx order)
+        template<typename TYPE, typename MAT>
+        void im2col(MAT &col, const Tensor &X, const int n0, const int num){
+            const int P = m_output[0] * m_output[1];
+            const int W = X.dsize[0];
+            const int H = X.dsize[1];
 
-                    const SP_REAL *pb = &mB(ov * m_output[0] + ou, 0);
-                    const int hsize = m_winSize / 2;
+            const int dsize[2] = { num * P, m_kernel[0] * m_kernel[1] * m_kernel[2] };
+            col.resize(dsize);
 
-                    // convolution backward
-                    for (int kc = 0; kc < m_kernel[2]; kc++){
-                        for (int ky = 0; ky < m_kernel[1]; ky++){
-                            for (int kx = 0; kx < m_kernel[0]; kx++){
-                                const SP_REAL b = *(pb++);
-                                if (inRect(rect, u + kx - hsize, v + ky - hsize) == false) continue;
+            getIndex(W, H);
 
-                                acs3(B, u + kx - hsize, v + ky - hsize, kc) += b;
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int n = 0; n < num; n++){
+                const SP_REAL *px = X[n0 + n];
+
+                int k = 0;
+                for (int kc = 0; kc < m_kernel[2]; kc++){
+                    for (int ky = 0; ky < m_kernel[1]; ky++){
+                        for (int kx = 0; kx < m_kernel[0]; kx++){
+                            TYPE *pc = &col[(k++) * dsize[0] + n * P];
+                            const int *pu = &m_us[kx * m_output[0]];
+
+                            for (int ov = 0; ov < m_output[1]; ov++){
+                                const SP_REAL *pl = &px[(kc * H + m_vs[ky * m_output[1] + ov]) * W];
+                                for (int ou = 0; ou < m_output[0]; ou++){
+                                    *pc++ = pl[pu[ou]];
+                                }
                             }
                         }
                     }
                 }
             }
-            return B;
         }
 
-        NodeParam grdBwrd(const Mem<SP_REAL>  &A, const Mem<SP_REAL>  &X){
-            NodeParam grd;
-            grd.resize(m_nodeNum, m_kernel[0] * m_kernel[1] * m_kernel[2]);
-            grd.zero();
+        // B[n0 + n](u + kx - hsize, v + ky - hsize, kc) += col(k, n * P + p) (inside only)
+        template<typename TYPE, typename MAT>
+        void col2im(Tensor &B, const MAT &col, const Tensor &X, const int n0, const int num){
+            const int P = m_output[0] * m_output[1];
+            const int hsize = m_winSize / 2;
+            const int W = X.dsize[0];
+            const int H = X.dsize[1];
+            const int step = X.step();
+
+            // valid output range [ou0, ou1) for each kx
+            m_ous.resize(m_kernel[0] * 2);
+            for (int kx = 0; kx < m_kernel[0]; kx++){
+                int ou0 = m_output[0], ou1 = 0;
+                for (int ou = 0; ou < m_output[0]; ou++){
+                    const int u = ou * m_stride + m_margin + kx - hsize;
+                    if (u < 0 || u >= W) continue;
+                    ou0 = minVal(ou0, ou);
+                    ou1 = maxVal(ou1, ou + 1);
+                }
+                m_ous[kx * 2 + 0] = ou0;
+                m_ous[kx * 2 + 1] = ou1;
+            }
+
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int n = 0; n < num; n++){
+                SP_REAL *pd = B[n0 + n];
+                memset(pd, 0, step * sizeof(SP_REAL));
+
+                int k = 0;
+                for (int kc = 0; kc < m_kernel[2]; kc++){
+                    for (int ky = 0; ky < m_kernel[1]; ky++){
+                        for (int kx = 0; kx < m_kernel[0]; kx++){
+                            const TYPE *pc = &col[(k++) * col.dsize[0] + n * P];
+                            const int ou0 = m_ous[kx * 2 + 0];
+                            const int ou1 = m_ous[kx * 2 + 1];
+
+                            for (int ov = 0; ov < m_output[1]; ov++){
+                                const int v = ov * m_stride + m_margin + ky - hsize;
+                                if (v < 0 || v >= H) continue;
+
+                                SP_REAL *pb = pd + (kc * H + v) * W + m_margin + kx - hsize;
+                                const TYPE *pl = &pc[ov * m_output[0]];
+                                for (int ou = ou0; ou < ou1; ou++){
+                                    pb[ou * m_stride] += pl[ou];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
 
-            for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
+        // Y = sx * sw * (qw * qcol) + b (int8, per sample / per node scale)
+        void fwrdInt8(Tensor &Y, const Tensor &X){
+            const int P = m_output[0] * m_output[1];
+            const int K = m_kernel[0] * m_kernel[1] * m_kernel[2];
+            const int W = X.dsize[0];
+            const int H = X.dsize[1];
+            const int step = X.step();
+            const int chunk = minVal(getChunk(), X.num);
 
-                        const int u = ou * m_stride + m_margin;
-                        const int v = ov * m_stride + m_margin;
+            getIndex(W, H);
 
-                        const SP_REAL a = acs3(A, ou, ov, oc);
-                        const int hsize = m_winSize / 2;
+            m_qX.resize(chunk * step);
+            m_qcol.resize(chunk * P * K);
 
-                        // w
-                        SP_REAL *pw = &grd.w(oc, 0);
+            for (int n0 = 0; n0 < X.num; n0 += chunk){
+                const int num = minVal(chunk, X.num - n0);
 
-                        for (int kc = 0; kc < m_kernel[2]; kc++){
-                            for (int ky = 0; ky < m_kernel[1]; ky++){
-                                for (int kx = 0; kx < m_kernel[0]; kx++){
-                                    *(pw++) += a * acs3(X, u + kx - hsize, v + ky - hsize, kc);
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+                for (int n = 0; n < num; n++){
+                    signed char *qx = &m_qX[n * step];
+                    const SP_REAL sx = _neu::quantize(qx, X[n0 + n], step);
+
+                    // transposed im2col (row : output pixel)
+                    signed char *qcol = &m_qcol[n * P * K];
+                    for (int ov = 0; ov < m_output[1]; ov++){
+                        for (int ou = 0; ou < m_output[0]; ou++){
+                            signed char *pc = &qcol[(ov * m_output[0] + ou) * K];
+                            for (int kc = 0; kc < m_kernel[2]; kc++){
+                                for (int ky = 0; ky < m_kernel[1]; ky++){
+                                    const signed char *pl = &qx[(kc * H + m_vs[ky * m_output[1] + ov]) * W];
+                                    for (int kx = 0; kx < m_kernel[0]; kx++){
+                                        *pc++ = pl[m_us[kx * m_output[0] + ou]];
+                                    }
                                 }
                             }
                         }
+                    }
 
-                        // b
-                        grd.b(oc, 0) += a;
+                    SP_REAL *py = Y[n0 + n];
+                    for (int oc = 0; oc < m_output[2]; oc++){
+                        const signed char *pw = &m_qw[oc * K];
+                        const SP_REAL scale = sx * m_qs[oc];
+                        const SP_REAL b = m_prm.b(oc, 0);
+
+                        for (int p = 0; p < P; p++){
+                            py[oc * P + p] = scale * _neu::dot8(pw, &qcol[p * K], K) + b;
+                        }
                     }
                 }
             }
-            return grd;
         }
 
     };
@@ -627,8 +998,8 @@ namespace sp{
         // kernel dsize
         int m_kernel[2];
 
-        // forward id map
-        Mem1<Mem<int> > m_fwrdMap;
+        // forward id map (index in sample, N x output)
+        Mem1<int> m_fwrdMap;
 
     public:
         MaxPoolingLayer(){
@@ -647,6 +1018,10 @@ namespace sp{
             return "MaxPoolingLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            return new MaxPoolingLayer(*this);
+        }
+
         SP_TEXTEX(){
             BaseLayer::textex(file);
 
@@ -659,12 +1034,12 @@ namespace sp{
 
     private:
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor &X){
 
             // output dsize
-            m_output[0] = (X[0].dsize[0] - 2 * m_margin) / m_stride;
-            m_output[1] = (X[0].dsize[1] - 2 * m_margin) / m_stride;
-            m_output[2] = maxVal(X[0].dsize[2], 1);
+            m_output[0] = (X.dsize[0] - 2 * m_margin) / m_stride;
+            m_output[1] = (X.dsize[1] - 2 * m_margin) / m_stride;
+            m_output[2] = maxVal(X.dsize[2], 1);
 
             // kernel dsize
             m_kernel[0] = m_winSize;
@@ -672,83 +1047,81 @@ namespace sp{
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-            m_fwrdMap.resize(Y.size());
+        virtual void forward(Tensor &Y, const Tensor &X){
+            Y.resize(X.num, 3, m_output);
+
+            const int ostep = Y.step();
+            m_fwrdMap.resize(Y.num * ostep);
 
 #if SP_USE_OMP
 #pragma omp parallel for
 #endif
-            for (int n = 0; n < Y.size(); n++){
-                Y[n] = poolFwrd(X[n], m_fwrdMap[n]);
+            for (int n = 0; n < Y.num; n++){
+                poolFwrd(Y[n], &m_fwrdMap[n * ostep], X[n], X.dsize);
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            B.resize(X.num, X.dim, X.dsize);
+
+            const int ostep = A.step();
+            const int step = X.step();
 
 #if SP_USE_OMP
 #pragma omp parallel for
 #endif
-            for (int n = 0; n < B.size(); n++){
-                B[n] = poolBwrd(A[n], X[n], m_fwrdMap[n]);
+            for (int n = 0; n < B.num; n++){
+                SP_REAL *pb = B[n];
+                memset(pb, 0, step * sizeof(SP_REAL));
+
+                // max pooling backward
+                const SP_REAL *pa = A[n];
+                const int *pm = &m_fwrdMap[n * ostep];
+                for (int i = 0; i < ostep; i++){
+                    pb[pm[i]] += pa[i];
+                }
             }
 
         }
 
-        Mem<SP_REAL>  poolFwrd(const Mem<SP_REAL>  &X, Mem<int> &fwrdMap){
-            fwrdMap.resize(3, m_output);
-
-            Mem3<SP_REAL> Y(m_output);
+        void poolFwrd(SP_REAL *py, int *pm, const SP_REAL *px, const int *dsize){
+            const int W = dsize[0];
+            const int H = dsize[1];
+            const int hsize = m_winSize / 2;
 
-            const Rect2 rect = getRect2(X.dsize);
             for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
+                const SP_REAL *pc = px + oc * W * H;
 
-                        const int u = ou * m_stride + m_margin;
-                        const int v = ov * m_stride + m_margin;
+                for (int ov = 0; ov < m_output[1]; ov++){
+                    const int v = ov * m_stride + m_margin - hsize;
 
-                        const int hsize = m_winSize / 2;
+                    // window range inside the image
+                    const int ky0 = maxVal(0, -v);
+                    const int ky1 = minVal(m_kernel[1], H - v);
 
-                        int &id = acs3(fwrdMap, ou, ov, oc);
+                    for (int ou = 0; ou < m_output[0]; ou++){
+                        const int u = ou * m_stride + m_margin - hsize;
+                        const int kx0 = maxVal(0, -u);
+                        const int kx1 = minVal(m_kernel[0], W - u);
 
                         SP_REAL maxv = -SP_INFINITY;
+                        int id = 0;
 
                         // max pooling forward
-                        for (int ky = 0; ky < m_kernel[1]; ky++){
-                            for (int kx = 0; kx < m_kernel[0]; kx++){
-                                if (inRect(rect, u + kx - hsize, v + ky - hsize) == false) continue;
-
-                                const SP_REAL val = acs3(X, u + kx - hsize, v + ky - hsize, oc);
-                                if (val > maxv){
-                                    maxv = val;
-                                    id = acsid3(X.dsize, u + kx - hsize, v + ky - hsize, oc);
+                        for (int ky = ky0; ky < ky1; ky++){
+                            const SP_REAL *pl = pc + (v + ky) * W + u;
+                            for (int kx = kx0; kx < kx1; kx++){
+                                if (pl[kx] > maxv){
+                                    maxv = pl[kx];
+                                    id = (v + ky) * W + u + kx;
                                 }
                             }
                         }
-                        acs3(Y, ou, ov, oc) = maxv;
+                        *py++ = maxv;
+                        *pm++ = oc * W * H + id;
                     }
                 }
             }
-            return Y;
-        }
-
-        Mem<SP_REAL>  poolBwrd(const Mem<SP_REAL>  &A, const Mem<SP_REAL>  &X, const Mem<int> &fwrdMap){
-            Mem<SP_REAL>  B(X.dim, X.dsize);
-            B.zero();
-
-            const Rect2 rect = getRect2(X.dsize);
-            for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
-
-                        const int id = acs3(fwrdMap, ou, ov, oc);
-
-                        // max pooling backward
-                        B[id] += acs3(A, ou, ov, oc);
-                    }
-                }
-            }
-            return B;
         }
 
     };
@@ -763,17 +1136,28 @@ namespace sp{
     public:
         SP_REAL m_passRate;
 
-        Mem1<Mem<char> > m_mask;
+        Mem1<char> m_mask;
+
+        // random seed (per layer, layers can run on different threads)
+        unsigned int m_seed;
+
     public:
 
         DropOutLayer(const SP_REAL passRate = 0.5){
             m_passRate = passRate;
+            m_seed = rand();
         }
 
         virtual const char* getName(){
             return "DropOutLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            DropOutLayer *layer = new DropOutLayer(*this);
+            layer->m_seed = rand();
+            return layer;
+        }
+
         SP_TEXTEX(){
             BaseLayer::textex(file);
             file.text(&m_passRate, 1, "passRate");
@@ -781,33 +1165,37 @@ namespace sp{
 
     private:
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor &Y, const Tensor &X){
+            Y.resize(X.num, X.dim, X.dsize);
+
+            const SP_REAL *px = X.buf.ptr;
+            SP_REAL *py = Y.buf.ptr;
+
             if (m_train == true){
                 m_mask.resize(Y.size());
 
-                for (int n = 0; n < Y.size(); n++){
-                    Y[n].resize(X[n].dim, X[n].dsize);
-                    m_mask[n].resize(X[n].dim, X[n].dsize);
-
-                    for (int i = 0; i < Y[n].size(); i++){
-                        const char mask = (0.5 * (randu() + 1.0) < m_passRate) ? 1 : 0;
+                for (int i = 0; i < Y.size(); i++){
+                    m_seed = snext(m_seed);
+                    const char mask = (0.5 * (randu(m_seed) + 1.0) < m_passRate) ? 1 : 0;
 
-                        Y[n][i] = X[n][i] * mask;
-                        m_mask[n][i] = mask;
-                    }
+                    py[i] = px[i] * mask;
+                    m_mask[i] = mask;
                 }
             }
             else{
-                for (int n = 0; n < Y.size(); n++){
-                    mulElm(Y[n], X[n], m_passRate);
+                for (int i = 0; i < Y.size(); i++){
+                    py[i] = px[i] * m_passRate;
                 }
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            B.resize(A.num, A.dim, A.dsize);
 
-            for (int n = 0; n < B.size(); n++){
-                mulMem(B[n], A[n], m_mask[n]);
+            const SP_REAL *pa = A.buf.ptr;
+            SP_REAL *pb = B.buf.ptr;
+            for (int i = 0; i < B.size(); i++){
+                pb[i] = pa[i] * m_mask[i];
             }
         }
 
@@ -822,22 +1210,47 @@ namespace sp{
 
     private:
 
-        Mem1<Mem1<SP_REAL> > m_cX, m_nX;
+        // centered / normalized input (same layout as X)
+        Mem1<SP_REAL> m_cX, m_nX;
         Mem1<SP_REAL> m_mean, m_var, m_std;
 
+    public:
+
+        // running statistics blend (running = blend * running + (1 - blend) * batch)
+        SP_REAL m_blend;
+
     public:
 
         BatchNormLayer(){
+            m_blend = 0.9;
         }
         
         BatchNormLayer(const int nodeNum){
             m_nodeNum = nodeNum;
+            m_blend = 0.9;
         }
 
         virtual const char* getName(){
             return "BatchNormLayer";
         };
 
+        virtual BaseLayer* clone() const{
+            return new BatchNormLayer(*this);
+        }
+
+        // computed in double precision
+        virtual void setPrecision(const Precision){
+        }
+
+        // running statistics (reduced by the caller, data parallel training)
+        Mem1<SP_REAL>& getMean(){
+            return m_mean;
+        }
+
+        Mem1<SP_REAL>& getVar(){
+            return m_var;
+        }
+
         SP_TEXTEX(){
             ParamLayer::textex(file);
             file.text(&m_mean, 1, "mean");
@@ -847,9 +1260,9 @@ namespace sp{
 
     private:
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor &X){
             if (m_nodeNum == 0){
-                m_nodeNum = X[0].size();
+                m_nodeNum = X.step();
             }
 
             m_prm.resize(m_nodeNum, 1);
@@ -867,130 +1280,128 @@ namespace sp{
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        // node r : X[n][r * P + p] (n < batch, p < P), statistics over M = batch * P
+        virtual void forward(Tensor &Y, const Tensor &X){
+            const int step = X.step();
+            const int P = step / m_nodeNum;
+            const int M = X.num * P;
 
-            m_cX.resize(m_nodeNum);
-            m_nX.resize(m_nodeNum);
+            Y.resize(X.num, X.dim, X.dsize);
 
-            Mat M;
-            reshape(M, X);
+            if (m_train == true){
+                m_cX.resize(X.size());
+                m_nX.resize(X.size());
+            }
 
-            for (int r = 0; r < M.rows(); r++){
-                Mem1<SP_REAL> bX(M.cols(), &M(r, 0));
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int r = 0; r < m_nodeNum; r++){
+                const SP_REAL w = m_prm.w[r];
+                const SP_REAL b = m_prm.b[r];
 
-                Mem1<SP_REAL> cX, nX;
                 if (m_train == true){
-                    const SP_REAL mean = meanVal(bX);
-                    cX = bX - mean;
-
-                    const double var = meanSq(cX);
-                    const double std = sqrt(var + 10e-6);
-                    nX = cX / std;
-
-                    m_cX[r] = cX;
-                    m_nX[r] = nX;
+                    SP_REAL mean = 0.0;
+                    for (int n = 0; n < X.num; n++){
+                        const SP_REAL *px = X.buf.ptr + n * step + r * P;
+                        for (int p = 0; p < P; p++){
+                            mean += px[p];
+                        }
+                    }
+                    mean /= M;
+
+                    SP_REAL var = 0.0;
+                    for (int n = 0; n < X.num; n++){
+                        const SP_REAL *px = X.buf.ptr + n * step + r * P;
+                        SP_REAL *pc = m_cX.ptr + n * step + r * P;
+                        for (int p = 0; p < P; p++){
+                            pc[p] = px[p] - mean;
+                            var += pc[p] * pc[p];
+                        }
+                    }
+                    var /= M;
+
+                    const SP_REAL std = sqrt(var + 10e-6);
+                    for (int n = 0; n < X.num; n++){
+                        const SP_REAL *pc = m_cX.ptr + n * step + r * P;
+                        SP_REAL *pn = m_nX.ptr + n * step + r * P;
+                        SP_REAL *py = Y.buf.ptr + n * step + r * P;
+                        for (int p = 0; p < P; p++){
+                            pn[p] = pc[p] / std;
+                            py[p] = w * pn[p] + b;
+                        }
+                    }
 
                     m_std[r] = std;
 
-                    const double blend = 0.9;
-                    m_mean[r] = blend * m_mean[r] + (1 - blend) * mean;
-                    m_var[r] = blend * m_var[r] + (1 - blend) * var;
+                    m_mean[r] = m_blend * m_mean[r] + (1 - m_blend) * mean;
+                    m_var[r] = m_blend * m_var[r] + (1 - m_blend) * var;
                 }
                 else{
-                    cX = bX - m_mean[r];
-                    nX = cX / sqrt(m_var[r] + 10e-6);
-                }
-
-                for (int c = 0; c < M.cols(); c++){
-                    M(r, c) = m_prm.w[r] * nX[c] + m_prm.b[r];
+                    const SP_REAL mean = m_mean[r];
+                    const SP_REAL std = sqrt(m_var[r] + 10e-6);
+
+                    for (int n = 0; n < X.num; n++){
+                        const SP_REAL *px = X.buf.ptr + n * step + r * P;
+                        SP_REAL *py = Y.buf.ptr + n * step + r * P;
+                        for (int p = 0; p < P; p++){
+                            py[p] = w * (px[p] - mean) / std + b;
+                        }
+                    }
                 }
             }
-
-            reshape(Y, M);
-
-            for (int n = 0; n < Y.size(); n++){
-                Y[n].resize(X[n].dim, X[n].dsize);
-            }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor &B, const Tensor &A, const Tensor &Y, const Tensor &X){
+            const int step = X.step();
+            const int P = step / m_nodeNum;
+            const int M = X.num * P;
 
-            Mat M;
-            reshape(M, A);
+            B.resize(X.num, X.dim, X.dsize);
 
-            NodeParam m_grd;
             m_grd.resize(m_nodeNum, 1);
-            m_grd.zero();
-
-            for (int r = 0; r < M.rows(); r++){
-                Mem1<SP_REAL> bA(M.cols(), &M(r, 0));
-
-                for (int c = 0; c < M.cols(); c++){
-                    m_grd.w[r] += m_nX[r][c] * bA[c];
-                    m_grd.b[r] += bA[c];
-                }
-
-                Mem1<SP_REAL> dnX(M.cols());
-                Mem1<SP_REAL> dcX(M.cols());
-                for (int c = 0; c < M.cols(); c++){
-                    dnX[c] = m_prm.w[r] * bA[c];
-                    dcX[c] = dnX[c] / m_std[r];
-                }
 
-                Mem1<SP_REAL> tmp(M.cols());
-                for (int c = 0; c < M.cols(); c++){
-                    tmp[c] = dnX[c] * m_cX[r][c] / (m_std[r] * m_std[r]);
-                }
-                const SP_REAL dstd = -sumVal(tmp);
-                const SP_REAL dvar = 0.5 * dstd / m_std[r];
-
-                for (int c = 0; c < M.cols(); c++){
-                    dcX[c] += (2.0 / M.cols()) * m_cX[r][c] * dvar;
+#if SP_USE_OMP
+#pragma omp parallel for
+#endif
+            for (int r = 0; r < m_nodeNum; r++){
+                const SP_REAL w = m_prm.w[r];
+                const SP_REAL std = m_std[r];
+
+                // sum(A), sum(nX * A), sum(cX * A), sum(cX)
+                SP_REAL sa = 0.0, sna = 0.0, sca = 0.0, sc = 0.0;
+                for (int n = 0; n < X.num; n++){
+                    const SP_REAL *pa = A.buf.ptr + n * step + r * P;
+                    const SP_REAL *pc = m_cX.ptr + n * step + r * P;
+                    const SP_REAL *pn = m_nX.ptr + n * step + r * P;
+                    for (int p = 0; p < P; p++){
+                        sa += pa[p];
+                        sna += pn[p] * pa[p];
+                        sca += pc[p] * pa[p];
+                        sc += pc[p];
+                    }
                 }
-                const SP_REAL dmean = sumVal(dcX);
-
-                for (int c = 0; c < M.cols(); c++){
-                    M(r, c) = dcX[c] - dmean / M.cols();
+                m_grd.w[r] = sna;
+                m_grd.b[r] = sa;
+
+                // dcX = w * A / std + (2 / M) * cX * dvar, B = dcX - mean(dcX)
+                const SP_REAL dstd = -w * sca / (std * std);
+                const SP_REAL dvar = 0.5 * dstd / std;
+                const SP_REAL dmean = w * sa / std + (2.0 / M) * sc * dvar;
+
+                for (int n = 0; n < X.num; n++){
+                    const SP_REAL *pa = A.buf.ptr + n * step + r * P;
+                    const SP_REAL *pc = m_cX.ptr + n * step + r * P;
+                    SP_REAL *pb = B.buf.ptr + n * step + r * P;
+                    for (int p = 0; p < P; p++){
+                        const SP_REAL dcX = w * pa[p] / std + (2.0 / M) * pc[p] * dvar;
+                        pb[p] = dcX - dmean / M;
+                    }
                 }
             }
 
             // update
-            update(m_grd);
-
-            reshape(B, M);
-        }
-
-    private:
-
-        void reshape(Mat &M, const Mem1<Mem<SP_REAL> > &D){
-            const int batchNum = D.size();
-            const int dataNum = D[0].size();
-
-            M.resize(m_nodeNum, batchNum * dataNum / m_nodeNum);
-
-            SP_REAL *m = M.ptr;
-            for (int i = 0; i < dataNum; i++){
-                for (int n = 0; n < batchNum; n++){
-                    *m++ = D[n][i];
-                }
-            }
-        }
-
-        void reshape(Mem1<Mem<SP_REAL> > &R, const Mat &M){
-            const int batchNum = R.size();
-            const int dataNum = M.cols() * m_nodeNum / batchNum;
-            
-            for (int n = 0; n < batchNum; n++){
-                const int dsize[1] = { dataNum };
-                R[n].resize(1, dsize);
-            }
-
-            SP_REAL *m = M.ptr;
-            for (int i = 0; i < dataNum; i++){
-                for (int n = 0; n < batchNum; n++){
-                    R[n][i] = *m++;
-                }
-            }
+            updateGrad();
         }
 
     };
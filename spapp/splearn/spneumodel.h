@@ -20,15 +20,33 @@ namespace sp{
     private:
         Mem1<BaseLayer*> m_order;
 
+        // input / truth (buffers are reused over iterations)
+        Tensor m_src, m_truth;
+
     public:
 
         NetworkModel(){
         }
 
+        NetworkModel(const NetworkModel &model){
+            *this = model;
+        }
+
         ~NetworkModel(){
             reset();
         }
 
+        // copy layers (deep copy)
+        NetworkModel& operator = (const NetworkModel &model){
+            if (this == &model) return *this;
+
+            reset();
+            for (int i = 0; i < model.m_order.size(); i++){
+                addLayer(model.m_order[i]->clone());
+            }
+            return *this;
+        }
+
         void reset(){
             for (int i = 0; i < m_order.size(); i++){
                 delete m_order[i];
@@ -40,32 +58,58 @@ namespace sp{
             m_order.push(layer);
         }
 
-        const Mem1<Mem<SP_REAL> >& getResult(){
+        const Mem1<BaseLayer*>& getLayers() const{
+            return m_order;
+        }
+
+        const Tensor& getResult(){
             return m_order[m_order.size() - 1]->getResult(true);
         }
 
+        // computation precision (Int8 : affine / convolution inference, quantized at first forward)
+        void setPrecision(const BaseLayer::Precision precision){
+            for (int i = 0; i < m_order.size(); i++){
+                m_order[i]->setPrecision(precision);
+            }
+        }
+
 
         //--------------------------------------------------------------------------------
         // train
         //--------------------------------------------------------------------------------
 
-        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<Mem<SP_REAL> > &truth){
+        void train(const Tensor &src, const Tensor &truth){
 
             forward(src, true);
 
             backward(truth);
         }
 
-        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<int> &truth){
+        void train(const Tensor &src, const Mem1<int> &truth){
             forward(src, true);
-            const int labelNum = getResult()[0].size();
 
-            Mem1<Mem<SP_REAL> > oh(truth.size());
-            for (int i = 0; i < oh.size(); i++){
-                oh[i] = oneHot<SP_REAL>(truth[i], labelNum);
+            // one hot
+            const int dsize[1] = { getResult().step() };
+            m_truth.resize(truth.size(), 1, dsize);
+            m_truth.zero();
+            for (int n = 0; n < truth.size(); n++){
+                m_truth[n][truth[n]] = 1.0;
             }
 
-            backward(oh);
+            backward(m_truth);
+        }
+
+        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<Mem<SP_REAL> > &truth){
+            m_truth.set(truth);
+            m_src.set(src);
+
+            train(m_src, m_truth);
+        }
+
+        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<int> &truth){
+            m_src.set(src);
+
+            train(m_src, truth);
         }
 
 
@@ -73,14 +117,19 @@ namespace sp{
         // forward
         //--------------------------------------------------------------------------------
 
-        void forward(const Mem1<Mem<SP_REAL> > &mem, bool train = false){
-            const Mem1<Mem<SP_REAL> > *prop = &mem;
+        void forward(const Tensor &src, bool train = false){
+            const Tensor *prop = &src;
             for (int i = 0; i < m_order.size(); i++){
                 m_order[i]->m_train = train;
                 prop = m_order[i]->execute(prop, true);
             }
         }
 
+        void forward(const Mem1<Mem<SP_REAL> > &mem, bool train = false){
+            m_src.set(mem);
+            forward(m_src, train);
+        }
+
         void forward(const Mem<SP_REAL>  &mem, bool train = false){
             forward(Mem1<Mem<SP_REAL> >(1, &mem), train);
         }
@@ -91,18 +140,14 @@ namespace sp{
         // backward
         //--------------------------------------------------------------------------------
 
-        void backward(const Mem1<Mem<SP_REAL> > &mem){
+        void backward(const Tensor &truth){
 
-            const Mem1<Mem<SP_REAL> > *prop = &mem;
+            const Tensor *prop = &truth;
             for (int i = m_order.size() - 1; i >= 0; i--){
                 prop = m_order[i]->execute(prop, false);
             }
         }
 
-        void backward(const Mem<SP_REAL>  &mem, bool train = false){
-            backward(Mem1<Mem<SP_REAL> >(1, &mem));
-        }
-
 
     public:
 
@@ -141,8 +186,8 @@ namespace sp{
                 _SP_IF_LAYER(layer, name, DropOutLayer);
 
                 if (layer == NULL) break;
-                file.textf(layer->getName());
-                file.textf(",\n");
+
+                // layer name line is already read by gets
                 file.textex(layer, 1);
                 addLayer(layer);
             }
@@ -0,0 +1,319 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_NEUTRAIN_H__
+#define __SP_NEUTRAIN_H__
+
+#include "spcore/spcore.h"
+#include "spapp/splearn/spneubase.h"
+#include "spapp/splearn/spneulayer.h"
+#include "spapp/splearn/spneumodel.h"
+
+#if SP_USE_OMP && defined(_OPENMP)
+#include <omp.h>
+#endif
+
+namespace sp{
+
+    //--------------------------------------------------------------------------------
+    // data parallel trainer
+    //--------------------------------------------------------------------------------
+
+    //
+    // a mini batch is split into shards, one per worker thread.
+    // each worker runs forward / backward on its own model replica,
+    // gradients are summed in disjoint slices (lock free) and every replica applies the same update.
+    // batch norm statistics are computed per shard, the running mean / var are merged over the shards
+    // (same weights, var includes the spread of the shard means) and copied back to every replica.
+    //
+
+    class NetworkTrainer{
+
+    private:
+
+        // source model (replica 0)
+        NetworkModel *m_model;
+
+        // worker replica (0 : source model)
+        Mem1<NetworkModel*> m_replicas;
+
+        // parameter layers of each replica
+        Mem1<Mem1<ParamLayer*> > m_params;
+
+        // batch norm layers of each replica
+        Mem1<Mem1<BatchNormLayer*> > m_norms;
+
+        ThreadPool m_pool;
+
+        // shard input / label
+        Mem1<Tensor> m_shardX;
+        Mem1<Mem1<int> > m_shardT;
+
+        // shard range [m_range[w], m_range[w + 1])
+        Mem1<int> m_range;
+
+        // double buffered mini batch (prefetch)
+        Tensor m_batch[2];
+        Mem1<int> m_label[2];
+
+        // samples per second (last epoch)
+        double m_rate;
+
+    public:
+
+        // threads <= 0 : hardware concurrency
+        NetworkTrainer(NetworkModel &model, const int threads = 0) : m_pool(threads){
+            m_model = &model;
+            m_rate = 0.0;
+        }
+
+        ~NetworkTrainer(){
+            for (int w = 1; w < m_replicas.size(); w++){
+                delete m_replicas[w];
+            }
+
+            // source model updates in backward again
+            if (m_params.size() > 0){
+                for (int l = 0; l < m_params[0].size(); l++){
+                    m_params[0][l]->m_hold = false;
+                }
+            }
+        }
+
+        int getThreadNum() const{
+            return m_pool.size();
+        }
+
+        double getRate() const{
+            return m_rate;
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // train
+        //--------------------------------------------------------------------------------
+
+        // one mini batch
+        void train(const Tensor &X, const Mem1<int> &T){
+            begin(X, T);
+            end();
+        }
+
+        // one epoch (shuffled by seed, the next mini batch is gathered while the current one is trained)
+        double train(const Mem1<Mem<SP_REAL> > &images, const Mem1<int> &labels, const int batch, const int seed = 0){
+            if (images.size() == 0) return 0.0;
+
+            const Mem1<int> index = shuffle(images.size(), seed);
+
+            Timer timer;
+            timer.start();
+
+            gather(m_batch[0], m_label[0], images, labels, index, 0, batch);
+
+            int b = 0;
+            for (int i = 0; i < images.size(); i += batch){
+                begin(m_batch[b], m_label[b]);
+
+                // prefetch
+                if (i + batch < images.size()){
+                    gather(m_batch[1 - b], m_label[1 - b], images, labels, index, i + batch, batch);
+                }
+                end();
+
+                b = 1 - b;
+            }
+
+            timer.stop();
+            m_rate = images.size() / maxVal(timer.getms() * 0.001, 1.0e-6);
+
+            return m_rate;
+        }
+
+    private:
+
+        void gather(Tensor &X, Mem1<int> &T, const Mem1<Mem<SP_REAL> > &images, const Mem1<int> &labels, const Mem1<int> &index, const int base, const int batch){
+            const int num = minVal(batch, images.size() - base);
+            const Mem<SP_REAL> &img = images[index[base]];
+
+            X.resize(num, img.dim, img.dsize);
+            T.resize(num);
+
+            const int step = X.step();
+            for (int n = 0; n < num; n++){
+                memcpy(X[n], images[index[base + n]].ptr, step * sizeof(SP_REAL));
+                T[n] = labels[index[base + n]];
+            }
+        }
+
+        // create replicas (after the source model is initialized)
+        void prepare(const Tensor &X){
+            if (m_replicas.size() > 0) return;
+
+            const int num = m_pool.size();
+
+            // initialize layers
+            {
+                Tensor tmp;
+                tmp.resize(1, X.dim, X.dsize);
+                memcpy(tmp[0], X[0], X.step() * sizeof(SP_REAL));
+                m_model->forward(tmp, false);
+            }
+
+            m_replicas.resize(num);
+            m_replicas[0] = m_model;
+            for (int w = 1; w < num; w++){
+                m_replicas[w] = new NetworkModel(*m_model);
+            }
+
+            m_params.resize(num);
+            m_norms.resize(num);
+            for (int w = 0; w < num; w++){
+                const Mem1<BaseLayer*> &layers = m_replicas[w]->getLayers();
+
+                m_params[w].clear();
+                m_norms[w].clear();
+                for (int l = 0; l < layers.size(); l++){
+                    ParamLayer *layer = dynamic_cast<ParamLayer*>(layers[l]);
+                    if (layer == NULL) continue;
+
+                    layer->m_hold = true;
+                    m_params[w].push(layer);
+
+                    BatchNormLayer *norm = dynamic_cast<BatchNormLayer*>(layer);
+                    if (norm != NULL) m_norms[w].push(norm);
+                }
+            }
+
+            m_shardX.resize(num);
+            m_shardT.resize(num);
+            m_range.resize(num + 1);
+        }
+
+        // start forward / backward on the workers
+        void begin(const Tensor &X, const Mem1<int> &T){
+            prepare(X);
+
+            // leading shards are filled first (shard 0 is never empty)
+            const int num = m_pool.size();
+            const int size = (X.num + num - 1) / num;
+            for (int w = 0; w <= num; w++){
+                m_range[w] = minVal(X.num, w * size);
+            }
+
+            const Tensor *pX = &X;
+            const Mem1<int> *pT = &T;
+
+            m_pool.start([this, pX, pT](const int w){
+#if SP_USE_OMP && defined(_OPENMP)
+                // data parallel (no nested team in layers)
+                omp_set_num_threads(1);
+#endif
+                const int n0 = m_range[w];
+                const int n1 = m_range[w + 1];
+                if (n1 == n0) return;
+
+                Tensor &sX = m_shardX[w];
+                Mem1<int> &sT = m_shardT[w];
+
+                sX.resize(n1 - n0, pX->dim, pX->dsize);
+                sT.resize(n1 - n0);
+                memcpy(sX.buf.ptr, (*pX)[n0], sX.size() * sizeof(SP_REAL));
+                memcpy(sT.ptr, &(*pT)[n0], sT.size() * sizeof(int));
+
+                m_replicas[w]->train(sX, sT);
+            });
+        }
+
+        // reduce gradients and update all replicas
+        void end(){
+            m_pool.wait();
+
+            // grd = sum(n_w / N * grd_w), slice w is summed by thread w
+            m_pool.run([this](const int w){
+                const int num = m_pool.size();
+                const int N = m_range[num];
+
+                for (int l = 0; l < m_params[0].size(); l++){
+                    NodeParam &dst = m_params[0][l]->getGrad();
+                    reduce(dst.w, l, w, N, true);
+                    reduce(dst.b, l, w, N, false);
+                }
+            });
+
+            // same update on every replica (parameters stay identical)
+            m_pool.run([this](const int w){
+                for (int l = 0; l < m_params[w].size(); l++){
+                    m_params[w][l]->update(m_params[0][l]->getGrad());
+                }
+            });
+
+            for (int l = 0; l < m_norms[0].size(); l++){
+                reduceNorm(l);
+            }
+        }
+
+        // dst : weight (isw = true) or bias gradient of layer l
+        void reduce(Mat &dst, const int l, const int w, const int N, const bool isw){
+            const int num = m_pool.size();
+            const int i0 = dst.size() * w / num;
+            const int i1 = dst.size() * (w + 1) / num;
+
+            for (int i = i0; i < i1; i++){
+                SP_REAL sum = 0.0;
+                for (int r = 0; r < num; r++){
+                    const int n = m_range[r + 1] - m_range[r];
+                    if (n == 0) continue;
+
+                    const NodeParam &grd = m_params[r][l]->getGrad();
+                    const Mat &src = (isw == true) ? grd.w : grd.b;
+                    sum += src[i] * n / N;
+                }
+                dst[i] = sum;
+            }
+        }
+
+        // running statistics of batch norm layer l (replicas start from the same values)
+        // mean = sum(n_w / N * mean_w), var = sum(n_w / N * (var_w + (mean_w - mean)^2 / (1 - blend)))
+        void reduceNorm(const int l){
+            const int num = m_pool.size();
+            const int N = m_range[num];
+
+            Mem1<SP_REAL> &mean = m_norms[0][l]->getMean();
+            Mem1<SP_REAL> &var = m_norms[0][l]->getVar();
+
+            // mean_w - mean = (1 - blend) * (batch mean_w - batch mean)
+            const SP_REAL rate = 1 - m_norms[0][l]->m_blend;
+
+            for (int i = 0; i < mean.size(); i++){
+                SP_REAL smean = 0.0;
+                for (int r = 0; r < num; r++){
+                    const int n = m_range[r + 1] - m_range[r];
+                    if (n == 0) continue;
+
+                    smean += m_norms[r][l]->getMean()[i] * n / N;
+                }
+
+                SP_REAL svar = 0.0;
+                for (int r = 0; r < num; r++){
+                    const int n = m_range[r + 1] - m_range[r];
+                    if (n == 0) continue;
+
+                    const SP_REAL d = m_norms[r][l]->getMean()[i] - smean;
+                    svar += (m_norms[r][l]->getVar()[i] + ((rate > 0.0) ? d * d / rate : 0.0)) * n / N;
+                }
+
+                mean[i] = smean;
+                var[i] = svar;
+            }
+
+            for (int r = 1; r < num; r++){
+                memcpy(m_norms[r][l]->getMean().ptr, mean.ptr, mean.size() * sizeof(SP_REAL));
+                memcpy(m_norms[r][l]->getVar().ptr, var.ptr, var.size() * sizeof(SP_REAL));
+            }
+        }
+
+    };
+
+}
+#endif
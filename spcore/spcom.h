@@ -26,6 +26,32 @@
 #define SP_USE_DEBUG 0
 #endif
 
+// profiler (SP_USE_LOGGER : old name)
+#ifndef SP_USE_PROFILER
+#if defined(SP_USE_LOGGER)
+#define SP_USE_PROFILER SP_USE_LOGGER
+#else
+#define SP_USE_PROFILER SP_USE_DEBUG
+#endif
+#endif
+
+// simd (sse2 / avx2)
+#ifndef SP_USE_SSE
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SP_USE_SSE 1
+#else
+#define SP_USE_SSE 0
+#endif
+#endif
+
+#ifndef SP_USE_AVX
+#if defined(__AVX2__)
+#define SP_USE_AVX 1
+#else
+#define SP_USE_AVX 0
+#endif
+#endif
+
 
 //--------------------------------------------------------------------------------
 // calling convention
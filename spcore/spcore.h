@@ -21,12 +21,15 @@
 #include "spcore/spgen/sppose.h"
 
 // cpu
+#include "spcore/spcpu/spalloc.h"
 #include "spcore/spcpu/spmem.h"
+#include "spcore/spcpu/spgemm.h"
 #include "spcore/spcpu/spmop.h"
 #include "spcore/spcpu/spsolve.h"
 #include "spcore/spcpu/spstat.h"
 #include "spcore/spcpu/spstr.h"
 #include "spcore/spcpu/spcode.h"
+#include "spcore/spcpu/spsimd.h"
 
 
 #include "spcore/spsystem.h"
@@ -0,0 +1,351 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_ALLOC_H__
+#define __SP_ALLOC_H__
+
+#include "spcore/spcom.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// alignment of Mem storage (bytes, power of 2)
+#ifndef SP_MEM_ALIGN
+#define SP_MEM_ALIGN 64
+#endif
+
+namespace sp{
+
+    //--------------------------------------------------------------------------------
+    // allocation stats
+    //--------------------------------------------------------------------------------
+
+    struct MemStat {
+        // allocation / release count (Mem)
+        long long allocs;
+        long long frees;
+
+        // requested bytes (Mem, total)
+        long long bytes;
+
+        // system heap allocation count / bytes (pool miss)
+        long long heaps;
+        long long hbytes;
+
+        // live bytes (Mem) and its peak
+        long long usage;
+        long long peak;
+    };
+
+    namespace _alloc {
+
+        class Counter {
+        public:
+            std::atomic<long long> allocs, frees, bytes, heaps, hbytes, usage, peak;
+
+            Counter() {
+                reset();
+            }
+
+            void reset() {
+                allocs = 0; frees = 0; bytes = 0; heaps = 0; hbytes = 0; peak = usage.load();
+            }
+
+            static Counter* instance() {
+                static Counter counter;
+                return &counter;
+            }
+
+            // requested bytes of calling thread (profiler)
+            static long long& local() {
+                static thread_local long long bytes = 0;
+                return bytes;
+            }
+        };
+
+        SP_CPUFUNC void countAlloc(const size_t size) {
+            Counter &c = *Counter::instance();
+            c.allocs++;
+            c.bytes += size;
+
+            const long long usage = (c.usage += size);
+            long long peak = c.peak.load();
+            while (usage > peak && !c.peak.compare_exchange_weak(peak, usage));
+
+#if SP_USE_PROFILER
+            Counter::local() += size;
+#endif
+        }
+
+        SP_CPUFUNC void countFree(const size_t size) {
+            Counter &c = *Counter::instance();
+            c.frees++;
+            c.usage -= size;
+        }
+
+        // aligned system heap
+        SP_CPUFUNC void* sysAlloc(const size_t size) {
+            Counter &c = *Counter::instance();
+            c.heaps++;
+            c.hbytes += size;
+
+#if defined(_MSC_VER)
+            return _aligned_malloc(size, SP_MEM_ALIGN);
+#else
+            void *ptr = NULL;
+            return (posix_memalign(&ptr, SP_MEM_ALIGN, size) == 0) ? ptr : NULL;
+#endif
+        }
+
+        SP_CPUFUNC void sysFree(void *ptr) {
+#if defined(_MSC_VER)
+            _aligned_free(ptr);
+#else
+            ::free(ptr);
+#endif
+        }
+    }
+
+    SP_CPUFUNC inline MemStat getMemStat() {
+        const _alloc::Counter &c = *_alloc::Counter::instance();
+
+        MemStat stat;
+        stat.allocs = c.allocs;
+        stat.frees = c.frees;
+        stat.bytes = c.bytes;
+        stat.heaps = c.heaps;
+        stat.hbytes = c.hbytes;
+        stat.usage = c.usage;
+        stat.peak = c.peak;
+        return stat;
+    }
+
+    // reset counters (live bytes are kept)
+    SP_CPUFUNC inline void resetMemStat() {
+        _alloc::Counter::instance()->reset();
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // allocator interface (blocks are SP_MEM_ALIGN aligned)
+    //--------------------------------------------------------------------------------
+
+    class MemAllocator {
+    public:
+        virtual ~MemAllocator() {}
+
+        virtual void* alloc(const size_t size) = 0;
+
+        virtual void free(void *ptr, const size_t size) = 0;
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // aligned allocator (default)
+    //--------------------------------------------------------------------------------
+
+    class AlignedAllocator : public MemAllocator {
+    public:
+
+        virtual void* alloc(const size_t size) {
+            return _alloc::sysAlloc(size);
+        }
+
+        virtual void free(void *ptr, const size_t) {
+            _alloc::sysFree(ptr);
+        }
+
+        static AlignedAllocator* instance() {
+            static AlignedAllocator alloc;
+            return &alloc;
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // pool allocator (thread local free list per size class)
+    //--------------------------------------------------------------------------------
+
+    class PoolAllocator : public MemAllocator {
+
+    private:
+
+        // size class : 4 classes per power of 2, 64 bytes ~ 256 MB
+        static const int MIN_LOG2 = 6;
+        static const int MAX_LOG2 = 28;
+        static const int CLASS_NUM = (MAX_LOG2 - MIN_LOG2) * 4 + 1;
+
+        struct Cache {
+            void *heads[CLASS_NUM];
+            size_t bytes;
+
+            Cache() {
+                for (int i = 0; i < CLASS_NUM; i++) {
+                    heads[i] = NULL;
+                }
+                bytes = 0;
+                alive() = true;
+            }
+
+            ~Cache() {
+                alive() = false;
+                for (int i = 0; i < CLASS_NUM; i++) {
+                    while (heads[i] != NULL) {
+                        void *next = *static_cast<void**>(heads[i]);
+                        _alloc::sysFree(heads[i]);
+                        heads[i] = next;
+                    }
+                }
+            }
+        };
+
+        // cached bytes limit per thread
+        std::atomic<size_t> m_limit;
+
+    public:
+
+        PoolAllocator() {
+            m_limit = static_cast<size_t>(256) << 20;
+        }
+
+        void setLimit(const size_t limit) {
+            m_limit = limit;
+        }
+
+        virtual void* alloc(const size_t size) {
+            size_t csize = 0;
+            const int c = getClass(size, csize);
+            if (c < 0) return _alloc::sysAlloc(size);
+
+            Cache &cache = getCache();
+            void *ptr = cache.heads[c];
+            if (ptr != NULL) {
+                cache.heads[c] = *static_cast<void**>(ptr);
+                cache.bytes -= csize;
+                return ptr;
+            }
+            return _alloc::sysAlloc(csize);
+        }
+
+        virtual void free(void *ptr, const size_t size) {
+            size_t csize = 0;
+            const int c = getClass(size, csize);
+
+            // released after thread exit or over the limit
+            if (c < 0 || alive() == false) {
+                _alloc::sysFree(ptr);
+                return;
+            }
+
+            Cache &cache = getCache();
+            if (cache.bytes + csize > m_limit) {
+                _alloc::sysFree(ptr);
+                return;
+            }
+            *static_cast<void**>(ptr) = cache.heads[c];
+            cache.heads[c] = ptr;
+            cache.bytes += csize;
+        }
+
+        static PoolAllocator* instance() {
+            static PoolAllocator alloc;
+            return &alloc;
+        }
+
+    private:
+
+        static bool& alive() {
+            static thread_local bool flag = false;
+            return flag;
+        }
+
+        static Cache& getCache() {
+            static thread_local Cache cache;
+            return cache;
+        }
+
+        static int getClass(const size_t size, size_t &csize) {
+            if (size <= (static_cast<size_t>(1) << MIN_LOG2)) {
+                csize = static_cast<size_t>(1) << MIN_LOG2;
+                return 0;
+            }
+
+            int lg2 = MIN_LOG2;
+            while ((static_cast<size_t>(1) << (lg2 + 1)) < size) lg2++;
+            if (lg2 >= MAX_LOG2) return -1;
+
+            const size_t base = static_cast<size_t>(1) << lg2;
+            const size_t step = base / 4;
+            const int q = static_cast<int>((size - base + step - 1) / step);
+
+            csize = base + q * step;
+            return (lg2 - MIN_LOG2) * 4 + q;
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // allocator for Mem
+    //--------------------------------------------------------------------------------
+
+    namespace _alloc {
+        SP_CPUFUNC std::atomic<MemAllocator*>& getAllocator() {
+            static std::atomic<MemAllocator*> alloc(AlignedAllocator::instance());
+            return alloc;
+        }
+    }
+
+    // NULL : default (aligned allocator)
+    SP_CPUFUNC inline void setMemAllocator(MemAllocator *alloc) {
+        _alloc::getAllocator() = (alloc != NULL) ? alloc : AlignedAllocator::instance();
+    }
+
+    SP_CPUFUNC inline void setMemPool(const bool flag) {
+        setMemAllocator(flag ? static_cast<MemAllocator*>(PoolAllocator::instance()) : NULL);
+    }
+
+    namespace _alloc {
+
+        // block header (owner allocator, block size)
+        struct Header {
+            MemAllocator *alloc;
+            size_t size;
+        };
+
+        // throws std::bad_alloc on failure (same as new[])
+        SP_CPUFUNC void* memAlloc(const size_t size) {
+            if (size == 0) return NULL;
+
+            MemAllocator *alloc = getAllocator();
+            const size_t bsize = size + SP_MEM_ALIGN;
+
+            char *base = static_cast<char*>(alloc->alloc(bsize));
+            if (base == NULL) throw std::bad_alloc();
+
+            Header *header = reinterpret_cast<Header*>(base);
+            header->alloc = alloc;
+            header->size = bsize;
+
+            countAlloc(size);
+            return base + SP_MEM_ALIGN;
+        }
+
+        SP_CPUFUNC void memFree(void *ptr) {
+            if (ptr == NULL) return;
+
+            char *base = static_cast<char*>(ptr) - SP_MEM_ALIGN;
+            const Header *header = reinterpret_cast<const Header*>(base);
+
+            countFree(header->size - SP_MEM_ALIGN);
+            header->alloc->free(base, header->size);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,363 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_GEMM_H__
+#define __SP_GEMM_H__
+
+#include "spcore/spcom.h"
+#include "spcore/spcpu/spmem.h"
+
+#if SP_USE_SSE || SP_USE_AVX
+#include <immintrin.h>
+#endif
+
+namespace sp{
+
+    //--------------------------------------------------------------------------------
+    // general matrix multiply (C = alpha * op(A) * op(B) + beta * C)
+    //--------------------------------------------------------------------------------
+    
+    namespace _gemm {
+
+        // cache block size (KC x NC : packed B, MC x KC : packed A)
+        static const int KC = 256;
+        static const int MC = 96;
+        static const int NC = 4096;
+
+#if SP_USE_AVX
+        // micro tile (MR x NR, 2 vectors per row)
+        static const int MR = 6;
+        template <typename T> struct Tile;
+        template <> struct Tile<double> { typedef __m256d V; static const int NR = 8; };
+        template <> struct Tile<float> { typedef __m256 V; static const int NR = 16; };
+
+        SP_CPUFUNC __m256d vload(const double *p) { return _mm256_loadu_pd(p); }
+        SP_CPUFUNC __m256 vload(const float *p) { return _mm256_loadu_ps(p); }
+        SP_CPUFUNC __m256d vset(const double v) { return _mm256_set1_pd(v); }
+        SP_CPUFUNC __m256 vset(const float v) { return _mm256_set1_ps(v); }
+        SP_CPUFUNC void vstore(double *p, const __m256d v) { _mm256_storeu_pd(p, v); }
+        SP_CPUFUNC void vstore(float *p, const __m256 v) { _mm256_storeu_ps(p, v); }
+        SP_CPUFUNC __m256d vadd(const __m256d a, const __m256d b) { return _mm256_add_pd(a, b); }
+        SP_CPUFUNC __m256 vadd(const __m256 a, const __m256 b) { return _mm256_add_ps(a, b); }
+#if defined(__FMA__)
+        SP_CPUFUNC __m256d vmadd(const __m256d a, const __m256d b, const __m256d c) { return _mm256_fmadd_pd(a, b, c); }
+        SP_CPUFUNC __m256 vmadd(const __m256 a, const __m256 b, const __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+        SP_CPUFUNC __m256d vmadd(const __m256d a, const __m256d b, const __m256d c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+        SP_CPUFUNC __m256 vmadd(const __m256 a, const __m256 b, const __m256 c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+        // c[i * ldc + j] (+)= sum(pa[k * MR + i] * pb[k * NR + j])
+        template <typename T>
+        SP_CPUFUNC void kernel(const int kc, const T *pa, const T *pb, T *c, const int ldc, const bool add) {
+            typedef typename Tile<T>::V V;
+            const int W = Tile<T>::NR / 2;
+
+            V c00 = vset(T(0)), c01 = vset(T(0));
+            V c10 = vset(T(0)), c11 = vset(T(0));
+            V c20 = vset(T(0)), c21 = vset(T(0));
+            V c30 = vset(T(0)), c31 = vset(T(0));
+            V c40 = vset(T(0)), c41 = vset(T(0));
+            V c50 = vset(T(0)), c51 = vset(T(0));
+
+            for (int k = 0; k < kc; k++) {
+                const V b0 = vload(pb);
+                const V b1 = vload(pb + W);
+
+                V a;
+                a = vset(pa[0]); c00 = vmadd(a, b0, c00); c01 = vmadd(a, b1, c01);
+                a = vset(pa[1]); c10 = vmadd(a, b0, c10); c11 = vmadd(a, b1, c11);
+                a = vset(pa[2]); c20 = vmadd(a, b0, c20); c21 = vmadd(a, b1, c21);
+                a = vset(pa[3]); c30 = vmadd(a, b0, c30); c31 = vmadd(a, b1, c31);
+                a = vset(pa[4]); c40 = vmadd(a, b0, c40); c41 = vmadd(a, b1, c41);
+                a = vset(pa[5]); c50 = vmadd(a, b0, c50); c51 = vmadd(a, b1, c51);
+
+                pa += MR;
+                pb += Tile<T>::NR;
+            }
+
+            T *p;
+            p = c + 0 * ldc; vstore(p, add ? vadd(vload(p), c00) : c00); vstore(p + W, add ? vadd(vload(p + W), c01) : c01);
+            p = c + 1 * ldc; vstore(p, add ? vadd(vload(p), c10) : c10); vstore(p + W, add ? vadd(vload(p + W), c11) : c11);
+            p = c + 2 * ldc; vstore(p, add ? vadd(vload(p), c20) : c20); vstore(p + W, add ? vadd(vload(p + W), c21) : c21);
+            p = c + 3 * ldc; vstore(p, add ? vadd(vload(p), c30) : c30); vstore(p + W, add ? vadd(vload(p + W), c31) : c31);
+            p = c + 4 * ldc; vstore(p, add ? vadd(vload(p), c40) : c40); vstore(p + W, add ? vadd(vload(p + W), c41) : c41);
+            p = c + 5 * ldc; vstore(p, add ? vadd(vload(p), c50) : c50); vstore(p + W, add ? vadd(vload(p + W), c51) : c51);
+        }
+
+#elif SP_USE_SSE
+        // micro tile (MR x NR, 2 vectors per row)
+        static const int MR = 4;
+        template <typename T> struct Tile;
+        template <> struct Tile<double> { typedef __m128d V; static const int NR = 4; };
+        template <> struct Tile<float> { typedef __m128 V; static const int NR = 8; };
+
+        SP_CPUFUNC __m128d vload(const double *p) { return _mm_loadu_pd(p); }
+        SP_CPUFUNC __m128 vload(const float *p) { return _mm_loadu_ps(p); }
+        SP_CPUFUNC __m128d vset(const double v) { return _mm_set1_pd(v); }
+        SP_CPUFUNC __m128 vset(const float v) { return _mm_set1_ps(v); }
+        SP_CPUFUNC void vstore(double *p, const __m128d v) { _mm_storeu_pd(p, v); }
+        SP_CPUFUNC void vstore(float *p, const __m128 v) { _mm_storeu_ps(p, v); }
+        SP_CPUFUNC __m128d vadd(const __m128d a, const __m128d b) { return _mm_add_pd(a, b); }
+        SP_CPUFUNC __m128 vadd(const __m128 a, const __m128 b) { return _mm_add_ps(a, b); }
+        SP_CPUFUNC __m128d vmadd(const __m128d a, const __m128d b, const __m128d c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+        SP_CPUFUNC __m128 vmadd(const __m128 a, const __m128 b, const __m128 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+        // c[i * ldc + j] (+)= sum(pa[k * MR + i] * pb[k * NR + j])
+        template <typename T>
+        SP_CPUFUNC void kernel(const int kc, const T *pa, const T *pb, T *c, const int ldc, const bool add) {
+            typedef typename Tile<T>::V V;
+            const int W = Tile<T>::NR / 2;
+
+            V c00 = vset(T(0)), c01 = vset(T(0));
+            V c10 = vset(T(0)), c11 = vset(T(0));
+            V c20 = vset(T(0)), c21 = vset(T(0));
+            V c30 = vset(T(0)), c31 = vset(T(0));
+
+            for (int k = 0; k < kc; k++) {
+                const V b0 = vload(pb);
+                const V b1 = vload(pb + W);
+
+                V a;
+                a = vset(pa[0]); c00 = vmadd(a, b0, c00); c01 = vmadd(a, b1, c01);
+                a = vset(pa[1]); c10 = vmadd(a, b0, c10); c11 = vmadd(a, b1, c11);
+                a = vset(pa[2]); c20 = vmadd(a, b0, c20); c21 = vmadd(a, b1, c21);
+                a = vset(pa[3]); c30 = vmadd(a, b0, c30); c31 = vmadd(a, b1, c31);
+
+                pa += MR;
+                pb += Tile<T>::NR;
+            }
+
+            T *p;
+            p = c + 0 * ldc; vstore(p, add ? vadd(vload(p), c00) : c00); vstore(p + W, add ? vadd(vload(p + W), c01) : c01);
+            p = c + 1 * ldc; vstore(p, add ? vadd(vload(p), c10) : c10); vstore(p + W, add ? vadd(vload(p + W), c11) : c11);
+            p = c + 2 * ldc; vstore(p, add ? vadd(vload(p), c20) : c20); vstore(p + W, add ? vadd(vload(p + W), c21) : c21);
+            p = c + 3 * ldc; vstore(p, add ? vadd(vload(p), c30) : c30); vstore(p + W, add ? vadd(vload(p + W), c31) : c31);
+        }
+
+#else
+        // micro tile (MR x NR)
+        static const int MR = 4;
+        template <typename T> struct Tile { static const int NR = 4; };
+
+        // c[i * ldc + j] (+)= sum(pa[k * MR + i] * pb[k * NR + j])
+        template <typename T>
+        SP_CPUFUNC void kernel(const int kc, const T *pa, const T *pb, T *c, const int ldc, const bool add) {
+            const int NR = Tile<T>::NR;
+
+            T acc[MR * NR] = { 0 };
+            for (int k = 0; k < kc; k++) {
+                for (int i = 0; i < MR; i++) {
+                    for (int j = 0; j < NR; j++) {
+                        acc[i * NR + j] += pa[i] * pb[j];
+                    }
+                }
+                pa += MR;
+                pb += NR;
+            }
+            for (int i = 0; i < MR; i++) {
+                for (int j = 0; j < NR; j++) {
+                    c[i * ldc + j] = add ? c[i * ldc + j] + acc[i * NR + j] : acc[i * NR + j];
+                }
+            }
+        }
+#endif
+
+        // pack op(A)[i0 : i0 + mc, k0 : k0 + kc] * alpha into MR row panels (zero padded)
+        template <typename T>
+        SP_CPUFUNC void packA(T *dst, const T *A, const int lda, const bool trans, const int i0, const int k0, const int mc, const int kc, const T alpha) {
+            for (int ip = 0; ip < mc; ip += MR) {
+                const int mr = minVal(MR, mc - ip);
+                T *pd = dst + ip * kc;
+
+                if (trans == true) {
+                    for (int k = 0; k < kc; k++) {
+                        const T *pa = &A[(k0 + k) * lda + (i0 + ip)];
+                        for (int i = 0; i < MR; i++) {
+                            pd[k * MR + i] = (i < mr) ? alpha * pa[i] : T(0);
+                        }
+                    }
+                }
+                else {
+                    for (int i = 0; i < MR; i++) {
+                        if (i < mr) {
+                            const T *pa = &A[(i0 + ip + i) * lda + k0];
+                            for (int k = 0; k < kc; k++) {
+                                pd[k * MR + i] = alpha * pa[k];
+                            }
+                        }
+                        else {
+                            for (int k = 0; k < kc; k++) {
+                                pd[k * MR + i] = T(0);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // pack op(B)[k0 : k0 + kc, j0 : j0 + nc] into NR column panels (zero padded)
+        template <typename T>
+        SP_CPUFUNC void packB(T *dst, const T *B, const int ldb, const bool trans, const int k0, const int j0, const int kc, const int nc) {
+            const int NR = Tile<T>::NR;
+            const int panels = (nc + NR - 1) / NR;
+
+#if SP_USE_OMP
+#pragma omp parallel for if(panels > 8)
+#endif
+            for (int jp = 0; jp < panels; jp++) {
+                const int nr = minVal(NR, nc - jp * NR);
+                T *pd = dst + jp * NR * kc;
+
+                if (trans == true) {
+                    for (int j = 0; j < NR; j++) {
+                        if (j < nr) {
+                            const T *pb = &B[(j0 + jp * NR + j) * ldb + k0];
+                            for (int k = 0; k < kc; k++) {
+                                pd[k * NR + j] = pb[k];
+                            }
+                        }
+                        else {
+                            for (int k = 0; k < kc; k++) {
+                                pd[k * NR + j] = T(0);
+                            }
+                        }
+                    }
+                }
+                else {
+                    for (int k = 0; k < kc; k++) {
+                        const T *pb = &B[(k0 + k) * ldb + (j0 + jp * NR)];
+                        if (nr == NR) {
+                            memcpy(&pd[k * NR], pb, NR * sizeof(T));
+                        }
+                        else {
+                            for (int j = 0; j < NR; j++) {
+                                pd[k * NR + j] = (j < nr) ? pb[j] : T(0);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // row major, C : M x N, op(A) : M x K, op(B) : K x N
+    template <typename T>
+    SP_CPUFUNC void gemm(T *C, const int ldc, const T *A, const int lda, const bool transA, const T *B, const int ldb, const bool transB,
+        const int M, const int N, const int K, const T alpha = T(1), const T beta = T(0)) {
+
+        using namespace _gemm;
+
+        if (M <= 0 || N <= 0) return;
+
+        // beta == 0 : C is overwritten by the first k block
+        const bool zero = (beta == T(0) && K > 0 && alpha != T(0));
+
+        if (beta != T(1) && zero == false) {
+            for (int i = 0; i < M; i++) {
+                T *pc = &C[i * ldc];
+                for (int j = 0; j < N; j++) {
+                    pc[j] = (beta == T(0)) ? T(0) : beta * pc[j];
+                }
+            }
+        }
+        if (K <= 0 || alpha == T(0)) return;
+
+        const int NR = Tile<T>::NR;
+
+        // pack buffer (per calling thread, kept over calls)
+        static thread_local Mem1<T> bbuf, abuf;
+        bbuf.resize(KC * ((minVal(N, NC) + NR - 1) / NR) * NR);
+        abuf.resize(KC * ((minVal(M, MC) + MR - 1) / MR) * MR);
+
+        // omp workers have their own (empty) thread_local copies
+        // pack and read through the caller's buffers
+        T *const apack = abuf.ptr;
+        T *const bpack = bbuf.ptr;
+
+        for (int jc = 0; jc < N; jc += NC) {
+            const int nc = minVal(NC, N - jc);
+            const int np = (nc + NR - 1) / NR;
+
+            for (int pc = 0; pc < K; pc += KC) {
+                const int kc = minVal(KC, K - pc);
+                packB(bpack, B, ldb, transB, pc, jc, kc, nc);
+
+                for (int ic = 0; ic < M; ic += MC) {
+                    const int mc = minVal(MC, M - ic);
+                    const int mp = (mc + MR - 1) / MR;
+                    packA(apack, A, lda, transA, ic, pc, mc, kc, alpha);
+
+#if SP_USE_OMP
+#pragma omp parallel for if(mp * np > 8)
+#endif
+                    for (int t = 0; t < mp * np; t++) {
+                        const int jp = t / mp;
+                        const int ip = t % mp;
+
+                        const T *pa = apack + ip * MR * kc;
+                        const T *pb = bpack + jp * NR * kc;
+
+                        const int r = ic + ip * MR;
+                        const int c = jc + jp * NR;
+                        const int mr = minVal(MR, M - r);
+                        const int nr = minVal(NR, N - c);
+
+                        const bool add = (pc > 0 || zero == false);
+
+                        if (mr == MR && nr == NR) {
+                            kernel(kc, pa, pb, &C[r * ldc + c], ldc, add);
+                        }
+                        else {
+                            T tmp[MR * Tile<T>::NR];
+                            kernel(kc, pa, pb, tmp, NR, false);
+
+                            for (int i = 0; i < mr; i++) {
+                                T *pd = &C[(r + i) * ldc + c];
+                                for (int j = 0; j < nr; j++) {
+                                    pd[j] = add ? pd[j] + tmp[i * NR + j] : tmp[i * NR + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // dst = alpha * op(mat0) * op(mat1) + beta * dst
+    SP_CPUFUNC void gemm(Mat &dst, const Mat &mat0, const bool trans0, const Mat &mat1, const bool trans1, const SP_REAL alpha = 1.0, const SP_REAL beta = 0.0) {
+        const int M = trans0 ? mat0.cols() : mat0.rows();
+        const int K = trans0 ? mat0.rows() : mat0.cols();
+        const int N = trans1 ? mat1.rows() : mat1.cols();
+        SP_ASSERT(K == (trans1 ? mat1.cols() : mat1.rows()));
+        SP_ASSERT(&dst != &mat0 && &dst != &mat1);
+
+        if (dst.rows() != M || dst.cols() != N) {
+            SP_ASSERT(beta == 0.0);
+            dst.resize(M, N);
+        }
+
+        gemm<SP_REAL>(dst.ptr, N, mat0.ptr, mat0.cols(), trans0, mat1.ptr, mat1.cols(), trans1, M, N, K, alpha, beta);
+    }
+
+    // Mem2 (dsize[0] : cols, dsize[1] : rows)
+    template <typename TYPE>
+    SP_CPUFUNC void gemm(Mem2<TYPE> &dst, const Mem2<TYPE> &mat0, const bool trans0, const Mem2<TYPE> &mat1, const bool trans1, const TYPE alpha = 1, const TYPE beta = 0) {
+        const int M = trans0 ? mat0.dsize[0] : mat0.dsize[1];
+        const int K = trans0 ? mat0.dsize[1] : mat0.dsize[0];
+        const int N = trans1 ? mat1.dsize[1] : mat1.dsize[0];
+        SP_ASSERT(K == (trans1 ? mat1.dsize[0] : mat1.dsize[1]));
+        SP_ASSERT(&dst != &mat0 && &dst != &mat1);
+
+        if (dst.dsize[1] != M || dst.dsize[0] != N) {
+            SP_ASSERT(beta == 0);
+            dst.resize(N, M);
+        }
+
+        gemm<TYPE>(dst.ptr, N, mat0.ptr, mat0.dsize[0], trans0, mat1.ptr, mat1.dsize[0], trans1, M, N, K, alpha, beta);
+    }
+}
+
+#endif
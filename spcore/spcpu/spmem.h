@@ -7,9 +7,11 @@
 
 #include "spcore/spcom.h"
 #include "spcore/spgen/spbase.h"
+#include "spcore/spcpu/spalloc.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 
 namespace sp{
 
@@ -40,7 +42,7 @@ namespace sp{
         }
 
         void free(){
-            delete[]this->ptr;
+            release(this->ptr, this->msize);
             reset();
         }
 
@@ -51,21 +53,39 @@ namespace sp{
         
         void malloc(const int msize, const void *cpy) {
             const TYPE *tmp = this->ptr;
+            const int tsize = this->msize;
 
             if (msize > this->msize) {
+                this->ptr = create(msize);
                 this->msize = msize;
-                this->ptr = new TYPE[msize];
             }
 
             if (cpy != NULL) {
                 copy(cpy, size());
             }
 
-            if (this->ptr != tmp && (cpy == tmp || cpy == NULL)) {
-                delete[]tmp;
+            if (this->ptr != tmp) {
+                release(const_cast<TYPE*>(tmp), tsize);
             }
         }
 
+        // aligned storage from the current allocator (see spalloc.h)
+        static TYPE* create(const int msize) {
+            TYPE *ptr = static_cast<TYPE*>(_alloc::memAlloc(msize * sizeof(TYPE)));
+            for (int i = 0; i < msize; i++) {
+                new (&ptr[i]) TYPE;
+            }
+            return ptr;
+        }
+
+        static void release(TYPE *ptr, const int msize) {
+            if (ptr == NULL) return;
+            for (int i = 0; i < msize; i++) {
+                ptr[i].~TYPE();
+            }
+            _alloc::memFree(ptr);
+        }
+
         virtual void copy(const void *cpy, const int csize){
             memcpy(this->ptr, cpy, csize * sizeof(TYPE));
         }
@@ -627,6 +647,136 @@ namespace sp{
     };
 
 
+    //--------------------------------------------------------------------------------
+    // mem view (non-owning 2d, row pitch in bytes)
+    //--------------------------------------------------------------------------------
+
+    template<typename TYPE> class MemView {
+
+    public:
+
+        // pointer to (0, 0) of the view
+        TYPE *ptr;
+
+        // dimension size
+        int dsize[2];
+
+        // row pitch (bytes)
+        int pitch;
+
+    public:
+
+        MemView() {
+            ptr = NULL;
+            dsize[0] = 0;
+            dsize[1] = 0;
+            pitch = 0;
+        }
+
+        // external buffer (pitch = 0 : dsize0 * sizeof(TYPE))
+        MemView(const void *ptr, const int dsize0, const int dsize1, const int pitch = 0) {
+            this->ptr = static_cast<TYPE*>(const_cast<void*>(ptr));
+            this->dsize[0] = dsize0;
+            this->dsize[1] = dsize1;
+            this->pitch = (pitch > 0) ? pitch : dsize0 * static_cast<int>(sizeof(TYPE));
+        }
+
+        MemView(const Mem<TYPE> &mem) {
+            *this = MemView(mem.ptr, mem.dsize[0], mem.dsize[1]);
+        }
+
+        MemView(const Mem<TYPE> &mem, const Rect2 &rect) {
+            *this = MemView(mem).part(rect.dbase[0], rect.dbase[1], rect.dsize[0], rect.dsize[1]);
+        }
+
+        //--------------------------------------------------------------------------------
+        // access
+        //--------------------------------------------------------------------------------
+
+        TYPE* row(const int d1) const {
+            return reinterpret_cast<TYPE*>(reinterpret_cast<char*>(ptr) + static_cast<size_t>(d1) * pitch);
+        }
+
+        // clamped access (same as Mem2)
+        TYPE& operator () (const int d0, const int d1) {
+            return row(maxVal(0, minVal(dsize[1] - 1, d1)))[maxVal(0, minVal(dsize[0] - 1, d0))];
+        }
+
+        const TYPE& operator () (const int d0, const int d1) const {
+            return row(maxVal(0, minVal(dsize[1] - 1, d1)))[maxVal(0, minVal(dsize[0] - 1, d0))];
+        }
+
+        //--------------------------------------------------------------------------------
+        // util
+        //--------------------------------------------------------------------------------
+
+        int size() const {
+            return dsize[0] * dsize[1];
+        }
+
+        // rows are stored without padding
+        bool isCont() const {
+            return pitch == dsize[0] * static_cast<int>(sizeof(TYPE));
+        }
+
+        // sub region (zero copy)
+        MemView part(const int dbase0, const int dbase1, const int dsize0, const int dsize1) const {
+            const int b0 = maxVal(0, minVal(dsize[0], dbase0));
+            const int b1 = maxVal(0, minVal(dsize[1], dbase1));
+
+            return MemView(&row(b1)[b0], maxVal(0, minVal(dsize0, dsize[0] - b0)), maxVal(0, minVal(dsize1, dsize[1] - b1)), pitch);
+        }
+
+        // copy to dense memory
+        Mem2<TYPE> clone() const {
+            Mem2<TYPE> dst(dsize[0], dsize[1]);
+            for (int v = 0; v < dsize[1]; v++) {
+                const TYPE *src = row(v);
+                TYPE *pd = &dst.ptr[v * dsize[0]];
+                for (int u = 0; u < dsize[0]; u++) {
+                    pd[u] = src[u];
+                }
+            }
+            return dst;
+        }
+    };
+
+    template<typename TYPE>
+    SP_GENFUNC bool checkPtr(const MemView<TYPE> &src) {
+        return (src.ptr != NULL && src.dsize[0] > 0 && src.dsize[1] > 0);
+    }
+
+    template<typename TYPE>
+    SP_GENFUNC bool checkPtr(const MemView<TYPE> &src, const int dim) {
+        return (dim == 2) ? checkPtr(src) : false;
+    }
+
+    template<typename TYPE, typename ELEM = TYPE>
+    SP_GENFUNC ELEM& acs2(MemView<TYPE> &src, const int d0, const int d1, const int c = 0) {
+        return reinterpret_cast<ELEM*>(&src(d0, d1))[c];
+    }
+
+    template<typename TYPE, typename ELEM = TYPE>
+    SP_GENFUNC const ELEM& acs2(const MemView<TYPE> &src, const int d0, const int d1, const int c = 0) {
+        return reinterpret_cast<const ELEM*>(&src(d0, d1))[c];
+    }
+
+    template<typename TYPE, typename ELEM = TYPE>
+    SP_GENFUNC SP_REAL acs2(const MemView<TYPE> &src, const double d0, const double d1, const int c = 0) {
+        const int id0 = static_cast<int>(d0);
+        const int id1 = static_cast<int>(d1);
+        const double ad0 = d0 - id0;
+        const double ad1 = d1 - id1;
+
+        const double v00 = acs2<TYPE, ELEM>(src, id0 + 0, id1 + 0, c) * (1 - ad0) * (1 - ad1);
+        const double v10 = acs2<TYPE, ELEM>(src, id0 + 1, id1 + 0, c) * (0 + ad0) * (1 - ad1);
+        const double v01 = acs2<TYPE, ELEM>(src, id0 + 0, id1 + 1, c) * (1 - ad0) * (0 + ad1);
+        const double v11 = acs2<TYPE, ELEM>(src, id0 + 1, id1 + 1, c) * (0 + ad0) * (0 + ad1);
+
+        return static_cast<SP_REAL>(v00 + v10 + v01 + v11);
+    }
+
+
     //--------------------------------------------------------------------------------
     // mem array
     //--------------------------------------------------------------------------------
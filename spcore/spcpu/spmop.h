@@ -475,6 +475,20 @@ namespace sp{
     
     SP_CPUFUNC void mulMat(Mat &dst, const Mat &mat0, const Mat &mat1){
         if (mat0.rows() > 0 && mat1.cols() > 0 && mat0.cols() == mat1.rows()){
+
+            // blocked gemm for large matrix
+            if (static_cast<double>(mat0.rows()) * mat0.cols() * mat1.cols() >= 32 * 32 * 32) {
+                if (&dst == &mat0 || &dst == &mat1) {
+                    Mat tmp;
+                    gemm(tmp, mat0, false, mat1, false);
+                    dst = tmp;
+                }
+                else {
+                    gemm(dst, mat0, false, mat1, false);
+                }
+                return;
+            }
+
             dst.resize(mat0.rows(), mat1.cols());
             mulMat(dst.ptr, dst.dsize[1], dst.dsize[0], mat0.ptr, mat0.rows(), mat0.cols(), mat1.ptr, mat1.rows(), mat1.cols());
         }
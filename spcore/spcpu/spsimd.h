@@ -0,0 +1,60 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_SIMD_H__
+#define __SP_SIMD_H__
+
+#include "spcore/spcom.h"
+
+#if SP_USE_SSE || SP_USE_AVX
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // bit count
+    //--------------------------------------------------------------------------------
+
+    SP_CPUFUNC int popcnt64(const unsigned long long v) {
+#if defined(_MSC_VER) && defined(_M_X64) && SP_USE_AVX
+        return static_cast<int>(__popcnt64(v));
+#elif defined(__GNUC__) || defined(__clang__)
+        // popcnt instruction when -mpopcnt (or -mavx2) is enabled
+        return __builtin_popcountll(v);
+#else
+        unsigned long long x = v;
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // horizontal sum
+    //--------------------------------------------------------------------------------
+
+#if SP_USE_SSE
+    SP_CPUFUNC float hsum(const __m128 v) {
+        const __m128 a = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        const __m128 b = _mm_add_ss(a, _mm_shuffle_ps(a, a, 0x55));
+        return _mm_cvtss_f32(b);
+    }
+#endif
+
+#if SP_USE_AVX
+    SP_CPUFUNC float hsum(const __m256 v) {
+        return hsum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+    }
+#endif
+
+}
+
+#endif
@@ -215,5 +215,355 @@ namespace sp{
             return next;
         }
     };
+
+
+    //--------------------------------------------------------------------------------
+    // ransac engine
+    //--------------------------------------------------------------------------------
+
+    // hypotheses scored at once for large data (the result does not depend on the thread num)
+#define SP_RANSAC_BATCH 8
+
+    class RansacParam {
+    public:
+
+        // inlier threshold (err < thresh)
+        SP_REAL thresh;
+
+        // sampling max
+        int itmax;
+
+        // confidence of the adaptive stop
+        double conf;
+
+        // PROSAC sampling (data must be sorted by quality, best first)
+        bool prosac;
+
+        // local optimization of a new best model (LO-RANSAC, refine is used)
+        bool lo;
+
+        // sequential probability ratio test (early rejection of bad models)
+        bool sprt;
+
+        RansacParam(const SP_REAL thresh = 1.0) {
+            this->thresh = thresh;
+            itmax = SP_RANSAC_ITMAX;
+            conf = 0.99;
+            prosac = false;
+            lo = true;
+            sprt = true;
+        }
+    };
+
+    // data of the sample / inlier ids
+    template<typename TYPE>
+    SP_CPUFUNC Mem1<TYPE> ransacData(const Mem<TYPE> &src, const int *ids, const int num) {
+        Mem1<TYPE> dst(num);
+        for (int i = 0; i < num; i++) {
+            dst[i] = src[ids[i]];
+        }
+        return dst;
+    }
+
+    namespace _ransac {
+
+        // sample size max
+        const int UNIT_MAX = 8;
+
+        // local optimization iteration
+        const int LO_ITMAX = 4;
+
+        // model estimation time (in data verification unit)
+        const double SPRT_TIME = 200.0;
+
+        // data num x batch for parallel scoring
+        const int OMP_MIN = 2048;
+
+        // unit distinct ids from [0, n) (ids[unit - 1] = n - 1 if fix == true)
+        SP_CPUFUNC void sample(int *ids, const int unit, const int n, const bool fix, unsigned int seed) {
+            const int m = (fix == true) ? unit - 1 : unit;
+            const int r = (fix == true) ? n - 1 : n;
+
+            for (int k = 0; k < m; k++) {
+                while (true) {
+                    seed = snext(seed);
+                    const int id = static_cast<int>((seed >> 1) % r);
+
+                    bool dup = false;
+                    for (int j = 0; j < k; j++) {
+                        if (ids[j] == id) dup = true;
+                    }
+                    if (dup == false) {
+                        ids[k] = id;
+                        break;
+                    }
+                }
+            }
+            if (fix == true) {
+                ids[unit - 1] = n - 1;
+            }
+        }
+
+        // PROSAC growth function (sampling set of the t-th hypothesis, t = 1, 2, ...)
+        class Prosac {
+            int m_unit, m_num;
+
+            // sampling set size
+            int m_n;
+
+            // T_n, T'_n
+            double m_T;
+            int m_Tp;
+
+        public:
+            Prosac(const int unit, const int num, const int itmax) {
+                m_unit = unit;
+                m_num = num;
+
+                m_n = unit;
+                m_T = itmax;
+                for (int i = 0; i < unit; i++) {
+                    m_T *= static_cast<double>(unit - i) / (num - i);
+                }
+                m_Tp = 1;
+            }
+
+            // returns n (fix : the n-th data is in the sample)
+            int next(const int t, bool &fix) {
+                while (m_n < m_num && t > m_Tp) {
+                    const double T = m_T * (m_n + 1) / (m_n + 1 - m_unit);
+                    m_Tp += static_cast<int>(ceil(T - m_T));
+                    m_T = T;
+                    m_n++;
+                }
+                fix = (t <= m_Tp);
+                return m_n;
+            }
+        };
+
+        // SPRT decision threshold A (eps : inlier rate, delta : consistent rate of a bad model)
+        SP_CPUFUNC double sprtThresh(const double eps, const double delta) {
+            const double C = (1.0 - delta) * log((1.0 - delta) / (1.0 - eps)) + delta * log(delta / eps);
+
+            const double K = SPRT_TIME * C + 1.0;
+            double A = K;
+            for (int i = 0; i < 10; i++) {
+                A = K + log(A);
+            }
+            return A;
+        }
+
+        SP_CPUFUNC int adaptiveStop(const double rate, const int unit, const double conf, const int itmax, const double A) {
+            const double e = maxVal(rate, 0.1);
+
+            // a good sample passes SPRT with 1 - 1 / A
+            const double p = pow(e, unit) * ((A > 1.0) ? 1.0 - 1.0 / A : 1.0);
+
+            const int k = round(1.0 + log(1.0 - conf) / log(1.0 - p));
+            return maxVal(1, minVal(k, itmax));
+        }
+
+        // hypothesis slot of a batch
+        template<typename MODEL>
+        class Slot {
+        public:
+            Mem1<MODEL> models;
+
+            // best model (-1 : none) and its inlier num
+            int best;
+            int cnt;
+
+            // SPRT rejected model num, verified / consistent data num of them
+            int rnum;
+            int rver;
+            int rcon;
+        };
+
+        // inlier num (-1 : the model can not be better than minv or is rejected by SPRT)
+        template<typename MODEL, typename ERROR>
+        SP_CPUFUNC int score(const MODEL &model, ERROR &error, const int num, const Mem1<int> &order, const SP_REAL thresh, const int minv,
+            const double A, const double rin, const double rout, int &rver, int &rcon) {
+
+            double lambda = 1.0;
+
+            int cnt = 0;
+            for (int k = 0; k < num; k++) {
+                const int i = (order.size() > 0) ? order[k] : k;
+
+                if (error(model, i) < thresh) {
+                    cnt++;
+                    lambda *= rin;
+                }
+                else {
+                    lambda *= rout;
+                }
+
+                if (cnt + num - 1 - k <= minv) return -1;
+
+                if (A > 1.0 && lambda > A) {
+                    rver += k + 1;
+                    rcon += cnt;
+                    return -1;
+                }
+            }
+            return cnt;
+        }
+
+        template<typename MODEL>
+        class NoRefine {
+        public:
+            bool operator()(MODEL &model, const Mem1<int> &ids) const {
+                return false;
+            }
+        };
+    }
+
+    // MODEL : model type
+    // solve(Mem1<MODEL> &models, const int *ids) : minimal solver (unit ids), false : degenerate sample
+    // error(const MODEL &model, const int i) : residual of the i-th data (thread safe)
+    // refine(MODEL &model, const Mem1<int> &ids) : non minimal solver (inlier ids, local optimization)
+    // return : eval of the model, (inlier num - unit) / (num - unit)
+    template<typename MODEL, typename SOLVE, typename ERROR, typename REFINE>
+    SP_CPUFUNC SP_REAL ransac(MODEL &model, const int num, const int unit, const RansacParam &param, SOLVE solve, ERROR error, REFINE refine) {
+        if (unit < 1 || unit > _ransac::UNIT_MAX || num <= unit) return 0.0;
+
+        // verification order (SPRT needs random order)
+        Mem1<int> order;
+        if (param.sprt == true) {
+            order.resize(num);
+            unsigned int seed = 0;
+            for (int i = 0; i < num; i++) {
+                order[i] = i;
+            }
+            for (int i = num - 1; i > 0; i--) {
+                seed = snext(seed);
+                swap(order[i], order[(seed >> 1) % (i + 1)]);
+            }
+        }
+
+        _ransac::Prosac prosac(unit, num, param.itmax);
+
+        Mem1<_ransac::Slot<MODEL> > slots(SP_RANSAC_BATCH);
+        int ids[SP_RANSAC_BATCH][_ransac::UNIT_MAX];
+        int size[SP_RANSAC_BATCH];
+        bool fix[SP_RANSAC_BATCH];
+
+        // a model needs inliers more than unit
+        int maxv = unit;
+
+        // SPRT state
+        double delta = 0.05;
+        int rver = 0;
+        int rcon = 0;
+
+        int maxit = minVal(param.itmax, ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit, param.conf));
+
+        // small data is scored one by one (adaptive stop for each hypothesis)
+        const int bsize = (num * SP_RANSAC_BATCH >= _ransac::OMP_MIN) ? SP_RANSAC_BATCH : 1;
+
+        for (int it = 0; it < maxit; it += bsize) {
+            const int bnum = minVal(bsize, maxit - it);
+
+            const double eps = maxVal(static_cast<double>(maxv) / num, SP_RANSAC_MINEVAL);
+            const bool sprt = (param.sprt == true && eps > delta * 1.5 && eps < 1.0);
+
+            const double A = (sprt == true) ? _ransac::sprtThresh(eps, delta) : 0.0;
+            const double rin = (sprt == true) ? delta / eps : 1.0;
+            const double rout = (sprt == true) ? (1.0 - delta) / (1.0 - eps) : 1.0;
+
+            for (int b = 0; b < bnum; b++) {
+                size[b] = num;
+                fix[b] = false;
+                if (param.prosac == true) {
+                    size[b] = prosac.next(it + b + 1, fix[b]);
+                }
+            }
+
+#if SP_USE_OMP
+#pragma omp parallel for if(bnum > 1)
+#endif
+            for (int b = 0; b < bnum; b++) {
+                _ransac::Slot<MODEL> &slot = slots[b];
+                slot.best = -1;
+                slot.cnt = 0;
+                slot.rnum = 0;
+                slot.rver = 0;
+                slot.rcon = 0;
+                slot.models.clear();
+
+                _ransac::sample(ids[b], unit, size[b], fix[b], snext(static_cast<unsigned int>(it + b) * 2654435761u));
+                if (solve(slot.models, ids[b]) == false) continue;
+
+                for (int m = 0; m < slot.models.size(); m++) {
+                    const int minv = maxVal(maxv, slot.cnt);
+
+                    int ver = 0;
+                    int con = 0;
+                    const int cnt = _ransac::score(slot.models[m], error, num, order, param.thresh, minv, A, rin, rout, ver, con);
+                    if (ver > 0) {
+                        slot.rnum++;
+                        slot.rver += ver;
+                        slot.rcon += con;
+                    }
+                    if (cnt > minv) {
+                        slot.best = m;
+                        slot.cnt = cnt;
+                    }
+                }
+            }
+
+            // merge in sample order
+            for (int b = 0; b < bnum; b++) {
+                const _ransac::Slot<MODEL> &slot = slots[b];
+
+                rver += slot.rver;
+                rcon += slot.rcon;
+
+                if (slot.best < 0 || slot.cnt <= maxv) continue;
+
+                model = slot.models[slot.best];
+                maxv = slot.cnt;
+
+                if (param.lo == true) {
+                    Mem1<int> inls;
+                    for (int lo = 0; lo < _ransac::LO_ITMAX; lo++) {
+                        inls.clear();
+                        for (int i = 0; i < num; i++) {
+                            if (error(model, i) < param.thresh) inls.push(i);
+                        }
+                        if (inls.size() <= unit) break;
+
+                        MODEL test = model;
+                        if (refine(test, inls) == false) break;
+
+                        int cnt = 0;
+                        for (int i = 0; i < num; i++) {
+                            if (error(test, i) < param.thresh) cnt++;
+                        }
+                        if (cnt <= maxv) break;
+
+                        model = test;
+                        maxv = cnt;
+                    }
+                }
+
+                const double eval = static_cast<double>(maxv - unit) / (num - unit);
+                maxit = minVal(maxit, _ransac::adaptiveStop(eval, unit, param.conf, param.itmax, A));
+            }
+
+            if (rver > 0) {
+                delta = maxVal(0.01, minVal(0.5, static_cast<double>(rcon) / rver));
+            }
+        }
+
+        return (maxv > unit) ? SP_CAST_REAL(static_cast<double>(maxv - unit) / (num - unit)) : 0.0;
+    }
+
+    template<typename MODEL, typename SOLVE, typename ERROR>
+    SP_CPUFUNC SP_REAL ransac(MODEL &model, const int num, const int unit, const RansacParam &param, SOLVE solve, ERROR error) {
+        RansacParam tmp = param;
+        tmp.lo = false;
+        return ransac(model, num, unit, tmp, solve, error, _ransac::NoRefine<MODEL>());
+    }
 }
 #endif
\ No newline at end of file
@@ -17,6 +17,8 @@ namespace sp{
     //--------------------------------------------------------------------------------
 
     SP_GENFUNC void qsort(void *base, const int nsize, const int esize, int compare(const void *a, const void *b)) {
+        // ::qsort requires a non null base even for an empty array
+        if (base == NULL || nsize <= 1) return;
         ::qsort(base, nsize, esize, compare);
     }
 
@@ -8,145 +8,474 @@
 #include "spcore/spsystem.h"
 #include "spcore/sptime.h"
 #include "spcore/spprint.h"
+#include "spcore/spcpu/spalloc.h"
 
 #include <string>
 #include <vector>
 
 
 //--------------------------------------------------------------------------------
-// time logger
+// profiler
 //--------------------------------------------------------------------------------
 
-#ifndef SP_USE_LOGGER
-#define SP_USE_LOGGER SP_USE_DEBUG
+// records per thread (ring buffer for trace)
+#ifndef SP_PROFILE_RING
+#define SP_PROFILE_RING 65536
 #endif
 
-#if SP_USE_LOGGER
+#if SP_USE_PROFILER
 
-#define SP_LOGGER_SET(NAME) sp::LoggerUnit _lunit(sp::Logger::instance(), NAME);
-#define SP_LOGGER_START(NAME) sp::Logger::instance()->start(NAME);
-#define SP_LOGGER_STOP(NAME) sp::Logger::instance()->stop(NAME);
-#define SP_LOGGER_PRINT(NAME) sp::Logger::instance()->print(NAME);
+#include <chrono>
+#include <mutex>
+#include <string.h>
+
+#define SP_PROFILE_CAT0(A, B) A##B
+#define SP_PROFILE_CAT(A, B) SP_PROFILE_CAT0(A, B)
+
+#define SP_PROFILE_SCOPE(NAME) sp::ProfileScope SP_PROFILE_CAT(_pscope, __LINE__)(NAME);
+#define SP_PROFILE_BEGIN(NAME) sp::Profiler::instance()->begin(NAME);
+#define SP_PROFILE_END(NAME) sp::Profiler::instance()->end(NAME);
+#define SP_PROFILE_COUNT(NAME, VAL) sp::Profiler::instance()->count(NAME, VAL);
+#define SP_PROFILE_PRINT(NAME) sp::Profiler::instance()->print(NAME);
+#define SP_PROFILE_SAVE(PATH) sp::Profiler::instance()->save(PATH);
+#define SP_PROFILE_RESET() sp::Profiler::instance()->reset();
 #else
 
-#define SP_LOGGER_SET(NAME) 
-#define SP_LOGGER_START(NAME) 
-#define SP_LOGGER_STOP(NAME) 
-#define SP_LOGGER_PRINT(NAME)
+#define SP_PROFILE_SCOPE(NAME)
+#define SP_PROFILE_BEGIN(NAME)
+#define SP_PROFILE_END(NAME)
+#define SP_PROFILE_COUNT(NAME, VAL)
+#define SP_PROFILE_PRINT(NAME)
+#define SP_PROFILE_SAVE(PATH)
+#define SP_PROFILE_RESET()
 #endif
 
+// old time logger
+#define SP_LOGGER_SET(NAME) SP_PROFILE_SCOPE(NAME)
+#define SP_LOGGER_START(NAME) SP_PROFILE_BEGIN(NAME)
+#define SP_LOGGER_STOP(NAME) SP_PROFILE_END(NAME)
+#define SP_LOGGER_PRINT(NAME) SP_PROFILE_PRINT(NAME)
+
+#if SP_USE_PROFILER
+
 namespace sp {
 
-    class Logger {
+    // scope tree per thread, merged by name path on print
+    class Profiler {
     public:
 
-#if SP_USE_LOGGER
+        // duration histogram (8 bins per octave, [ns])
+        static const int HIST = 488;
 
-        std::vector<std::string> names;
-        std::vector<Timer> timers;
-        std::vector<bool> flags;
-#endif
+        struct Stat {
+            long long cnt;
+            long long sum, minv, maxv;
+            int hist[HIST];
+
+            Stat() {
+                reset();
+            }
+
+            void reset() {
+                cnt = 0; sum = 0; minv = 0; maxv = 0;
+                memset(hist, 0, sizeof(hist));
+            }
+
+            void add(const long long ns) {
+                minv = (cnt == 0 || ns < minv) ? ns : minv;
+                maxv = (cnt == 0 || ns > maxv) ? ns : maxv;
+                sum += ns;
+                cnt++;
+                hist[bin(ns)]++;
+            }
+
+            void add(const Stat &stat) {
+                if (stat.cnt == 0) return;
+                minv = (cnt == 0 || stat.minv < minv) ? stat.minv : minv;
+                maxv = (cnt == 0 || stat.maxv > maxv) ? stat.maxv : maxv;
+                sum += stat.sum;
+                cnt += stat.cnt;
+                for (int i = 0; i < HIST; i++) {
+                    hist[i] += stat.hist[i];
+                }
+            }
+
+            // percentile (rate : 0.0 - 1.0)
+            long long tile(const double rate) const {
+                long long n = 0;
+                for (int i = 0; i < HIST; i++) {
+                    n += hist[i];
+                    if (n >= rate * cnt) {
+                        const long long v = val(i);
+                        return (v < minv) ? minv : (v > maxv) ? maxv : v;
+                    }
+                }
+                return maxv;
+            }
+
+            static int bin(const long long ns) {
+                if (ns < 16) return (ns > 0) ? static_cast<int>(ns) : 0;
+
+                int e = 4;
+                while ((ns >> (e + 1)) > 0) e++;
+                return 16 + (e - 4) * 8 + static_cast<int>((ns >> (e - 3)) & 7);
+            }
+
+            static long long val(const int bin) {
+                if (bin < 16) return bin;
+
+                const int e = (bin - 16) / 8 + 4;
+                const long long w = 1LL << (e - 3);
+                return (8 + (bin - 16) % 8) * w + w / 2;
+            }
+        };
+
+        struct Count {
+            const char *name;
+            long long val;
+        };
+
+        struct Node {
+            const char *name;
+            std::vector<int> childs;
+
+            Stat stat;
+            std::vector<Count> counts;
+        };
+
+        // completed scope (t1 >= 0) or counter value (t1 < 0)
+        struct Record {
+            const char *name;
+            long long t0, t1;
+            long long val;
+        };
+
+    private:
+
+        struct Frame {
+            int node;
+            long long t0;
+            long long bytes;
+        };
+
+        struct Buffer {
+            int tid;
+            std::mutex mtx;
+
+            // nodes[0] : root
+            std::vector<Node> nodes;
+            std::vector<Frame> stack;
+
+            // ring buffer
+            std::vector<Record> ring;
+            long long rnum;
+
+            // counter total of thread
+            std::vector<Count> totals;
+        };
+
+        std::mutex m_mtx;
+        std::vector<Buffer*> m_bufs;
+        std::chrono::steady_clock::time_point m_base;
 
     public:
 
+        Profiler() {
+            m_base = std::chrono::steady_clock::now();
+        }
+
+        ~Profiler() {
+            for (int i = 0; i < static_cast<int>(m_bufs.size()); i++) {
+                delete m_bufs[i];
+            }
+        }
+
+        static Profiler *instance() {
+            static Profiler profiler;
+            return &profiler;
+        }
+
+        // elapsed time from construction [ns]
+        long long now() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_base).count();
+        }
+
+        // clear stats and records (scope tree is kept for running scopes)
         void reset() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            for (int i = 0; i < static_cast<int>(m_bufs.size()); i++) {
+                Buffer &buf = *m_bufs[i];
+                std::lock_guard<std::mutex> block(buf.mtx);
+
+                for (int n = 0; n < static_cast<int>(buf.nodes.size()); n++) {
+                    buf.nodes[n].stat.reset();
+                    buf.nodes[n].counts.clear();
+                }
+                buf.rnum = 0;
+                buf.totals.clear();
+            }
+        }
 
-#if SP_USE_LOGGER
-            names.clear();
-            timers.clear();
-            flags.clear();
-#endif
+        void begin(const char *name) {
+            Buffer &buf = local();
+            {
+                std::lock_guard<std::mutex> lock(buf.mtx);
+
+                const int parent = (buf.stack.size() > 0) ? buf.stack.back().node : 0;
+
+                int node = find(buf.nodes, buf.nodes[parent].childs, name);
+                if (node < 0) {
+                    node = static_cast<int>(buf.nodes.size());
+                    buf.nodes[parent].childs.push_back(node);
+
+                    Node tmp;
+                    tmp.name = name;
+                    buf.nodes.push_back(tmp);
+                }
+
+                Frame frame;
+                frame.node = node;
+                frame.bytes = _alloc::Counter::local();
+                buf.stack.push_back(frame);
+            }
+            buf.stack.back().t0 = now();
         }
 
-        void start(const char* name) {
+        // close scope of name (and inner scopes left open)
+        void end(const char *name) {
+            const long long t1 = now();
 
-#if SP_USE_LOGGER
+            Buffer &buf = local();
+            std::lock_guard<std::mutex> lock(buf.mtx);
 
-            int id = -1;
-            for (int i = 0; i < names.size(); i++) {
-                if (name == names[i]) {
-                    id = i;
-                    break;
+            int s = static_cast<int>(buf.stack.size()) - 1;
+            while (s >= 0 && same(buf.nodes[buf.stack[s].node].name, name) == false) s--;
+            if (s < 0) return;
+
+            while (static_cast<int>(buf.stack.size()) > s) {
+                const Frame &frame = buf.stack.back();
+                Node &node = buf.nodes[frame.node];
+
+                node.stat.add(t1 - frame.t0);
+
+                const long long bytes = _alloc::Counter::local() - frame.bytes;
+                if (bytes > 0) {
+                    add(node.counts, "bytes", bytes);
                 }
+
+                Record rec;
+                rec.name = node.name;
+                rec.t0 = frame.t0;
+                rec.t1 = t1;
+                rec.val = 0;
+                push(buf, rec);
+
+                buf.stack.pop_back();
             }
+        }
 
-            const Timer timer = Timer();
+        // add val to counter of current scope
+        void count(const char *name, const long long val) {
+            const long long t = now();
 
-            if (id < 0) {
-                names.push_back(name);
-                timers.push_back(Timer());
+            Buffer &buf = local();
+            std::lock_guard<std::mutex> lock(buf.mtx);
+
+            const int node = (buf.stack.size() > 0) ? buf.stack.back().node : 0;
+            add(buf.nodes[node].counts, name, val);
+
+            Record rec;
+            rec.name = name;
+            rec.t0 = t;
+            rec.t1 = -1;
+            rec.val = add(buf.totals, name, val);
+            push(buf, rec);
+        }
+
+        // name : NULL (all) or scope name
+        void print(const char *name = NULL) {
+            std::vector<Node> nodes;
+            merge(nodes);
+
+            SP_PRINTF("%-32s %8s %10s %9s %9s %9s [ms]\n", "scope", "count", "total", "mean", "min", "p99");
+            print(nodes, 0, 0, name, name == NULL);
+            SP_PRINTF("\n");
+        }
+
+        // chrome trace_event format (json)
+        bool save(const char *path) {
+            FILE *fp = fopen(path, "w");
+            if (fp == NULL) return false;
+
+            fprintf(fp, "{\"traceEvents\":[\n");
 
-                flags.push_back(false);
+            std::lock_guard<std::mutex> lock(m_mtx);
+
+            bool first = true;
+            for (int i = 0; i < static_cast<int>(m_bufs.size()); i++) {
+                Buffer &buf = *m_bufs[i];
+                std::lock_guard<std::mutex> block(buf.mtx);
+
+                fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", first ? "" : ",\n", buf.tid, buf.tid);
+                first = false;
+
+                const long long num = (buf.rnum < SP_PROFILE_RING) ? buf.rnum : SP_PROFILE_RING;
+                for (long long r = buf.rnum - num; r < buf.rnum; r++) {
+                    const Record &rec = buf.ring[r % SP_PROFILE_RING];
+
+                    fprintf(fp, ",\n{\"name\":\"");
+                    escape(fp, rec.name);
+                    if (rec.t1 >= 0) {
+                        fprintf(fp, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3lf,\"dur\":%.3lf}", buf.tid, rec.t0 * 1e-3, (rec.t1 - rec.t0) * 1e-3);
+                    }
+                    else {
+                        fprintf(fp, "\",\"ph\":\"C\",\"pid\":0,\"tid\":%d,\"ts\":%.3lf,\"args\":{\"value\":%lld}}", buf.tid, rec.t0 * 1e-3, rec.val);
+                    }
+                }
             }
-            else {
-                names[id] = name;
-                timers[id] = Timer();
+            fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+            fclose(fp);
+            return true;
+        }
 
-                flags[id] = false;
+    private:
+
+        Buffer& local() {
+            static thread_local Buffer *buf = NULL;
+            if (buf == NULL) {
+                buf = new Buffer();
+                buf->nodes.resize(1);
+                buf->nodes[0].name = NULL;
+                buf->ring.resize(SP_PROFILE_RING);
+                buf->rnum = 0;
+
+                std::lock_guard<std::mutex> lock(m_mtx);
+                buf->tid = static_cast<int>(m_bufs.size());
+                m_bufs.push_back(buf);
             }
-#endif
+            return *buf;
         }
 
-        void stop(const char *name) {
+        static bool same(const char *a, const char *b) {
+            return (a == b) || (a != NULL && b != NULL && strcmp(a, b) == 0);
+        }
 
-#if SP_USE_LOGGER
+        static int find(const std::vector<Node> &nodes, const std::vector<int> &childs, const char *name) {
+            for (int i = 0; i < static_cast<int>(childs.size()); i++) {
+                if (same(nodes[childs[i]].name, name)) return childs[i];
+            }
+            return -1;
+        }
 
-            int id = -1;
-            for (int i = 0; i < names.size(); i++) {
-                if (name == names[i]) {
-                    id = i;
-                    break;
+        static long long add(std::vector<Count> &counts, const char *name, const long long val) {
+            for (int i = 0; i < static_cast<int>(counts.size()); i++) {
+                if (same(counts[i].name, name)) {
+                    return counts[i].val += val;
                 }
             }
+            Count cnt;
+            cnt.name = name;
+            cnt.val = val;
+            counts.push_back(cnt);
+            return val;
+        }
+
+        static void push(Buffer &buf, const Record &rec) {
+            buf.ring[buf.rnum % SP_PROFILE_RING] = rec;
+            buf.rnum++;
+        }
 
-            if (id >= 0 && flags[id] == false) {
-                timers[id].stop();
-                flags[id] = true;
+        // merge scope trees of all threads
+        void merge(std::vector<Node> &dst) {
+            dst.resize(1);
+            dst[0].name = NULL;
+
+            std::lock_guard<std::mutex> lock(m_mtx);
+            for (int i = 0; i < static_cast<int>(m_bufs.size()); i++) {
+                Buffer &buf = *m_bufs[i];
+                std::lock_guard<std::mutex> block(buf.mtx);
+                merge(dst, 0, buf.nodes, 0);
             }
-#endif
         }
 
-        void print(const char *name = NULL) {
+        static void merge(std::vector<Node> &dst, const int d, const std::vector<Node> &src, const int s) {
+            dst[d].stat.add(src[s].stat);
+            for (int i = 0; i < static_cast<int>(src[s].counts.size()); i++) {
+                add(dst[d].counts, src[s].counts[i].name, src[s].counts[i].val);
+            }
 
-#if SP_USE_LOGGER
-            for (int i = 0; i < names.size(); i++) {
-                if (name == NULL || name == names[i]) {
-                    if (flags[i] == false) stop(names[i].c_str());
-                    SP_PRINTF("%s : %.3lf [ms]\n", names[i].c_str(), timers[i].getms());
+            for (int i = 0; i < static_cast<int>(src[s].childs.size()); i++) {
+                const int c = src[s].childs[i];
+
+                int n = find(dst, dst[d].childs, src[c].name);
+                if (n < 0) {
+                    n = static_cast<int>(dst.size());
+                    dst[d].childs.push_back(n);
+
+                    Node tmp;
+                    tmp.name = src[c].name;
+                    dst.push_back(tmp);
                 }
+                merge(dst, n, src, c);
+            }
+        }
+
+        static void print(const std::vector<Node> &nodes, const int n, const int depth, const char *name, const bool flag) {
+            const Node &node = nodes[n];
+            const bool show = flag || (n > 0 && same(node.name, name));
+
+            if (show && n > 0) {
+                const Stat &stat = node.stat;
+                char str[SP_STRMAX];
+                snprintf(str, SP_STRMAX, "%*s%s", 2 * depth, "", node.name);
+
+                SP_PRINTF("%-32s %8lld %10.3lf %9.3lf %9.3lf %9.3lf", str, stat.cnt, stat.sum * 1e-6, 
+                    (stat.cnt > 0) ? stat.sum * 1e-6 / stat.cnt : 0.0, stat.minv * 1e-6, stat.tile(0.99) * 1e-6);
+
+                for (int i = 0; i < static_cast<int>(node.counts.size()); i++) {
+                    SP_PRINTF(" %s %lld", node.counts[i].name, node.counts[i].val);
+                }
+                SP_PRINTF("\n");
+            }
+            if (show && n == 0 && node.counts.size() > 0) {
+                SP_PRINTF("%-32s", "-");
+                for (int i = 0; i < static_cast<int>(node.counts.size()); i++) {
+                    SP_PRINTF(" %s %lld", node.counts[i].name, node.counts[i].val);
+                }
+                SP_PRINTF("\n");
+            }
+
+            for (int i = 0; i < static_cast<int>(node.childs.size()); i++) {
+                print(nodes, node.childs[i], (n > 0 && show) ? depth + 1 : depth, name, show);
             }
-            SP_PRINTF("\n");
-#endif
         }
 
-        static Logger *instance() {
-            static Logger logger;
-            return &logger;
+        static void escape(FILE *fp, const char *str) {
+            for (const char *c = str; c != NULL && *c != '\0'; c++) {
+                if (*c == '"' || *c == '\\') fputc('\\', fp);
+                if (static_cast<unsigned char>(*c) >= 0x20) fputc(*c, fp);
+            }
         }
     };
 
-    class LoggerUnit {
-
+    class ProfileScope {
     private:
-        Logger * logger;
         const char *name;
 
     public:
-        LoggerUnit(Logger *logger, const char *name) {
-            //SP_PRINTF("%s\n", str);
-
-            this->logger = logger;
+        ProfileScope(const char *name) {
             this->name = name;
-
-            logger->start(name);
+            Profiler::instance()->begin(name);
         }
 
-        ~LoggerUnit() {
-            logger->stop(name);
+        ~ProfileScope() {
+            Profiler::instance()->end(name);
         }
     };
 }
 
+#endif
+
 
 //--------------------------------------------------------------------------------
 // data holder
@@ -12,7 +12,10 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <vector>
 
 namespace sp {
 
@@ -100,6 +103,159 @@ namespace sp {
             return true;
         }
     };
+
+
+    //--------------------------------------------------------------------------------
+    // thread pool (fork join, every thread runs func(id) once per start)
+    //--------------------------------------------------------------------------------
+
+    class ThreadPool {
+    private:
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_mtx;
+        std::condition_variable m_start, m_end;
+
+        std::function<void(int)> m_func;
+
+        // job generation / running thread number
+        int m_gen;
+        int m_busy;
+
+        bool m_quit;
+
+    public:
+        ThreadPool(const int num = 0) {
+            m_gen = 0;
+            m_busy = 0;
+            m_quit = false;
+            init(num);
+        }
+
+        ~ThreadPool() {
+            free();
+        }
+
+        // num <= 0 : hardware concurrency
+        void init(const int num = 0) {
+            free();
+
+            int n = (num > 0) ? num : static_cast<int>(std::thread::hardware_concurrency());
+            n = (n > 0) ? n : 1;
+
+            for (int i = 0; i < n; i++) {
+                m_threads.push_back(std::thread(&ThreadPool::loop, this, i, m_gen));
+            }
+        }
+
+        int size() const {
+            return static_cast<int>(m_threads.size());
+        }
+
+        // start func(id) on all threads (asynchronous)
+        void start(const std::function<void(int)> &func) {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_end.wait(lock, [this] { return m_busy == 0; });
+
+            m_func = func;
+            m_busy = size();
+            m_gen++;
+            m_start.notify_all();
+        }
+
+        // wait for the current job
+        void wait() {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_end.wait(lock, [this] { return m_busy == 0; });
+        }
+
+        void run(const std::function<void(int)> &func) {
+            start(func);
+            wait();
+        }
+
+    private:
+
+        void free() {
+            if (m_threads.size() == 0) return;
+            wait();
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_quit = true;
+            }
+            m_start.notify_all();
+
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                m_threads[i].join();
+            }
+            m_threads.clear();
+            m_quit = false;
+        }
+
+        void loop(const int id, int gen) {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(m_mtx);
+                    m_start.wait(lock, [this, gen] { return m_quit == true || m_gen != gen; });
+                    if (m_quit == true) return;
+                    gen = m_gen;
+                }
+
+                // m_func is not changed until all threads end
+                m_func(id);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mtx);
+                    if (--m_busy == 0) m_end.notify_all();
+                }
+            }
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // snapshot (versioned read only data, a reader keeps its data alive while it is used)
+    //--------------------------------------------------------------------------------
+
+    template<typename TYPE>
+    class Snapshot {
+    private:
+        std::mutex m_mtx;
+
+        std::shared_ptr<const TYPE> m_ptr;
+
+        int m_version;
+
+    public:
+        Snapshot() {
+            m_version = 0;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_ptr.reset();
+            m_version = 0;
+        }
+
+        // writer (data must not be changed after publish)
+        int publish(const std::shared_ptr<const TYPE> &ptr) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_ptr = ptr;
+            return ++m_version;
+        }
+
+        // reader (the lock is held only to copy the pointer)
+        std::shared_ptr<const TYPE> get(int *version = NULL) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (version != NULL) *version = m_version;
+            return m_ptr;
+        }
+
+        int version() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_version;
+        }
+    };
 }
 
 #endif
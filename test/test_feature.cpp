@@ -0,0 +1,93 @@
+﻿#include "simplesp.h"
+using namespace sp;
+
+// random SIFT like descriptor (non negative, unit length, binary : val > 1 / sqrt(dim))
+static Ftr randFtr() {
+    const int dim = 128;
+
+    Ftr ftr;
+    ftr.cst = 1.0;
+    ftr.dsc.dim = dim;
+    ftr.dsc.type = Dsc::DSC_SIFT;
+    ftr.dsc.val.resize(dim * sizeof(float));
+    ftr.dsc.bin.resize(dim / 8);
+
+    float *val = reinterpret_cast<float*>(ftr.dsc.val.ptr);
+    double sq = 0.0;
+    for (int k = 0; k < dim; k++) {
+        val[k] = static_cast<float>(::fabs(randu()));
+        sq += val[k] * val[k];
+    }
+    for (int k = 0; k < dim; k++) {
+        val[k] = static_cast<float>(val[k] / ::sqrt(sq));
+    }
+    cnvBit(ftr.dsc.bin.ptr, dim / 8, val, dim, static_cast<float>(1.0 / ::sqrt(static_cast<double>(dim))));
+
+    return ftr;
+}
+
+int main() {
+
+    bool ret = true;
+
+    // DscIndex insert / remove
+    {
+        const int num = 500;
+
+        Mem1<Ftr> ftrs;
+        DscIndex index;
+        for (int i = 0; i < num; i++) {
+            ftrs.push(randFtr());
+            ret &= (index.add(ftrs[i]) == i);
+        }
+
+        int found = 0;
+        for (int i = 0; i < num; i++) {
+            found += (index.search(ftrs[i]) == i) ? 1 : 0;
+        }
+        printf("add    : size %d, found %d / %d\n", index.size(), found, num);
+        ret &= (index.size() == num && found == num);
+
+        // remove every 3rd entry (unlinked from the middle of the bucket lists)
+        for (int i = 0; i < num; i += 3) {
+            index.del(i);
+        }
+        // removed twice : no effect
+        index.del(0);
+
+        int removed = 0;
+        int kept = 0;
+        for (int i = 0; i < num; i++) {
+            const int id = index.search(ftrs[i]);
+            if (i % 3 == 0) {
+                removed += (id == -1 && index.valid(i) == false) ? 1 : 0;
+            }
+            else {
+                kept += (id == i) ? 1 : 0;
+            }
+        }
+        const int rnum = (num + 2) / 3;
+        printf("del    : size %d, removed %d / %d, kept %d / %d\n", index.size(), removed, rnum, kept, num - rnum);
+        ret &= (index.size() == num - rnum && index.num() == num && removed == rnum && kept == num - rnum);
+
+        // batch search
+        const Mem1<int> ids = index.search(ftrs);
+        int batch = 0;
+        for (int i = 0; i < num; i++) {
+            batch += (ids[i] == ((i % 3 == 0) ? -1 : i)) ? 1 : 0;
+        }
+        printf("search : %d / %d\n", batch, num);
+        ret &= (batch == num);
+
+        // insert again (removed ids are reused, id range does not grow)
+        int reused = 0;
+        for (int i = 0; i < num; i += 3) {
+            const int id = index.add(ftrs[i]);
+            reused += (id % 3 == 0 && index.search(ftrs[i]) == id) ? 1 : 0;
+        }
+        printf("reuse  : size %d, num %d, reused %d / %d\n", index.size(), index.num(), reused, rnum);
+        ret &= (index.size() == num && index.num() == num && reused == rnum);
+    }
+
+    return ret ? 0 : 1;
+}
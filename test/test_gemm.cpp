@@ -0,0 +1,84 @@
+﻿#include "simplesp.h"
+using namespace sp;
+
+#if SP_USE_OMP && defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// naive reference, C = op(A) * op(B)
+static void refMul(Mem2<double> &C, const Mem2<double> &A, const bool transA, const Mem2<double> &B, const bool transB) {
+    const int M = transA ? A.dsize[0] : A.dsize[1];
+    const int K = transA ? A.dsize[1] : A.dsize[0];
+    const int N = transB ? B.dsize[1] : B.dsize[0];
+
+    C.resize(N, M);
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < K; k++) {
+                const double a = transA ? A(i, k) : A(k, i);
+                const double b = transB ? B(k, j) : B(j, k);
+                sum += a * b;
+            }
+            C(j, i) = sum;
+        }
+    }
+}
+
+static bool check(const int M, const int K, const int N, const bool transA, const bool transB) {
+    Mem2<double> A(transA ? M : K, transA ? K : M);
+    Mem2<double> B(transB ? K : N, transB ? N : K);
+    for (int i = 0; i < A.size(); i++) A[i] = randu();
+    for (int i = 0; i < B.size(); i++) B[i] = randu();
+
+    Mem2<double> C(N, M), R;
+    gemm<double>(C.ptr, N, A.ptr, A.dsize[0], transA, B.ptr, B.dsize[0], transB, M, N, K);
+    refMul(R, A, transA, B, transB);
+
+    double err = 0.0;
+    for (int i = 0; i < R.size(); i++) {
+        err = maxVal(err, ::fabs(C[i] - R[i]));
+    }
+
+    const bool ret = (err < 1e-9);
+    printf("gemm %4d x %4d x %4d (transA %d, transB %d) : err %e %s\n", M, K, N, transA, transB, err, ret ? "ok" : "NG");
+    return ret;
+}
+
+int main() {
+#if SP_USE_OMP && defined(_OPENMP)
+    omp_set_num_threads(4);
+#endif
+
+    bool ret = true;
+
+    // blocked path over several micro tiles (multi threaded)
+    ret &= check(200, 150, 300, false, false);
+    ret &= check(200, 150, 300, true, false);
+    ret &= check(200, 150, 300, false, true);
+    ret &= check(333, 300, 700, true, true);
+
+    // mulMat (gemm for large matrix)
+    {
+        Mat A(200, 150), B(150, 300);
+        for (int i = 0; i < A.size(); i++) A[i] = randu();
+        for (int i = 0; i < B.size(); i++) B[i] = randu();
+
+        const Mat C = A * B;
+
+        double err = 0.0;
+        for (int r = 0; r < C.rows(); r++) {
+            for (int c = 0; c < C.cols(); c++) {
+                double sum = 0.0;
+                for (int k = 0; k < A.cols(); k++) {
+                    sum += A(r, k) * B(k, c);
+                }
+                err = maxVal(err, ::fabs(C(r, c) - sum));
+            }
+        }
+        printf("mulMat 200 x 150 x 300 : err %e\n", err);
+        ret &= (err < 1e-9);
+    }
+
+    return ret ? 0 : 1;
+}